@@ -11,7 +11,11 @@ AFallingBlock::AFallingBlock()
 
 	MidiNote = 0;
     Manager = nullptr;
+    TargetKey = nullptr;
+    ScaledUnitsPerSecond = 0.0f;
+    ScaledKeyWidth = 0.0f;
     TargetTime = 0.0f;
+    Duration = 0.0f;
 	BlockScaleMultiplier = FVector(1.0f, 1.0f, 1.0f);
 }
 
@@ -23,10 +27,11 @@ void AFallingBlock::BeginPlay()
 	SetActorTickEnabled(false);
 }
 
-void AFallingBlock::Initialize(AFallingBlockManager* InManager, float InTargetTime, float InDuration, float InKeyWidth, int32 InMidiNote)
+void AFallingBlock::Initialize(AFallingBlockManager* InManager, double InTargetTime, float InDuration, int32 InMidiNote)
 {
     Manager = InManager;
     TargetTime = InTargetTime;
+    Duration = InDuration;
     MidiNote = InMidiNote;
 
     if (!Manager)
@@ -34,41 +39,66 @@ void AFallingBlock::Initialize(AFallingBlockManager* InManager, float InTargetTi
         return;
     }
 
+    TargetKey = &Manager->GetKeyWorldFrame(InMidiNote);
+    UpdateScale();
+}
+
+void AFallingBlock::UpdateScale()
+{
+    ScaledUnitsPerSecond = Manager->UnitsPerSecond;
+    ScaledKeyWidth = TargetKey->Width;
+	BlockMesh->SetWorldScale3D(ComputeBlockScale(ScaledUnitsPerSecond, Duration, ScaledKeyWidth, BlockScaleMultiplier));
+}
+
+FVector AFallingBlock::ComputeBlockScale(float UnitsPerSecond, float InDuration, float InKeyWidth, const FVector& ScaleMultiplier)
+{
 	// --- Dynamic Scaling Logic ---
 	const float ScaleX = 0.08f;
 	const float Margin = 1.0f;
 	const float ScaleY = (InKeyWidth > Margin) ? (InKeyWidth - Margin) / 100.0f : 0.1f;
 	// The length of the block is its duration in seconds multiplied by the highway speed.
-	const float ScaleZ = (Manager->UnitsPerSecond * InDuration) / 100.0f; // 100.0f is the default mesh size
+	const float ScaleZ = (UnitsPerSecond * InDuration) / 100.0f; // 100.0f is the default mesh size
 
-	FVector FinalScale = FVector(ScaleX, ScaleY, FMath::Max(ScaleZ, 0.01f)) * BlockScaleMultiplier;
-	BlockMesh->SetWorldScale3D(FinalScale);
+	return FVector(ScaleX, ScaleY, FMath::Max(ScaleZ, 0.01f)) * ScaleMultiplier;
 }
 
 void AFallingBlock::Tick(float DeltaTime)
 {
 	// This Tick is called manually by the FallingBlockManager
 
-	if (!Manager)
+	if (!Manager || !TargetKey)
 	{
 		return;
 	}
 
-    const float CurrentMasterTime = Manager->GetCurrentSongTime();
+    const double CurrentMasterTime = Manager->GetCurrentSongTime();
 
-	// Destroy the block if it's far past its target time.
-	// The grace period of 2 seconds ensures it's not destroyed while potentially still needed for learning mode.
-	if (CurrentMasterTime > TargetTime + 2.0f)
+	// Destroy the block once its note has ended and the grace period is over.
+	if (CurrentMasterTime > GetDespawnTime())
 	{
 		Destroy();
 		return;
 	}
 
+	// Prespawned blocks stay hidden until they enter the lookahead window.
+	const bool bVisible = CurrentMasterTime >= TargetTime - Manager->LookaheadTime;
+	if (IsHidden() == bVisible)
+	{
+		SetActorHiddenInGame(!bVisible);
+	}
+
+	// The highway speed can be changed at run time and calibration can rescale the keys.
+	if (ScaledUnitsPerSecond != Manager->UnitsPerSecond || ScaledKeyWidth != TargetKey->Width)
+	{
+		UpdateScale();
+	}
+
 	// Calculate the Z offset based on the time difference and the highway speed.
-	const float TimeDiff = TargetTime - CurrentMasterTime;
+	const float TimeDiff = float(TargetTime - CurrentMasterTime);
 	const float ZOffset = TimeDiff * Manager->UnitsPerSecond;
 
 	// The final position is the key's base location plus the calculated Z offset.
-	const FVector NewLocation = TargetKeyLocation + (TargetKeyUpVector * ZOffset);
-	SetActorLocation(NewLocation);
+	// The key frame is re-read every frame, so the block follows the piano when it is moved.
+	const FVector NewLocation = TargetKey->Location + (TargetKey->UpVector * ZOffset);
+	SetActorLocationAndRotation(NewLocation, TargetKey->Rotation);
 }
\ No newline at end of file
@@ -1,8 +1,14 @@
 #include "FallingBlockManager.h"
 #include "FallingBlock.h"
 #include "PianoActor.h"
+#include "PianoSamplerComponent.h"
 #include "VrPianoPawn.h"
+#include "PianoTickScheduling.h"
 #include "Engine/World.h"
+#include "AudioDevice.h"
+#include "Engine/StaticMesh.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "Async/ParallelFor.h"
 #include "Kismet/GameplayStatics.h"
 #include "Common/UdpSocketBuilder.h"
 #include "Common/UdpSocketReceiver.h"
@@ -10,12 +16,41 @@
 #include "JsonUtilities.h"
 #include "Containers/StringConv.h" // Required for FUTF8ToTCHAR
 
+DECLARE_DWORD_COUNTER_STAT(TEXT("Falling Block Instances"), STAT_FallingBlockInstances, STATGROUP_VrPiano);
+DECLARE_CYCLE_STAT(TEXT("Falling Block Instance Update"), STAT_FallingBlockInstanceUpdate, STATGROUP_VrPiano);
+DECLARE_CYCLE_STAT(TEXT("Falling Block Spawn"), STAT_FallingBlockSpawn, STATGROUP_VrPiano);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Falling Block Spawn Backlog"), STAT_FallingBlockSpawnBacklog, STATGROUP_VrPiano);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Falling Block Spawn Overruns"), STAT_FallingBlockSpawnOverruns, STATGROUP_VrPiano);
+
+namespace
+{
+    // Fewer blocks than this are cheaper to update on the game thread than to fan out.
+    constexpr int32 MinBlocksForParallelUpdate = 256;
+}
+
 AFallingBlockManager::AFallingBlockManager()
 {
     PrimaryActorTick.bCanEverTick = true;
+
+    BlockInstances = CreateDefaultSubobject<UInstancedStaticMeshComponent>(TEXT("BlockInstances"));
+    RootComponent = BlockInstances;
+    BlockInstances->SetMobility(EComponentMobility::Movable);
+    BlockInstances->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+    BlockInstances->SetCastShadow(false);
+
+    InstancedBlockMesh = nullptr;
+    InstancedBlockScaleMultiplier = FVector::OneVector;
+    Song = MakeUnique<FPianoSong>();
+    SongView = Song->GetView(EPianoHand::Any);
+    PendingSong = nullptr;
+    bRestartRequested = false;
     NextSpawnIndex = 0;
     NextHighlightIndex = 0;
-    CurrentSongTime = 0.f;
+    NextAudioIndex = INDEX_NONE;
+    NextChordGroup = 0;
+    WaitingChordGroup = INDEX_NONE;
+    CurrentSongTime = 0.0;
+    PendingPlaybackRate = -1.0f;
     ListenSocket = nullptr;
     UDPReceiver = nullptr;
     PianoActorRef = nullptr;
@@ -39,12 +74,27 @@ AFallingBlockManager::~AFallingBlockManager()
         ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->DestroySocket(ListenSocket);
         ListenSocket = nullptr;
     }
+    delete PendingSong.exchange(nullptr);
 }
 
 void AFallingBlockManager::BeginPlay()
 {
     Super::BeginPlay();
     StartUDPListener();
+    SetupBlockInstances();
+
+    if (bUseAudioClock)
+    {
+        FAudioDeviceHandle AudioDevice = GetWorld()->GetAudioDevice();
+        if (AudioDevice.IsValid())
+        {
+            SongClock.SetReferenceClock([AudioDevice]() { return AudioDevice->GetAudioClock(); });
+        }
+        else
+        {
+            UE_LOG(LogTemp, Warning, TEXT("FallingBlockManager: No audio device, the song clock follows the platform clock."));
+        }
+    }
 
     // Find PianoActor and VrPianoPawn
     TArray<AActor*> FoundActors;
@@ -60,6 +110,10 @@ void AFallingBlockManager::BeginPlay()
             PianoActorRef->OnCalibrationComplete.AddDynamic(this, &AFallingBlockManager::OnPianoCalibrationComplete);
             PianoActorRef->OnPlayerNotePlayed.AddDynamic(this, &AFallingBlockManager::OnNotePlayed);
             PianoActorRef->OnLearningModeStateChanged.AddDynamic(this, &AFallingBlockManager::OnLearningModeChanged);
+            if (USceneComponent* PianoRoot = PianoActorRef->GetRootComponent())
+            {
+                PianoTransformUpdatedHandle = PianoRoot->TransformUpdated.AddUObject(this, &AFallingBlockManager::OnPianoTransformUpdated);
+            }
 
             // Attempt to populate data right away, in case the piano has already initialized.
             PopulateKeyData();
@@ -85,6 +139,12 @@ void AFallingBlockManager::BeginPlay()
 void AFallingBlockManager::EndPlay(const EEndPlayReason::Type EndPlayReason)
 {
     Super::EndPlay(EndPlayReason);
+
+    if (IsValid(PianoActorRef) && PianoActorRef->GetRootComponent())
+    {
+        PianoActorRef->GetRootComponent()->TransformUpdated.Remove(PianoTransformUpdatedHandle);
+    }
+
     // Cleanup UDP
     if (UDPReceiver)
     {
@@ -98,37 +158,73 @@ void AFallingBlockManager::EndPlay(const EEndPlayReason::Type EndPlayReason)
         ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->DestroySocket(ListenSocket);
         ListenSocket = nullptr;
     }
+
+    // The receiver thread is stopped, so nothing can publish another song now.
+    delete PendingSong.exchange(nullptr);
 }
 
 void AFallingBlockManager::Tick(float DeltaTime)
 {
     Super::Tick(DeltaTime);
+    PianoTickScheduling::NoteTicked();
+
+    // Songs and restarts arrive on the UDP receiver thread; they take effect here, between frames.
+    ConsumePendingSong();
 
-    if (!BlockClass || !PianoActorRef || !bHasPopulatedKeyData)
+    const float NewPlaybackRate = PendingPlaybackRate.exchange(-1.0f);
+    if (NewPlaybackRate > 0.0f)
     {
-        return;
+        SongClock.SetRate(NewPlaybackRate);
     }
 
-    const bool bShouldWaitForInput = PianoActorRef->bIsLearningMode && NextHighlightIndex < ArrivalTimes.Num() && CurrentSongTime >= ArrivalTimes[NextHighlightIndex].Time;
+    // A song with no notes in the practised hand is finished before it starts. Nothing is polled until
+    // a new song, a restart or another hand wakes the manager up.
+    if (SongView.Num() == 0)
+    {
+        SongClock.SetPaused(true);
+        CurrentSongTime = SongClock.GetSongTime();
+        ResetSongAudio();
+        PianoTickScheduling::SleepIfIdle(this, false);
+        return;
+    }
 
-    if (PianoActorRef->bIsPaused)
+    if (!CanSpawnBlocks() || !PianoActorRef || !bHasPopulatedKeyData)
     {
+        // Nothing can be shown yet, so the song does not move on either.
+        SongClock.SetPaused(true);
+        CurrentSongTime = SongClock.GetSongTime();
+        ResetSongAudio();
         return;
     }
 
-    if (!bShouldWaitForInput)
+    // In learning mode the clock stops exactly at the next chord until it has been played.
+    const bool bShouldWaitForInput = PianoActorRef->bIsLearningMode && NextHighlightIndex < SongView.Num() && SongClock.GetSongTime() >= SongView[NextHighlightIndex].Time;
+    if (bShouldWaitForInput && !SongClock.IsPaused())
     {
-        CurrentSongTime += DeltaTime;
+        SongClock.Seek(SongView[NextHighlightIndex].Time);
     }
+    SongClock.SetPaused(PianoActorRef->bIsPaused || bShouldWaitForInput);
+    CurrentSongTime = SongClock.GetSongTime();
 
-    // Spawn new blocks
-    while (NextSpawnIndex < ArrivalTimes.Num() && CurrentSongTime >= ArrivalTimes[NextSpawnIndex].Time - LookaheadTime)
+    // Learning mode sounds what the player plays, not the song.
+    if (PianoActorRef->IsSchedulingSongAudio() && !PianoActorRef->bIsLearningMode && !SongClock.IsPaused())
     {
-        SpawnBlockForNote(ArrivalTimes[NextSpawnIndex]);
-        NextSpawnIndex++;
+        ScheduleSongAudio();
+    }
+    else
+    {
+        ResetSongAudio();
     }
 
+    if (PianoActorRef->bIsPaused)
+    {
+        return;
+    }
+
+    SpawnPendingBlocks();
+
 	// Update positions of active blocks
+	UpdateBlockInstances();
 	for (int32 i = ActiveBlocks.Num() - 1; i >= 0; --i)
 	{
 		AFallingBlock* Block = ActiveBlocks[i];
@@ -138,45 +234,79 @@ void AFallingBlockManager::Tick(float DeltaTime)
 		}
 		else
 		{
-			ActiveBlocks.RemoveAt(i);
+			ActiveBlocks.RemoveAtSwap(i, 1, EAllowShrinking::No);
 		}
 	}
 
     // Handle notes reaching the strike zone
-    while (NextHighlightIndex < ArrivalTimes.Num() && CurrentSongTime >= ArrivalTimes[NextHighlightIndex].Time)
+    while (NextHighlightIndex < SongView.Num() && CurrentSongTime >= SongView[NextHighlightIndex].Time)
     {
-        const FBlockSpawnInfo& NoteInfo = ArrivalTimes[NextHighlightIndex];
+        const FPianoSongNote& NoteInfo = SongView[NextHighlightIndex];
 
         if (PianoActorRef->bIsLearningMode)
         {
-            const float WaitTime = NoteInfo.Time;
-            int32 TempIndex = NextHighlightIndex;
-            while (TempIndex < ArrivalTimes.Num() && ArrivalTimes[TempIndex].Time <= WaitTime)
+            // Highlight the whole chord once, then wait for OnNotePlayed to clear it.
+            if (WaitingChordGroup != NextChordGroup && SongView.GetChordGroups().IsValidIndex(NextChordGroup))
             {
-                const FBlockSpawnInfo& ChordNoteInfo = ArrivalTimes[TempIndex];
-                if (!WaitingNotes.Contains(ChordNoteInfo.MidiNote))
-                {
-                    WaitingNotes.Add(ChordNoteInfo.MidiNote);
-                    PianoActorRef->HighlightKeyForDuration(ChordNoteInfo.MidiNote, 3600.0f);
-                }
-                TempIndex++;
+                WaitingChordGroup = NextChordGroup;
+                WaitingNotes = SongView.GetChordGroups()[NextChordGroup].Mask;
+                WaitingNotes.ForEachNote([this](int32 MidiNote) { PianoActorRef->HighlightKeyForDuration(MidiNote, 3600.0f); });
             }
             break;
         }
         else // Normal Mode
         {
-            PianoActorRef->PlayNote(NoteInfo.MidiNote, true);
+            PianoActorRef->PlayNote(NoteInfo.MidiNote, float(NoteInfo.Duration / SongClock.GetRate()));
             NextHighlightIndex++;
+            SyncNextChordGroup();
         }
     }
 }
 
+void AFallingBlockManager::ScheduleSongAudio()
+{
+    UPianoSamplerComponent* Sampler = PianoActorRef->GetSampler();
+    if (NextAudioIndex == INDEX_NONE)
+    {
+        // Notes already under way when scheduling starts are not restarted half-way through.
+        NextAudioIndex = SongView.LowerBound(CurrentSongTime);
+    }
+
+    // The sampler schedules in FPlatformTime::Seconds, but the song clock may run on the audio
+    // device clock, so song times are mapped through one fresh reading of both clocks rather than
+    // through the clock's reference time. Notes already handed over keep the rate they were
+    // scheduled at.
+    const double Rate = SongClock.GetRate();
+    const double SongTimeNow = SongClock.GetSongTime();
+    const double PlatformSecondsNow = FPlatformTime::Seconds();
+    const double ScheduleEndTime = CurrentSongTime + AudioScheduleAhead * Rate;
+    for (; NextAudioIndex < SongView.Num() && SongView[NextAudioIndex].Time < ScheduleEndTime; ++NextAudioIndex)
+    {
+        const FPianoSongNote& NoteInfo = SongView[NextAudioIndex];
+        const double StartSeconds = PlatformSecondsNow + (NoteInfo.Time - SongTimeNow) / Rate;
+        Sampler->ScheduleNote(NoteInfo.MidiNote, NoteInfo.Velocity, StartSeconds, StartSeconds + NoteInfo.Duration / Rate);
+    }
+}
+
+void AFallingBlockManager::ResetSongAudio()
+{
+    if (NextAudioIndex == INDEX_NONE)
+    {
+        return;
+    }
+    NextAudioIndex = INDEX_NONE;
+    if (UPianoSamplerComponent* Sampler = PianoActorRef ? PianoActorRef->GetSampler() : nullptr)
+    {
+        Sampler->ClearScheduled();
+        Sampler->AllNotesOff();
+    }
+}
+
 void AFallingBlockManager::OnLearningModeChanged(bool bNewState)
 {
     if (!bNewState)
     {
-        if(PianoActorRef) PianoActorRef->UnhighlightKeys(WaitingNotes.Array());
-        WaitingNotes.Empty();
+        ClearWaitingNotes();
     }
 }
 
@@ -190,53 +320,80 @@ void AFallingBlockManager::OnNotePlayed(int32 MidiNote)
     WaitingNotes.Remove(MidiNote);
     PianoActorRef->UnhighlightKeys({MidiNote});
 
-    for (int32 i = ActiveBlocks.Num() - 1; i >= 0; --i)
+    KeyBlockBuckets[MidiNote].PopHits(CurrentSongTime, [this](const FKeyBlockEntry& Block)
     {
-        AFallingBlock* Block = ActiveBlocks[i];
-        if (IsValid(Block) && Block->MidiNote == MidiNote && FMath::IsNearlyZero(Block->TargetTime - CurrentSongTime, 0.05f))
+        if (IsBlockAlive(Block))
         {
-            Block->Destroy();
-            ActiveBlocks.RemoveAt(i);
+            // Destroyed actors are dropped from ActiveBlocks on the next Tick.
+            if (AFallingBlock* BlockActor = Block.Actor.Get()) BlockActor->Destroy();
+            else ReleaseBlockSlot(Block.Slot);
         }
-    }
+    });
 
-    if (WaitingNotes.IsEmpty())
+    if (WaitingNotes.IsEmpty() && SongView.GetChordGroups().IsValidIndex(WaitingChordGroup))
     {
-        if (NextHighlightIndex < ArrivalTimes.Num())
-        {
-            const float FinishedTime = ArrivalTimes[NextHighlightIndex].Time;
-            while (NextHighlightIndex < ArrivalTimes.Num() && ArrivalTimes[NextHighlightIndex].Time <= FinishedTime)
-            {
-                NextHighlightIndex++;
-            }
-        }
+        NextHighlightIndex = SongView.GetChordGroups()[WaitingChordGroup].EndIndex();
+        WaitingChordGroup = INDEX_NONE;
+        SyncNextChordGroup();
     }
 }
 
-void AFallingBlockManager::SpawnBlockForNote(const FBlockSpawnInfo& NoteInfo)
+void AFallingBlockManager::SpawnBlockForNote(const FPianoSongNote& NoteInfo)
 {
     const int32 MidiNote = NoteInfo.MidiNote;
-    const FTransform* KeyRelativeTransformPtr = KeyRelativeTransforms.Find(MidiNote);
-    const float* KeyWidthPtr = KeyWidths.Find(MidiNote);
+    const FKeyWorldFrame& Key = KeyWorldFrames[MidiNote];
 
-    if (KeyRelativeTransformPtr && KeyWidthPtr)
+    if (Key.bValid)
     {
-        const FTransform PianoWorldTransform = PianoActorRef->GetActorTransform();
-        const FTransform KeyWorldTransform = *KeyRelativeTransformPtr * PianoWorldTransform;
-        const FVector KeyLocation = KeyWorldTransform.GetLocation();
-		const FVector KeyUpVector = KeyWorldTransform.GetUnitAxis(EAxis::Z);
+
+        if (RenderMode == EFallingBlockRenderMode::Instanced)
+        {
+            int32 SlotIndex = INDEX_NONE;
+            if (!FreeBlockSlots.IsEmpty())
+            {
+                SlotIndex = FreeBlockSlots.Pop(EAllowShrinking::No);
+            }
+            else
+            {
+                SlotIndex = BlockSlots.AddDefaulted();
+                BlockInstanceTransforms.Add(FTransform(FQuat::Identity, FVector::ZeroVector, FVector::ZeroVector));
+                BlockInstances->AddInstance(BlockInstanceTransforms[SlotIndex], /*bWorldSpace=*/true);
+            }
+
+            FFallingBlockSlot& Slot = BlockSlots[SlotIndex];
+            Slot.MidiNote = MidiNote;
+            Slot.TargetTime = NoteInfo.Time;
+            Slot.DespawnTime = AFallingBlock::ComputeDespawnTime(NoteInfo.Time, NoteInfo.Duration);
+            Slot.Duration = NoteInfo.Duration;
+            Slot.bActive = true;
+            ++Slot.Serial;
+            INC_DWORD_STAT(STAT_FallingBlockInstances);
+
+            FKeyBlockEntry Entry;
+            Entry.TargetTime = Slot.TargetTime;
+            Entry.DespawnTime = Slot.DespawnTime;
+            Entry.Slot = SlotIndex;
+            Entry.Serial = Slot.Serial;
+            AddToKeyBucket(MidiNote, Entry);
+            return;
+        }
 
         // Spawn the block at the key's base location, rotation will be handled by the block itself
         FActorSpawnParameters SpawnParams;
         SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
 
-        AFallingBlock* NewBlock = GetWorld()->SpawnActor<AFallingBlock>(BlockClass, KeyLocation, KeyWorldTransform.GetRotation().Rotator(), SpawnParams);
+        AFallingBlock* NewBlock = GetWorld()->SpawnActor<AFallingBlock>(BlockClass, Key.Location, Key.Rotation.Rotator(), SpawnParams);
         if (NewBlock)
         {
-			NewBlock->TargetKeyLocation = KeyLocation;
-			NewBlock->TargetKeyUpVector = KeyUpVector;
-            NewBlock->Initialize(this, NoteInfo.Time, NoteInfo.Duration, *KeyWidthPtr, NoteInfo.MidiNote);
+            NewBlock->Initialize(this, NoteInfo.Time, NoteInfo.Duration, NoteInfo.MidiNote);
+            NewBlock->SetActorHiddenInGame(CurrentSongTime < NoteInfo.Time - LookaheadTime);
             ActiveBlocks.Add(NewBlock);
+
+            FKeyBlockEntry Entry;
+            Entry.TargetTime = NewBlock->TargetTime;
+            Entry.DespawnTime = NewBlock->GetDespawnTime();
+            Entry.Actor = NewBlock;
+            AddToKeyBucket(MidiNote, Entry);
         }
     }
     else
@@ -251,33 +408,57 @@ void AFallingBlockManager::OnPianoKeysInitialized()
     PopulateKeyData();
 }
 
-void AFallingBlockManager::SetSongTime(float Time)
+void AFallingBlockManager::SetSongTime(double Time)
 {
+    SongClock.Seek(Time);
     CurrentSongTime = Time;
 
-    for (AFallingBlock* Block : ActiveBlocks)
+    ClearBlocks();
+    ClearWaitingNotes();
+    ResetSongAudio();
+    if (PianoActorRef) PianoActorRef->ReleaseAllKeys();
+
+    // Notes that are still sounding at the new time: their blocks stay visible until the note ends,
+    // and in normal mode their keys are held down for the rest of the note.
+    TArray<int32> SoundingNotes;
+    Song->TimeIndex.FindSounding(CurrentSongTime, SoundingNotes);
+
+    const double GraceStartTime = CurrentSongTime - AFallingBlock::GracePeriod;
+    const int32 FirstVisibleIndex = SongView.LowerBound(GraceStartTime);
+    const bool bCanSpawn = CanSpawnBlocks() && PianoActorRef && bHasPopulatedKeyData;
+    for (int32 NoteIndex : SoundingNotes)
     {
-        if(IsValid(Block)) Block->Destroy();
+        // The time index covers the whole song; keep only the notes of the practised view.
+        const FPianoSongNote& NoteInfo = Song->Notes[NoteIndex];
+        if (!SongView.Contains(NoteInfo))
+        {
+            continue;
+        }
+        if (bCanSpawn && NoteInfo.Time < GraceStartTime)
+        {
+            SpawnBlockForNote(NoteInfo);
+        }
+        if (PianoActorRef && !PianoActorRef->bIsLearningMode)
+        {
+            PianoActorRef->PlayNote(NoteInfo.MidiNote, float((NoteInfo.Time + NoteInfo.Duration - CurrentSongTime) / SongClock.GetRate()));
+        }
     }
-    ActiveBlocks.Empty();
-    WaitingNotes.Empty();
 
-    FScopeLock Lock(&ArrivalTimesMutex);
-    NextSpawnIndex = 0;
-    NextHighlightIndex = 0;
-    for (int32 i = 0; i < ArrivalTimes.Num(); ++i)
+    // Everything from the grace window up to the lookahead window is on screen as well.
+    NextHighlightIndex = SongView.LowerBound(CurrentSongTime);
+    SyncNextChordGroup();
+    NextSpawnIndex = SongView.LowerBound(CurrentSongTime + LookaheadTime);
+    if (bCanSpawn)
     {
-        if (ArrivalTimes[i].Time >= CurrentSongTime)
+        for (int32 NoteIndex = FirstVisibleIndex; NoteIndex < NextSpawnIndex; ++NoteIndex)
         {
-            NextSpawnIndex = i;
-            NextHighlightIndex = i;
-            break;
+            SpawnBlockForNote(SongView[NoteIndex]);
         }
-		if (i == ArrivalTimes.Num() - 1)
-		{
-			NextSpawnIndex = ArrivalTimes.Num();
-			NextHighlightIndex = ArrivalTimes.Num();
-		}
+    }
+    else
+    {
+        // Nothing to draw yet; let Tick spawn the visible blocks once it can.
+        NextSpawnIndex = FirstVisibleIndex;
     }
 }
 
@@ -310,7 +491,8 @@ void AFallingBlockManager::OnUDPMessageReceived(const FArrayReaderPtr& Data, con
     if (ReceivedString.TrimStartAndEnd().Equals(TEXT("/start_song"), ESearchCase::IgnoreCase))
     {
 		UE_LOG(LogTemp, Log, TEXT("FallingBlockManager: Received /start_song command. Resetting state."));
-        SetMidiData(this->ArrivalTimes);
+        bRestartRequested = true;
+        PianoTickScheduling::WakeFromAnyThread(this);
         return;
     }
 
@@ -319,25 +501,24 @@ void AFallingBlockManager::OnUDPMessageReceived(const FArrayReaderPtr& Data, con
 
     if (FJsonSerializer::Deserialize(Reader, JsonObject) && JsonObject.IsValid())
     {
-        TArray<FBlockSpawnInfo> NewNotes;
-        const TArray<TSharedPtr<FJsonValue>>* NotesJsonArray;
+        // {"speed_factor": x} is sent by the bridge whenever its playback speed changes.
+        double SpeedFactor = 0.0;
+        if (JsonObject->TryGetNumberField(TEXT("speed_factor"), SpeedFactor))
+        {
+            PendingPlaybackRate = float(FMath::Max(SpeedFactor, 0.01));
+            PianoTickScheduling::WakeFromAnyThread(this);
+            return;
+        }
 
-        if (JsonObject->TryGetArrayField(TEXT("notes"), NotesJsonArray))
+        TArray<FPianoSongNote> NewNotes;
+        if (FPianoSong::ParseNotes(*JsonObject, NewNotes))
         {
-            for (const auto& Value : *NotesJsonArray)
-            {
-                const TSharedPtr<FJsonObject>& NoteObject = Value->AsObject();
-                if (NoteObject.IsValid())
-                {
-                    NewNotes.Add(FBlockSpawnInfo(
-                        NoteObject->GetNumberField(TEXT("time")),
-                        NoteObject->GetIntegerField(TEXT("midi_note")),
-                        NoteObject->GetNumberField(TEXT("duration"))
-                    ));
-                }
-            }
             UE_LOG(LogTemp, Log, TEXT("FallingBlockManager: Received full song with %d notes."), NewNotes.Num());
-            SetMidiData(NewNotes);
+            TUniquePtr<FPianoSong> NewSong = FPianoSong::Build(MoveTemp(NewNotes), ChordTolerance);
+
+            // Views are built on first use; build the practised one here rather than on the game thread.
+            NewSong->GetView(PracticeHand);
+            PublishSong(MoveTemp(NewSong));
         }
     }
     else
@@ -352,26 +533,50 @@ void AFallingBlockManager::OnPianoCalibrationComplete()
     PopulateKeyData();
 }
 
-void AFallingBlockManager::SetMidiData(const TArray<FBlockSpawnInfo>& NewArrivalTimes)
+void AFallingBlockManager::PublishSong(TUniquePtr<FPianoSong> NewSong)
 {
-    FScopeLock Lock(&ArrivalTimesMutex);
-    ArrivalTimes = NewArrivalTimes;
-    
-    ArrivalTimes.Sort([](const FBlockSpawnInfo& A, const FBlockSpawnInfo& B) {
-        return A.Time < B.Time;
-    });
+    delete PendingSong.exchange(NewSong.Release());
+    PianoTickScheduling::WakeFromAnyThread(this);
+}
 
-    for (AFallingBlock* Block : ActiveBlocks)
+void AFallingBlockManager::ConsumePendingSong()
+{
+    if (FPianoSong* NewSong = PendingSong.exchange(nullptr))
     {
-        if(IsValid(Block)) Block->Destroy();
+        Song.Reset(NewSong);
+        SongView = Song->GetView(PracticeHand);
+        bRestartRequested = false;
+        RestartSong();
+        UE_LOG(LogTemp, Log, TEXT("FallingBlockManager: Song with %d notes loaded. Ready to play."), Song->Notes.Num());
     }
-    ActiveBlocks.Empty();
+    else if (bRestartRequested.exchange(false))
+    {
+        RestartSong();
+    }
+}
+
+void AFallingBlockManager::SetPracticeHand(EPianoHand NewPracticeHand)
+{
+    PracticeHand = NewPracticeHand;
+    SongView = Song->GetView(PracticeHand);
+    PianoTickScheduling::Wake(this);
+
+    // Positions in the old view mean nothing in the new one; rebuild the scheduler state at the current time.
+    SetSongTime(CurrentSongTime);
+}
+
+void AFallingBlockManager::RestartSong()
+{
+    ClearBlocks();
+    ClearWaitingNotes();
+    ResetSongAudio();
+    if (PianoActorRef) PianoActorRef->ReleaseAllKeys();
 
     NextSpawnIndex = 0;
     NextHighlightIndex = 0;
-    CurrentSongTime = 0.0f;
-	
-	UE_LOG(LogTemp, Log, TEXT("FallingBlockManager: MIDI data set and sorted. Ready to play."));
+    NextChordGroup = 0;
+    SongClock.Seek(0.0);
+    CurrentSongTime = 0.0;
 }
 
 void AFallingBlockManager::PopulateKeyData()
@@ -382,33 +587,228 @@ void AFallingBlockManager::PopulateKeyData()
         return;
     }
 
-    KeyRelativeTransforms.Empty();
-    KeyWidths.Empty();
+    FKeyLayoutSnapshotPtr Snapshot = PianoActorRef->GetKeyLayoutSnapshot();
+    if (!Snapshot.IsValid() || Snapshot->NumValidKeys == 0)
+    {
+        UE_LOG(LogTemp, Warning, TEXT("FallingBlockManager: PopulateKeyData ran, but the piano has no key layout yet. bHasPopulatedKeyData remains false."));
+        return;
+    }
+
+    // Calibration only moves the piano; the layout itself is relative and usually unchanged.
+    if (KeyLayout.IsValid() && KeyLayout->Version == Snapshot->Version)
+    {
+        return;
+    }
+
+    KeyLayout = Snapshot;
+    bHasPopulatedKeyData = true;
+    RebuildKeyWorldFrames();
+    UE_LOG(LogTemp, Log, TEXT("FallingBlockManager: Using key layout version %u with %d keys."), KeyLayout->Version, KeyLayout->NumValidKeys);
+}
+
+void AFallingBlockManager::RebuildKeyWorldFrames()
+{
+    if (!PianoActorRef || !KeyLayout.IsValid())
+    {
+        return;
+    }
+
+    const FTransform PianoWorldTransform = PianoActorRef->GetActorTransform();
+    const float WidthScale = PianoWorldTransform.GetScale3D().Y;
+    for (int32 MidiNote = 0; MidiNote < PianoKeys::NumMidiNotes; ++MidiNote)
+    {
+        const FKeyLayoutSnapshotEntry* Key = KeyLayout->Find(MidiNote);
+        FKeyWorldFrame& Frame = KeyWorldFrames[MidiNote];
+        Frame.bValid = Key != nullptr;
+        if (!Key)
+        {
+            continue;
+        }
+
+        const FTransform KeyWorldTransform = Key->RelativeTransform * PianoWorldTransform;
+        Frame.Location = KeyWorldTransform.GetLocation();
+        Frame.UpVector = KeyWorldTransform.GetUnitAxis(EAxis::Z);
+        Frame.Rotation = KeyWorldTransform.GetRotation();
+        Frame.Width = Key->Width * WidthScale;
+    }
+}
+
+void AFallingBlockManager::OnPianoTransformUpdated(USceneComponent* UpdatedComponent, EUpdateTransformFlags UpdateTransformFlags, ETeleportType Teleport)
+{
+    // Only calibration and position nudges move the piano, so this is rare.
+    RebuildKeyWorldFrames();
+}
+
+void AFallingBlockManager::SpawnPendingBlocks()
+{
+    SCOPE_CYCLE_COUNTER(STAT_FallingBlockSpawn);
 
-    const FTransform PianoInverseTransform = PianoActorRef->GetActorTransform().Inverse();
-    const FVector PianoScale = PianoActorRef->GetActorScale3D();
-    const float KeyWidthScale = PianoScale.Y;
+    // Notes are in target-time order, so the most urgent block is always spawned first.
+    const uint64 StartCycles = FPlatformTime::Cycles64();
+    const uint64 BudgetCycles = uint64(SpawnBudgetMicroseconds * 1e-6 / FPlatformTime::GetSecondsPerCycle64());
+    bool bOverran = false;
 
-    for (int32 MidiNote = 0; MidiNote < 128; ++MidiNote)
+    while (NextSpawnIndex < SongView.Num())
     {
-        FTransform KeyWorldTransform;
-        float KeyWidth;
-        if (PianoActorRef->GetKeyTransformAndWidth(MidiNote, KeyWorldTransform, KeyWidth))
+        const FPianoSongNote& NoteInfo = SongView[NextSpawnIndex];
+        const double VisibleTime = NoteInfo.Time - LookaheadTime;
+        const bool bDue = CurrentSongTime >= VisibleTime;
+        const bool bWithinBudget = FPlatformTime::Cycles64() - StartCycles < BudgetCycles;
+
+        if (!bDue && (!bWithinBudget || CurrentSongTime < VisibleTime - PrespawnTime))
         {
-            FTransform KeyRelativeTransform = KeyWorldTransform * PianoInverseTransform;
-            KeyRelativeTransforms.Add(MidiNote, KeyRelativeTransform);
-            KeyWidths.Add(MidiNote, KeyWidth * KeyWidthScale);
+            break;
         }
+        bOverran |= bDue && !bWithinBudget;
+
+        SpawnBlockForNote(NoteInfo);
+        NextSpawnIndex++;
     }
-    UE_LOG(LogTemp, Log, TEXT("FallingBlockManager: Populated data for %d keys."), KeyRelativeTransforms.Num());
 
-    if (KeyRelativeTransforms.Num() > 0)
+    if (bOverran)
     {
-        bHasPopulatedKeyData = true;
-        UE_LOG(LogTemp, Log, TEXT("FallingBlockManager: bHasPopulatedKeyData set to true."));
+        INC_DWORD_STAT(STAT_FallingBlockSpawnOverruns);
     }
-    else
+
+#if STATS
+    SET_DWORD_STAT(STAT_FallingBlockSpawnBacklog, SongView.LowerBound(CurrentSongTime + LookaheadTime + PrespawnTime) - NextSpawnIndex);
+#endif
+}
+
+bool AFallingBlockManager::CanSpawnBlocks() const
+{
+    if (RenderMode == EFallingBlockRenderMode::Instanced)
+    {
+        return BlockInstances && BlockInstances->GetStaticMesh();
+    }
+    return BlockClass != nullptr;
+}
+
+void AFallingBlockManager::SetupBlockInstances()
+{
+    if (RenderMode != EFallingBlockRenderMode::Instanced)
+    {
+        return;
+    }
+
+    // Without an explicit mesh, draw whatever mesh and scale the block class would have used.
+    const AFallingBlock* BlockDefaults = BlockClass ? BlockClass->GetDefaultObject<AFallingBlock>() : nullptr;
+    UStaticMesh* Mesh = InstancedBlockMesh;
+    if (!Mesh && BlockDefaults && BlockDefaults->GetBlockMesh())
+    {
+        Mesh = BlockDefaults->GetBlockMesh()->GetStaticMesh();
+        for (int32 MaterialIndex = 0; MaterialIndex < BlockDefaults->GetBlockMesh()->GetNumMaterials(); ++MaterialIndex)
+        {
+            BlockInstances->SetMaterial(MaterialIndex, BlockDefaults->GetBlockMesh()->GetMaterial(MaterialIndex));
+        }
+    }
+    InstancedBlockScaleMultiplier = BlockDefaults ? BlockDefaults->BlockScaleMultiplier : FVector::OneVector;
+
+    if (!Mesh)
+    {
+        UE_LOG(LogTemp, Error, TEXT("FallingBlockManager: Instanced render mode needs InstancedBlockMesh or a BlockClass with a mesh."));
+        return;
+    }
+    BlockInstances->SetStaticMesh(Mesh);
+}
+
+void AFallingBlockManager::UpdateBlockInstances()
+{
+    if (BlockSlots.IsEmpty())
+    {
+        return;
+    }
+
+    SCOPE_CYCLE_COUNTER(STAT_FallingBlockInstanceUpdate);
+
+    // Every slot is written, free ones with zero scale, so the whole array goes to the GPU in one batch.
+    const double SongTime = CurrentSongTime;
+    const float Speed = UnitsPerSecond;
+    const float Lookahead = LookaheadTime;
+    ParallelFor(BlockSlots.Num(), [this, SongTime, Speed, Lookahead](int32 SlotIndex)
+    {
+        const FFallingBlockSlot& Slot = BlockSlots[SlotIndex];
+        if (!Slot.bActive || SongTime > Slot.DespawnTime || SongTime < Slot.TargetTime - Lookahead)
+        {
+            BlockInstanceTransforms[SlotIndex] = FTransform(FQuat::Identity, FVector::ZeroVector, FVector::ZeroVector);
+            return;
+        }
+
+        const FKeyWorldFrame& Key = KeyWorldFrames[Slot.MidiNote];
+        const float ZOffset = float(Slot.TargetTime - SongTime) * Speed;
+        const FVector Scale = AFallingBlock::ComputeBlockScale(Speed, Slot.Duration, Key.Width, InstancedBlockScaleMultiplier);
+        BlockInstanceTransforms[SlotIndex] = FTransform(Key.Rotation, Key.Location + Key.UpVector * ZOffset, Scale);
+    }, BlockSlots.Num() < MinBlocksForParallelUpdate ? EParallelForFlags::ForceSingleThread : EParallelForFlags::None);
+
+    for (int32 SlotIndex = 0; SlotIndex < BlockSlots.Num(); ++SlotIndex)
+    {
+        if (BlockSlots[SlotIndex].bActive && SongTime > BlockSlots[SlotIndex].DespawnTime)
+        {
+            ReleaseBlockSlot(SlotIndex);
+        }
+    }
+
+    BlockInstances->BatchUpdateInstancesTransforms(0, BlockInstanceTransforms, /*bWorldSpace=*/true, /*bMarkRenderStateDirty=*/true);
+}
+
+void AFallingBlockManager::ReleaseBlockSlot(int32 SlotIndex)
+{
+    // The instance itself is hidden by the next UpdateBlockInstances.
+    BlockSlots[SlotIndex].bActive = false;
+    FreeBlockSlots.Add(SlotIndex);
+    DEC_DWORD_STAT(STAT_FallingBlockInstances);
+}
+
+void AFallingBlockManager::ClearBlocks()
+{
+    for (AFallingBlock* Block : ActiveBlocks)
+    {
+        if(IsValid(Block)) Block->Destroy();
+    }
+    ActiveBlocks.Empty();
+
+    for (int32 SlotIndex = 0; SlotIndex < BlockSlots.Num(); ++SlotIndex)
+    {
+        if (BlockSlots[SlotIndex].bActive)
+        {
+            ReleaseBlockSlot(SlotIndex);
+        }
+    }
+
+    for (FKeyBlockBucket& Bucket : KeyBlockBuckets)
+    {
+        Bucket.Reset();
+    }
+}
+
+void AFallingBlockManager::AddToKeyBucket(int32 MidiNote, const FKeyBlockEntry& Entry)
+{
+    // Drop blocks that have already left the screen, so keys that are never played do not pile up entries.
+    FKeyBlockBucket& Bucket = KeyBlockBuckets[MidiNote];
+    Bucket.DropExpired(CurrentSongTime);
+    Bucket.PushBack(Entry);
+}
+
+bool AFallingBlockManager::IsBlockAlive(const FKeyBlockEntry& Entry) const
+{
+    if (Entry.Slot != INDEX_NONE)
+    {
+        return BlockSlots.IsValidIndex(Entry.Slot) && BlockSlots[Entry.Slot].bActive && BlockSlots[Entry.Slot].Serial == Entry.Serial;
+    }
+    return Entry.Actor.IsValid();
+}
+
+void AFallingBlockManager::SyncNextChordGroup()
+{
+    NextChordGroup = SongView.FindChordGroup(NextHighlightIndex, NextChordGroup);
+}
+
+void AFallingBlockManager::ClearWaitingNotes()
+{
+    if (PianoActorRef && !WaitingNotes.IsEmpty())
     {
-        UE_LOG(LogTemp, Warning, TEXT("FallingBlockManager: PopulateKeyData ran, but no key data was retrieved. bHasPopulatedKeyData remains false."));
+        PianoActorRef->UnhighlightKeys(WaitingNotes.ToArray());
     }
+    WaitingNotes.Reset();
+    WaitingChordGroup = INDEX_NONE;
 }
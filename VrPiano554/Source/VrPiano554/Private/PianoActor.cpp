@@ -1,9 +1,9 @@
 #include "PianoActor.h"
+#include "PianoSamplerComponent.h"
 #include "Components/StaticMeshComponent.h"
 #include "Components/SceneComponent.h"
 #include "Components/InputComponent.h"
 #include "Kismet/KismetSystemLibrary.h"
-#include "Containers/Set.h"
 #include "GameFramework/PlayerController.h"
 #include "GameFramework/Pawn.h"
 #include "MotionControllerComponent.h"
@@ -15,10 +15,22 @@
 #include "Interfaces/IPv4/IPv4Address.h" // Added for FIPv4Address
 #include "Common/UdpSocketBuilder.h" // Added for FUdpSocketBuilder
 #include "PianoSaveGame.h" // Added for UPianoSaveGame
+#include "PianoTickScheduling.h"
+#include "PianoLatencyTrace.h"
+#include "Algo/BinarySearch.h"
+
+DECLARE_CYCLE_STAT(TEXT("Piano PressKey"), STAT_PianoPressKey, STATGROUP_VrPiano);
+DECLARE_CYCLE_STAT(TEXT("Piano Tick"), STAT_PianoTick, STATGROUP_VrPiano);
+DECLARE_CYCLE_STAT(TEXT("Piano Highlight"), STAT_PianoHighlight, STATGROUP_VrPiano);
 
 APianoActor::APianoActor()
 {
+    // Ticks only while keys are animating; PressKey/ReleaseKey wake it up.
     PrimaryActorTick.bCanEverTick = true;
+    PrimaryActorTick.bStartWithTickEnabled = false;
+
+    HeldKeys.Init(false, PianoKeys::NumMidiNotes);
+    SostenutoKeys.Init(false, PianoKeys::NumMidiNotes);
 
     StableRoot = CreateDefaultSubobject<USceneComponent>(TEXT("StableRoot"));
     RootComponent = StableRoot;
@@ -40,11 +52,20 @@ APianoActor::APianoActor()
     Connectique = CreateDefaultSubobject<UStaticMeshComponent>(TEXT("connectique"));
     Connectique->SetupAttachment(RootComponent);
 
-    for (int32 i = 36; i <= 96; ++i)
+    // Every key hangs off its own pivot so it can rotate around the centre of its bounds.
+    // The pivots sit at the root until BeginPlay moves them into place from the key layout.
+    // These are the keys the model has meshes for. Other keys in KeyboardRange only get a layout
+    // entry, for the falling blocks: they sound and count as played, but have no visible key.
+    constexpr PianoKeys::FKeyboardRange ModelKeys = PianoKeys::GetKeyboardRange(EPianoKeyboardRange::Keys61);
+    for (int32 i = ModelKeys.FirstNote; i <= ModelKeys.LastNote; ++i)
     {
+        USceneComponent* KeyPivot = CreateDefaultSubobject<USceneComponent>(FName(*FString::Printf(TEXT("Pivot_%d"), i)));
+        KeyPivot->SetupAttachment(RootComponent);
+        KeyPivotComponents.Add(i, KeyPivot);
+
         FName ComponentName = FName(*FString::Printf(TEXT("Note%d"), i));
         UStaticMeshComponent* KeyMesh = CreateDefaultSubobject<UStaticMeshComponent>(ComponentName);
-        KeyMesh->SetupAttachment(RootComponent);
+        KeyMesh->SetupAttachment(KeyPivot);
         KeyMeshComponents.Add(i, KeyMesh);
     }
 
@@ -61,6 +82,9 @@ APianoActor::APianoActor()
         MenuWidgetComponent->SetWidgetClass(MenuWidgetClass.Class);
     }
 
+    Sampler = CreateDefaultSubobject<UPianoSamplerComponent>(TEXT("Sampler"));
+    Sampler->SetupAttachment(RootComponent);
+
     WidgetInteractionComponent = CreateDefaultSubobject<UWidgetInteractionComponent>(TEXT("WidgetInteraction"));
     WidgetInteractionComponent->SetupAttachment(RootComponent);
     WidgetInteractionComponent->bShowDebug = true;
@@ -75,6 +99,8 @@ APianoActor::APianoActor()
     bIsLiveMuted = false;
     bIsLifeHoldActive = false;
 
+    KeyLayout = nullptr;
+    KeyboardRange = EPianoKeyboardRange::Keys61;
     SenderSocket = nullptr;
 	CalculatedOffset = FVector::ZeroVector;
 }
@@ -87,6 +113,7 @@ void APianoActor::BeginPlay()
     {
         MenuWidgetComponent->SetVisibility(false);
         PianoMenuWidgetInstance = Cast<UPianoMenuWidget>(MenuWidgetComponent->GetUserWidgetObject());
+        OnMenuToggled.Broadcast(false);
     }
 
     FTimerHandle TimerHandle;
@@ -107,81 +134,221 @@ void APianoActor::BeginPlay()
         InputComponent->BindAction("TriggerLeft", IE_Released, this, &APianoActor::OnLeftTriggerReleased);
     }
 
-    const TSet<int32> BlackKeyIndexes = { 1, 3, 6, 8, 10 };
-    for (const TPair<int32, UStaticMeshComponent*>& Pair : KeyMeshComponents)
+    const PianoKeys::FKeyboardRange Range = GetKeyboardRange();
+    for (const TPair<int32, UStaticMeshComponent*>& KeyMesh : KeyMeshComponents)
     {
-        if (UStaticMeshComponent* KeyComponent = Pair.Value)
+        if (KeyMesh.Value && !Range.Contains(KeyMesh.Key))
         {
-            if (BlackKeyIndexes.Contains(Pair.Key % 12))
-            {
-                if (BlackKeyMaterial) KeyComponent->SetMaterial(0, BlackKeyMaterial);
-            }
-            else
+            KeyMesh.Value->SetVisibility(false);
+            KeyMesh.Value->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+        }
+    }
+
+    TArray<FPianoKeyLayoutEntry> Keys;
+    if (KeyLayout && KeyLayout->Keys.Num() > 0)
+    {
+        Keys = KeyLayout->Keys;
+    }
+    else
+    {
+        // No baked layout for this mesh set yet; measure the meshes once.
+        MeasureKeyLayout(Keys);
+    }
+    AddMissingKeys(Keys);
+    ApplyKeyLayout(Keys);
+
+    OnKeysInitialized.Broadcast();
+
+    if (bUseNativeSampler && Sampler)
+    {
+        Sampler->Start();
+    }
+
+    if (bUseNativeMidiInput)
+    {
+        // One wake per idle period is enough; the tick drains everything queued by then.
+        MidiInput = FPianoMidiInput::Open(NativeMidiInputDevice, [this]()
+        {
+            if (!bMidiWakePending.exchange(true))
             {
-                if (WhiteKeyMaterial) KeyComponent->SetMaterial(0, WhiteKeyMaterial);
+                PianoTickScheduling::WakeFromAnyThread(this);
             }
-        }
+        });
+        if (!MidiInput) UE_LOG(LogTemp, Warning, TEXT("APianoActor: native MIDI input \"%s\" unavailable; use the bridge's live input."), *NativeMidiInputDevice);
     }
 
-    KeyPivotMap.Empty();
-    UE_LOG(LogTemp, Log, TEXT("PianoActor: Starting KeyPivotMap population loop."));
+    SenderSocket = FUdpSocketBuilder(TEXT("PianoActorSenderSocket")).AsReusable().WithBroadcast();
+    if (!SenderSocket) UE_LOG(LogTemp, Error, TEXT("APianoActor: Failed to create UDP Sender Socket!"));
+}
 
-    for (const TPair<int32, UStaticMeshComponent*>& Pair : KeyMeshComponents)
+void APianoActor::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+    Super::EndPlay(EndPlayReason);
+    MidiInput.Reset();
+    if (SenderSocket)
     {
-        int32 MidiNote = Pair.Key;
-        UStaticMeshComponent* KeyComponent = Pair.Value;
+        SenderSocket->Close();
+        ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->DestroySocket(SenderSocket);
+        SenderSocket = nullptr;
+    }
+}
 
+void APianoActor::MeasureKeyLayout(TArray<FPianoKeyLayoutEntry>& OutKeys) const
+{
+    OutKeys.Reset();
+    const FTransform RootTransform = RootComponent->GetComponentTransform();
+    const PianoKeys::FKeyboardRange Range = GetKeyboardRange();
+
+    for (int32 MidiNote = Range.FirstNote; MidiNote <= Range.LastNote; ++MidiNote)
+    {
+        UStaticMeshComponent* KeyComponent = KeyMeshComponents.FindRef(MidiNote);
         if (!IsValid(KeyComponent) || !IsValid(KeyComponent->GetStaticMesh()))
         {
-            UE_LOG(LogTemp, Warning, TEXT("Key %d: Component or StaticMesh is invalid."), MidiNote);
             continue;
         }
 
-        FBoxSphereBounds Bounds = KeyComponent->CalcBounds(KeyComponent->GetComponentTransform());
-        if (Bounds.BoxExtent.IsNearlyZero())
+        const FBoxSphereBounds LocalBounds = KeyComponent->GetStaticMesh()->GetBounds();
+        if (LocalBounds.BoxExtent.IsNearlyZero())
         {
             UE_LOG(LogTemp, Warning, TEXT("Key %d: Mesh has zero bounds."), MidiNote);
             continue;
         }
 
-        UE_LOG(LogTemp, Log, TEXT("Key %d: Bounds.Origin at X=%.2f, Y=%.2f, Z=%.2f"), MidiNote, Bounds.Origin.X, Bounds.Origin.Y, Bounds.Origin.Z);
+        const FTransform KeyToRoot = KeyComponent->GetComponentTransform().GetRelativeTransform(RootTransform);
 
-        FVector PivotWorldPosition = Bounds.Origin;
+        FPianoKeyLayoutEntry& Entry = OutKeys.AddDefaulted_GetRef();
+        Entry.MidiNote = MidiNote;
+        Entry.PivotOffset = KeyToRoot.TransformPosition(LocalBounds.Origin);
+        Entry.Width = LocalBounds.BoxExtent.Y * 2.0f * KeyToRoot.GetScale3D().Y;
+        Entry.bIsBlack = PianoKeys::IsBlackKey(MidiNote);
+    }
+}
 
-        FName PivotName = FName(*FString::Printf(TEXT("Pivot_%d"), MidiNote));
-        USceneComponent* NewPivot = NewObject<USceneComponent>(this, PivotName);
+void APianoActor::AddMissingKeys(TArray<FPianoKeyLayoutEntry>& Keys) const
+{
+    const PianoKeys::FKeyboardRange Range = GetKeyboardRange();
+
+    // Measured keys of each colour in note order; black keys sit higher and further back than white ones.
+    TArray<const FPianoKeyLayoutEntry*> Measured[2];
+    TBitArray<> bHasEntry(false, PianoKeys::NumMidiNotes);
+    Keys.Sort([](const FPianoKeyLayoutEntry& A, const FPianoKeyLayoutEntry& B) { return A.MidiNote < B.MidiNote; });
+    for (const FPianoKeyLayoutEntry& Entry : Keys)
+    {
+        if (Range.Contains(Entry.MidiNote))
+        {
+            Measured[Entry.bIsBlack ? 1 : 0].Add(&Entry);
+            bHasEntry[Entry.MidiNote] = true;
+        }
+    }
 
-        if (NewPivot)
+    TArray<FPianoKeyLayoutEntry> MissingKeys;
+    const float WhiteKeyWidth = PianoModelWidth / Range.NumWhiteKeys();
+    for (int32 MidiNote = Range.FirstNote; MidiNote <= Range.LastNote; ++MidiNote)
+    {
+        if (bHasEntry[MidiNote])
         {
-            NewPivot->SetupAttachment(RootComponent);
-            NewPivot->SetWorldLocation(PivotWorldPosition);
-            NewPivot->RegisterComponent();
-            KeyPivotMap.Add(MidiNote, NewPivot);
-            KeyComponent->AttachToComponent(NewPivot, FAttachmentTransformRules::KeepWorldTransform);
+            continue;
         }
-        else
+
+        FPianoKeyLayoutEntry& Entry = MissingKeys.AddDefaulted_GetRef();
+        Entry.MidiNote = MidiNote;
+        Entry.bIsBlack = PianoKeys::IsBlackKey(MidiNote);
+
+        const TArray<const FPianoKeyLayoutEntry*>& Neighbours = Measured[Entry.bIsBlack ? 1 : 0];
+        if (Neighbours.Num() < 2)
         {
-            UE_LOG(LogTemp, Warning, TEXT("Key %d: Failed to create NewPivot object."), MidiNote);
+            // Nothing to line up with: lay the key out from the key geometry table across PianoModelWidth.
+            Entry.PivotOffset = FVector(0.0f, (Range.GetKeyOffset(MidiNote) - Range.NumWhiteKeys() * 0.5f) * WhiteKeyWidth, 0.0f);
+            Entry.Width = Entry.bIsBlack ? WhiteKeyWidth * 0.6f : WhiteKeyWidth;
+            continue;
         }
+
+        // Interpolate between the nearest measured keys of the same colour on either side, or
+        // extrapolate from the two nearest past either end, along the key's position in white keys.
+        const int32 Upper = FMath::Clamp(Algo::LowerBoundBy(Neighbours, MidiNote, [](const FPianoKeyLayoutEntry* Key) { return Key->MidiNote; }), 1, Neighbours.Num() - 1);
+        const FPianoKeyLayoutEntry& Below = *Neighbours[Upper - 1];
+        const FPianoKeyLayoutEntry& Above = *Neighbours[Upper];
+        const float BelowOffset = PianoKeys::NoteTable.Notes[Below.MidiNote].CenterOffset;
+        const float AboveOffset = PianoKeys::NoteTable.Notes[Above.MidiNote].CenterOffset;
+        const float Alpha = (PianoKeys::NoteTable.Notes[MidiNote].CenterOffset - BelowOffset) / (AboveOffset - BelowOffset);
+        Entry.PivotOffset = FMath::Lerp(Below.PivotOffset, Above.PivotOffset, Alpha);
+        Entry.Width = Alpha < 0.5f ? Below.Width : Above.Width;
     }
-    UE_LOG(LogTemp, Log, TEXT("PianoActor: KeyPivotMap populated with %d entries."), KeyPivotMap.Num());
 
-    OnKeysInitialized.Broadcast();
+    Keys.Append(MissingKeys);
+    Keys.Sort([](const FPianoKeyLayoutEntry& A, const FPianoKeyLayoutEntry& B) { return A.MidiNote < B.MidiNote; });
+}
 
-    SenderSocket = FUdpSocketBuilder(TEXT("PianoActorSenderSocket")).AsReusable().WithBroadcast();
-    if (!SenderSocket) UE_LOG(LogTemp, Error, TEXT("APianoActor: Failed to create UDP Sender Socket!"));
+void APianoActor::ApplyKeyLayout(const TArray<FPianoKeyLayoutEntry>& Keys)
+{
+    const PianoKeys::FKeyboardRange Range = GetKeyboardRange();
+    KeyPivots.Init(nullptr, PianoKeys::NumMidiNotes);
+    AppliedKeyLayout.Init(FPianoKeyLayoutEntry(), PianoKeys::NumMidiNotes);
+    TBitArray<> bApplied(false, PianoKeys::NumMidiNotes);
+
+    for (const FPianoKeyLayoutEntry& Entry : Keys)
+    {
+        if (!Range.Contains(Entry.MidiNote))
+        {
+            continue;
+        }
+        AppliedKeyLayout[Entry.MidiNote] = Entry;
+        bApplied[Entry.MidiNote] = true;
+
+        // Keys the model has no mesh for are published for the falling blocks but have nothing to move.
+        USceneComponent* KeyPivot = KeyPivotComponents.FindRef(Entry.MidiNote);
+        UStaticMeshComponent* KeyComponent = KeyMeshComponents.FindRef(Entry.MidiNote);
+        if (!KeyPivot || !KeyComponent)
+        {
+            continue;
+        }
+
+        UMaterialInterface* KeyMaterial = Entry.bIsBlack ? BlackKeyMaterial : WhiteKeyMaterial;
+        if (KeyMaterial) KeyComponent->SetMaterial(0, KeyMaterial);
+
+        // Move the pivot onto the key and shift the mesh back by the same amount so it stays in place.
+        const FVector PivotDelta = Entry.PivotOffset - KeyPivot->GetRelativeLocation();
+        KeyPivot->SetRelativeLocation(Entry.PivotOffset);
+        KeyComponent->SetRelativeLocation(KeyComponent->GetRelativeLocation() - PivotDelta);
+
+        KeyPivots[Entry.MidiNote] = KeyPivot;
+    }
+
+    // Publish the new layout. Versions are global so that snapshots of different pianos never compare equal.
+    static uint32 LastKeyLayoutVersion = 0;
+
+    TSharedPtr<FKeyLayoutSnapshot, ESPMode::ThreadSafe> Snapshot = MakeShared<FKeyLayoutSnapshot, ESPMode::ThreadSafe>();
+    Snapshot->Version = ++LastKeyLayoutVersion;
+    Snapshot->Range = Range;
+    for (int32 MidiNote = Range.FirstNote; MidiNote <= Range.LastNote; ++MidiNote)
+    {
+        if (bApplied[MidiNote])
+        {
+            FKeyLayoutSnapshotEntry& SnapshotEntry = Snapshot->Keys[MidiNote];
+            SnapshotEntry.RelativeTransform = FTransform(AppliedKeyLayout[MidiNote].PivotOffset);
+            SnapshotEntry.Width = AppliedKeyLayout[MidiNote].Width;
+            SnapshotEntry.bValid = true;
+            ++Snapshot->NumValidKeys;
+        }
+    }
+    KeyLayoutSnapshot = Snapshot;
 }
 
-void APianoActor::EndPlay(const EEndPlayReason::Type EndPlayReason)
+#if WITH_EDITOR
+void APianoActor::BakeKeyLayout()
 {
-    Super::EndPlay(EndPlayReason);
-    if (SenderSocket)
+    if (!KeyLayout)
     {
-        SenderSocket->Close();
-        ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->DestroySocket(SenderSocket);
-        SenderSocket = nullptr;
+        UE_LOG(LogTemp, Warning, TEXT("APianoActor::BakeKeyLayout - Assign a KeyLayout asset first."));
+        return;
     }
+
+    KeyLayout->Modify();
+    MeasureKeyLayout(KeyLayout->Keys);
+    KeyLayout->MarkPackageDirty();
+    UE_LOG(LogTemp, Log, TEXT("APianoActor::BakeKeyLayout - Baked %d keys into %s."), KeyLayout->Keys.Num(), *KeyLayout->GetName());
 }
+#endif
 
 void APianoActor::ToggleMenu()
 {
@@ -274,40 +441,143 @@ void APianoActor::ApplyCalibration()
     OnCalibrationComplete.Broadcast();
 }
 
-void APianoActor::PressKey(int32 MidiNote)
+void APianoActor::PressKey(int32 MidiNote, int32 Velocity)
 {
-    if (KeyPivotMap.Contains(MidiNote))
+    SCOPE_CYCLE_COUNTER(STAT_PianoPressKey);
+    if (bUseNativeSampler && Velocity > 0 && Sampler) Sampler->NoteOn(MidiNote, Velocity);
+    if (HeldKeys.IsValidIndex(MidiNote)) HeldKeys[MidiNote] = true;
+    if (KeyPivots.IsValidIndex(MidiNote) && KeyPivots[MidiNote])
     {
         ActiveKeyAnimations.Add(MidiNote, TargetRotationAngle);
+        if (const uint32 TraceId = PianoLatencyTrace::GetCurrentEventId())
+        {
+            PianoLatencyTrace::Record(TraceId, EPianoLatencyStage::PressKey, FPlatformTime::Seconds());
+            KeyTraceIds.Add(MidiNote, TraceId);
+        }
+        PianoTickScheduling::Wake(this);
+    }
+    if (AppliedKeyLayout.IsValidIndex(MidiNote) && AppliedKeyLayout[MidiNote].MidiNote == MidiNote)
+    {
         OnPlayerNotePlayed.Broadcast(MidiNote);
     }
 }
 
-void APianoActor::ReleaseKey(int32 MidiNote)
+void APianoActor::ReleaseKey(int32 MidiNote, bool bStopSound)
 {
-    if (KeyPivotMap.Contains(MidiNote)) ActiveKeyAnimations.Add(MidiNote, 0.0f);
+    if (bStopSound && bUseNativeSampler && Sampler) Sampler->NoteOff(MidiNote);
+    if (HeldKeys.IsValidIndex(MidiNote)) HeldKeys[MidiNote] = false;
+    if (KeyPivots.IsValidIndex(MidiNote) && KeyPivots[MidiNote])
+    {
+        ActiveKeyAnimations.Add(MidiNote, 0.0f);
+        PianoTickScheduling::Wake(this);
+    }
 }
 
 void APianoActor::Tick(float DeltaTime)
 {
     Super::Tick(DeltaTime);
+    PianoTickScheduling::NoteTicked();
+    SCOPE_CYCLE_COUNTER(STAT_PianoTick);
+
+    DispatchNativeMidiEvents();
+
     TMap<int32, float> AnimationsToProcess = ActiveKeyAnimations;
     for (const TPair<int32, float>& Pair : AnimationsToProcess)
     {
-        if (USceneComponent* Pivot = KeyPivotMap.FindRef(Pair.Key))
+        if (USceneComponent* Pivot = KeyPivots[Pair.Key])
         {
             FRotator TargetRotator = FRotator(0.0f, 0.0f, Pair.Value);
             FRotator NewRotation = FMath::RInterpTo(Pivot->GetRelativeRotation(), TargetRotator, DeltaTime, AnimationSpeed);
             Pivot->SetRelativeRotation(NewRotation);
+            uint32 TraceId;
+            if (KeyTraceIds.RemoveAndCopyValue(Pair.Key, TraceId))
+            {
+                PianoLatencyTrace::Record(TraceId, EPianoLatencyStage::AnimationStart, FPlatformTime::Seconds());
+                PianoLatencyTrace::RecordFrameRendered(TraceId);
+            }
             if (FMath::IsNearlyEqual(NewRotation.Roll, TargetRotator.Roll, 0.01f)) ActiveKeyAnimations.Remove(Pair.Key);
         }
     }
+
+    PianoTickScheduling::SleepIfIdle(this, ActiveKeyAnimations.Num() > 0 || (MidiInput && MidiInput->HasEvents()));
+}
+
+void APianoActor::DispatchNativeMidiEvents()
+{
+    if (!MidiInput) return;
+
+    // Cleared before draining, so an event queued after the drain wakes the actor again.
+    bMidiWakePending = false;
+    FPianoMidiEvent Event;
+    while (MidiInput->Dequeue(Event))
+    {
+        uint32 TraceId = 0;
+        if (Event.Type == EPianoMidiEventType::NoteOn && PianoLatencyTrace::IsEnabled())
+        {
+            TraceId = PianoLatencyTrace::NewEventId();
+            PianoLatencyTrace::Record(TraceId, EPianoLatencyStage::Capture, Event.Time);
+            PianoLatencyTrace::Record(TraceId, EPianoLatencyStage::Decode, FPlatformTime::Seconds());
+        }
+        PianoLatencyTrace::FEventScope TraceScope(TraceId);
+
+        switch (Event.Type)
+        {
+        case EPianoMidiEventType::NoteOn: HandleMidiEventWithSource(Event.MidiNote, true, TEXT("live"), Event.Value); break;
+        case EPianoMidiEventType::NoteOff: HandleMidiEventWithSource(Event.MidiNote, false, TEXT("live"), 0); break;
+        case EPianoMidiEventType::Sustain: HandleMidiControlChange(64, Event.Value, TEXT("live")); break;
+        case EPianoMidiEventType::Sostenuto: HandleMidiControlChange(66, Event.Value, TEXT("live")); break;
+        }
+    }
 }
 
-void APianoActor::HandleMidiEventWithSource(int32 Note, bool bIsNoteOn, const FString& Source)
+void APianoActor::HandleMidiEventWithSource(int32 Note, bool bIsNoteOn, const FString& Source, int32 Velocity)
 {
-    if (Source.Equals(TEXT("file"), ESearchCase::IgnoreCase) && bIsFileAnimationMuted) return;
-    bIsNoteOn ? PressKey(Note) : ReleaseKey(Note);
+    const bool bFromFile = Source.Equals(TEXT("file"), ESearchCase::IgnoreCase);
+    if (bFromFile && bIsFileAnimationMuted) return;
+
+    // Muted sources still move the keys, they just do not sound. File notes are already on the
+    // sampler's schedule when the engine sounds the song itself.
+    const bool bSilent = bFromFile ? (bIsFileMuted || IsSchedulingSongAudio()) : bIsLiveMuted;
+    bIsNoteOn ? PressKey(Note, bSilent ? 0 : Velocity) : ReleaseKey(Note, !(bFromFile && IsSchedulingSongAudio()));
+}
+
+void APianoActor::HandleMidiControlChange(int32 Controller, int32 Value, const FString& Source)
+{
+    // Song pedalling is part of the file's sound, which is on the sampler's schedule or muted.
+    const bool bFromFile = Source.Equals(TEXT("file"), ESearchCase::IgnoreCase);
+    if (bFromFile && (bIsFileMuted || IsSchedulingSongAudio())) return;
+
+    switch (Controller)
+    {
+    case 64: SetSustainPedal(Value >= 64); break;
+    case 66: SetSostenutoPedal(Value >= 64); break;
+    default: break;
+    }
+}
+
+void APianoActor::SetSustainPedal(bool bDown)
+{
+    if (bDown == bSustainPedalDown) return;
+    bSustainPedalDown = bDown;
+    if (bUseNativeSampler && Sampler) Sampler->SetSustainPedal(bDown);
+}
+
+void APianoActor::SetSostenutoPedal(bool bDown)
+{
+    if (bDown == bSostenutoPedalDown) return;
+    bSostenutoPedalDown = bDown;
+
+    // Catches the dampers that are up as it goes down, as the sampler does.
+    for (int32 MidiNote = 0; MidiNote < SostenutoKeys.Num(); ++MidiNote)
+    {
+        SostenutoKeys[MidiNote] = bDown && (HeldKeys[MidiNote] || bSustainPedalDown);
+    }
+    if (bUseNativeSampler && Sampler) Sampler->SetSostenutoPedal(bDown);
+}
+
+bool APianoActor::IsDamperRaised(int32 MidiNote) const
+{
+    return HeldKeys.IsValidIndex(MidiNote) && (HeldKeys[MidiNote] || SostenutoKeys[MidiNote] || bSustainPedalDown);
 }
 
 void APianoActor::HandleMidiNote(int32 Note, bool bIsNoteOn)
@@ -326,6 +596,7 @@ void APianoActor::HandleMidiNote(int32 Note, bool bIsNoteOn)
 
 void APianoActor::HighlightKeys(const TArray<int32>& NotesToHighlight)
 {
+    SCOPE_CYCLE_COUNTER(STAT_PianoHighlight);
     if (!HighlightedKeyMaterial) return;
     for (int32 Note : NotesToHighlight)
     {
@@ -339,6 +610,7 @@ void APianoActor::HighlightKeys(const TArray<int32>& NotesToHighlight)
 
 void APianoActor::UnhighlightKeys(const TArray<int32>& NotesToUnhighlight)
 {
+    SCOPE_CYCLE_COUNTER(STAT_PianoHighlight);
     for (int32 Note : NotesToUnhighlight)
     {
         if (UMaterialInterface** OriginalMaterial = OriginalKeyMaterials.Find(Note))
@@ -414,37 +686,40 @@ void APianoActor::ToggleFileAnimationMute() { bIsFileAnimationMuted = !bIsFileAn
 void APianoActor::PlayNote(int32 MidiNote, float Duration)
 {
     PressKey(MidiNote);
-    FTimerHandle ReleaseTimerHandle;
+
+    // A re-struck key is released by its latest note, not by an earlier one.
+    FTimerHandle& ReleaseTimerHandle = KeyReleaseTimers.FindOrAdd(MidiNote);
     FTimerDelegate ReleaseDelegate;
-    ReleaseDelegate.BindLambda([this, MidiNote]() { ReleaseKey(MidiNote); });
+    ReleaseDelegate.BindLambda([this, MidiNote]()
+    {
+        KeyReleaseTimers.Remove(MidiNote);
+        ReleaseKey(MidiNote, /*bStopSound=*/false);
+    });
     GetWorldTimerManager().SetTimer(ReleaseTimerHandle, ReleaseDelegate, Duration, false);
 }
 
+void APianoActor::ReleaseAllKeys()
+{
+    for (TPair<int32, FTimerHandle>& Pair : KeyReleaseTimers)
+    {
+        GetWorldTimerManager().ClearTimer(Pair.Value);
+        ReleaseKey(Pair.Key, /*bStopSound=*/false);
+    }
+    KeyReleaseTimers.Empty();
+}
+
 void APianoActor::LoadMidiFile() {}
 
 bool APianoActor::GetKeyTransformAndWidth(int32 MidiNote, FTransform& OutTransform, float& OutWidth)
 {
-    if (USceneComponent** PivotPtr = KeyPivotMap.Find(MidiNote))
+    if (const FKeyLayoutSnapshotEntry* Key = KeyLayoutSnapshot ? KeyLayoutSnapshot->Find(MidiNote) : nullptr)
     {
-        if (USceneComponent* Pivot = *PivotPtr)
-        {
-            OutTransform = Pivot->GetComponentTransform();
-            UE_LOG(LogTemp, Log, TEXT("GetKeyTransformAndWidth: Found transform for key %d at location X=%.2f, Y=%.2f, Z=%.2f"), MidiNote, OutTransform.GetLocation().X, OutTransform.GetLocation().Y, OutTransform.GetLocation().Z);
-            if (UStaticMeshComponent** KeyMeshPtr = KeyMeshComponents.Find(MidiNote))
-            {
-                if (UStaticMeshComponent* KeyMesh = *KeyMeshPtr)
-                {
-                    FBoxSphereBounds LocalBounds = KeyMesh->GetStaticMesh()->GetBounds();
-                    OutWidth = LocalBounds.BoxExtent.Y * 2.0f * KeyMesh->GetComponentScale().Y;
-                    return true;
-                }
-            }
-        }
-    }
-    else
-    {
-        UE_LOG(LogTemp, Warning, TEXT("GetKeyTransformAndWidth: Could not find pivot in KeyPivotMap for note %d."), MidiNote);
+        OutTransform = Key->RelativeTransform * GetActorTransform();
+        OutWidth = Key->Width * GetActorScale3D().Y;
+        return true;
     }
+
+    UE_LOG(LogTemp, Warning, TEXT("GetKeyTransformAndWidth: No key layout for note %d."), MidiNote);
     OutTransform = FTransform::Identity;
     OutWidth = 0.0f;
     return false;
@@ -454,8 +729,9 @@ void APianoActor::BroadcastKeysInitialized() { OnKeysInitialized.Broadcast(); }
 
 FString APianoActor::GetNoteName(int32 MidiNote)
 {
-    static const FString NoteNames[] = { TEXT("C"), TEXT("C#"), TEXT("D"), TEXT("D#"), TEXT("E"), TEXT("F"), TEXT("F#"), TEXT("G"), TEXT("G#"), TEXT("A"), TEXT("A#"), TEXT("B") };
-    int32 NoteIndex = MidiNote % 12;
-    int32 Octave = (MidiNote / 12) - 1;
-    return FString::Printf(TEXT("%s%d"), *NoteNames[NoteIndex], Octave);
+    if (MidiNote < 0 || MidiNote >= PianoKeys::NumMidiNotes)
+    {
+        return FString();
+    }
+    return FString(PianoKeys::NoteTable.Notes[MidiNote].Name);
 }
\ No newline at end of file
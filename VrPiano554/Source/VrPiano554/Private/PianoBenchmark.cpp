@@ -0,0 +1,91 @@
+#include "PianoBenchmark.h"
+#include "VrPiano554.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Dom/JsonObject.h"
+#include "Serialization/JsonSerializer.h"
+#include "Serialization/JsonWriter.h"
+
+#if !UE_BUILD_SHIPPING
+
+namespace
+{
+    template <typename ValueType, typename ConvertFunction>
+    bool ParseListOf(const FString& Arg, const TCHAR* Key, TArray<ValueType>& Out, ConvertFunction Convert)
+    {
+        FString List;
+        if (!FParse::Value(*Arg, Key, List))
+        {
+            return false;
+        }
+
+        TArray<FString> Items;
+        List.ParseIntoArray(Items, TEXT(","));
+        Out.Reset();
+        for (const FString& Item : Items) Out.Add(Convert(*Item));
+        return true;
+    }
+}
+
+PianoBenchmark::FTimingStats PianoBenchmark::FTimingStats::FromSamples(TArray<double>& Samples)
+{
+    FTimingStats Stats;
+    if (Samples.Num() == 0)
+    {
+        return Stats;
+    }
+
+    Samples.Sort();
+    for (double Sample : Samples) Stats.Mean += Sample;
+    Stats.Mean /= Samples.Num();
+    auto Percentile = [&Samples](double Fraction) { return Samples[FMath::Min(Samples.Num() - 1, FMath::FloorToInt(Samples.Num() * Fraction))]; };
+    Stats.P50 = Percentile(0.5);
+    Stats.P90 = Percentile(0.9);
+    Stats.P95 = Percentile(0.95);
+    Stats.P99 = Percentile(0.99);
+    Stats.Max = Samples.Last();
+    return Stats;
+}
+
+void PianoBenchmark::FTimingStats::Write(FJsonObject& Entry, const TCHAR* Prefix, const TCHAR* Unit) const
+{
+    auto Set = [&Entry, Prefix, Unit](const TCHAR* Name, double Value) { Entry.SetNumberField(FString(Prefix) + Name + Unit, Value); };
+    Set(TEXT("Mean"), Mean);
+    Set(TEXT("P50"), P50);
+    Set(TEXT("P90"), P90);
+    Set(TEXT("P95"), P95);
+    Set(TEXT("P99"), P99);
+    Set(TEXT("Max"), Max);
+}
+
+double PianoBenchmark::CyclesToUs(uint64 Cycles)
+{
+    return FPlatformTime::ToMilliseconds64(Cycles) * 1000.0;
+}
+
+double PianoBenchmark::GetBlockBudgetUs(int32 BlockFrames, int32 SampleRate)
+{
+    return 1e6 * BlockFrames / FMath::Max(1, SampleRate);
+}
+
+bool PianoBenchmark::ParseList(const FString& Arg, const TCHAR* Key, TArray<int32>& Out)
+{
+    return ParseListOf(Arg, Key, Out, [](const TCHAR* Item) { return FMath::Max(1, FCString::Atoi(Item)); });
+}
+
+bool PianoBenchmark::ParseList(const FString& Arg, const TCHAR* Key, TArray<double>& Out)
+{
+    return ParseListOf(Arg, Key, Out, [](const TCHAR* Item) { return FMath::Max(0.01, FCString::Atod(Item)); });
+}
+
+void PianoBenchmark::WriteReport(const FString& FileName, const TSharedRef<FJsonObject>& Report, const TCHAR* CommandName)
+{
+    const FString ReportPath = FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("Benchmarks"), FileName);
+    FString Output;
+    FJsonSerializer::Serialize(Report, TJsonWriterFactory<>::Create(&Output));
+    FFileHelper::SaveStringToFile(Output, *ReportPath);
+    UE_LOG(LogVrPiano554, Display, TEXT("%s: Report written to %s."), CommandName, *ReportPath);
+}
+
+#endif // !UE_BUILD_SHIPPING
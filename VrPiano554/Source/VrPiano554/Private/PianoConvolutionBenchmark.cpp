@@ -0,0 +1,201 @@
+// PianoConvolutionBenchmark.cpp
+//
+// Headless cost measurement of the partitioned convolution reverb, for choosing an impulse response length.
+//   UnrealEditor-Cmd VrPiano554 -game -nullrhi -nosound -unattended -ExecCmds="piano.ConvolutionBenchmark Quit"
+//     convolves noise with 0.5 to 4 s responses in 128-frame blocks, once with the whole response on
+//     the calling thread and once with the tail on the worker thread, paced in real time so the
+//     worker sees the audio thread's cadence. Reports per-block cost percentiles of the calling
+//     thread, the worker's share, and blocks whose tail came late. Responses are synthetic
+//     decaying noise unless IR=Path is given, which is trimmed to each length instead.
+// Writes a JSON report to Saved/Benchmarks/PianoConvolution.json.
+
+#include "VrPiano554.h"
+#include "PianoBenchmark.h"
+#include "PianoConvolutionReverb.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformProcess.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/Paths.h"
+#include "Math/RandomStream.h"
+#include "Dom/JsonObject.h"
+
+#if !UE_BUILD_SHIPPING
+
+namespace
+{
+    struct FConvolutionRun
+    {
+        PianoBenchmark::FTimingStats BlockUs;
+        int32 LateTailBlocks = 0;
+        int32 NumPartitions = 0;
+    };
+
+    // Stereo noise with an exponential decay of 60 dB over Seconds, like a room's late reverberation.
+    TArray<TArray<float>> MakeSyntheticResponse(double Seconds, int32 SampleRate)
+    {
+        FRandomStream Random(1234);
+        const int32 NumFrames = FMath::Max(1, FMath::RoundToInt32(Seconds * SampleRate));
+        const double DecayPerFrame = FMath::Pow(10.0, -3.0 / (Seconds * SampleRate));
+        TArray<TArray<float>> Response;
+        Response.SetNum(2);
+        for (TArray<float>& Channel : Response)
+        {
+            Channel.SetNumUninitialized(NumFrames);
+            double Envelope = 0.05;
+            for (float& Sample : Channel)
+            {
+                Sample = float(Random.FRandRange(-1.0f, 1.0f) * Envelope);
+                Envelope *= DecayPerFrame;
+            }
+        }
+        return Response;
+    }
+
+    FConvolutionRun RunConvolution(const TArray<TArray<float>>& Response, const FPianoConvolutionSettings& Settings, int32 SampleRate, int32 BlockFrames, int32 NumBlocks, bool bRealtime)
+    {
+        FPianoConvolutionReverb Reverb(Response, Settings);
+        FRandomStream Random(42);
+        TArray<float> Block;
+        Block.SetNumUninitialized(BlockFrames * 2);
+        TArray<double> BlockUs;
+        BlockUs.Reserve(NumBlocks);
+
+        const double BlockSeconds = double(BlockFrames) / SampleRate;
+        const double Start = FPlatformTime::Seconds();
+        for (int32 BlockIndex = 0; BlockIndex < NumBlocks; ++BlockIndex)
+        {
+            for (float& Sample : Block)
+            {
+                Sample = Random.FRandRange(-0.5f, 0.5f);
+            }
+
+            const uint64 BlockStart = FPlatformTime::Cycles64();
+            Reverb.Process(Block.GetData(), BlockFrames);
+            BlockUs.Add(PianoBenchmark::CyclesToUs(FPlatformTime::Cycles64() - BlockStart));
+
+            if (bRealtime)
+            {
+                const double Wait = Start + (BlockIndex + 1) * BlockSeconds - FPlatformTime::Seconds();
+                if (Wait > 0.0)
+                {
+                    FPlatformProcess::SleepNoStats(float(Wait));
+                }
+            }
+        }
+
+        FConvolutionRun Run;
+        Run.BlockUs = PianoBenchmark::FTimingStats::FromSamples(BlockUs);
+        Run.LateTailBlocks = Reverb.GetNumLateTailBlocks();
+        Run.NumPartitions = Reverb.GetNumPartitions();
+        return Run;
+    }
+
+    void RunPianoConvolutionBenchmark(const TArray<FString>& Args)
+    {
+        TArray<double> Lengths = { 0.5, 1.0, 2.0, 3.0, 4.0 };
+        FString ResponsePath;
+        FPianoConvolutionSettings Settings;
+        int32 SampleRate = 48000;
+        int32 BlockFrames = 128;
+        double Seconds = 5.0;
+
+        // Share of a block's wall time the reverb may take on the audio thread next to the sampler.
+        double BudgetFraction = 0.25;
+        bool bQuit = false;
+        for (const FString& Arg : Args)
+        {
+            PianoBenchmark::ParseList(Arg, TEXT("Lengths="), Lengths);
+            FParse::Value(*Arg, TEXT("IR="), ResponsePath);
+            FParse::Value(*Arg, TEXT("Rate="), SampleRate);
+            FParse::Value(*Arg, TEXT("Block="), BlockFrames);
+            FParse::Value(*Arg, TEXT("Partition="), Settings.PartitionFrames);
+            FParse::Value(*Arg, TEXT("Head="), Settings.HeadPartitions);
+            FParse::Value(*Arg, TEXT("Seconds="), Seconds);
+            FParse::Value(*Arg, TEXT("Budget="), BudgetFraction);
+            bQuit |= Arg.Equals(TEXT("Quit"), ESearchCase::IgnoreCase);
+        }
+        if (!ResponsePath.IsEmpty() && FPaths::IsRelative(ResponsePath))
+        {
+            ResponsePath = FPaths::ConvertRelativePathToFull(FPaths::ProjectDir(), ResponsePath);
+        }
+
+        SampleRate = FMath::Max(1, SampleRate);
+        BlockFrames = FMath::Clamp(BlockFrames, 16, 4096);
+        const int32 NumBlocks = FMath::Max(1, FMath::CeilToInt32(Seconds * SampleRate / BlockFrames));
+        const double BudgetUs = PianoBenchmark::GetBlockBudgetUs(BlockFrames, SampleRate);
+
+        TArray<TSharedPtr<FJsonValue>> Entries;
+        double LongestSafeSeconds = 0.0;
+        for (double Length : Lengths)
+        {
+            TArray<TArray<float>> Response;
+            if (ResponsePath.IsEmpty())
+            {
+                Response = MakeSyntheticResponse(Length, SampleRate);
+            }
+            else if (!FPianoConvolutionReverb::LoadImpulseResponse(ResponsePath, SampleRate, float(Length), Response))
+            {
+                if (bQuit) FPlatformMisc::RequestExitWithStatus(false, 1);
+                return;
+            }
+
+            // Everything on the calling thread needs no pacing; it measures the full cost of a block.
+            FPianoConvolutionSettings InlineSettings = Settings;
+            InlineSettings.bUseWorkerThread = false;
+            const FConvolutionRun Inline = RunConvolution(Response, InlineSettings, SampleRate, BlockFrames, NumBlocks, false);
+
+            FPianoConvolutionSettings ThreadedSettings = Settings;
+            ThreadedSettings.bUseWorkerThread = true;
+            const FConvolutionRun Threaded = RunConvolution(Response, ThreadedSettings, SampleRate, BlockFrames, NumBlocks, true);
+
+            const int32 NumPartitions = Inline.NumPartitions;
+            const double WorkerUs = FMath::Max(0.0, Inline.BlockUs.Mean - Threaded.BlockUs.Mean);
+            if (Threaded.BlockUs.P99 <= BudgetUs * BudgetFraction && Threaded.LateTailBlocks == 0)
+            {
+                LongestSafeSeconds = FMath::Max(LongestSafeSeconds, Length);
+            }
+
+            UE_LOG(LogVrPiano554, Display,
+                TEXT("piano.ConvolutionBenchmark: %.1f s (%d partitions), %d-frame blocks of %.0f us: inline mean %.1f us p99 %.1f us; with worker mean %.1f us p50 %.1f us p99 %.1f us max %.1f us, worker about %.1f us per block, %d late tails"),
+                Length, NumPartitions, BlockFrames, BudgetUs, Inline.BlockUs.Mean, Inline.BlockUs.P99,
+                Threaded.BlockUs.Mean, Threaded.BlockUs.P50, Threaded.BlockUs.P99, Threaded.BlockUs.Max, WorkerUs, Threaded.LateTailBlocks);
+
+            TSharedRef<FJsonObject> Entry = MakeShared<FJsonObject>();
+            Entry->SetNumberField(TEXT("Seconds"), Length);
+            Entry->SetNumberField(TEXT("Partitions"), NumPartitions);
+            Inline.BlockUs.Write(*Entry, TEXT("InlineBlock"), TEXT("Us"));
+            Threaded.BlockUs.Write(*Entry, TEXT("ThreadedBlock"), TEXT("Us"));
+            Entry->SetNumberField(TEXT("WorkerBlockMeanUs"), WorkerUs);
+            Entry->SetNumberField(TEXT("LateTailBlocks"), Threaded.LateTailBlocks);
+            Entries.Add(MakeShared<FJsonValueObject>(Entry));
+        }
+
+        UE_LOG(LogVrPiano554, Display, TEXT("piano.ConvolutionBenchmark: Responses up to %.1f s keep the audio thread's 99th percentile under %.0f%% of a block with no late tails."),
+            LongestSafeSeconds, BudgetFraction * 100.0);
+
+        TSharedRef<FJsonObject> Report = MakeShared<FJsonObject>();
+        Report->SetStringField(TEXT("ImpulseResponse"), ResponsePath.IsEmpty() ? TEXT("synthetic") : *ResponsePath);
+        Report->SetNumberField(TEXT("SampleRate"), SampleRate);
+        Report->SetNumberField(TEXT("BlockFrames"), BlockFrames);
+        Report->SetNumberField(TEXT("PartitionFrames"), Settings.PartitionFrames);
+        Report->SetNumberField(TEXT("HeadPartitions"), Settings.HeadPartitions);
+        Report->SetNumberField(TEXT("BlockBudgetUs"), BudgetUs);
+        Report->SetNumberField(TEXT("BudgetFraction"), BudgetFraction);
+        Report->SetNumberField(TEXT("LongestSafeSeconds"), LongestSafeSeconds);
+        Report->SetArrayField(TEXT("Results"), Entries);
+
+        PianoBenchmark::WriteReport(TEXT("PianoConvolution.json"), Report, TEXT("piano.ConvolutionBenchmark"));
+
+        if (bQuit)
+        {
+            FPlatformMisc::RequestExitWithStatus(false, 0);
+        }
+    }
+
+    FAutoConsoleCommandWithArgs PianoConvolutionBenchmarkCommand(
+        TEXT("piano.ConvolutionBenchmark"),
+        TEXT("Measures the convolution reverb's per-block cost for 0.5 to 4 s impulse responses. Args: Lengths=S,S,... IR=Path Rate=Hz Block=Frames Partition=Frames Head=N Seconds=S Budget=Fraction Quit"),
+        FConsoleCommandWithArgsDelegate::CreateStatic(&RunPianoConvolutionBenchmark));
+}
+
+#endif // !UE_BUILD_SHIPPING
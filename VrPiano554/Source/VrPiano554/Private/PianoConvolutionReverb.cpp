@@ -0,0 +1,423 @@
+#include "PianoConvolutionReverb.h"
+#include "VrPiano554.h"
+#include "PianoResampler.h"
+#include "PianoWaveFile.h"
+#include "DSP/FFTAlgorithm.h"
+#include "HAL/Event.h"
+#include "HAL/PlatformProcess.h"
+#include "HAL/Runnable.h"
+#include "HAL/RunnableThread.h"
+#include "Math/VectorRegister.h"
+#include "Misc/FileHelper.h"
+
+DECLARE_CYCLE_STAT(TEXT("Piano Convolution"), STAT_PianoConvolution, STATGROUP_VrPiano);
+DECLARE_CYCLE_STAT(TEXT("Piano Convolution Tail"), STAT_PianoConvolutionTail, STATGROUP_VrPiano);
+
+namespace
+{
+    // Scalings are relative to an unscaled forward transform and an inverse that divides by the size.
+    double GetScalingFactor(Audio::EFFTScaling Scaling, int32 FFTSize)
+    {
+        switch (Scaling)
+        {
+        case Audio::EFFTScaling::MultipliedByFFTSize: return FFTSize;
+        case Audio::EFFTScaling::MultipliedBySqrtFFTSize: return FMath::Sqrt(double(FFTSize));
+        case Audio::EFFTScaling::DividedByFFTSize: return 1.0 / FFTSize;
+        case Audio::EFFTScaling::DividedBySqrtFFTSize: return 1.0 / FMath::Sqrt(double(FFTSize));
+        default: return 1.0;
+        }
+    }
+
+    // The FFT's interleaved (re, im) bins to and from the planar layout the multiply-accumulate reads.
+    void Deinterleave(const float* Complex, int32 NumBins, int32 HalfFloats, float Scale, float* Planar)
+    {
+        for (int32 Bin = 0; Bin < NumBins; ++Bin)
+        {
+            Planar[Bin] = Complex[Bin * 2] * Scale;
+            Planar[HalfFloats + Bin] = Complex[Bin * 2 + 1] * Scale;
+        }
+    }
+
+    void Interleave(const float* Planar, int32 NumBins, int32 HalfFloats, float* Complex)
+    {
+        for (int32 Bin = 0; Bin < NumBins; ++Bin)
+        {
+            Complex[Bin * 2] = Planar[Bin];
+            Complex[Bin * 2 + 1] = Planar[HalfFloats + Bin];
+        }
+    }
+
+    void AddSpectrum(const float* RESTRICT Src, float* RESTRICT Dst, int32 NumFloats)
+    {
+        for (int32 Index = 0; Index < NumFloats; Index += 4)
+        {
+            VectorStoreAligned(VectorAdd(VectorLoadAligned(Dst + Index), VectorLoadAligned(Src + Index)), Dst + Index);
+        }
+    }
+}
+
+class FPianoConvolutionTailWorker : public FRunnable
+{
+public:
+    explicit FPianoConvolutionTailWorker(FPianoConvolutionReverb& InReverb)
+        : Reverb(InReverb)
+    {
+    }
+
+    virtual uint32 Run() override
+    {
+        while (!bStopping.load(std::memory_order_relaxed))
+        {
+            // The timeout only bounds how long a missed wake-up can stall the tail.
+            Reverb.WorkEvent->Wait(10);
+            Reverb.ProcessPendingTails();
+        }
+        return 0;
+    }
+
+    virtual void Stop() override
+    {
+        bStopping = true;
+        Reverb.WorkEvent->Trigger();
+    }
+
+private:
+    FPianoConvolutionReverb& Reverb;
+    std::atomic<bool> bStopping { false };
+};
+
+FPianoConvolutionReverb::FPianoConvolutionReverb(const TArray<TArray<float>>& ImpulseResponse, const FPianoConvolutionSettings& InSettings)
+    : Settings(InSettings)
+    , WetGain(InSettings.WetGain)
+    , DryGain(InSettings.DryGain)
+    , LatestInputBlock(-1)
+    , NumLateTailBlocks(0)
+{
+    PartitionFrames = int32(FMath::RoundUpToPowerOfTwo(uint32(FMath::Clamp(Settings.PartitionFrames, 16, 8192))));
+    FFTSize = PartitionFrames * 2;
+    NumBins = PartitionFrames + 1;
+    SpectrumFloats = 2 * Align(NumBins, 4);
+
+    int32 ResponseFrames = 0;
+    for (const TArray<float>& Channel : ImpulseResponse)
+    {
+        ResponseFrames = FMath::Max(ResponseFrames, Channel.Num());
+    }
+    NumPartitions = FMath::Max(1, FMath::DivideAndRoundUp(ResponseFrames, PartitionFrames));
+    bUseWorker = Settings.bUseWorkerThread && NumPartitions > 1;
+    HeadPartitions = bUseWorker ? FMath::Clamp(Settings.HeadPartitions, 1, NumPartitions) : NumPartitions;
+    bUseWorker = bUseWorker && HeadPartitions < NumPartitions;
+
+    // The worker summing block B's tail reads inputs back to B - NumPartitions + 1 while the audio
+    // thread writes up to B, so one slot per partition keeps them apart. Tail slots cover the
+    // HeadPartitions blocks the worker works ahead, plus the one being played.
+    RingSize = NumPartitions;
+    TailSlots = HeadPartitions + 1;
+
+    Audio::FFFTSettings FFTSettings;
+    FFTSettings.Log2Size = FMath::FloorLog2(FFTSize);
+    FFTSettings.bArrays128BitAligned = true;
+    FFTSettings.bEnableHardwareAcceleration = true;
+    FFT = Audio::FFFTFactory::NewFFTAlgorithm(FFTSettings);
+    if (!FFT.IsValid())
+    {
+        UE_LOG(LogVrPiano554, Error, TEXT("Convolution reverb: no FFT available for %d points; reverb disabled."), FFTSize);
+        return;
+    }
+
+    Accumulator.SetNumZeroed(SpectrumFloats);
+    ComplexScratch.SetNumZeroed(FMath::Max(FFT->NumOutputFloats(), FFTSize + 2));
+    TimeScratch.SetNumZeroed(FFTSize);
+
+    // Forward and inverse scaling are folded into the response spectra, so an overlap-save block
+    // comes out of the inverse transform at unit gain.
+    const double Forward = GetScalingFactor(FFT->ForwardScaling(), FFTSize);
+    const double Inverse = GetScalingFactor(FFT->InverseScaling(), FFTSize);
+    const float SpectrumScale = float(1.0 / (Forward * Forward * Inverse));
+    const int32 HalfFloats = SpectrumFloats / 2;
+
+    for (int32 Channel = 0; Channel < NumChannels; ++Channel)
+    {
+        PartitionSpectra[Channel].SetNumZeroed(NumPartitions * SpectrumFloats);
+        InputSpectra[Channel].SetNumZeroed(RingSize * SpectrumFloats);
+        TailSpectra[Channel].SetNumZeroed(TailSlots * SpectrumFloats);
+        TimeInput[Channel].SetNumZeroed(FFTSize);
+        InputFifo[Channel].SetNumZeroed(PartitionFrames);
+        OutputFifo[Channel].SetNumZeroed(PartitionFrames);
+
+        if (ImpulseResponse.IsEmpty())
+        {
+            continue;
+        }
+        const TArray<float>& Response = ImpulseResponse[FMath::Min(Channel, ImpulseResponse.Num() - 1)];
+        for (int32 Partition = 0; Partition < NumPartitions; ++Partition)
+        {
+            // Each partition is zero-padded to the FFT size, so its product with the input window is a linear convolution.
+            FMemory::Memzero(TimeScratch.GetData(), FFTSize * sizeof(float));
+            const int32 First = Partition * PartitionFrames;
+            const int32 Count = FMath::Clamp(Response.Num() - First, 0, PartitionFrames);
+            FMemory::Memcpy(TimeScratch.GetData(), Response.GetData() + First, Count * sizeof(float));
+            FFT->ForwardRealToComplex(TimeScratch.GetData(), ComplexScratch.GetData());
+            Deinterleave(ComplexScratch.GetData(), NumBins, HalfFloats, SpectrumScale, PartitionSpectra[Channel].GetData() + Partition * SpectrumFloats);
+        }
+    }
+
+    TailReadyBlock = MakeUnique<std::atomic<int64>[]>(TailSlots);
+    for (int32 Slot = 0; Slot < TailSlots; ++Slot)
+    {
+        TailReadyBlock[Slot].store(-1, std::memory_order_relaxed);
+    }
+
+    if (bUseWorker)
+    {
+        WorkEvent = FPlatformProcess::GetSynchEventFromPool(false);
+        Worker = MakeUnique<FPianoConvolutionTailWorker>(*this);
+        WorkerThread.Reset(FRunnableThread::Create(Worker.Get(), TEXT("PianoConvolutionTail"), 0, TPri_AboveNormal));
+    }
+
+    UE_LOG(LogVrPiano554, Log, TEXT("Convolution reverb: %d frames in %d partitions of %d, %d on the audio thread."),
+        ResponseFrames, NumPartitions, PartitionFrames, HeadPartitions);
+}
+
+FPianoConvolutionReverb::~FPianoConvolutionReverb()
+{
+    if (WorkerThread.IsValid())
+    {
+        WorkerThread->Kill(/*bShouldWait=*/true);
+        WorkerThread.Reset();
+    }
+    Worker.Reset();
+    if (WorkEvent)
+    {
+        FPlatformProcess::ReturnSynchEventToPool(WorkEvent);
+        WorkEvent = nullptr;
+    }
+}
+
+bool FPianoConvolutionReverb::LoadImpulseResponse(const FString& Path, int32 SampleRate, float MaxSeconds, TArray<TArray<float>>& OutChannels)
+{
+    OutChannels.Reset();
+    TArray<uint8> FileBytes;
+    FPianoWaveFormat Format;
+    if (!FFileHelper::LoadFileToArray(FileBytes, *Path) || !PianoWaveFile::ParseHeader(FileBytes, Format) || Format.NumFrames == 0)
+    {
+        UE_LOG(LogVrPiano554, Warning, TEXT("Convolution reverb: could not read impulse response %s"), *Path);
+        return false;
+    }
+
+    const int32 NumChannels = FMath::Min(Format.NumChannels, 2);
+    const int64 SourceFrames = MaxSeconds > 0.0f ? FMath::Clamp<int64>(int64(double(MaxSeconds) * Format.SampleRate), 1, Format.NumFrames) : Format.NumFrames;
+    const double Step = double(Format.SampleRate) / FMath::Max(1, SampleRate);
+
+    // Decoded with zero padding around it for the resampler's taps.
+    constexpr int32 Padding = FPianoResampleKernel::NumTaps;
+    TArray<float> Source[2];
+    for (int32 Channel = 0; Channel < NumChannels; ++Channel)
+    {
+        Source[Channel].SetNumZeroed(int32(SourceFrames) + 2 * Padding);
+        PianoWaveFile::DecodeChannel(FileBytes, Format, Channel, 0, SourceFrames, Source[Channel].GetData() + Padding);
+    }
+
+    OutChannels.SetNum(NumChannels);
+    if (FMath::IsNearlyEqual(Step, 1.0))
+    {
+        for (int32 Channel = 0; Channel < NumChannels; ++Channel)
+        {
+            OutChannels[Channel] = TArray<float>(Source[Channel].GetData() + Padding, int32(SourceFrames));
+        }
+    }
+    else
+    {
+        const FPianoResampleKernel Kernel(FPianoResampleKernel::CutoffForStep(Step));
+        const int32 OutputFrames = int32(double(SourceFrames - 1) / Step) + 1;
+        TArray<float> Discard;
+        Discard.SetNumZeroed(NumChannels == 1 ? OutputFrames : 0);
+        for (int32 Channel = 0; Channel < NumChannels; ++Channel)
+        {
+            OutChannels[Channel].SetNumZeroed(OutputFrames);
+        }
+        const float* Right = Source[NumChannels - 1].GetData() + Padding;
+        float* DstRight = NumChannels == 1 ? Discard.GetData() : OutChannels[1].GetData();
+        Kernel.Mix(Source[0].GetData() + Padding, Right, 0.0, Step, OutputFrames, 1.0f, 0.0f, OutChannels[0].GetData(), DstRight);
+    }
+
+    double MaxEnergy = 0.0;
+    for (const TArray<float>& Channel : OutChannels)
+    {
+        double Energy = 0.0;
+        for (float Sample : Channel)
+        {
+            Energy += double(Sample) * Sample;
+        }
+        MaxEnergy = FMath::Max(MaxEnergy, Energy);
+    }
+    if (MaxEnergy <= 0.0)
+    {
+        UE_LOG(LogVrPiano554, Warning, TEXT("Convolution reverb: impulse response %s is silent"), *Path);
+        OutChannels.Reset();
+        return false;
+    }
+    const float Scale = float(1.0 / FMath::Sqrt(MaxEnergy));
+    for (TArray<float>& Channel : OutChannels)
+    {
+        for (float& Sample : Channel)
+        {
+            Sample *= Scale;
+        }
+    }
+    return true;
+}
+
+void FPianoConvolutionReverb::SetGains(float InWetGain, float InDryGain)
+{
+    WetGain.store(InWetGain, std::memory_order_relaxed);
+    DryGain.store(InDryGain, std::memory_order_relaxed);
+}
+
+void FPianoConvolutionReverb::Process(float* InOutInterleaved, int32 NumFrames)
+{
+    SCOPE_CYCLE_COUNTER(STAT_PianoConvolution);
+    const float Wet = WetGain.load(std::memory_order_relaxed);
+    const float Dry = DryGain.load(std::memory_order_relaxed);
+    if (!FFT.IsValid())
+    {
+        for (int32 Index = 0; Index < NumFrames * NumChannels; ++Index)
+        {
+            InOutInterleaved[Index] *= Dry;
+        }
+        return;
+    }
+
+    // The wet output of a partition is ready once the whole partition is in, so it plays one partition late.
+    for (int32 Done = 0; Done < NumFrames;)
+    {
+        const int32 Count = FMath::Min(PartitionFrames - FifoPosition, NumFrames - Done);
+        float* Frames = InOutInterleaved + Done * NumChannels;
+        for (int32 Channel = 0; Channel < NumChannels; ++Channel)
+        {
+            float* In = InputFifo[Channel].GetData() + FifoPosition;
+            const float* Out = OutputFifo[Channel].GetData() + FifoPosition;
+            for (int32 Frame = 0; Frame < Count; ++Frame)
+            {
+                float& Sample = Frames[Frame * NumChannels + Channel];
+                In[Frame] = Sample;
+                Sample = Sample * Dry + Out[Frame] * Wet;
+            }
+        }
+
+        Done += Count;
+        FifoPosition += Count;
+        if (FifoPosition == PartitionFrames)
+        {
+            ProcessPartition();
+            FifoPosition = 0;
+        }
+    }
+}
+
+void FPianoConvolutionReverb::ProcessPartition()
+{
+    const int64 Block = NextBlock++;
+    const int32 HalfFloats = SpectrumFloats / 2;
+
+    // Overlap-save: transform the last two partitions of input and keep the second half of the result.
+    for (int32 Channel = 0; Channel < NumChannels; ++Channel)
+    {
+        float* Window = TimeInput[Channel].GetData();
+        FMemory::Memcpy(Window, Window + PartitionFrames, PartitionFrames * sizeof(float));
+        FMemory::Memcpy(Window + PartitionFrames, InputFifo[Channel].GetData(), PartitionFrames * sizeof(float));
+        FFT->ForwardRealToComplex(Window, ComplexScratch.GetData());
+        Deinterleave(ComplexScratch.GetData(), NumBins, HalfFloats, 1.0f, GetInputSpectrum(Channel, Block));
+    }
+
+    // Triggering the worker is the audio thread's only call into the OS here.
+    LatestInputBlock.store(Block, std::memory_order_release);
+    if (bUseWorker)
+    {
+        WorkEvent->Trigger();
+    }
+
+    // Inputs before the first block are silence, so early blocks have no tail to wait for.
+    const bool bNeedsTail = bUseWorker && Block >= HeadPartitions;
+    const bool bTailReady = bNeedsTail && TailReadyBlock[Block % TailSlots].load(std::memory_order_acquire) == Block;
+    if (bNeedsTail && !bTailReady)
+    {
+        NumLateTailBlocks.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    for (int32 Channel = 0; Channel < NumChannels; ++Channel)
+    {
+        float* Acc = Accumulator.GetData();
+        FMemory::Memzero(Acc, SpectrumFloats * sizeof(float));
+        AccumulatePartitions(Channel, Block, 0, HeadPartitions, Acc);
+        if (bTailReady)
+        {
+            AddSpectrum(GetTailSpectrum(Channel, Block), Acc, SpectrumFloats);
+        }
+        else if (bNeedsTail)
+        {
+            // The worker fell behind; its late result for this block is never read.
+            AccumulatePartitions(Channel, Block, HeadPartitions, NumPartitions, Acc);
+        }
+
+        Interleave(Acc, NumBins, HalfFloats, ComplexScratch.GetData());
+        FFT->InverseComplexToReal(ComplexScratch.GetData(), TimeScratch.GetData());
+        FMemory::Memcpy(OutputFifo[Channel].GetData(), TimeScratch.GetData() + PartitionFrames, PartitionFrames * sizeof(float));
+    }
+}
+
+void FPianoConvolutionReverb::ProcessPendingTails()
+{
+    SCOPE_CYCLE_COUNTER(STAT_PianoConvolutionTail);
+    const int64 Latest = LatestInputBlock.load(std::memory_order_acquire);
+    for (int64 Block = LastTailBlock + 1; Block <= Latest; ++Block)
+    {
+        // The tail of block Block + HeadPartitions only needs inputs up to Block, so it can be summed
+        // HeadPartitions blocks before it plays. Once the audio thread reaches it, it is too late.
+        const int64 Target = Block + HeadPartitions;
+        if (Target <= LatestInputBlock.load(std::memory_order_relaxed))
+        {
+            continue;
+        }
+        for (int32 Channel = 0; Channel < NumChannels; ++Channel)
+        {
+            float* Tail = GetTailSpectrum(Channel, Target);
+            FMemory::Memzero(Tail, SpectrumFloats * sizeof(float));
+            AccumulatePartitions(Channel, Target, HeadPartitions, NumPartitions, Tail);
+        }
+        TailReadyBlock[Target % TailSlots].store(Target, std::memory_order_release);
+    }
+    LastTailBlock = FMath::Max(LastTailBlock, Latest);
+}
+
+void FPianoConvolutionReverb::AccumulatePartitions(int32 Channel, int64 Block, int32 FirstPartition, int32 EndPartition, float* Acc)
+{
+    const int32 HalfFloats = SpectrumFloats / 2;
+    float* AccRe = Acc;
+    float* AccIm = Acc + HalfFloats;
+
+    // Blocks before the first are silence.
+    EndPartition = int32(FMath::Min<int64>(EndPartition, Block + 1));
+    for (int32 Partition = FirstPartition; Partition < EndPartition; ++Partition)
+    {
+        const float* XRe = GetInputSpectrum(Channel, Block - Partition);
+        const float* XIm = XRe + HalfFloats;
+        const float* HRe = GetPartitionSpectrum(Channel, Partition);
+        const float* HIm = HRe + HalfFloats;
+
+        // (a + bi)(c + di) = (ac - bd) + (ad + bc)i, four bins per vector.
+        for (int32 Bin = 0; Bin < HalfFloats; Bin += 4)
+        {
+            const VectorRegister4Float A = VectorLoadAligned(XRe + Bin);
+            const VectorRegister4Float B = VectorLoadAligned(XIm + Bin);
+            const VectorRegister4Float C = VectorLoadAligned(HRe + Bin);
+            const VectorRegister4Float D = VectorLoadAligned(HIm + Bin);
+            VectorRegister4Float Re = VectorMultiplyAdd(A, C, VectorLoadAligned(AccRe + Bin));
+            VectorRegister4Float Im = VectorMultiplyAdd(A, D, VectorLoadAligned(AccIm + Bin));
+            Re = VectorNegateMultiplyAdd(B, D, Re);
+            Im = VectorMultiplyAdd(B, C, Im);
+            VectorStoreAligned(Re, AccRe + Bin);
+            VectorStoreAligned(Im, AccIm + Bin);
+        }
+    }
+}
@@ -0,0 +1,440 @@
+// PianoLatencyTrace.cpp
+//
+// Console:
+//   stat VrPianoLatency         per-stage mean latency and the total's percentiles, live
+//   piano.LatencyReport         logs events, mean, p50, p95 and max per stage
+//   piano.LatencyExport [File=] writes Saved/Profiling/PianoLatency.csv and PianoLatency_Histogram.csv
+//   piano.LatencyReset          starts the histograms over
+//   piano.LatencyTrace 0|1      stops or resumes recording
+
+#include "PianoLatencyTrace.h"
+#include "VrPiano554.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/CoreDelegates.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Misc/ScopeLock.h"
+#include "ProfilingDebugging/CountersTrace.h"
+#include "ProfilingDebugging/MiscTrace.h"
+#include "RenderingThread.h"
+#include <atomic>
+
+DECLARE_STATS_GROUP(TEXT("VrPianoLatency"), STATGROUP_VrPianoLatency, STATCAT_Advanced);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Events"), STAT_PianoLatencyEvents, STATGROUP_VrPianoLatency);
+DECLARE_FLOAT_ACCUMULATOR_STAT(TEXT("Bridge Send (mean ms)"), STAT_PianoLatencyBridgeSend, STATGROUP_VrPianoLatency);
+DECLARE_FLOAT_ACCUMULATOR_STAT(TEXT("Socket Receive (mean ms)"), STAT_PianoLatencySocketReceive, STATGROUP_VrPianoLatency);
+DECLARE_FLOAT_ACCUMULATOR_STAT(TEXT("Decode (mean ms)"), STAT_PianoLatencyDecode, STATGROUP_VrPianoLatency);
+DECLARE_FLOAT_ACCUMULATOR_STAT(TEXT("Press Key (mean ms)"), STAT_PianoLatencyPressKey, STATGROUP_VrPianoLatency);
+DECLARE_FLOAT_ACCUMULATOR_STAT(TEXT("Animation Start (mean ms)"), STAT_PianoLatencyAnimationStart, STATGROUP_VrPianoLatency);
+DECLARE_FLOAT_ACCUMULATOR_STAT(TEXT("Frame Rendered (mean ms)"), STAT_PianoLatencyFrameRendered, STATGROUP_VrPianoLatency);
+DECLARE_FLOAT_ACCUMULATOR_STAT(TEXT("Total p50 (ms)"), STAT_PianoLatencyTotalP50, STATGROUP_VrPianoLatency);
+DECLARE_FLOAT_ACCUMULATOR_STAT(TEXT("Total p95 (ms)"), STAT_PianoLatencyTotalP95, STATGROUP_VrPianoLatency);
+
+TRACE_DECLARE_FLOAT_COUNTER(PianoLatencyTotal, TEXT("Piano/Latency/Total (ms)"));
+TRACE_DECLARE_FLOAT_COUNTER(PianoLatencyDecode, TEXT("Piano/Latency/Decode (ms)"));
+TRACE_DECLARE_FLOAT_COUNTER(PianoLatencyFrame, TEXT("Piano/Latency/AnimationStart to FrameRendered (ms)"));
+
+namespace
+{
+    constexpr int32 NumStages = int32(EPianoLatencyStage::Num);
+    const TCHAR* const StageNames[NumStages] = {
+        TEXT("Capture"), TEXT("BridgeSend"), TEXT("SocketReceive"), TEXT("Decode"), TEXT("PressKey"), TEXT("AnimationStart"), TEXT("FrameRendered") };
+
+    // Upper bucket edges in milliseconds; the last bucket is open.
+    constexpr double BucketEdgesMs[] = { 0.1, 0.25, 0.5, 1, 2, 3, 4, 5, 6, 8, 10, 12, 14, 16, 20, 25, 33, 50, 66, 100, 150, 250, 500, 1000 };
+    constexpr int32 NumBuckets = UE_ARRAY_COUNT(BucketEdgesMs) + 1;
+
+    // Events in flight are few, one per key press for a few frames, so a small ring indexed by id will do.
+    constexpr int32 InFlightSlots = 256;
+    constexpr int32 MaxCompletedEvents = 4096;
+
+    // The bridge numbers events from 1; the engine's own start here.
+    constexpr uint32 FirstEngineEventId = 0x80000000u;
+
+    struct FHistogram
+    {
+        uint32 Buckets[NumBuckets] = {};
+        uint64 Count = 0;
+        double SumMs = 0.0;
+        double MaxMs = 0.0;
+
+        void Add(double Ms)
+        {
+            Ms = FMath::Max(Ms, 0.0);
+            int32 Bucket = 0;
+            while (Bucket < NumBuckets - 1 && Ms > BucketEdgesMs[Bucket])
+            {
+                ++Bucket;
+            }
+            ++Buckets[Bucket];
+            ++Count;
+            SumMs += Ms;
+            MaxMs = FMath::Max(MaxMs, Ms);
+        }
+
+        double GetMeanMs() const { return Count > 0 ? SumMs / Count : 0.0; }
+
+        // Interpolated within the bucket the percentile falls in.
+        double GetPercentileMs(double Percentile) const
+        {
+            if (Count == 0)
+            {
+                return 0.0;
+            }
+            const double Target = Percentile * Count;
+            double Below = 0.0;
+            for (int32 Bucket = 0; Bucket < NumBuckets; ++Bucket)
+            {
+                if (Buckets[Bucket] > 0 && Below + Buckets[Bucket] >= Target)
+                {
+                    if (Bucket == NumBuckets - 1)
+                    {
+                        return MaxMs;
+                    }
+                    const double Low = Bucket > 0 ? BucketEdgesMs[Bucket - 1] : 0.0;
+                    const double High = FMath::Min(BucketEdgesMs[Bucket], MaxMs);
+                    return Low + (High - Low) * (Target - Below) / Buckets[Bucket];
+                }
+                Below += Buckets[Bucket];
+            }
+            return MaxMs;
+        }
+    };
+
+    // Stage times in seconds; 0 where the event did not pass through that stage.
+    struct FTracedEvent
+    {
+        uint32 Id = 0;
+        double Times[NumStages] = {};
+    };
+
+    struct FLatencyState
+    {
+        FCriticalSection Lock;
+        FTracedEvent InFlight[InFlightSlots];
+        FHistogram StageHistograms[NumStages];
+        FHistogram Total;
+        TArray<FTracedEvent> Completed;
+        int32 NextCompleted = 0;
+        uint64 NumDropped = 0;
+    };
+
+    FLatencyState& GetState()
+    {
+        static FLatencyState State;
+        return State;
+    }
+
+    bool bTraceEnabled = true;
+    FAutoConsoleVariableRef CVarPianoLatencyTrace(
+        TEXT("piano.LatencyTrace"),
+        bTraceEnabled,
+        TEXT("Record live note-ons through the input pipeline for the latency histograms and Insights."));
+
+    std::atomic<uint32> NextEngineEventId { FirstEngineEventId };
+    uint32 CurrentEventId = 0;
+    double UnixMinusPlatformSeconds = 0.0;
+    bool bClockCalibrated = false;
+    FDelegateHandle EndFrameHandle;
+
+    // Render thread: events whose pose is in the frame being rendered.
+    TArray<uint32> RenderThreadEventIds;
+
+    void UpdateStats(const FLatencyState& State)
+    {
+        const FHistogram* Stages = State.StageHistograms;
+        SET_DWORD_STAT(STAT_PianoLatencyEvents, uint32(State.Total.Count));
+        SET_FLOAT_STAT(STAT_PianoLatencyBridgeSend, Stages[int32(EPianoLatencyStage::BridgeSend)].GetMeanMs());
+        SET_FLOAT_STAT(STAT_PianoLatencySocketReceive, Stages[int32(EPianoLatencyStage::SocketReceive)].GetMeanMs());
+        SET_FLOAT_STAT(STAT_PianoLatencyDecode, Stages[int32(EPianoLatencyStage::Decode)].GetMeanMs());
+        SET_FLOAT_STAT(STAT_PianoLatencyPressKey, Stages[int32(EPianoLatencyStage::PressKey)].GetMeanMs());
+        SET_FLOAT_STAT(STAT_PianoLatencyAnimationStart, Stages[int32(EPianoLatencyStage::AnimationStart)].GetMeanMs());
+        SET_FLOAT_STAT(STAT_PianoLatencyFrameRendered, Stages[int32(EPianoLatencyStage::FrameRendered)].GetMeanMs());
+        SET_FLOAT_STAT(STAT_PianoLatencyTotalP50, State.Total.GetPercentileMs(0.5));
+        SET_FLOAT_STAT(STAT_PianoLatencyTotalP95, State.Total.GetPercentileMs(0.95));
+    }
+
+    // Called with the lock held once the last stage is in.
+    void CompleteEvent(FLatencyState& State, const FTracedEvent& Event)
+    {
+        double FirstTime = 0.0;
+        double PreviousTime = 0.0;
+        for (int32 Stage = 0; Stage < NumStages; ++Stage)
+        {
+            const double Time = Event.Times[Stage];
+            if (Time <= 0.0)
+            {
+                continue;
+            }
+            if (PreviousTime > 0.0)
+            {
+                State.StageHistograms[Stage].Add((Time - PreviousTime) * 1000.0);
+            }
+            else
+            {
+                FirstTime = Time;
+            }
+            PreviousTime = Time;
+        }
+        const double TotalMs = (PreviousTime - FirstTime) * 1000.0;
+        State.Total.Add(TotalMs);
+
+        if (State.Completed.Num() < MaxCompletedEvents)
+        {
+            State.Completed.Add(Event);
+        }
+        else
+        {
+            State.Completed[State.NextCompleted] = Event;
+            State.NextCompleted = (State.NextCompleted + 1) % MaxCompletedEvents;
+        }
+
+        const double* Times = Event.Times;
+        TRACE_COUNTER_SET(PianoLatencyTotal, TotalMs);
+        if (Times[int32(EPianoLatencyStage::PressKey)] > 0.0 && Times[int32(EPianoLatencyStage::Decode)] > 0.0)
+        {
+            TRACE_COUNTER_SET(PianoLatencyDecode, (Times[int32(EPianoLatencyStage::PressKey)] - Times[int32(EPianoLatencyStage::Decode)]) * 1000.0);
+        }
+        TRACE_COUNTER_SET(PianoLatencyFrame, (Times[int32(EPianoLatencyStage::FrameRendered)] - Times[int32(EPianoLatencyStage::AnimationStart)]) * 1000.0);
+        UpdateStats(State);
+    }
+
+    void OnEndFrameRenderThread()
+    {
+        const double Now = FPlatformTime::Seconds();
+        for (uint32 EventId : RenderThreadEventIds)
+        {
+            PianoLatencyTrace::Record(EventId, EPianoLatencyStage::FrameRendered, Now);
+        }
+        RenderThreadEventIds.Reset();
+    }
+
+    void CalibrateClock()
+    {
+        // The wall clock may only tick in milliseconds; pair it with the platform clock at a tick.
+        const FDateTime Start = FDateTime::UtcNow();
+        FDateTime Now = Start;
+        const double GiveUp = FPlatformTime::Seconds() + 0.05;
+        while (Now == Start && FPlatformTime::Seconds() < GiveUp)
+        {
+            Now = FDateTime::UtcNow();
+        }
+        UnixMinusPlatformSeconds = (Now - FDateTime(1970, 1, 1)).GetTotalSeconds() - FPlatformTime::Seconds();
+        bClockCalibrated = true;
+    }
+}
+
+void PianoLatencyTrace::Startup()
+{
+    CalibrateClock();
+    EndFrameHandle = FCoreDelegates::OnEndFrameRT.AddStatic(&OnEndFrameRenderThread);
+}
+
+void PianoLatencyTrace::Shutdown()
+{
+    FCoreDelegates::OnEndFrameRT.Remove(EndFrameHandle);
+}
+
+bool PianoLatencyTrace::IsEnabled()
+{
+    return bTraceEnabled;
+}
+
+uint32 PianoLatencyTrace::NewEventId()
+{
+    return NextEngineEventId.fetch_add(1, std::memory_order_relaxed) | FirstEngineEventId;
+}
+
+void PianoLatencyTrace::Record(uint32 EventId, EPianoLatencyStage Stage, double Seconds)
+{
+    if (EventId == 0 || !bTraceEnabled)
+    {
+        return;
+    }
+
+    FLatencyState& State = GetState();
+    FScopeLock ScopeLock(&State.Lock);
+    FTracedEvent& Slot = State.InFlight[EventId % InFlightSlots];
+    if (Slot.Id != EventId)
+    {
+        // An event that never reached the screen, e.g. a key that is not on this keyboard.
+        State.NumDropped += Slot.Id != 0 ? 1 : 0;
+        Slot = FTracedEvent();
+        Slot.Id = EventId;
+    }
+    Slot.Times[int32(Stage)] = Seconds;
+
+    const double Since = Slot.Times[0] > 0.0 ? (Seconds - Slot.Times[0]) * 1000.0 : 0.0;
+    TRACE_BOOKMARK(TEXT("Piano %u %s +%.2f ms"), EventId, StageNames[int32(Stage)], Since);
+
+    if (Stage == EPianoLatencyStage::FrameRendered)
+    {
+        CompleteEvent(State, Slot);
+        Slot = FTracedEvent();
+    }
+}
+
+void PianoLatencyTrace::RecordFrameRendered(uint32 EventId)
+{
+    if (EventId == 0 || !bTraceEnabled)
+    {
+        return;
+    }
+    ENQUEUE_RENDER_COMMAND(PianoLatencyFrame)([EventId](FRHICommandListImmediate&)
+    {
+        RenderThreadEventIds.Add(EventId);
+    });
+}
+
+double PianoLatencyTrace::UnixToPlatformSeconds(double UnixSeconds)
+{
+    if (!bClockCalibrated)
+    {
+        CalibrateClock();
+    }
+    return UnixSeconds - UnixMinusPlatformSeconds;
+}
+
+uint32 PianoLatencyTrace::GetCurrentEventId()
+{
+    return CurrentEventId;
+}
+
+PianoLatencyTrace::FEventScope::FEventScope(uint32 EventId)
+    : PreviousEventId(CurrentEventId)
+{
+    check(IsInGameThread());
+    CurrentEventId = EventId;
+}
+
+PianoLatencyTrace::FEventScope::~FEventScope()
+{
+    CurrentEventId = PreviousEventId;
+}
+
+void PianoLatencyTrace::Reset()
+{
+    FLatencyState& State = GetState();
+    FScopeLock ScopeLock(&State.Lock);
+    for (FHistogram& Histogram : State.StageHistograms)
+    {
+        Histogram = FHistogram();
+    }
+    State.Total = FHistogram();
+    State.Completed.Reset();
+    State.NextCompleted = 0;
+    State.NumDropped = 0;
+    UpdateStats(State);
+}
+
+FString PianoLatencyTrace::FormatReport()
+{
+    FLatencyState& State = GetState();
+    FScopeLock ScopeLock(&State.Lock);
+
+    FString Report = FString::Printf(TEXT("%-16s %8s %9s %9s %9s %9s\n"), TEXT("Stage"), TEXT("Events"), TEXT("Mean"), TEXT("p50"), TEXT("p95"), TEXT("Max"));
+    auto AddLine = [&Report](const TCHAR* Name, const FHistogram& Histogram)
+    {
+        Report += FString::Printf(TEXT("%-16s %8llu %9.2f %9.2f %9.2f %9.2f\n"), Name, Histogram.Count, Histogram.GetMeanMs(),
+            Histogram.GetPercentileMs(0.5), Histogram.GetPercentileMs(0.95), Histogram.MaxMs);
+    };
+    for (int32 Stage = 1; Stage < NumStages; ++Stage)
+    {
+        AddLine(StageNames[Stage], State.StageHistograms[Stage]);
+    }
+    AddLine(TEXT("Total"), State.Total);
+    Report += FString::Printf(TEXT("Milliseconds since the previous stage; %llu events dropped before rendering."), State.NumDropped);
+    return Report;
+}
+
+bool PianoLatencyTrace::ExportCsv(const FString& Path)
+{
+    FLatencyState& State = GetState();
+    FScopeLock ScopeLock(&State.Lock);
+
+    // Events oldest first, each stage in milliseconds after the event's first stage; empty if skipped.
+    FString Events = TEXT("Id");
+    for (int32 Stage = 0; Stage < NumStages; ++Stage)
+    {
+        Events += FString::Printf(TEXT(",%s"), StageNames[Stage]);
+    }
+    Events += TEXT("\n");
+    for (int32 Index = 0; Index < State.Completed.Num(); ++Index)
+    {
+        const FTracedEvent& Event = State.Completed[(State.NextCompleted + Index) % State.Completed.Num()];
+        double FirstTime = 0.0;
+        Events += FString::Printf(TEXT("%u"), Event.Id);
+        for (int32 Stage = 0; Stage < NumStages; ++Stage)
+        {
+            const double Time = Event.Times[Stage];
+            FirstTime = FirstTime > 0.0 ? FirstTime : Time;
+            Events += Time > 0.0 ? FString::Printf(TEXT(",%.3f"), (Time - FirstTime) * 1000.0) : FString(TEXT(","));
+        }
+        Events += TEXT("\n");
+    }
+
+    FString Histograms = TEXT("UpperMs");
+    for (int32 Stage = 1; Stage < NumStages; ++Stage)
+    {
+        Histograms += FString::Printf(TEXT(",%s"), StageNames[Stage]);
+    }
+    Histograms += TEXT(",Total\n");
+    for (int32 Bucket = 0; Bucket < NumBuckets; ++Bucket)
+    {
+        Histograms += Bucket < NumBuckets - 1 ? FString::Printf(TEXT("%g"), BucketEdgesMs[Bucket]) : FString(TEXT("inf"));
+        for (int32 Stage = 1; Stage < NumStages; ++Stage)
+        {
+            Histograms += FString::Printf(TEXT(",%u"), State.StageHistograms[Stage].Buckets[Bucket]);
+        }
+        Histograms += FString::Printf(TEXT(",%u\n"), State.Total.Buckets[Bucket]);
+    }
+
+    const FString HistogramPath = FPaths::Combine(FPaths::GetPath(Path), FPaths::GetBaseFilename(Path) + TEXT("_Histogram.csv"));
+    return FFileHelper::SaveStringToFile(Events, *Path) && FFileHelper::SaveStringToFile(Histograms, *HistogramPath);
+}
+
+#if !UE_BUILD_SHIPPING
+namespace
+{
+    void RunLatencyReport(const TArray<FString>& Args)
+    {
+        TArray<FString> Lines;
+        PianoLatencyTrace::FormatReport().ParseIntoArrayLines(Lines);
+        for (const FString& Line : Lines)
+        {
+            UE_LOG(LogVrPiano554, Display, TEXT("%s"), *Line);
+        }
+    }
+
+    void RunLatencyExport(const TArray<FString>& Args)
+    {
+        const FString CommandLine = FString::Join(Args, TEXT(" "));
+        FString Path = FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("Profiling"), TEXT("PianoLatency.csv"));
+        FParse::Value(*CommandLine, TEXT("File="), Path);
+        if (PianoLatencyTrace::ExportCsv(Path))
+        {
+            UE_LOG(LogVrPiano554, Display, TEXT("Latency trace written to %s"), *FPaths::ConvertRelativePathToFull(Path));
+        }
+        else
+        {
+            UE_LOG(LogVrPiano554, Error, TEXT("Could not write %s"), *Path);
+        }
+    }
+
+    FAutoConsoleCommandWithArgs PianoLatencyReportCommand(
+        TEXT("piano.LatencyReport"),
+        TEXT("Logs per-stage input latency of live note-ons: events, mean, p50, p95 and max in ms."),
+        FConsoleCommandWithArgsDelegate::CreateStatic(&RunLatencyReport));
+
+    FAutoConsoleCommandWithArgs PianoLatencyExportCommand(
+        TEXT("piano.LatencyExport"),
+        TEXT("Writes recent traced note-ons and the latency histograms as CSV. Args: [File=Saved/Profiling/PianoLatency.csv]"),
+        FConsoleCommandWithArgsDelegate::CreateStatic(&RunLatencyExport));
+
+    FAutoConsoleCommand PianoLatencyResetCommand(
+        TEXT("piano.LatencyReset"),
+        TEXT("Clears the input latency histograms."),
+        FConsoleCommandDelegate::CreateStatic(&PianoLatencyTrace::Reset));
+}
+#endif
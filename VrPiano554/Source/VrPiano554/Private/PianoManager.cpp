@@ -11,7 +11,8 @@
 
 APianoManager::APianoManager()
 {
-    PrimaryActorTick.bCanEverTick = true;
+    // All of the manager's work is driven by input events, so it never needs to tick.
+    PrimaryActorTick.bCanEverTick = false;
 	RootComponent = CreateDefaultSubobject<USceneComponent>(TEXT("RootComponent"));
 }
 
@@ -22,11 +23,6 @@ void APianoManager::BeginPlay()
 	LoadPianoTransform();
 }
 
-void APianoManager::Tick(float DeltaTime)
-{
-    Super::Tick(DeltaTime);
-}
-
 void APianoManager::SetupInput()
 {
     APlayerController* PlayerController = UGameplayStatics::GetPlayerController(this, 0);
@@ -0,0 +1,281 @@
+#include "PianoMidiFile.h"
+#include "Algo/StableSort.h"
+#include "Misc/FileHelper.h"
+
+namespace
+{
+    uint32 ReadUInt32BE(const uint8* Bytes) { return (uint32(Bytes[0]) << 24) | (uint32(Bytes[1]) << 16) | (uint32(Bytes[2]) << 8) | uint32(Bytes[3]); }
+    uint16 ReadUInt16BE(const uint8* Bytes) { return uint16((Bytes[0] << 8) | Bytes[1]); }
+
+    constexpr uint8 MetaEvent = 0xFF;
+    constexpr uint8 MetaSetTempo = 0x51;
+    constexpr uint8 SysExStart = 0xF0;
+    constexpr uint8 SysExContinue = 0xF7;
+    constexpr uint8 ControlSustain = 64;
+    constexpr uint8 ControlSostenuto = 66;
+
+    // 120 bpm, the default until the first tempo event.
+    constexpr uint32 DefaultMicrosecondsPerQuarter = 500000;
+
+    struct FTrackReader
+    {
+        const uint8* Cursor;
+        const uint8* End;
+
+        bool AtEnd() const { return Cursor >= End; }
+
+        bool ReadByte(uint8& OutByte)
+        {
+            if (Cursor >= End)
+            {
+                return false;
+            }
+            OutByte = *Cursor++;
+            return true;
+        }
+
+        // Variable-length quantity: seven bits per byte, most significant first, at most four bytes.
+        bool ReadVariableLength(uint32& OutValue)
+        {
+            OutValue = 0;
+            for (int32 Index = 0; Index < 4; ++Index)
+            {
+                uint8 Byte;
+                if (!ReadByte(Byte))
+                {
+                    return false;
+                }
+                OutValue = (OutValue << 7) | (Byte & 0x7F);
+                if ((Byte & 0x80) == 0)
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        bool Skip(uint32 Count)
+        {
+            if (Count > uint32(End - Cursor))
+            {
+                return false;
+            }
+            Cursor += Count;
+            return true;
+        }
+    };
+
+    struct FTickEvent
+    {
+        uint64 Tick;
+        FPianoMidiEvent Event;
+    };
+
+    struct FTempoChange
+    {
+        uint64 Tick;
+        uint32 MicrosecondsPerQuarter;
+    };
+
+    bool Fail(FString* OutError, const FString& Message)
+    {
+        if (OutError)
+        {
+            *OutError = Message;
+        }
+        return false;
+    }
+}
+
+int32 PianoMidiFile::GetChannelMessageDataLength(uint8 Status)
+{
+    switch (Status & 0xF0)
+    {
+    case 0x80: case 0x90: case 0xA0: case 0xB0: case 0xE0:
+        return 2;
+    case 0xC0: case 0xD0:
+        return 1;
+    default:
+        return -1;
+    }
+}
+
+bool PianoMidiFile::DecodeChannelMessage(uint8 Status, uint8 Data0, uint8 Data1, FPianoMidiEvent& OutEvent)
+{
+    OutEvent.Channel = Status & 0x0F;
+    OutEvent.MidiNote = Data0 & 0x7F;
+    OutEvent.Value = Data1 & 0x7F;
+    switch (Status & 0xF0)
+    {
+    case 0x90:
+        OutEvent.Type = OutEvent.Value > 0 ? EPianoMidiEventType::NoteOn : EPianoMidiEventType::NoteOff;
+        return true;
+    case 0x80:
+        OutEvent.Type = EPianoMidiEventType::NoteOff;
+        return true;
+    case 0xB0:
+        if (OutEvent.MidiNote != ControlSustain && OutEvent.MidiNote != ControlSostenuto)
+        {
+            return false;
+        }
+        OutEvent.Type = OutEvent.MidiNote == ControlSustain ? EPianoMidiEventType::Sustain : EPianoMidiEventType::Sostenuto;
+        OutEvent.MidiNote = 0;
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool PianoMidiFile::Parse(TConstArrayView<uint8> FileBytes, TArray<FPianoMidiEvent>& OutEvents, FString* OutError)
+{
+    OutEvents.Reset();
+    const uint8* Bytes = FileBytes.GetData();
+    const int64 Size = FileBytes.Num();
+    if (Size < 14 || FMemory::Memcmp(Bytes, "MThd", 4) != 0 || ReadUInt32BE(Bytes + 4) < 6)
+    {
+        return Fail(OutError, TEXT("not a Standard MIDI File"));
+    }
+
+    const uint16 Format = ReadUInt16BE(Bytes + 8);
+    const uint16 NumTracks = ReadUInt16BE(Bytes + 10);
+    const uint16 Division = ReadUInt16BE(Bytes + 12);
+    if (Format > 1)
+    {
+        return Fail(OutError, FString::Printf(TEXT("format %d files are not supported"), Format));
+    }
+
+    // Either ticks per quarter note, or SMPTE frames per second times ticks per frame.
+    const bool bSmpte = (Division & 0x8000) != 0;
+    const double TicksPerQuarter = bSmpte ? 0.0 : double(FMath::Max<uint16>(Division, 1));
+    const double SmpteTicksPerSecond = bSmpte ? double(-int8(Division >> 8)) * double(Division & 0xFF) : 0.0;
+    if (bSmpte && SmpteTicksPerSecond <= 0.0)
+    {
+        return Fail(OutError, TEXT("invalid SMPTE division"));
+    }
+
+    TArray<FTickEvent> TickEvents;
+    TArray<FTempoChange> TempoChanges;
+    int64 Offset = 8 + ReadUInt32BE(Bytes + 4);
+    for (int32 Track = 0; Track < NumTracks && Offset + 8 <= Size; )
+    {
+        const uint32 ChunkSize = ReadUInt32BE(Bytes + Offset + 4);
+        const bool bIsTrack = FMemory::Memcmp(Bytes + Offset, "MTrk", 4) == 0;
+        const int64 ChunkData = Offset + 8;
+        Offset = ChunkData + ChunkSize;
+        if (!bIsTrack)
+        {
+            // Unknown chunks are skipped, as the standard asks.
+            continue;
+        }
+        ++Track;
+
+        FTrackReader Reader { Bytes + ChunkData, Bytes + FMath::Min<int64>(Offset, Size) };
+        uint64 Tick = 0;
+        uint8 RunningStatus = 0;
+        while (!Reader.AtEnd())
+        {
+            uint32 Delta;
+            uint8 Status;
+            if (!Reader.ReadVariableLength(Delta) || !Reader.ReadByte(Status))
+            {
+                return Fail(OutError, FString::Printf(TEXT("track %d is truncated"), Track));
+            }
+            Tick += Delta;
+
+            if (Status == MetaEvent)
+            {
+                uint8 Type;
+                uint32 Length;
+                if (!Reader.ReadByte(Type) || !Reader.ReadVariableLength(Length) || Length > uint32(Reader.End - Reader.Cursor))
+                {
+                    return Fail(OutError, FString::Printf(TEXT("track %d has a truncated meta event"), Track));
+                }
+                if (Type == MetaSetTempo && Length == 3)
+                {
+                    const uint8* Data = Reader.Cursor;
+                    TempoChanges.Add({ Tick, (uint32(Data[0]) << 16) | (uint32(Data[1]) << 8) | uint32(Data[2]) });
+                }
+                Reader.Skip(Length);
+                RunningStatus = 0;
+                continue;
+            }
+            if (Status == SysExStart || Status == SysExContinue)
+            {
+                uint32 Length;
+                if (!Reader.ReadVariableLength(Length) || !Reader.Skip(Length))
+                {
+                    return Fail(OutError, FString::Printf(TEXT("track %d has a truncated system exclusive event"), Track));
+                }
+                RunningStatus = 0;
+                continue;
+            }
+
+            // A data byte where a status byte should be repeats the previous channel status.
+            uint8 Data[2] = { 0, 0 };
+            int32 DataIndex = 0;
+            if (Status < 0x80)
+            {
+                if (RunningStatus == 0)
+                {
+                    return Fail(OutError, FString::Printf(TEXT("track %d uses running status without a status"), Track));
+                }
+                Data[DataIndex++] = Status;
+                Status = RunningStatus;
+            }
+            const int32 DataLength = GetChannelMessageDataLength(Status);
+            if (DataLength < 0)
+            {
+                return Fail(OutError, FString::Printf(TEXT("track %d has an unexpected status byte 0x%02X"), Track, Status));
+            }
+            RunningStatus = Status;
+            for (; DataIndex < DataLength; ++DataIndex)
+            {
+                if (!Reader.ReadByte(Data[DataIndex]))
+                {
+                    return Fail(OutError, FString::Printf(TEXT("track %d is truncated"), Track));
+                }
+            }
+
+            FPianoMidiEvent Event;
+            if (!DecodeChannelMessage(Status, Data[0], Data[1], Event))
+            {
+                continue;
+            }
+            TickEvents.Add({ Tick, Event });
+        }
+    }
+
+    // Tracks were read one after another; merge them. The sort is stable, so events on the same
+    // tick keep their track order and a note-off still comes before a re-strike of the same key.
+    Algo::StableSortBy(TickEvents, &FTickEvent::Tick);
+    Algo::StableSortBy(TempoChanges, &FTempoChange::Tick);
+
+    OutEvents.Reserve(TickEvents.Num());
+    int32 NextTempo = 0;
+    uint64 SegmentTick = 0;
+    double SegmentSeconds = 0.0;
+    double SecondsPerTick = bSmpte ? 1.0 / SmpteTicksPerSecond : DefaultMicrosecondsPerQuarter * 1e-6 / TicksPerQuarter;
+    for (const FTickEvent& TickEvent : TickEvents)
+    {
+        // SMPTE time is absolute; tempo events only matter for ticks per quarter note.
+        for (; !bSmpte && NextTempo < TempoChanges.Num() && TempoChanges[NextTempo].Tick <= TickEvent.Tick; ++NextTempo)
+        {
+            SegmentSeconds += (TempoChanges[NextTempo].Tick - SegmentTick) * SecondsPerTick;
+            SegmentTick = TempoChanges[NextTempo].Tick;
+            SecondsPerTick = TempoChanges[NextTempo].MicrosecondsPerQuarter * 1e-6 / TicksPerQuarter;
+        }
+        FPianoMidiEvent& Event = OutEvents.Add_GetRef(TickEvent.Event);
+        Event.Time = SegmentSeconds + (TickEvent.Tick - SegmentTick) * SecondsPerTick;
+    }
+    return true;
+}
+
+bool PianoMidiFile::Load(const FString& Path, TArray<FPianoMidiEvent>& OutEvents, FString* OutError)
+{
+    TArray<uint8> FileBytes;
+    if (!FFileHelper::LoadFileToArray(FileBytes, *Path))
+    {
+        return Fail(OutError, FString::Printf(TEXT("could not read %s"), *Path));
+    }
+    return Parse(FileBytes, OutEvents, OutError);
+}
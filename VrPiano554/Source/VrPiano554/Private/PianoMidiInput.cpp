@@ -0,0 +1,628 @@
+#include "PianoMidiInput.h"
+#include "VrPiano554.h"
+#include "HAL/PlatformProcess.h"
+#include "HAL/RunnableThread.h"
+
+#if PLATFORM_LINUX || PLATFORM_MAC
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define PIANO_MIDI_WITH_FIFO 1
+#else
+#define PIANO_MIDI_WITH_FIFO 0
+#endif
+
+#if PLATFORM_WINDOWS
+#include "Containers/CircularQueue.h"
+#include "Windows/AllowWindowsPlatformTypes.h"
+#include <mmsystem.h>
+#include "Windows/HideWindowsPlatformTypes.h"
+#endif
+
+namespace
+{
+    constexpr int32 ReadBufferBytes = 256;
+
+    // Bounds how long Stop waits for the reader.
+    constexpr int32 ReadTimeoutMs = 50;
+
+    constexpr float ReopenIntervalSeconds = 1.0f;
+
+#if PIANO_MIDI_WITH_FIFO
+    // Waits for Fd to become readable; returns 1 if it is, 0 on timeout, -1 on error.
+    int32 PollReadable(pollfd* Fds, int32 NumFds, int32 TimeoutMs)
+    {
+        const int Ready = poll(Fds, NumFds, TimeoutMs);
+        if (Ready < 0)
+        {
+            return errno == EINTR ? 0 : -1;
+        }
+        for (int32 Index = 0; Index < NumFds; ++Index)
+        {
+            if (Fds[Index].revents & (POLLERR | POLLNVAL))
+            {
+                return -1;
+            }
+        }
+        return Ready > 0 ? 1 : 0;
+    }
+
+    // A named pipe carrying raw MIDI bytes, e.g. from `amidi -d`, a test script, or `cat file.syx > pipe`.
+    class FPianoMidiFifoSource : public IPianoMidiByteSource
+    {
+    public:
+        static TUniquePtr<IPianoMidiByteSource> Open(const FString& Path)
+        {
+            const FTCHARToUTF8 PathUtf8(*Path);
+            if (mkfifo(PathUtf8.Get(), 0666) != 0 && errno != EEXIST)
+            {
+                UE_LOG(LogVrPiano554, Warning, TEXT("MIDI input: could not create FIFO %s (errno %d)."), *Path, errno);
+                return nullptr;
+            }
+            struct stat Info;
+            if (stat(PathUtf8.Get(), &Info) != 0 || !S_ISFIFO(Info.st_mode))
+            {
+                UE_LOG(LogVrPiano554, Warning, TEXT("MIDI input: %s exists and is not a FIFO."), *Path);
+                return nullptr;
+            }
+
+            // Opened for writing too, so the pipe never reports end of file between writers.
+            const int Fd = open(PathUtf8.Get(), O_RDWR | O_NONBLOCK);
+            if (Fd < 0)
+            {
+                UE_LOG(LogVrPiano554, Warning, TEXT("MIDI input: could not open FIFO %s (errno %d)."), *Path, errno);
+                return nullptr;
+            }
+            return MakeUnique<FPianoMidiFifoSource>(Fd, Path);
+        }
+
+        FPianoMidiFifoSource(int InFd, const FString& InPath)
+            : Fd(InFd)
+            , Path(InPath)
+        {
+        }
+
+        virtual ~FPianoMidiFifoSource() override
+        {
+            close(Fd);
+        }
+
+        virtual int32 Read(uint8* Buffer, int32 Capacity, int32 TimeoutMs) override
+        {
+            pollfd Poll { Fd, POLLIN, 0 };
+            const int32 Ready = PollReadable(&Poll, 1, TimeoutMs);
+            if (Ready <= 0)
+            {
+                return Ready;
+            }
+            const ssize_t NumBytes = read(Fd, Buffer, Capacity);
+            if (NumBytes < 0)
+            {
+                return errno == EAGAIN || errno == EINTR ? 0 : -1;
+            }
+            return int32(NumBytes);
+        }
+
+        virtual FString Describe() const override
+        {
+            return FString::Printf(TEXT("FIFO %s"), *Path);
+        }
+
+    private:
+        int Fd;
+        FString Path;
+    };
+#endif
+
+#if PLATFORM_LINUX
+    // libasound is loaded at run time, so the module neither links nor needs headers for it; the
+    // sequencer's structs stay opaque and are only handled through pointers.
+    struct snd_seq_t;
+    struct snd_seq_event_t;
+    struct snd_midi_event_t;
+    struct snd_seq_client_info_t;
+    struct snd_seq_port_info_t;
+
+    constexpr int SND_SEQ_OPEN_INPUT = 2;
+    constexpr int SND_SEQ_NONBLOCK = 1;
+    constexpr unsigned int SND_SEQ_PORT_CAP_READ = 1 << 0;
+    constexpr unsigned int SND_SEQ_PORT_CAP_WRITE = 1 << 1;
+    constexpr unsigned int SND_SEQ_PORT_CAP_SUBS_READ = 1 << 5;
+    constexpr unsigned int SND_SEQ_PORT_CAP_SUBS_WRITE = 1 << 6;
+    constexpr unsigned int SND_SEQ_PORT_TYPE_MIDI_GENERIC = 1 << 1;
+    constexpr unsigned int SND_SEQ_PORT_TYPE_APPLICATION = 1 << 20;
+
+    struct FAlsaApi
+    {
+        int (*seq_open)(snd_seq_t**, const char*, int, int) = nullptr;
+        int (*seq_close)(snd_seq_t*) = nullptr;
+        int (*seq_client_id)(snd_seq_t*) = nullptr;
+        int (*seq_set_client_name)(snd_seq_t*, const char*) = nullptr;
+        int (*seq_create_simple_port)(snd_seq_t*, const char*, unsigned int, unsigned int) = nullptr;
+        int (*seq_connect_from)(snd_seq_t*, int, int, int) = nullptr;
+        int (*seq_poll_descriptors_count)(snd_seq_t*, short) = nullptr;
+        int (*seq_poll_descriptors)(snd_seq_t*, pollfd*, unsigned int, short) = nullptr;
+        int (*seq_event_input)(snd_seq_t*, snd_seq_event_t**) = nullptr;
+        int (*seq_event_input_pending)(snd_seq_t*, int) = nullptr;
+        int (*midi_event_new)(size_t, snd_midi_event_t**) = nullptr;
+        void (*midi_event_free)(snd_midi_event_t*) = nullptr;
+        void (*midi_event_no_status)(snd_midi_event_t*, int) = nullptr;
+        long (*midi_event_decode)(snd_midi_event_t*, unsigned char*, long, const snd_seq_event_t*) = nullptr;
+        int (*seq_client_info_malloc)(snd_seq_client_info_t**) = nullptr;
+        void (*seq_client_info_free)(snd_seq_client_info_t*) = nullptr;
+        void (*seq_client_info_set_client)(snd_seq_client_info_t*, int) = nullptr;
+        int (*seq_client_info_get_client)(const snd_seq_client_info_t*) = nullptr;
+        const char* (*seq_client_info_get_name)(snd_seq_client_info_t*) = nullptr;
+        int (*seq_query_next_client)(snd_seq_t*, snd_seq_client_info_t*) = nullptr;
+        int (*seq_port_info_malloc)(snd_seq_port_info_t**) = nullptr;
+        void (*seq_port_info_free)(snd_seq_port_info_t*) = nullptr;
+        void (*seq_port_info_set_client)(snd_seq_port_info_t*, int) = nullptr;
+        void (*seq_port_info_set_port)(snd_seq_port_info_t*, int) = nullptr;
+        int (*seq_port_info_get_port)(const snd_seq_port_info_t*) = nullptr;
+        unsigned int (*seq_port_info_get_capability)(const snd_seq_port_info_t*) = nullptr;
+        const char* (*seq_port_info_get_name)(const snd_seq_port_info_t*) = nullptr;
+        int (*seq_query_next_port)(snd_seq_t*, snd_seq_port_info_t*) = nullptr;
+
+        bool Load()
+        {
+            void* Library = FPlatformProcess::GetDllHandle(TEXT("libasound.so.2"));
+            if (!Library)
+            {
+                return false;
+            }
+#define PIANO_ALSA_LOAD(Name) \
+            Name = reinterpret_cast<decltype(Name)>(FPlatformProcess::GetDllExport(Library, TEXT("snd_" #Name))); \
+            if (!Name) { UE_LOG(LogVrPiano554, Warning, TEXT("MIDI input: libasound has no snd_%s."), TEXT(#Name)); return false; }
+            PIANO_ALSA_LOAD(seq_open)
+            PIANO_ALSA_LOAD(seq_close)
+            PIANO_ALSA_LOAD(seq_client_id)
+            PIANO_ALSA_LOAD(seq_set_client_name)
+            PIANO_ALSA_LOAD(seq_create_simple_port)
+            PIANO_ALSA_LOAD(seq_connect_from)
+            PIANO_ALSA_LOAD(seq_poll_descriptors_count)
+            PIANO_ALSA_LOAD(seq_poll_descriptors)
+            PIANO_ALSA_LOAD(seq_event_input)
+            PIANO_ALSA_LOAD(seq_event_input_pending)
+            PIANO_ALSA_LOAD(midi_event_new)
+            PIANO_ALSA_LOAD(midi_event_free)
+            PIANO_ALSA_LOAD(midi_event_no_status)
+            PIANO_ALSA_LOAD(midi_event_decode)
+            PIANO_ALSA_LOAD(seq_client_info_malloc)
+            PIANO_ALSA_LOAD(seq_client_info_free)
+            PIANO_ALSA_LOAD(seq_client_info_set_client)
+            PIANO_ALSA_LOAD(seq_client_info_get_client)
+            PIANO_ALSA_LOAD(seq_client_info_get_name)
+            PIANO_ALSA_LOAD(seq_query_next_client)
+            PIANO_ALSA_LOAD(seq_port_info_malloc)
+            PIANO_ALSA_LOAD(seq_port_info_free)
+            PIANO_ALSA_LOAD(seq_port_info_set_client)
+            PIANO_ALSA_LOAD(seq_port_info_set_port)
+            PIANO_ALSA_LOAD(seq_port_info_get_port)
+            PIANO_ALSA_LOAD(seq_port_info_get_capability)
+            PIANO_ALSA_LOAD(seq_port_info_get_name)
+            PIANO_ALSA_LOAD(seq_query_next_port)
+#undef PIANO_ALSA_LOAD
+            return true;
+        }
+    };
+
+    const FAlsaApi* GetAlsaApi()
+    {
+        static FAlsaApi Api;
+        static const bool bLoaded = Api.Load();
+        return bLoaded ? &Api : nullptr;
+    }
+
+    // Our own sequencer client with one writable port, subscribed to the keyboard's output port.
+    // Sequencer events are turned back into MIDI bytes, so the one parser serves every source.
+    class FPianoMidiAlsaSource : public IPianoMidiByteSource
+    {
+    public:
+        static TUniquePtr<IPianoMidiByteSource> Open(const FString& Name)
+        {
+            const FAlsaApi* Api = GetAlsaApi();
+            if (!Api)
+            {
+                UE_LOG(LogVrPiano554, Warning, TEXT("MIDI input: libasound.so.2 is not available."));
+                return nullptr;
+            }
+
+            snd_seq_t* Seq = nullptr;
+            if (Api->seq_open(&Seq, "default", SND_SEQ_OPEN_INPUT, SND_SEQ_NONBLOCK) < 0)
+            {
+                UE_LOG(LogVrPiano554, Warning, TEXT("MIDI input: could not open the ALSA sequencer."));
+                return nullptr;
+            }
+            TUniquePtr<FPianoMidiAlsaSource> Source = MakeUnique<FPianoMidiAlsaSource>(*Api, Seq);
+
+            Api->seq_set_client_name(Seq, "VrPiano");
+            const int Port = Api->seq_create_simple_port(Seq, "VrPiano In", SND_SEQ_PORT_CAP_WRITE | SND_SEQ_PORT_CAP_SUBS_WRITE,
+                SND_SEQ_PORT_TYPE_MIDI_GENERIC | SND_SEQ_PORT_TYPE_APPLICATION);
+            if (Port < 0 || Api->midi_event_new(ReadBufferBytes, &Source->Decoder) < 0)
+            {
+                UE_LOG(LogVrPiano554, Warning, TEXT("MIDI input: could not create an ALSA sequencer port."));
+                return nullptr;
+            }
+            Api->midi_event_no_status(Source->Decoder, 1);
+
+            int SourceClient = -1;
+            int SourcePort = -1;
+            FString Left, Right;
+            if (Name.Split(TEXT(":"), &Left, &Right) && Left.IsNumeric() && Right.IsNumeric())
+            {
+                SourceClient = FCString::Atoi(*Left);
+                SourcePort = FCString::Atoi(*Right);
+            }
+            else if (!Source->FindPort(Name, SourceClient, SourcePort))
+            {
+                UE_LOG(LogVrPiano554, Warning, TEXT("MIDI input: no readable ALSA sequencer port matches \"%s\"."), *Name);
+                return nullptr;
+            }
+            if (Api->seq_connect_from(Seq, Port, SourceClient, SourcePort) < 0)
+            {
+                UE_LOG(LogVrPiano554, Warning, TEXT("MIDI input: could not subscribe to ALSA port %d:%d."), SourceClient, SourcePort);
+                return nullptr;
+            }
+
+            const int NumFds = Api->seq_poll_descriptors_count(Seq, POLLIN);
+            Source->PollFds.SetNumZeroed(FMath::Max(NumFds, 1));
+            Api->seq_poll_descriptors(Seq, Source->PollFds.GetData(), Source->PollFds.Num(), POLLIN);
+            Source->PortName = FString::Printf(TEXT("%s%s%d:%d"), *Source->PortName, Source->PortName.IsEmpty() ? TEXT("") : TEXT(" "), SourceClient, SourcePort);
+            return Source;
+        }
+
+        FPianoMidiAlsaSource(const FAlsaApi& InApi, snd_seq_t* InSeq)
+            : Api(InApi)
+            , Seq(InSeq)
+        {
+        }
+
+        virtual ~FPianoMidiAlsaSource() override
+        {
+            if (Decoder)
+            {
+                Api.midi_event_free(Decoder);
+            }
+            Api.seq_close(Seq);
+        }
+
+        virtual int32 Read(uint8* Buffer, int32 Capacity, int32 TimeoutMs) override
+        {
+            // Events already fetched into the library's buffer do not wake poll().
+            if (Api.seq_event_input_pending(Seq, 0) <= 0)
+            {
+                const int32 Ready = PollReadable(PollFds.GetData(), PollFds.Num(), TimeoutMs);
+                if (Ready <= 0)
+                {
+                    return Ready;
+                }
+            }
+
+            // Channel messages decode to at most three bytes; longer ones are not ours to play.
+            int32 NumBytes = 0;
+            while (Capacity - NumBytes >= 3)
+            {
+                snd_seq_event_t* Event = nullptr;
+                const int Result = Api.seq_event_input(Seq, &Event);
+                if (Result == -ENOSPC)
+                {
+                    // The kernel queue overflowed and dropped events; what follows is still good.
+                    continue;
+                }
+                if (Result < 0 || !Event)
+                {
+                    break;
+                }
+                const long Decoded = Api.midi_event_decode(Decoder, Buffer + NumBytes, Capacity - NumBytes, Event);
+                if (Decoded > 0)
+                {
+                    NumBytes += int32(Decoded);
+                }
+            }
+            return NumBytes;
+        }
+
+        virtual FString Describe() const override
+        {
+            return FString::Printf(TEXT("ALSA %s"), *PortName);
+        }
+
+    private:
+        // The first port that others can read and subscribe to whose client or port name contains Name.
+        // An empty Name skips the kernel's Midi Through client and takes the first real device.
+        bool FindPort(const FString& Name, int& OutClient, int& OutPort)
+        {
+            snd_seq_client_info_t* ClientInfo = nullptr;
+            snd_seq_port_info_t* PortInfo = nullptr;
+            Api.seq_client_info_malloc(&ClientInfo);
+            Api.seq_port_info_malloc(&PortInfo);
+            const int OwnClient = Api.seq_client_id(Seq);
+            constexpr unsigned int Readable = SND_SEQ_PORT_CAP_READ | SND_SEQ_PORT_CAP_SUBS_READ;
+
+            bool bFound = false;
+            Api.seq_client_info_set_client(ClientInfo, -1);
+            while (!bFound && Api.seq_query_next_client(Seq, ClientInfo) >= 0)
+            {
+                const int Client = Api.seq_client_info_get_client(ClientInfo);
+                const FString ClientName = UTF8_TO_TCHAR(Api.seq_client_info_get_name(ClientInfo));
+
+                // Client 0 is the system timer and announcements.
+                if (Client == 0 || Client == OwnClient || (Name.IsEmpty() && ClientName.Contains(TEXT("Midi Through"))))
+                {
+                    continue;
+                }
+                Api.seq_port_info_set_client(PortInfo, Client);
+                Api.seq_port_info_set_port(PortInfo, -1);
+                while (Api.seq_query_next_port(Seq, PortInfo) >= 0)
+                {
+                    const FString FullName = FString::Printf(TEXT("%s %s"), *ClientName, UTF8_TO_TCHAR(Api.seq_port_info_get_name(PortInfo)));
+                    if ((Api.seq_port_info_get_capability(PortInfo) & Readable) == Readable && FullName.Contains(Name))
+                    {
+                        OutClient = Client;
+                        OutPort = Api.seq_port_info_get_port(PortInfo);
+                        PortName = FullName;
+                        bFound = true;
+                        break;
+                    }
+                }
+            }
+
+            Api.seq_port_info_free(PortInfo);
+            Api.seq_client_info_free(ClientInfo);
+            return bFound;
+        }
+
+        const FAlsaApi& Api;
+        snd_seq_t* Seq;
+        snd_midi_event_t* Decoder = nullptr;
+        TArray<pollfd> PollFds;
+        FString PortName;
+    };
+#endif
+
+#if PLATFORM_WINDOWS
+    // A WinMM input device. The driver calls back on its own thread with one short message at a time;
+    // they go through a fixed ring, since the callback must not allocate or block.
+    class FPianoMidiWinMMSource : public IPianoMidiByteSource
+    {
+    public:
+        static TUniquePtr<IPianoMidiByteSource> Open(const FString& Name)
+        {
+            const UINT NumDevices = midiInGetNumDevs();
+            for (UINT Device = 0; Device < NumDevices; ++Device)
+            {
+                MIDIINCAPSW Caps;
+                if (midiInGetDevCapsW(Device, &Caps, sizeof(Caps)) != MMSYSERR_NOERROR)
+                {
+                    continue;
+                }
+                const FString DeviceName(Caps.szPname);
+                if (!DeviceName.Contains(Name))
+                {
+                    continue;
+                }
+
+                TUniquePtr<FPianoMidiWinMMSource> Source = MakeUnique<FPianoMidiWinMMSource>(DeviceName);
+                if (midiInOpen(&Source->Handle, Device, reinterpret_cast<DWORD_PTR>(&FPianoMidiWinMMSource::Callback),
+                        reinterpret_cast<DWORD_PTR>(Source.Get()), CALLBACK_FUNCTION) != MMSYSERR_NOERROR)
+                {
+                    UE_LOG(LogVrPiano554, Warning, TEXT("MIDI input: could not open %s; is another program using it?"), *DeviceName);
+                    Source->Handle = nullptr;
+                    return nullptr;
+                }
+                midiInStart(Source->Handle);
+                return Source;
+            }
+            UE_LOG(LogVrPiano554, Warning, TEXT("MIDI input: no input device matches \"%s\"."), *Name);
+            return nullptr;
+        }
+
+        explicit FPianoMidiWinMMSource(const FString& InDeviceName)
+            : DeviceName(InDeviceName)
+            , Messages(1024)
+            , DataEvent(FPlatformProcess::GetSynchEventFromPool(false))
+        {
+        }
+
+        virtual ~FPianoMidiWinMMSource() override
+        {
+            if (Handle)
+            {
+                midiInStop(Handle);
+                midiInReset(Handle);
+                midiInClose(Handle);
+            }
+            FPlatformProcess::ReturnSynchEventToPool(DataEvent);
+        }
+
+        virtual int32 Read(uint8* Buffer, int32 Capacity, int32 TimeoutMs) override
+        {
+            if (Messages.IsEmpty())
+            {
+                DataEvent->Wait(TimeoutMs);
+            }
+            int32 NumBytes = 0;
+            uint32 Message;
+            while (Capacity - NumBytes >= 3 && Messages.Dequeue(Message))
+            {
+                const uint8 Status = uint8(Message);
+                const int32 DataLength = PianoMidiFile::GetChannelMessageDataLength(Status);
+                Buffer[NumBytes++] = Status;
+                for (int32 Index = 1; Index <= DataLength; ++Index)
+                {
+                    Buffer[NumBytes++] = uint8(Message >> (8 * Index));
+                }
+            }
+            return NumBytes;
+        }
+
+        virtual FString Describe() const override
+        {
+            return FString::Printf(TEXT("WinMM %s"), *DeviceName);
+        }
+
+    private:
+        static void CALLBACK Callback(HMIDIIN, UINT Message, DWORD_PTR Instance, DWORD_PTR Param1, DWORD_PTR)
+        {
+            if (Message == MIM_DATA)
+            {
+                FPianoMidiWinMMSource* Source = reinterpret_cast<FPianoMidiWinMMSource*>(Instance);
+                Source->Messages.Enqueue(uint32(Param1));
+                Source->DataEvent->Trigger();
+            }
+        }
+
+        FString DeviceName;
+        HMIDIIN Handle = nullptr;
+        TCircularQueue<uint32> Messages;
+        FEvent* DataEvent;
+    };
+#endif
+
+    TUniquePtr<IPianoMidiByteSource> OpenMidiSource(const FString& Device)
+    {
+        if (Device.StartsWith(TEXT("fifo:")))
+        {
+#if PIANO_MIDI_WITH_FIFO
+            return FPianoMidiFifoSource::Open(Device.RightChop(5));
+#else
+            UE_LOG(LogVrPiano554, Warning, TEXT("MIDI input: FIFO devices are not supported on this platform."));
+            return nullptr;
+#endif
+        }
+
+        FString Name = Device;
+        Name.RemoveFromStart(TEXT("alsa:"));
+#if PLATFORM_LINUX
+        return FPianoMidiAlsaSource::Open(Name);
+#elif PLATFORM_WINDOWS
+        return FPianoMidiWinMMSource::Open(Name);
+#else
+        UE_LOG(LogVrPiano554, Warning, TEXT("MIDI input: no native MIDI backend on this platform."));
+        return nullptr;
+#endif
+    }
+}
+
+bool FPianoMidiByteParser::Push(uint8 Byte, FPianoMidiEvent& OutEvent)
+{
+    // Clock, start, stop, active sensing and reset may interleave with anything.
+    if (Byte >= 0xF8)
+    {
+        return false;
+    }
+    if (Byte & 0x80)
+    {
+        // System exclusive and system common messages cancel running status, so their data is dropped below.
+        RunningStatus = Byte < 0xF0 ? Byte : 0;
+        NumData = 0;
+        return false;
+    }
+    if (RunningStatus == 0)
+    {
+        return false;
+    }
+
+    Data[NumData++] = Byte;
+    if (NumData < PianoMidiFile::GetChannelMessageDataLength(RunningStatus))
+    {
+        return false;
+    }
+    NumData = 0;
+    return PianoMidiFile::DecodeChannelMessage(RunningStatus, Data[0], Data[1], OutEvent);
+}
+
+void FPianoMidiByteParser::Reset()
+{
+    RunningStatus = 0;
+    NumData = 0;
+}
+
+TUniquePtr<FPianoMidiInput> FPianoMidiInput::Open(const FString& Device, TFunction<void()> InOnEvents)
+{
+    TUniquePtr<IPianoMidiByteSource> Source = OpenMidiSource(Device);
+    if (!Source)
+    {
+        return nullptr;
+    }
+    return TUniquePtr<FPianoMidiInput>(new FPianoMidiInput(Device, MoveTemp(Source), MoveTemp(InOnEvents)));
+}
+
+FPianoMidiInput::FPianoMidiInput(const FString& InDevice, TUniquePtr<IPianoMidiByteSource> InSource, TFunction<void()> InOnEvents)
+    : Device(InDevice)
+    , Description(InSource->Describe())
+    , Source(MoveTemp(InSource))
+    , OnEvents(MoveTemp(InOnEvents))
+{
+    UE_LOG(LogVrPiano554, Log, TEXT("MIDI input: reading %s."), *Description);
+    Thread.Reset(FRunnableThread::Create(this, TEXT("PianoMidiInput"), 0, TPri_AboveNormal));
+}
+
+FPianoMidiInput::~FPianoMidiInput()
+{
+    if (Thread.IsValid())
+    {
+        Thread->Kill(/*bShouldWait=*/true);
+        Thread.Reset();
+    }
+}
+
+uint32 FPianoMidiInput::Run()
+{
+    uint8 Buffer[ReadBufferBytes];
+    double ReopenTime = 0.0;
+    while (!bStopping.load(std::memory_order_relaxed))
+    {
+        if (!Source.IsValid())
+        {
+            if (FPlatformTime::Seconds() < ReopenTime)
+            {
+                FPlatformProcess::Sleep(ReadTimeoutMs * 0.001f);
+                continue;
+            }
+            Source = OpenMidiSource(Device);
+            ReopenTime = FPlatformTime::Seconds() + ReopenIntervalSeconds;
+            if (Source.IsValid())
+            {
+                UE_LOG(LogVrPiano554, Log, TEXT("MIDI input: reopened %s."), *Source->Describe());
+                Parser.Reset();
+            }
+            continue;
+        }
+
+        const int32 NumBytes = Source->Read(Buffer, ReadBufferBytes, ReadTimeoutMs);
+        if (NumBytes < 0)
+        {
+            UE_LOG(LogVrPiano554, Warning, TEXT("MIDI input: lost %s; retrying."), *Description);
+            Source.Reset();
+            ReopenTime = FPlatformTime::Seconds() + ReopenIntervalSeconds;
+            continue;
+        }
+
+        // Everything in one read arrived together, so it shares one capture time.
+        const double CaptureTime = FPlatformTime::Seconds();
+        bool bQueued = false;
+        for (int32 Index = 0; Index < NumBytes; ++Index)
+        {
+            FPianoMidiEvent Event;
+            if (Parser.Push(Buffer[Index], Event))
+            {
+                Event.Time = CaptureTime;
+                Events.Enqueue(Event);
+                bQueued = true;
+            }
+        }
+        if (bQueued && OnEvents)
+        {
+            OnEvents();
+        }
+    }
+    return 0;
+}
+
+void FPianoMidiInput::Stop()
+{
+    bStopping = true;
+}
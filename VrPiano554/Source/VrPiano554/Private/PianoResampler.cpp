@@ -0,0 +1,86 @@
+#include "PianoResampler.h"
+#include "Math/VectorRegister.h"
+
+namespace
+{
+    // Four-term Blackman-Harris over [-HalfWidth, HalfWidth]; about 90 dB of stop-band rejection.
+    double BlackmanHarris(double X, double HalfWidth)
+    {
+        if (FMath::Abs(X) >= HalfWidth)
+        {
+            return 0.0;
+        }
+        const double N = (X + HalfWidth) / (2.0 * HalfWidth);
+        return 0.35875 - 0.48829 * FMath::Cos(2.0 * UE_DOUBLE_PI * N) + 0.14128 * FMath::Cos(4.0 * UE_DOUBLE_PI * N) - 0.01168 * FMath::Cos(6.0 * UE_DOUBLE_PI * N);
+    }
+
+    double Sinc(double X)
+    {
+        return FMath::Abs(X) < 1e-9 ? 1.0 : FMath::Sin(UE_DOUBLE_PI * X) / (UE_DOUBLE_PI * X);
+    }
+
+    float HorizontalSum(VectorRegister4Float Vector)
+    {
+        alignas(16) float Lanes[4];
+        VectorStoreAligned(Vector, Lanes);
+        return (Lanes[0] + Lanes[1]) + (Lanes[2] + Lanes[3]);
+    }
+}
+
+FPianoResampleKernel::FPianoResampleKernel(float InCutoff)
+    : Cutoff(FMath::Clamp(InCutoff, 0.01f, 1.0f))
+{
+    static_assert(NumTaps % 4 == 0, "Mix processes taps four at a time.");
+
+    Coefficients.SetNumUninitialized((NumPhases + 1) * NumTaps);
+    for (int32 Phase = 0; Phase <= NumPhases; ++Phase)
+    {
+        const double Fraction = double(Phase) / NumPhases;
+        double Row[NumTaps];
+        double Sum = 0.0;
+        for (int32 Tap = 0; Tap < NumTaps; ++Tap)
+        {
+            const double X = (Tap - TapsBefore) - Fraction;
+            Row[Tap] = Cutoff * Sinc(Cutoff * X) * BlackmanHarris(X, NumTaps / 2);
+            Sum += Row[Tap];
+        }
+
+        // Unity gain at DC for every phase, so a shifted note keeps its level.
+        for (int32 Tap = 0; Tap < NumTaps; ++Tap)
+        {
+            Coefficients[Phase * NumTaps + Tap] = float(Row[Tap] / Sum);
+        }
+    }
+}
+
+void FPianoResampleKernel::Mix(const float* SrcLeft, const float* SrcRight, double Position, double Step, int32 NumFrames,
+    float GainStart, float GainStep, float* DstLeft, float* DstRight) const
+{
+    const float* Table = Coefficients.GetData();
+    for (int32 Frame = 0; Frame < NumFrames; ++Frame, Position += Step)
+    {
+        const int32 Index = FMath::FloorToInt32(Position);
+        const double PhasePosition = (Position - Index) * NumPhases;
+        const int32 Phase = FMath::Min(int32(PhasePosition), NumPhases - 1);
+        const VectorRegister4Float Blend = VectorSetFloat1(float(PhasePosition - Phase));
+
+        const float* RowA = Table + Phase * NumTaps;
+        const float* RowB = RowA + NumTaps;
+        const float* Left = SrcLeft + Index - TapsBefore;
+        const float* Right = SrcRight + Index - TapsBefore;
+
+        VectorRegister4Float SumLeft = VectorZeroFloat();
+        VectorRegister4Float SumRight = VectorZeroFloat();
+        for (int32 Tap = 0; Tap < NumTaps; Tap += 4)
+        {
+            const VectorRegister4Float A = VectorLoadAligned(RowA + Tap);
+            const VectorRegister4Float Taps = VectorMultiplyAdd(VectorSubtract(VectorLoadAligned(RowB + Tap), A), Blend, A);
+            SumLeft = VectorMultiplyAdd(VectorLoad(Left + Tap), Taps, SumLeft);
+            SumRight = VectorMultiplyAdd(VectorLoad(Right + Tap), Taps, SumRight);
+        }
+
+        const float Gain = GainStart + GainStep * Frame;
+        DstLeft[Frame] += HorizontalSum(SumLeft) * Gain;
+        DstRight[Frame] += HorizontalSum(SumRight) * Gain;
+    }
+}
@@ -0,0 +1,320 @@
+#include "PianoSampleBank.h"
+#include "VrPiano554.h"
+#include "Async/MappedFileHandle.h"
+#include "Async/ParallelFor.h"
+#include "HAL/FileManager.h"
+#include "HAL/PlatformFileManager.h"
+#include "HAL/PlatformMemory.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+struct FPianoSampleBank::FMappedFile
+{
+    // The region has to be released before the handle, hence the declaration order.
+    TUniquePtr<IMappedFileHandle> Handle;
+    TUniquePtr<IMappedFileRegion> Region;
+};
+
+namespace
+{
+    // "Clean Grand Mistral - GDCGM 060L.wav" -> note 60, left.
+    bool ParseSampleFileName(const FString& BaseName, int32& OutMidiNote, bool& bOutLeft)
+    {
+        if (BaseName.Len() < 4)
+        {
+            return false;
+        }
+        const TCHAR Side = FChar::ToUpper(BaseName[BaseName.Len() - 1]);
+        const FString Digits = BaseName.Mid(BaseName.Len() - 4, 3);
+        if ((Side != TEXT('L') && Side != TEXT('R')) || !Digits.IsNumeric())
+        {
+            return false;
+        }
+        OutMidiNote = FCString::Atoi(*Digits);
+        bOutLeft = Side == TEXT('L');
+        return OutMidiNote >= 0 && OutMidiNote < PianoKeys::NumMidiNotes;
+    }
+
+    // Granularity of TouchFrames; smaller than or equal to the page size on every target.
+    constexpr int64 TouchStride = 4096;
+}
+
+void FPianoSampleChannel::CopyFrames(int32 FirstFrame, int32 Count, float* Out) const
+{
+    if (FirstFrame < 0)
+    {
+        const int32 Silence = FMath::Min(-FirstFrame, Count);
+        FMemory::Memzero(Out, Silence * sizeof(float));
+        Out += Silence;
+        Count -= Silence;
+        FirstFrame = 0;
+    }
+
+    int32 Done = 0;
+    if (FirstFrame < Head.Num())
+    {
+        Done = FMath::Min(Count, Head.Num() - FirstFrame);
+        FMemory::Memcpy(Out, Head.GetData() + FirstFrame, Done * sizeof(float));
+    }
+
+    const int32 TailFirst = FirstFrame + Done;
+    const int32 TailCount = FMath::Clamp(NumFrames - TailFirst, 0, Count - Done);
+    if (TailCount > 0 && MappedFile.Num() > 0)
+    {
+        PianoWaveFile::DecodeChannel(MappedFile, Format, 0, TailFirst, TailCount, Out + Done);
+        Done += TailCount;
+    }
+
+    if (Done < Count)
+    {
+        FMemory::Memzero(Out + Done, (Count - Done) * sizeof(float));
+    }
+}
+
+void FPianoSampleChannel::TouchFrames(int32 FirstFrame, int32 Count) const
+{
+    if (MappedFile.Num() == 0)
+    {
+        return;
+    }
+
+    FirstFrame = FMath::Max(FirstFrame, Head.Num());
+    const int32 EndFrame = FMath::Min(FirstFrame + Count, NumFrames);
+    if (FirstFrame >= EndFrame)
+    {
+        return;
+    }
+
+    const int64 BytesPerFrame = Format.GetBytesPerFrame();
+    const uint8* Begin = MappedFile.GetData() + Format.DataOffset + FirstFrame * BytesPerFrame;
+    const uint8* End = MappedFile.GetData() + Format.DataOffset + EndFrame * BytesPerFrame;
+    uint32 Sink = 0;
+    for (const uint8* Byte = Begin; Byte < End; Byte += TouchStride)
+    {
+        Sink += *reinterpret_cast<const volatile uint8*>(Byte);
+    }
+    Sink += *reinterpret_cast<const volatile uint8*>(End - 1);
+    (void)Sink;
+}
+
+FPianoSampleBank::FPianoSampleBank()
+{
+    for (int8& Source : NearestSource)
+    {
+        Source = -1;
+    }
+}
+
+FPianoSampleBank::~FPianoSampleBank()
+{
+    // Channels point into the mappings; drop them first.
+    for (FPianoSample& Sample : Samples)
+    {
+        Sample = FPianoSample();
+    }
+    MappedFiles.Empty();
+}
+
+TSharedPtr<FPianoSampleBank, ESPMode::ThreadSafe> FPianoSampleBank::LoadFromDirectory(const FString& Directory, const FPianoSampleBankSettings& Settings)
+{
+    const double StartSeconds = FPlatformTime::Seconds();
+    const uint64 UsedPhysicalBefore = FPlatformMemory::GetStats().UsedPhysical;
+
+    TArray<FString> FileNames;
+    IFileManager::Get().FindFiles(FileNames, *FPaths::Combine(Directory, TEXT("*.wav")), true, false);
+    FileNames.Sort();
+
+    struct FLoadedFile
+    {
+        int32 MidiNote = 0;
+        bool bLeft = true;
+        bool bLoaded = false;
+        FPianoSampleChannel Channel;
+        TUniquePtr<FMappedFile> Mapping;
+    };
+    TArray<FLoadedFile> Files;
+    Files.SetNum(FileNames.Num());
+
+    TStaticArray<bool, PianoKeys::NumMidiNotes> bNoteWanted(InPlace, false);
+    for (int32 FileIndex = 0; FileIndex < FileNames.Num(); ++FileIndex)
+    {
+        FLoadedFile& File = Files[FileIndex];
+        if (ParseSampleFileName(FPaths::GetBaseFilename(FileNames[FileIndex]), File.MidiNote, File.bLeft))
+        {
+            bNoteWanted[File.MidiNote] = true;
+        }
+        else
+        {
+            File.MidiNote = INDEX_NONE;
+        }
+    }
+
+    if (Settings.ThinningStride >= 2)
+    {
+        TArray<int32> Recorded;
+        for (int32 MidiNote = 0; MidiNote < PianoKeys::NumMidiNotes; ++MidiNote)
+        {
+            if (bNoteWanted[MidiNote])
+            {
+                Recorded.Add(MidiNote);
+            }
+        }
+        for (int32 Index = Settings.ThinningStride - 1; Index < Recorded.Num() - 1; Index += Settings.ThinningStride)
+        {
+            bNoteWanted[Recorded[Index]] = false;
+        }
+    }
+
+    // Files are independent, so each one is opened, mapped and has its head decoded on its own worker.
+    ParallelFor(FileNames.Num(), [&](int32 FileIndex)
+    {
+        FLoadedFile& File = Files[FileIndex];
+        if (File.MidiNote == INDEX_NONE || !bNoteWanted[File.MidiNote])
+        {
+            return;
+        }
+
+        const FString Path = FPaths::Combine(Directory, FileNames[FileIndex]);
+        FPianoSampleChannel& Channel = File.Channel;
+
+        if (Settings.bMemoryMap)
+        {
+            TUniquePtr<FMappedFile> Mapping = MakeUnique<FMappedFile>();
+            Mapping->Handle.Reset(FPlatformFileManager::Get().GetPlatformFile().OpenMapped(*Path));
+            if (Mapping->Handle.IsValid())
+            {
+                Mapping->Region.Reset(Mapping->Handle->MapRegion(0, Mapping->Handle->GetFileSize()));
+            }
+            if (Mapping->Region.IsValid())
+            {
+                const TConstArrayView<uint8> Bytes(Mapping->Region->GetMappedPtr(), Mapping->Region->GetMappedSize());
+                if (PianoWaveFile::ParseHeader(Bytes, Channel.Format))
+                {
+                    Channel.NumFrames = int32(Channel.Format.NumFrames);
+                    const int32 HeadFrames = FMath::Min(Channel.NumFrames, FMath::CeilToInt32(Settings.ResidentMilliseconds * 0.001f * Channel.Format.SampleRate));
+                    Channel.Head.SetNumUninitialized(HeadFrames);
+                    PianoWaveFile::DecodeChannel(Bytes, Channel.Format, 0, 0, HeadFrames, Channel.Head.GetData());
+                    if (HeadFrames < Channel.NumFrames)
+                    {
+                        Channel.MappedFile = Bytes;
+                        File.Mapping = MoveTemp(Mapping);
+                    }
+                    File.bLoaded = true;
+                    return;
+                }
+            }
+        }
+
+        // No mapping: decode the whole note into memory.
+        TArray<uint8> FileBytes;
+        if (FFileHelper::LoadFileToArray(FileBytes, *Path) && PianoWaveFile::ParseHeader(FileBytes, Channel.Format))
+        {
+            Channel.NumFrames = int32(Channel.Format.NumFrames);
+            Channel.Head.SetNumUninitialized(Channel.NumFrames);
+            PianoWaveFile::DecodeChannel(FileBytes, Channel.Format, 0, 0, Channel.NumFrames, Channel.Head.GetData());
+            File.bLoaded = true;
+        }
+        else
+        {
+            UE_LOG(LogVrPiano554, Warning, TEXT("FPianoSampleBank: Could not read %s."), *Path);
+        }
+    });
+
+    TSharedPtr<FPianoSampleBank, ESPMode::ThreadSafe> NewBank = MakeShared<FPianoSampleBank, ESPMode::ThreadSafe>();
+    for (int32 FileIndex = 0; FileIndex < Files.Num(); ++FileIndex)
+    {
+        FLoadedFile& File = Files[FileIndex];
+        if (!File.bLoaded)
+        {
+            continue;
+        }
+        if (NewBank->SampleRate == 0)
+        {
+            NewBank->SampleRate = File.Channel.Format.SampleRate;
+        }
+        else if (File.Channel.Format.SampleRate != NewBank->SampleRate)
+        {
+            UE_LOG(LogVrPiano554, Warning, TEXT("FPianoSampleBank: %s is %d Hz, the bank is %d Hz; skipped."), *FileNames[FileIndex], File.Channel.Format.SampleRate, NewBank->SampleRate);
+            continue;
+        }
+
+        FPianoSample& Sample = NewBank->Samples[File.MidiNote];
+        (File.bLeft ? Sample.Left : Sample.Right) = MoveTemp(File.Channel);
+        if (File.Mapping.IsValid())
+        {
+            NewBank->MappedFiles.Add(MoveTemp(File.Mapping));
+        }
+    }
+
+    for (FPianoSample& Sample : NewBank->Samples)
+    {
+        if (Sample.Left.NumFrames == 0 && Sample.Right.NumFrames == 0)
+        {
+            continue;
+        }
+        if (Sample.Left.NumFrames == 0) Sample.Left = Sample.Right;
+        if (Sample.Right.NumFrames == 0) Sample.Right = Sample.Left;
+        Sample.NumFrames = FMath::Min(Sample.Left.NumFrames, Sample.Right.NumFrames);
+        ++NewBank->NumSamples;
+    }
+
+    if (NewBank->NumSamples == 0)
+    {
+        UE_LOG(LogVrPiano554, Warning, TEXT("FPianoSampleBank: No samples found in %s."), *Directory);
+        return nullptr;
+    }
+
+    // Every piano key without a recording borrows the nearest one; on a tie the higher note,
+    // since shifting down needs no anti-aliasing and keeps the full bandwidth.
+    for (int32 MidiNote = PianoKeys::LowestPianoNote; MidiNote <= PianoKeys::HighestPianoNote; ++MidiNote)
+    {
+        for (int32 Distance = 0; Distance < PianoKeys::NumMidiNotes; ++Distance)
+        {
+            const int32 Above = MidiNote + Distance;
+            const int32 Below = MidiNote - Distance;
+            const int32 Source = (Above < PianoKeys::NumMidiNotes && NewBank->Samples[Above].IsValid()) ? Above
+                : (Below >= 0 && NewBank->Samples[Below].IsValid()) ? Below : INDEX_NONE;
+            if (Source != INDEX_NONE)
+            {
+                NewBank->NearestSource[MidiNote] = int8(Source);
+                NewBank->NumReconstructedNotes += Source != MidiNote ? 1 : 0;
+                break;
+            }
+        }
+    }
+    for (int32 MidiNote = 0; MidiNote < PianoKeys::NumMidiNotes; ++MidiNote)
+    {
+        if (NewBank->Samples[MidiNote].IsValid())
+        {
+            NewBank->NearestSource[MidiNote] = int8(MidiNote);
+        }
+    }
+
+    NewBank->LoadSeconds = FPlatformTime::Seconds() - StartSeconds;
+    const int64 UsedPhysicalDelta = int64(FPlatformMemory::GetStats().UsedPhysical) - int64(UsedPhysicalBefore);
+    UE_LOG(LogVrPiano554, Log, TEXT("FPianoSampleBank: Loaded %d notes (%d more keys resampled) at %d Hz from %s in %.2f s; %.1f MB resident, %.1f MB mapped, process memory %+.1f MB."),
+        NewBank->NumSamples, NewBank->NumReconstructedNotes, NewBank->SampleRate, *Directory, NewBank->LoadSeconds,
+        NewBank->GetAllocatedSize() / (1024.0 * 1024.0), NewBank->GetMappedSize() / (1024.0 * 1024.0), UsedPhysicalDelta / (1024.0 * 1024.0));
+    return NewBank;
+}
+
+SIZE_T FPianoSampleBank::GetAllocatedSize() const
+{
+    SIZE_T Size = 0;
+    for (const FPianoSample& Sample : Samples)
+    {
+        Size += Sample.Left.Head.GetAllocatedSize() + Sample.Right.Head.GetAllocatedSize();
+    }
+    return Size;
+}
+
+int64 FPianoSampleBank::GetMappedSize() const
+{
+    int64 Size = 0;
+    for (const TUniquePtr<FMappedFile>& Mapping : MappedFiles)
+    {
+        Size += Mapping->Region->GetMappedSize();
+    }
+    return Size;
+}
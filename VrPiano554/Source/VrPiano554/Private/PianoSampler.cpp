@@ -0,0 +1,795 @@
+#include "PianoSampler.h"
+#include "VrPiano554.h"
+#include "HAL/Event.h"
+#include "HAL/PlatformProcess.h"
+#include "HAL/PlatformTime.h"
+#include "HAL/Runnable.h"
+#include "HAL/RunnableThread.h"
+#include "Math/VectorRegister.h"
+
+DECLARE_CYCLE_STAT(TEXT("Piano Sampler Render"), STAT_PianoSamplerRender, STATGROUP_VrPiano);
+
+namespace
+{
+    // Dst[i] += Src[i] * (GainStart + GainStep * i), four frames per vector.
+    void MixWithGainRamp(const float* RESTRICT Src, float* RESTRICT Dst, int32 NumFrames, float GainStart, float GainStep)
+    {
+        int32 Frame = 0;
+        VectorRegister4Float Gain = MakeVectorRegisterFloat(GainStart, GainStart + GainStep, GainStart + 2.0f * GainStep, GainStart + 3.0f * GainStep);
+        const VectorRegister4Float GainStep4 = VectorSetFloat1(4.0f * GainStep);
+        for (; Frame + 4 <= NumFrames; Frame += 4)
+        {
+            VectorStore(VectorMultiplyAdd(VectorLoad(Src + Frame), Gain, VectorLoad(Dst + Frame)), Dst + Frame);
+            Gain = VectorAdd(Gain, GainStep4);
+        }
+        for (; Frame < NumFrames; ++Frame)
+        {
+            Dst[Frame] += Src[Frame] * (GainStart + GainStep * Frame);
+        }
+    }
+
+    // Velocity 127 plays the recording at full level; the square gives a usable dynamic range of about 40 dB.
+    float VelocityToGain(int32 Velocity)
+    {
+        return FMath::Square(FMath::Clamp(Velocity, 0, 127) / 127.0f);
+    }
+}
+
+class FPianoSamplePrefetcher : public FRunnable
+{
+public:
+    explicit FPianoSamplePrefetcher(const FPianoSampler& InSampler)
+        : Sampler(InSampler)
+        , WakeEvent(FPlatformProcess::GetSynchEventFromPool(/*bIsManualReset=*/false))
+    {
+    }
+
+    virtual ~FPianoSamplePrefetcher() override
+    {
+        FPlatformProcess::ReturnSynchEventToPool(WakeEvent);
+    }
+
+    virtual uint32 Run() override
+    {
+        for (;;)
+        {
+            WakeEvent->Wait();
+            if (bStopping.load(std::memory_order_relaxed))
+            {
+                return 0;
+            }
+            Sampler.PrefetchActiveVoices();
+        }
+    }
+
+    virtual void Stop() override
+    {
+        bStopping = true;
+        WakeEvent->Trigger();
+    }
+
+    /** Audio thread: a streamed voice has used up part of what was paged in for it. */
+    void Wake()
+    {
+        WakeEvent->Trigger();
+    }
+
+private:
+    const FPianoSampler& Sampler;
+    FEvent* WakeEvent;
+    std::atomic<bool> bStopping { false };
+};
+
+FPianoSampler::FPianoSampler(int32 InNumVoices, int32 InOutputSampleRate)
+    : ActiveBank(nullptr)
+    , ActiveReverb(nullptr)
+    , Commands(MaxScheduledCommands)
+    , OutputSampleRate(FMath::Max(1, InOutputSampleRate))
+    , MasterGain(0.5f)
+    , NumActiveVoices(0)
+    , NumDroppedCommands(0)
+    , NumStolenVoices(0)
+    , RenderedFrames(0)
+    , FrameClockSequence(0)
+    , FrameClockFrame(0)
+    , FrameClockSeconds(0.0)
+{
+    Scheduled.Reserve(MaxScheduledCommands);
+    // Enough reserve for a chord's worth of steals within one quick fade.
+    MaxVoices = FMath::Max(1, InNumVoices);
+    Voices.SetNum(MaxVoices + FMath::Max(4, MaxVoices / 8));
+    for (int32 MidiNote = 0; MidiNote < PianoKeys::NumMidiNotes; ++MidiNote)
+    {
+        KeyDown[MidiNote] = false;
+        SostenutoKeys[MidiNote] = false;
+    }
+    VoiceStreams = MakeUnique<FVoiceStreamState[]>(Voices.Num());
+    MixLeft.SetNumZeroed(MaxBlockFrames);
+    MixRight.SetNumZeroed(MaxBlockFrames);
+    ScratchLeft.SetNumZeroed(MaxBlockFrames + FPianoResampleKernel::NumTaps);
+    ScratchRight.SetNumZeroed(MaxBlockFrames + FPianoResampleKernel::NumTaps);
+}
+
+FPianoSampler::~FPianoSampler()
+{
+    if (PrefetchThread.IsValid())
+    {
+        PrefetchThread->Kill(/*bShouldWait=*/true);
+        PrefetchThread.Reset();
+    }
+    Prefetcher.Reset();
+}
+
+bool FPianoSampler::SetBank(FPianoSampleBankPtr InBank)
+{
+    if (Bank.IsValid() || !InBank.IsValid())
+    {
+        return false;
+    }
+    Bank = InBank;
+    UpdateKeyPlayback(*Bank);
+    PrefetchFrames = FMath::CeilToInt32(PrefetchSeconds * Bank->GetSampleRate());
+
+    // Started before the bank is published: no voice streams until then, so the audio thread
+    // never wakes a prefetcher that is not there yet.
+    if (Bank->HasStreamedTails())
+    {
+        Prefetcher = MakeUnique<FPianoSamplePrefetcher>(*this);
+        PrefetchThread.Reset(FRunnableThread::Create(Prefetcher.Get(), TEXT("PianoSamplePrefetch"), 0, TPri_BelowNormal));
+    }
+    ActiveBank.store(Bank.Get(), std::memory_order_release);
+    return true;
+}
+
+bool FPianoSampler::SetReverb(FPianoConvolutionReverbPtr InReverb)
+{
+    if (Reverb.IsValid() || !InReverb.IsValid())
+    {
+        return false;
+    }
+    Reverb = InReverb;
+    ActiveReverb.store(Reverb.Get(), std::memory_order_release);
+    return true;
+}
+
+void FPianoSampler::SetOutputSampleRate(int32 InOutputSampleRate)
+{
+    OutputSampleRate = FMath::Max(1, InOutputSampleRate);
+    if (const FPianoSampleBank* CurrentBank = GetBank())
+    {
+        // Playing voices point at the kernels about to be rebuilt.
+        for (FVoice& Voice : Voices)
+        {
+            Voice = FVoice();
+        }
+        UpdateKeyPlayback(*CurrentBank);
+    }
+}
+
+void FPianoSampler::UpdateKeyPlayback(const FPianoSampleBank& InBank)
+{
+    // Kernels are shared between keys with the same cutoff; every key shifted down shares the full-band one.
+    auto FindOrAddKernel = [this](float Cutoff) -> const FPianoResampleKernel*
+    {
+        for (const TUniquePtr<FPianoResampleKernel>& Kernel : Kernels)
+        {
+            if (FMath::IsNearlyEqual(Kernel->GetCutoff(), Cutoff, 1e-4f))
+            {
+                return Kernel.Get();
+            }
+        }
+        return Kernels.Add_GetRef(MakeUnique<FPianoResampleKernel>(Cutoff)).Get();
+    };
+
+    Kernels.Reset();
+    const double RateRatio = double(InBank.GetSampleRate()) / OutputSampleRate;
+    for (int32 MidiNote = 0; MidiNote < PianoKeys::NumMidiNotes; ++MidiNote)
+    {
+        FKeyPlayback& Playback = KeyPlayback[MidiNote];
+        Playback = FKeyPlayback();
+        if (!InBank.FindNearest(MidiNote, Playback.SourceNote))
+        {
+            continue;
+        }
+        Playback.Step = RateRatio * FMath::Pow(2.0, (MidiNote - Playback.SourceNote) / 12.0);
+        if (!FMath::IsNearlyEqual(Playback.Step, 1.0, 1e-9))
+        {
+            Playback.Kernel = FindOrAddKernel(FPianoResampleKernel::CutoffForStep(Playback.Step));
+        }
+    }
+}
+
+void FPianoSampler::PrefetchActiveVoices() const
+{
+    const FPianoSampleBank* CurrentBank = GetBank();
+    if (!CurrentBank)
+    {
+        return;
+    }
+
+    for (int32 VoiceIndex = 0; VoiceIndex < Voices.Num(); ++VoiceIndex)
+    {
+        const int32 SourceNote = VoiceStreams[VoiceIndex].SourceNote.load(std::memory_order_relaxed);
+        if (const FPianoSample* Sample = SourceNote >= 0 ? CurrentBank->Find(SourceNote) : nullptr)
+        {
+            const int32 Frame = VoiceStreams[VoiceIndex].Frame.load(std::memory_order_relaxed);
+            Sample->Left.TouchFrames(Frame, PrefetchFrames);
+            Sample->Right.TouchFrames(Frame, PrefetchFrames);
+        }
+    }
+}
+
+bool FPianoSampler::Enqueue(const FPianoSamplerCommand& Command)
+{
+    if (Commands.Enqueue(Command))
+    {
+        return true;
+    }
+    NumDroppedCommands.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+bool FPianoSampler::ScheduleNoteOn(uint64 Frame, int32 MidiNote, int32 Velocity)
+{
+    if (MidiNote < 0 || MidiNote >= PianoKeys::NumMidiNotes)
+    {
+        return false;
+    }
+    FPianoSamplerCommand Command;
+    Command.Type = EPianoSamplerCommand::NoteOn;
+    Command.MidiNote = uint8(MidiNote);
+    Command.Velocity = uint8(FMath::Clamp(Velocity, 0, 127));
+    Command.Frame = Frame;
+    return Enqueue(Command);
+}
+
+bool FPianoSampler::ScheduleNoteOff(uint64 Frame, int32 MidiNote)
+{
+    if (MidiNote < 0 || MidiNote >= PianoKeys::NumMidiNotes)
+    {
+        return false;
+    }
+    FPianoSamplerCommand Command;
+    Command.Type = EPianoSamplerCommand::NoteOff;
+    Command.MidiNote = uint8(MidiNote);
+    Command.Frame = Frame;
+    return Enqueue(Command);
+}
+
+bool FPianoSampler::ScheduleSustainPedal(uint64 Frame, bool bDown)
+{
+    FPianoSamplerCommand Command;
+    Command.Type = EPianoSamplerCommand::Sustain;
+    Command.Velocity = bDown ? 127 : 0;
+    Command.Frame = Frame;
+    return Enqueue(Command);
+}
+
+bool FPianoSampler::ScheduleSostenutoPedal(uint64 Frame, bool bDown)
+{
+    FPianoSamplerCommand Command;
+    Command.Type = EPianoSamplerCommand::Sostenuto;
+    Command.Velocity = bDown ? 127 : 0;
+    Command.Frame = Frame;
+    return Enqueue(Command);
+}
+
+bool FPianoSampler::ScheduleVolume(uint64 Frame, float InVolume)
+{
+    FPianoSamplerCommand Command;
+    Command.Type = EPianoSamplerCommand::Volume;
+    Command.Volume = FMath::Max(0.0f, InVolume);
+    Command.Frame = Frame;
+    return Enqueue(Command);
+}
+
+void FPianoSampler::AllNotesOff()
+{
+    FPianoSamplerCommand Command;
+    Command.Type = EPianoSamplerCommand::AllNotesOff;
+    Enqueue(Command);
+}
+
+void FPianoSampler::ClearScheduled()
+{
+    FPianoSamplerCommand Command;
+    Command.Type = EPianoSamplerCommand::ClearScheduled;
+    Enqueue(Command);
+}
+
+uint64 FPianoSampler::PlatformSecondsToFrame(double Seconds) const
+{
+    uint32 Sequence;
+    uint64 Frame;
+    double FrameSeconds;
+    do
+    {
+        Sequence = FrameClockSequence.load(std::memory_order_acquire);
+        Frame = FrameClockFrame.load(std::memory_order_relaxed);
+        FrameSeconds = FrameClockSeconds.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+    }
+    while ((Sequence & 1) != 0 || Sequence != FrameClockSequence.load(std::memory_order_relaxed));
+
+    if (Sequence == 0)
+    {
+        // Nothing rendered yet: the first block will start at frame 0, about now.
+        FrameSeconds = FPlatformTime::Seconds();
+    }
+    const double Offset = (Seconds - FrameSeconds) * OutputSampleRate;
+    return Offset > -double(Frame) ? Frame + int64(Offset) : 0;
+}
+
+void FPianoSampler::UpdateFrameClock(int32 NumFrames)
+{
+    // Audio callbacks jitter by a good part of a block; extrapolate from the previous estimate and
+    // only pull it slowly towards the measured time, which still follows drift between the clocks.
+    constexpr double Smoothing = 0.05;
+    const double Now = FPlatformTime::Seconds();
+    const uint32 Sequence = FrameClockSequence.load(std::memory_order_relaxed);
+    const double Predicted = FrameClockSeconds.load(std::memory_order_relaxed) + double(NumFrames) / OutputSampleRate;
+    const double Estimate = Sequence == 0 || FMath::Abs(Now - Predicted) > 0.25 ? Now : Predicted + (Now - Predicted) * Smoothing;
+
+    FrameClockSequence.store(Sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    FrameClockFrame.store(RenderedFrames.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    FrameClockSeconds.store(Estimate, std::memory_order_relaxed);
+    FrameClockSequence.store(Sequence + 2, std::memory_order_release);
+}
+
+void FPianoSampler::Render(float* OutInterleaved, int32 NumFrames)
+{
+    SCOPE_CYCLE_COUNTER(STAT_PianoSamplerRender);
+    ProcessCommands();
+
+    const float Gain = MasterGain.load(std::memory_order_relaxed);
+    const uint64 FirstFrame = RenderedFrames.load(std::memory_order_relaxed);
+    for (int32 BlockStart = 0; BlockStart < NumFrames; BlockStart += MaxBlockFrames)
+    {
+        const int32 BlockFrames = FMath::Min(MaxBlockFrames, NumFrames - BlockStart);
+        const uint64 BlockFrame = FirstFrame + BlockStart;
+        FMemory::Memzero(MixLeft.GetData(), BlockFrames * sizeof(float));
+        FMemory::Memzero(MixRight.GetData(), BlockFrames * sizeof(float));
+
+        // The block is split at every scheduled command inside it, so each lands on its own frame.
+        float* Out = OutInterleaved + BlockStart * 2;
+        for (int32 SegmentStart = 0; SegmentStart < BlockFrames;)
+        {
+            for (; ScheduledHead < Scheduled.Num() && Scheduled[ScheduledHead].Frame <= BlockFrame + SegmentStart; ++ScheduledHead)
+            {
+                ApplyCommand(Scheduled[ScheduledHead]);
+            }
+            if (ScheduledHead == Scheduled.Num())
+            {
+                Scheduled.Reset();
+                ScheduledHead = 0;
+            }
+
+            const int32 SegmentEnd = ScheduledHead < Scheduled.Num()
+                ? int32(FMath::Min<uint64>(Scheduled[ScheduledHead].Frame - BlockFrame, BlockFrames))
+                : BlockFrames;
+
+            for (FVoice& Voice : Voices)
+            {
+                if (Voice.bActive)
+                {
+                    MixVoice(Voice, SegmentStart, SegmentEnd - SegmentStart);
+                }
+            }
+
+            for (int32 Frame = SegmentStart; Frame < SegmentEnd; ++Frame)
+            {
+                if (VolumeRampLeft > 0)
+                {
+                    Volume = --VolumeRampLeft > 0 ? Volume + VolumeStep : VolumeTarget;
+                }
+                const float FrameGain = Gain * Volume;
+                Out[Frame * 2] = MixLeft[Frame] * FrameGain;
+                Out[Frame * 2 + 1] = MixRight[Frame] * FrameGain;
+            }
+            SegmentStart = SegmentEnd;
+        }
+
+        int32 ActiveVoices = 0;
+        bool bWakePrefetcher = false;
+        for (int32 VoiceIndex = 0; VoiceIndex < Voices.Num(); ++VoiceIndex)
+        {
+            FVoice& Voice = Voices[VoiceIndex];
+            if (Voice.bActive)
+            {
+                ++ActiveVoices;
+                const int32 SourceFrame = int32(Voice.Position);
+                VoiceStreams[VoiceIndex].Frame.store(SourceFrame, std::memory_order_relaxed);
+
+                // Wake the prefetcher when a streamed voice starts and again each time it has
+                // played through half of what was paged in for it.
+                if (SourceFrame >= Voice.NextPrefetchFrame)
+                {
+                    Voice.NextPrefetchFrame = SourceFrame + PrefetchFrames / 2;
+                    bWakePrefetcher = true;
+                }
+            }
+            VoiceStreams[VoiceIndex].SourceNote.store(Voice.bActive ? KeyPlayback[Voice.MidiNote].SourceNote : -1, std::memory_order_relaxed);
+        }
+        NumActiveVoices.store(ActiveVoices, std::memory_order_relaxed);
+
+        if (bWakePrefetcher)
+        {
+            Prefetcher->Wake();
+        }
+    }
+
+    if (FPianoConvolutionReverb* CurrentReverb = ActiveReverb.load(std::memory_order_acquire))
+    {
+        CurrentReverb->Process(OutInterleaved, NumFrames);
+    }
+
+    RenderedFrames.store(FirstFrame + NumFrames, std::memory_order_relaxed);
+    UpdateFrameClock(NumFrames);
+}
+
+void FPianoSampler::ProcessCommands()
+{
+    FPianoSamplerCommand Command;
+    while (Commands.Dequeue(Command))
+    {
+        if (Command.Type == EPianoSamplerCommand::ClearScheduled)
+        {
+            Scheduled.Reset();
+            ScheduledHead = 0;
+            continue;
+        }
+
+        if (Scheduled.Num() == Scheduled.Max() && ScheduledHead > 0)
+        {
+            Scheduled.RemoveAt(0, ScheduledHead, EAllowShrinking::No);
+            ScheduledHead = 0;
+        }
+        if (Scheduled.Num() == Scheduled.Max())
+        {
+            NumDroppedCommands.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+
+        // Commands mostly arrive in frame order, so this is nearly always an append. Equal frames
+        // keep their queue order.
+        int32 Index = Scheduled.Num();
+        while (Index > ScheduledHead && Scheduled[Index - 1].Frame > Command.Frame)
+        {
+            --Index;
+        }
+        Scheduled.Insert(Command, Index);
+    }
+}
+
+void FPianoSampler::ApplyCommand(const FPianoSamplerCommand& Command)
+{
+    switch (Command.Type)
+    {
+    case EPianoSamplerCommand::NoteOn:
+        if (Command.Velocity > 0)
+        {
+            StartVoice(Command.MidiNote, Command.Velocity);
+        }
+        else
+        {
+            KeyUp(Command.MidiNote);
+        }
+        break;
+    case EPianoSamplerCommand::NoteOff:
+        KeyUp(Command.MidiNote);
+        break;
+    case EPianoSamplerCommand::AllNotesOff:
+        bSustainDown = false;
+        bSostenutoDown = false;
+        for (int32 MidiNote = 0; MidiNote < PianoKeys::NumMidiNotes; ++MidiNote)
+        {
+            KeyDown[MidiNote] = false;
+            SostenutoKeys[MidiNote] = false;
+            ReleaseVoices(MidiNote, ReleaseSeconds);
+        }
+        break;
+    case EPianoSamplerCommand::Sustain:
+        bSustainDown = Command.Velocity > 0;
+        if (!bSustainDown)
+        {
+            ReleaseUnheldVoices();
+        }
+        break;
+    case EPianoSamplerCommand::Sostenuto:
+        if (Command.Velocity > 0 && !bSostenutoDown)
+        {
+            // The pedal catches every damper that is up as it goes down: those of held keys, or all
+            // of them under the damper pedal. Keys struck later are not caught.
+            for (int32 MidiNote = 0; MidiNote < PianoKeys::NumMidiNotes; ++MidiNote)
+            {
+                SostenutoKeys[MidiNote] = KeyDown[MidiNote] || bSustainDown;
+            }
+        }
+        else if (Command.Velocity == 0 && bSostenutoDown)
+        {
+            for (int32 MidiNote = 0; MidiNote < PianoKeys::NumMidiNotes; ++MidiNote)
+            {
+                SostenutoKeys[MidiNote] = false;
+            }
+            ReleaseUnheldVoices();
+        }
+        bSostenutoDown = Command.Velocity > 0;
+        break;
+    case EPianoSamplerCommand::Volume:
+        VolumeTarget = Command.Volume;
+        VolumeStep = (VolumeTarget - Volume) / VolumeRampFrames;
+        VolumeRampLeft = VolumeRampFrames;
+        break;
+    case EPianoSamplerCommand::ClearScheduled:
+        break;
+    }
+}
+
+void FPianoSampler::StartVoice(int32 MidiNote, int32 Velocity)
+{
+    KeyDown[MidiNote] = true;
+    const FPianoSampleBank* CurrentBank = GetBank();
+    const FKeyPlayback& Playback = KeyPlayback[MidiNote];
+    const FPianoSample* Sample = CurrentBank ? CurrentBank->Find(Playback.SourceNote) : nullptr;
+    if (!Sample)
+    {
+        return;
+    }
+
+    // A re-struck key cuts its previous note short instead of layering on it, unless a pedal
+    // holds its damper off; then the earlier strikes ring on until the pedal lets go, up to
+    // MaxStrikesPerKey of them.
+    if (IsDamperRaised(MidiNote))
+    {
+        int32 NumStrikes = 0;
+        FVoice* OldestStrike = nullptr;
+        for (FVoice& Other : Voices)
+        {
+            if (Other.bActive && !Other.bReleased && Other.MidiNote == MidiNote)
+            {
+                Other.bSustained = true;
+                ++NumStrikes;
+                if (!OldestStrike || Other.StartOrder - OldestStrike->StartOrder > 0x80000000u)
+                {
+                    OldestStrike = &Other;
+                }
+            }
+        }
+        if (NumStrikes >= MaxStrikesPerKey)
+        {
+            StealVoice(*OldestStrike);
+        }
+    }
+    else
+    {
+        ReleaseVoices(MidiNote, QuickFadeSeconds);
+    }
+
+    FVoice& Voice = AllocateVoice();
+    Voice.Sample = Sample;
+    Voice.Kernel = Playback.Kernel;
+    Voice.Position = 0.0;
+    Voice.NextPrefetchFrame = Sample->Left.MappedFile.Num() > 0 ? 0 : MAX_int32;
+    Voice.Step = Playback.Step;
+    Voice.Gain = VelocityToGain(Velocity);
+    Voice.Envelope = 1.0f;
+    Voice.FadeRate = 0.0f;
+    Voice.StartOrder = NextStartOrder++;
+    Voice.MidiNote = uint8(MidiNote);
+    Voice.bActive = true;
+    Voice.bReleased = false;
+    Voice.bSustained = false;
+    Voice.bStolen = false;
+}
+
+void FPianoSampler::KeyUp(int32 MidiNote)
+{
+    KeyDown[MidiNote] = false;
+    if (!IsDamperRaised(MidiNote))
+    {
+        ReleaseVoices(MidiNote, ReleaseSeconds);
+        return;
+    }
+    for (FVoice& Voice : Voices)
+    {
+        if (Voice.bActive && !Voice.bReleased && Voice.MidiNote == MidiNote)
+        {
+            Voice.bSustained = true;
+        }
+    }
+}
+
+void FPianoSampler::ReleaseVoices(int32 MidiNote, float FadeSeconds)
+{
+    const float FadeRate = 1.0f / FMath::Max(1.0f, FadeSeconds * OutputSampleRate);
+    for (FVoice& Voice : Voices)
+    {
+        if (Voice.bActive && Voice.MidiNote == MidiNote)
+        {
+            Voice.bReleased = true;
+            Voice.FadeRate = FMath::Max(Voice.FadeRate, FadeRate);
+        }
+    }
+}
+
+void FPianoSampler::ReleaseUnheldVoices()
+{
+    const float FadeRate = 1.0f / FMath::Max(1.0f, ReleaseSeconds * OutputSampleRate);
+    for (FVoice& Voice : Voices)
+    {
+        // Earlier strikes of a key still held keep ringing: its damper stays up.
+        if (Voice.bActive && Voice.bSustained && !KeyDown[Voice.MidiNote] && !IsDamperRaised(Voice.MidiNote))
+        {
+            Voice.bSustained = false;
+            Voice.bReleased = true;
+            Voice.FadeRate = FMath::Max(Voice.FadeRate, FadeRate);
+        }
+    }
+}
+
+FPianoSampler::FVoice& FPianoSampler::AllocateVoice()
+{
+    FVoice* Free = nullptr;
+    int32 NumSounding = 0;
+    for (FVoice& Voice : Voices)
+    {
+        if (!Voice.bActive)
+        {
+            Free = Free ? Free : &Voice;
+        }
+        else if (!Voice.bStolen)
+        {
+            ++NumSounding;
+        }
+    }
+
+    if (NumSounding >= MaxVoices)
+    {
+        if (FVoice* Victim = ChooseVoiceToSteal())
+        {
+            StealVoice(*Victim);
+        }
+    }
+    if (Free)
+    {
+        return *Free;
+    }
+
+    // Every reserve slot is still fading out a stolen voice: cut the one closest to silence.
+    FVoice* Quietest = &Voices[0];
+    for (FVoice& Voice : Voices)
+    {
+        if (Voice.bStolen && (!Quietest->bStolen || Voice.Envelope < Quietest->Envelope))
+        {
+            Quietest = &Voice;
+        }
+    }
+    return *Quietest;
+}
+
+FPianoSampler::FVoice* FPianoSampler::ChooseVoiceToSteal() const
+{
+    // The latest strike of every key, so its earlier strikes can be told apart.
+    TStaticArray<uint32, PianoKeys::NumMidiNotes> LatestStart;
+    TStaticArray<bool, PianoKeys::NumMidiNotes> HasStrike;
+    for (int32 MidiNote = 0; MidiNote < PianoKeys::NumMidiNotes; ++MidiNote)
+    {
+        HasStrike[MidiNote] = false;
+    }
+    for (const FVoice& Voice : Voices)
+    {
+        if (Voice.bActive && !Voice.bStolen && (!HasStrike[Voice.MidiNote] || Voice.StartOrder - LatestStart[Voice.MidiNote] < 0x80000000u))
+        {
+            LatestStart[Voice.MidiNote] = Voice.StartOrder;
+            HasStrike[Voice.MidiNote] = true;
+        }
+    }
+
+    // Lowest weighted level wins. Released notes are on their way out, and notes only a pedal
+    // holds or that a later strike of their key masks matter less than a key still held.
+    const FVoice* Victim = nullptr;
+    float VictimScore = 0.0f;
+    for (const FVoice& Voice : Voices)
+    {
+        if (!Voice.bActive || Voice.bStolen)
+        {
+            continue;
+        }
+        float Score = EstimateLevel(Voice);
+        if (Voice.bReleased)
+        {
+            Score *= 0.25f;
+        }
+        else if (Voice.bSustained && !KeyDown[Voice.MidiNote])
+        {
+            Score *= 0.5f;
+        }
+        if (Voice.StartOrder != LatestStart[Voice.MidiNote])
+        {
+            Score *= 0.5f;
+        }
+        if (!Victim || Score < VictimScore)
+        {
+            Victim = &Voice;
+            VictimScore = Score;
+        }
+    }
+    return const_cast<FVoice*>(Victim);
+}
+
+void FPianoSampler::StealVoice(FVoice& Voice)
+{
+    Voice.bStolen = true;
+    Voice.bReleased = true;
+    Voice.bSustained = false;
+    Voice.FadeRate = FMath::Max(Voice.FadeRate, 1.0f / FMath::Max(1.0f, QuickFadeSeconds * OutputSampleRate));
+    NumStolenVoices.fetch_add(1, std::memory_order_relaxed);
+}
+
+float FPianoSampler::EstimateLevel(const FVoice& Voice) const
+{
+    // A piano note's level falls by 1/e in roughly 12 s at the bottom of the keyboard and 1 s at
+    // the top. Position counts source frames, so Step turns it back into output frames.
+    const float DecaySeconds = 4.0f * FMath::Pow(2.0f, (60 - int32(Voice.MidiNote)) / 24.0f);
+    const float Seconds = float(Voice.Position / Voice.Step) / OutputSampleRate;
+    return Voice.Gain * Voice.Envelope * FMath::Exp(-Seconds / DecaySeconds);
+}
+
+void FPianoSampler::MixVoice(FVoice& Voice, int32 Offset, int32 NumFrames)
+{
+    const FPianoSample& Sample = *Voice.Sample;
+
+    // Frames this voice can still produce before its sample or its fade ends.
+    const double FramesLeftInSample = (Sample.NumFrames - 1 - Voice.Position) / Voice.Step;
+    int32 FramesToMix = FMath::Min(NumFrames, FMath::Max(0, FMath::FloorToInt32(FramesLeftInSample) + 1));
+    if (Voice.FadeRate > 0.0f)
+    {
+        FramesToMix = FMath::Min(FramesToMix, FMath::CeilToInt32(Voice.Envelope / Voice.FadeRate));
+    }
+
+    const float EnvelopeEnd = FMath::Max(0.0f, Voice.Envelope - Voice.FadeRate * FramesToMix);
+    const float GainStart = Voice.Gain * Voice.Envelope;
+    const float GainStep = FramesToMix > 0 ? Voice.Gain * (EnvelopeEnd - Voice.Envelope) / FramesToMix : 0.0f;
+
+    // Source frames are decoded chunk by chunk into the scratch buffers, from the resident head
+    // or from the mapped tail, so the mixing below never touches the file directly.
+    for (int32 Done = 0; Done < FramesToMix;)
+    {
+        const double ChunkPosition = Voice.Position + Voice.Step * Done;
+        const int32 First = int32(ChunkPosition);
+        const float ChunkGain = GainStart + GainStep * Done;
+
+        if (!Voice.Kernel)
+        {
+            // Played at its own rate: a straight copy, vectorised.
+            const int32 Chunk = FMath::Min(FramesToMix - Done, MaxBlockFrames);
+            Sample.Left.CopyFrames(First, Chunk, ScratchLeft.GetData());
+            Sample.Right.CopyFrames(First, Chunk, ScratchRight.GetData());
+            MixWithGainRamp(ScratchLeft.GetData(), MixLeft.GetData() + Offset + Done, Chunk, ChunkGain, GainStep);
+            MixWithGainRamp(ScratchRight.GetData(), MixRight.GetData() + Offset + Done, Chunk, ChunkGain, GainStep);
+            Done += Chunk;
+        }
+        else
+        {
+            // Pitch-shifted or rate-converted: as many output frames as the scratch buffers hold
+            // source frames for, plus the kernel's reach on either side.
+            const int32 Chunk = FMath::Min(FramesToMix - Done, FMath::Max(1, FMath::FloorToInt32((MaxBlockFrames - 1) / Voice.Step)));
+            const int32 SourceFrames = int32(ChunkPosition + Voice.Step * (Chunk - 1)) - First + FPianoResampleKernel::NumTaps;
+            Sample.Left.CopyFrames(First - FPianoResampleKernel::TapsBefore, SourceFrames, ScratchLeft.GetData());
+            Sample.Right.CopyFrames(First - FPianoResampleKernel::TapsBefore, SourceFrames, ScratchRight.GetData());
+            Voice.Kernel->Mix(ScratchLeft.GetData() + FPianoResampleKernel::TapsBefore, ScratchRight.GetData() + FPianoResampleKernel::TapsBefore,
+                ChunkPosition - First, Voice.Step, Chunk, ChunkGain, GainStep, MixLeft.GetData() + Offset + Done, MixRight.GetData() + Offset + Done);
+            Done += Chunk;
+        }
+    }
+
+    Voice.Position += Voice.Step * FramesToMix;
+    Voice.Envelope = EnvelopeEnd;
+    if (FramesToMix < NumFrames || Voice.Envelope <= 0.0f || Voice.Position >= Sample.NumFrames)
+    {
+        Voice.bActive = false;
+        Voice.Sample = nullptr;
+        Voice.Kernel = nullptr;
+    }
+}
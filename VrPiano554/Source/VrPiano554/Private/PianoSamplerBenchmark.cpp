@@ -0,0 +1,316 @@
+// PianoSamplerBenchmark.cpp
+//
+// Headless throughput measurements of the native sampler, for sizing audio buffers and the polyphony cap.
+//   UnrealEditor-Cmd VrPiano554 -game -nullrhi -nosound -unattended -ExecCmds="piano.SamplerRenderMidi File=../midi/song.mid Quit"
+//     renders a MIDI file through FPianoSampler as fast as possible, writes the result to
+//     Saved/Audio/<file>.wav, and reports the realtime factor, per-block cost percentiles and peak voices.
+//     IR=Path adds the convolution reverb with that impulse response, mixed at Wet=Gain.
+//   UnrealEditor-Cmd VrPiano554 -game -nullrhi -nosound -unattended -ExecCmds="piano.SamplerPolyphonyBenchmark Quit"
+//     holds 16 to 512 voices sounding under the sustain pedal and measures the block cost at each count.
+// Both write a JSON report to Saved/Benchmarks/.
+
+#include "VrPiano554.h"
+#include "PianoBenchmark.h"
+#include "PianoMidiFile.h"
+#include "PianoSampler.h"
+#include "PianoWaveFile.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/Paths.h"
+#include "Math/RandomStream.h"
+#include "Dom/JsonObject.h"
+
+#if !UE_BUILD_SHIPPING
+
+namespace
+{
+    // Longest a song's last notes are left to ring out after its final event.
+    constexpr double MaxTailSeconds = 10.0;
+
+    struct FSamplerBenchmarkArgs
+    {
+        FString Directory = FPaths::ConvertRelativePathToFull(FPaths::ProjectDir(), TEXT("../samples"));
+        FPianoSampleBankSettings BankSettings;
+        int32 SampleRate = 48000;
+        int32 BlockFrames = 256;
+        bool bQuit = false;
+
+        void Parse(const FString& Arg)
+        {
+            FParse::Value(*Arg, TEXT("Dir="), Directory);
+            FParse::Value(*Arg, TEXT("Resident="), BankSettings.ResidentMilliseconds);
+            FParse::Bool(*Arg, TEXT("Map="), BankSettings.bMemoryMap);
+            FParse::Value(*Arg, TEXT("Thin="), BankSettings.ThinningStride);
+            FParse::Value(*Arg, TEXT("Rate="), SampleRate);
+            FParse::Value(*Arg, TEXT("Block="), BlockFrames);
+            bQuit |= Arg.Equals(TEXT("Quit"), ESearchCase::IgnoreCase);
+        }
+    };
+
+    using PianoBenchmark::FTimingStats;
+
+    void WriteBlockStats(FJsonObject& Entry, const FTimingStats& Stats, double BudgetUs)
+    {
+        Stats.Write(Entry, TEXT("Block"), TEXT("Us"));
+        Entry.SetNumberField(TEXT("BlockBudgetUs"), BudgetUs);
+    }
+
+    void RunPianoSamplerRenderMidi(const TArray<FString>& Args)
+    {
+        FSamplerBenchmarkArgs Common;
+        FString MidiPath = FPaths::ConvertRelativePathToFull(FPaths::ProjectDir(), TEXT("../midi/song.mid"));
+        FString OutputPath;
+        FString ResponsePath;
+        FPianoConvolutionSettings ReverbSettings;
+        int32 NumVoices = 256;
+        bool bWriteWav = true;
+        for (const FString& Arg : Args)
+        {
+            Common.Parse(Arg);
+            FParse::Value(*Arg, TEXT("File="), MidiPath);
+            FParse::Value(*Arg, TEXT("IR="), ResponsePath);
+            FParse::Value(*Arg, TEXT("Wet="), ReverbSettings.WetGain);
+            FParse::Value(*Arg, TEXT("Out="), OutputPath);
+            FParse::Value(*Arg, TEXT("Voices="), NumVoices);
+            bWriteWav &= !Arg.Equals(TEXT("NoWav"), ESearchCase::IgnoreCase);
+        }
+        if (FPaths::IsRelative(MidiPath))
+        {
+            MidiPath = FPaths::ConvertRelativePathToFull(FPaths::ProjectDir(), MidiPath);
+        }
+        if (OutputPath.IsEmpty())
+        {
+            OutputPath = FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("Audio"), FPaths::GetBaseFilename(MidiPath) + TEXT(".wav"));
+        }
+
+        TArray<FPianoMidiEvent> Events;
+        FString Error;
+        FPianoSampleBankPtr Bank;
+        if (!PianoMidiFile::Load(MidiPath, Events, &Error) || Events.Num() == 0)
+        {
+            UE_LOG(LogVrPiano554, Error, TEXT("piano.SamplerRenderMidi: %s: %s"), *MidiPath, Error.IsEmpty() ? TEXT("no notes") : *Error);
+        }
+        else
+        {
+            Bank = FPianoSampleBank::LoadFromDirectory(Common.Directory, Common.BankSettings);
+            if (!Bank.IsValid())
+            {
+                UE_LOG(LogVrPiano554, Error, TEXT("piano.SamplerRenderMidi: No samples in %s."), *Common.Directory);
+            }
+        }
+        if (!Bank.IsValid())
+        {
+            if (Common.bQuit) FPlatformMisc::RequestExitWithStatus(false, 1);
+            return;
+        }
+
+        const int32 SampleRate = FMath::Max(1, Common.SampleRate);
+        const int32 BlockFrames = FMath::Clamp(Common.BlockFrames, 16, 4096);
+        FPianoSampler Sampler(FMath::Max(1, NumVoices), SampleRate);
+        Sampler.SetBank(Bank);
+
+        // Offline, the audio thread can sum the whole response itself.
+        TArray<TArray<float>> Response;
+        if (!ResponsePath.IsEmpty())
+        {
+            if (FPaths::IsRelative(ResponsePath))
+            {
+                ResponsePath = FPaths::ConvertRelativePathToFull(FPaths::ProjectDir(), ResponsePath);
+            }
+            if (FPianoConvolutionReverb::LoadImpulseResponse(ResponsePath, SampleRate, 0.0f, Response))
+            {
+                ReverbSettings.bUseWorkerThread = false;
+                Sampler.SetReverb(MakeShared<FPianoConvolutionReverb, ESPMode::ThreadSafe>(Response, ReverbSettings));
+            }
+        }
+
+        TArray<float> Output;
+        TArray<float> Block;
+        Block.SetNumUninitialized(BlockFrames * 2);
+        TArray<double> BlockUs;
+
+        // Events are scheduled one block ahead and land on their exact frame. After the last one the
+        // song rings out until every voice has faded, or MaxTailSeconds at most.
+        const double LastEventTime = Events.Last().Time;
+        const int64 MaxFrames = FMath::CeilToInt64((LastEventTime + MaxTailSeconds) * SampleRate);
+        int32 NextEvent = 0;
+        int32 PeakVoices = 0;
+        int64 Frame = 0;
+        const uint64 RenderStart = FPlatformTime::Cycles64();
+        while (Frame < MaxFrames)
+        {
+            const double ScheduleEndTime = double(Frame + 2 * BlockFrames) / SampleRate;
+            for (; NextEvent < Events.Num() && Events[NextEvent].Time < ScheduleEndTime; ++NextEvent)
+            {
+                const FPianoMidiEvent& Event = Events[NextEvent];
+                const uint64 EventFrame = uint64(FMath::RoundToInt64(Event.Time * SampleRate));
+                switch (Event.Type)
+                {
+                case EPianoMidiEventType::NoteOn: Sampler.ScheduleNoteOn(EventFrame, Event.MidiNote, Event.Value); break;
+                case EPianoMidiEventType::NoteOff: Sampler.ScheduleNoteOff(EventFrame, Event.MidiNote); break;
+                case EPianoMidiEventType::Sustain: Sampler.ScheduleSustainPedal(EventFrame, Event.Value >= 64); break;
+                case EPianoMidiEventType::Sostenuto: Sampler.ScheduleSostenutoPedal(EventFrame, Event.Value >= 64); break;
+                }
+            }
+
+            const uint64 BlockStart = FPlatformTime::Cycles64();
+            Sampler.Render(Block.GetData(), BlockFrames);
+            BlockUs.Add(PianoBenchmark::CyclesToUs(FPlatformTime::Cycles64() - BlockStart));
+
+            PeakVoices = FMath::Max(PeakVoices, Sampler.GetNumActiveVoices());
+            if (bWriteWav)
+            {
+                Output.Append(Block);
+            }
+            Frame += BlockFrames;
+            if (NextEvent == Events.Num() && Frame > LastEventTime * SampleRate && Sampler.GetNumActiveVoices() == 0)
+            {
+                break;
+            }
+        }
+        const double RenderSeconds = FPlatformTime::ToSeconds64(FPlatformTime::Cycles64() - RenderStart);
+        const double AudioSeconds = double(Frame) / SampleRate;
+        const int32 NumBlocks = BlockUs.Num();
+        const FTimingStats Stats = FTimingStats::FromSamples(BlockUs);
+        const double BudgetUs = PianoBenchmark::GetBlockBudgetUs(BlockFrames, SampleRate);
+
+        const bool bSaved = bWriteWav && PianoWaveFile::Save(OutputPath, Output, 2, SampleRate);
+        UE_LOG(LogVrPiano554, Display,
+            TEXT("piano.SamplerRenderMidi: %s, %d events: rendered %.1f s in %.2f s (%.0fx realtime); %d-frame blocks mean %.1f us p50 %.1f us p90 %.1f us p99 %.1f us max %.1f us of %.0f us; peak %d voices for a cap of %d, %d stolen%s%s."),
+            *FPaths::GetCleanFilename(MidiPath), Events.Num(), AudioSeconds, RenderSeconds, AudioSeconds / FMath::Max(RenderSeconds, 1e-9),
+            BlockFrames, Stats.Mean, Stats.P50, Stats.P90, Stats.P99, Stats.Max, BudgetUs, PeakVoices, Sampler.GetNumVoices(), Sampler.GetNumStolenVoices(),
+            bSaved ? TEXT(", written to ") : TEXT(""), bSaved ? *OutputPath : TEXT(""));
+
+        TSharedRef<FJsonObject> Report = MakeShared<FJsonObject>();
+        Report->SetStringField(TEXT("File"), MidiPath);
+        Report->SetNumberField(TEXT("Events"), Events.Num());
+        Report->SetNumberField(TEXT("SampleRate"), SampleRate);
+        Report->SetNumberField(TEXT("BlockFrames"), BlockFrames);
+        Report->SetNumberField(TEXT("Blocks"), NumBlocks);
+        Report->SetNumberField(TEXT("AudioSeconds"), AudioSeconds);
+        Report->SetNumberField(TEXT("RenderSeconds"), RenderSeconds);
+        Report->SetNumberField(TEXT("RealtimeFactor"), AudioSeconds / FMath::Max(RenderSeconds, 1e-9));
+        Report->SetNumberField(TEXT("PeakVoices"), PeakVoices);
+        Report->SetNumberField(TEXT("VoiceCap"), Sampler.GetNumVoices());
+        Report->SetNumberField(TEXT("StolenVoices"), Sampler.GetNumStolenVoices());
+        WriteBlockStats(*Report, Stats, BudgetUs);
+        PianoBenchmark::WriteReport(TEXT("PianoSamplerRenderMidi.json"), Report, TEXT("piano.SamplerRenderMidi"));
+
+        if (Common.bQuit)
+        {
+            FPlatformMisc::RequestExitWithStatus(false, !bWriteWav || bSaved ? 0 : 1);
+        }
+    }
+
+    void RunPianoSamplerPolyphonyBenchmark(const TArray<FString>& Args)
+    {
+        FSamplerBenchmarkArgs Common;
+        TArray<int32> VoiceCounts = { 16, 32, 64, 128, 256, 512 };
+        double Seconds = 10.0;
+
+        // Share of a block's wall time the sampler may use and still leave the audio thread room for the rest of the mix.
+        double BudgetFraction = 0.5;
+        for (const FString& Arg : Args)
+        {
+            Common.Parse(Arg);
+            PianoBenchmark::ParseList(Arg, TEXT("Voices="), VoiceCounts);
+            FParse::Value(*Arg, TEXT("Seconds="), Seconds);
+            FParse::Value(*Arg, TEXT("Budget="), BudgetFraction);
+        }
+
+        FPianoSampleBankPtr Bank = FPianoSampleBank::LoadFromDirectory(Common.Directory, Common.BankSettings);
+        if (!Bank.IsValid())
+        {
+            UE_LOG(LogVrPiano554, Error, TEXT("piano.SamplerPolyphonyBenchmark: No samples in %s."), *Common.Directory);
+            if (Common.bQuit) FPlatformMisc::RequestExitWithStatus(false, 1);
+            return;
+        }
+
+        const int32 SampleRate = FMath::Max(1, Common.SampleRate);
+        const int32 BlockFrames = FMath::Clamp(Common.BlockFrames, 16, 4096);
+        const int32 NumBlocks = FMath::Max(1, FMath::CeilToInt32(Seconds * SampleRate / BlockFrames));
+        const double BudgetUs = PianoBenchmark::GetBlockBudgetUs(BlockFrames, SampleRate);
+        TArray<float> Block;
+        Block.SetNumUninitialized(BlockFrames * 2);
+
+        TArray<TSharedPtr<FJsonValue>> Entries;
+        int32 SafeVoices = 0;
+        for (int32 TargetVoices : VoiceCounts)
+        {
+            // The pedal stays down, so re-struck keys layer instead of cutting each other off, and a
+            // fresh note is struck whenever one has faded, keeping TargetVoices sounding.
+            FPianoSampler Sampler(TargetVoices, SampleRate);
+            Sampler.SetBank(Bank);
+            Sampler.SetSustainPedal(true);
+
+            FRandomStream Random(TargetVoices);
+            TArray<double> BlockUs;
+            BlockUs.Reserve(NumBlocks);
+            int64 VoiceBlocks = 0;
+            int32 NextKey = 0;
+            for (int32 BlockIndex = 0; BlockIndex < NumBlocks; ++BlockIndex)
+            {
+                for (int32 Missing = TargetVoices - Sampler.GetNumActiveVoices(); Missing > 0; --Missing)
+                {
+                    Sampler.NoteOn(PianoKeys::LowestPianoNote + NextKey, Random.RandRange(40, 127));
+                    NextKey = (NextKey + 37) % (PianoKeys::HighestPianoNote - PianoKeys::LowestPianoNote + 1);
+                }
+
+                const uint64 BlockStart = FPlatformTime::Cycles64();
+                Sampler.Render(Block.GetData(), BlockFrames);
+                BlockUs.Add(PianoBenchmark::CyclesToUs(FPlatformTime::Cycles64() - BlockStart));
+                VoiceBlocks += Sampler.GetNumActiveVoices();
+            }
+
+            double TotalUs = 0.0;
+            for (double Us : BlockUs) TotalUs += Us;
+            const FTimingStats Stats = FTimingStats::FromSamples(BlockUs);
+            const double MeanVoices = double(VoiceBlocks) / NumBlocks;
+            const double RealtimeFactor = BudgetUs * NumBlocks / FMath::Max(TotalUs, 1e-3);
+            if (Stats.P99 <= BudgetUs * BudgetFraction)
+            {
+                SafeVoices = FMath::Max(SafeVoices, TargetVoices);
+            }
+
+            UE_LOG(LogVrPiano554, Display,
+                TEXT("piano.SamplerPolyphonyBenchmark: %3d voices (%.0f sounding on average): %.0fx realtime, %d-frame blocks mean %.1f us p50 %.1f us p90 %.1f us p99 %.1f us max %.1f us of %.0f us, %.2f us per voice and block"),
+                TargetVoices, MeanVoices, RealtimeFactor, BlockFrames, Stats.Mean, Stats.P50, Stats.P90, Stats.P99, Stats.Max, BudgetUs,
+                Stats.Mean / FMath::Max(MeanVoices, 1.0));
+
+            TSharedRef<FJsonObject> Entry = MakeShared<FJsonObject>();
+            Entry->SetNumberField(TEXT("Voices"), TargetVoices);
+            Entry->SetNumberField(TEXT("MeanSoundingVoices"), MeanVoices);
+            Entry->SetNumberField(TEXT("RealtimeFactor"), RealtimeFactor);
+            WriteBlockStats(*Entry, Stats, BudgetUs);
+            Entries.Add(MakeShared<FJsonValueObject>(Entry));
+        }
+
+        UE_LOG(LogVrPiano554, Display, TEXT("piano.SamplerPolyphonyBenchmark: Up to %d voices keep the 99th percentile block under %.0f%% of its %d-frame budget."),
+            SafeVoices, BudgetFraction * 100.0, BlockFrames);
+
+        TSharedRef<FJsonObject> Report = MakeShared<FJsonObject>();
+        Report->SetNumberField(TEXT("SampleRate"), SampleRate);
+        Report->SetNumberField(TEXT("BlockFrames"), BlockFrames);
+        Report->SetNumberField(TEXT("BudgetFraction"), BudgetFraction);
+        Report->SetNumberField(TEXT("SafeVoices"), SafeVoices);
+        Report->SetArrayField(TEXT("Results"), Entries);
+        PianoBenchmark::WriteReport(TEXT("PianoSamplerPolyphony.json"), Report, TEXT("piano.SamplerPolyphonyBenchmark"));
+
+        if (Common.bQuit)
+        {
+            FPlatformMisc::RequestExitWithStatus(false, 0);
+        }
+    }
+
+    FAutoConsoleCommandWithArgs PianoSamplerRenderMidiCommand(
+        TEXT("piano.SamplerRenderMidi"),
+        TEXT("Renders a MIDI file through the native sampler as fast as possible and reports its cost. Args: File=Path Out=Path NoWav Voices=N IR=Path Wet=Gain Dir=Path Rate=Hz Block=Frames Resident=ms Map=true|false Thin=K Quit"),
+        FConsoleCommandWithArgsDelegate::CreateStatic(&RunPianoSamplerRenderMidi));
+
+    FAutoConsoleCommandWithArgs PianoSamplerPolyphonyBenchmarkCommand(
+        TEXT("piano.SamplerPolyphonyBenchmark"),
+        TEXT("Measures the sampler's block cost with 16 to 512 voices sounding. Args: Voices=N,N,... Seconds=S Budget=Fraction Dir=Path Rate=Hz Block=Frames Resident=ms Map=true|false Thin=K Quit"),
+        FConsoleCommandWithArgsDelegate::CreateStatic(&RunPianoSamplerPolyphonyBenchmark));
+}
+
+#endif // !UE_BUILD_SHIPPING
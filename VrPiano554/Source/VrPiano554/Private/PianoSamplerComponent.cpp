@@ -0,0 +1,168 @@
+#include "PianoSamplerComponent.h"
+#include "VrPiano554.h"
+#include "Async/Async.h"
+#include "Misc/Paths.h"
+
+UPianoSamplerComponent::UPianoSamplerComponent(const FObjectInitializer& ObjectInitializer)
+    : Super(ObjectInitializer)
+{
+    NumChannels = 2;
+    bAutoActivate = false;
+}
+
+void UPianoSamplerComponent::BeginPlay()
+{
+    Super::BeginPlay();
+
+    if (!Sampler.IsValid())
+    {
+        Sampler = MakeShared<FPianoSampler, ESPMode::ThreadSafe>(NumVoices);
+    }
+    Sampler->SetMasterGain(MasterGain);
+}
+
+bool UPianoSamplerComponent::Init(int32& SampleRate)
+{
+    NumChannels = 2;
+    if (!Sampler.IsValid())
+    {
+        Sampler = MakeShared<FPianoSampler, ESPMode::ThreadSafe>(NumVoices);
+    }
+    Sampler->SetOutputSampleRate(SampleRate);
+
+    // Init only runs once the component is started, so a piano that does not use the sampler
+    // never loads the sample set. The response is resampled to the output rate, only known here.
+    LoadBank();
+    LoadReverb(SampleRate);
+    return true;
+}
+
+int32 UPianoSamplerComponent::OnGenerateAudio(float* OutAudio, int32 NumSamples)
+{
+    // Audio render thread.
+    Sampler->Render(OutAudio, NumSamples / 2);
+    return NumSamples;
+}
+
+void UPianoSamplerComponent::NoteOn(int32 MidiNote, int32 Velocity)
+{
+    if (Sampler.IsValid())
+    {
+        Sampler->SetMasterGain(MasterGain);
+        Sampler->NoteOn(MidiNote, Velocity);
+    }
+}
+
+void UPianoSamplerComponent::NoteOff(int32 MidiNote)
+{
+    if (Sampler.IsValid())
+    {
+        Sampler->NoteOff(MidiNote);
+    }
+}
+
+void UPianoSamplerComponent::AllNotesOff()
+{
+    if (Sampler.IsValid())
+    {
+        Sampler->AllNotesOff();
+    }
+}
+
+FString UPianoSamplerComponent::GetSampleDirectoryPath() const
+{
+    return FPaths::IsRelative(SampleDirectory) ? FPaths::ConvertRelativePathToFull(FPaths::ProjectDir(), SampleDirectory) : SampleDirectory;
+}
+
+void UPianoSamplerComponent::LoadBank()
+{
+    if (Sampler->GetBank())
+    {
+        return;
+    }
+
+    FPianoSampleBankSettings BankSettings;
+    BankSettings.ResidentMilliseconds = ResidentAttackMilliseconds;
+    BankSettings.bMemoryMap = bMemoryMapSamples;
+    BankSettings.ThinningStride = SampleThinning;
+
+    // Loading still takes a moment; keep it off the game thread. Notes played before the
+    // bank arrives are dropped by the sampler.
+    Async(EAsyncExecution::ThreadPool, [WeakSampler = TWeakPtr<FPianoSampler, ESPMode::ThreadSafe>(Sampler), Directory = GetSampleDirectoryPath(), BankSettings]()
+    {
+        FPianoSampleBankPtr Bank = FPianoSampleBank::LoadFromDirectory(Directory, BankSettings);
+
+        // SetBank rebuilds the key playback tables that SetOutputSampleRate also rebuilds from
+        // Init; hand the bank over on the game thread so the two never overlap.
+        AsyncTask(ENamedThreads::GameThread, [WeakSampler, Bank]()
+        {
+            if (FPianoSamplerPtr PinnedSampler = WeakSampler.Pin())
+            {
+                PinnedSampler->SetBank(Bank);
+            }
+        });
+    });
+}
+
+void UPianoSamplerComponent::LoadReverb(int32 SampleRate)
+{
+    if (ImpulseResponsePath.IsEmpty() || Sampler->GetReverb())
+    {
+        return;
+    }
+
+    const FString Path = FPaths::IsRelative(ImpulseResponsePath) ? FPaths::ConvertRelativePathToFull(FPaths::ProjectDir(), ImpulseResponsePath) : ImpulseResponsePath;
+    FPianoConvolutionSettings Settings;
+    Settings.PartitionFrames = ReverbPartitionFrames;
+    Settings.HeadPartitions = ReverbHeadPartitions;
+    Settings.WetGain = ReverbWetGain;
+    Settings.DryGain = ReverbDryGain;
+
+    Async(EAsyncExecution::ThreadPool, [WeakSampler = TWeakPtr<FPianoSampler, ESPMode::ThreadSafe>(Sampler), Path, SampleRate, MaxSeconds = ReverbMaxSeconds, Settings]()
+    {
+        TArray<TArray<float>> Response;
+        if (!FPianoConvolutionReverb::LoadImpulseResponse(Path, SampleRate, MaxSeconds, Response))
+        {
+            return;
+        }
+        FPianoConvolutionReverbPtr Reverb = MakeShared<FPianoConvolutionReverb, ESPMode::ThreadSafe>(Response, Settings);
+        if (FPianoSamplerPtr PinnedSampler = WeakSampler.Pin())
+        {
+            PinnedSampler->SetReverb(Reverb);
+        }
+    });
+}
+
+void UPianoSamplerComponent::SetSustainPedal(bool bDown)
+{
+    if (Sampler.IsValid())
+    {
+        Sampler->SetSustainPedal(bDown);
+    }
+}
+
+void UPianoSamplerComponent::SetSostenutoPedal(bool bDown)
+{
+    if (Sampler.IsValid())
+    {
+        Sampler->SetSostenutoPedal(bDown);
+    }
+}
+
+void UPianoSamplerComponent::ScheduleNote(int32 MidiNote, int32 Velocity, double StartSeconds, double EndSeconds)
+{
+    if (Sampler.IsValid())
+    {
+        Sampler->SetMasterGain(MasterGain);
+        Sampler->ScheduleNoteOn(Sampler->PlatformSecondsToFrame(StartSeconds), MidiNote, Velocity);
+        Sampler->ScheduleNoteOff(Sampler->PlatformSecondsToFrame(EndSeconds), MidiNote);
+    }
+}
+
+void UPianoSamplerComponent::ClearScheduled()
+{
+    if (Sampler.IsValid())
+    {
+        Sampler->ClearScheduled();
+    }
+}
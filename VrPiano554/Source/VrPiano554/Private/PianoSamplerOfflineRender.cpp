@@ -0,0 +1,123 @@
+// PianoSamplerOfflineRender.cpp
+//
+// Renders FPianoSampler to a WAV file without an audio device, so the sampler can be checked
+// headless, e.g.
+//   UnrealEditor-Cmd VrPiano554 -game -nullrhi -nosound -unattended -ExecCmds="piano.SamplerRender Quit"
+// The test phrase is a rising arpeggio over the given notes followed by them as a held chord.
+// The default notes include keys the sample set has no recording for (36, 43), so the
+// resampled reconstruction is heard next to recorded notes.
+
+#include "VrPiano554.h"
+#include "PianoSampler.h"
+#include "PianoWaveFile.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/Paths.h"
+
+#if !UE_BUILD_SHIPPING
+
+namespace
+{
+    constexpr int32 OfflineBlockFrames = 256;
+
+    struct FOfflineNoteEvent
+    {
+        double Time;
+        int32 MidiNote;
+        int32 Velocity; // 0 releases the note
+    };
+
+    void RunPianoSamplerRender(const TArray<FString>& Args)
+    {
+        FString Directory = FPaths::ConvertRelativePathToFull(FPaths::ProjectDir(), TEXT("../samples"));
+        FString OutputPath = FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("Audio"), TEXT("PianoSamplerRender.wav"));
+        FString NotesList = TEXT("36,43,48,55,60,64,67,72");
+        int32 SampleRate = 48000;
+        int32 Velocity = 100;
+        FPianoSampleBankSettings BankSettings;
+        bool bQuit = false;
+
+        for (const FString& Arg : Args)
+        {
+            FParse::Value(*Arg, TEXT("Dir="), Directory);
+            FParse::Value(*Arg, TEXT("Out="), OutputPath);
+            FParse::Value(*Arg, TEXT("Notes="), NotesList);
+            FParse::Value(*Arg, TEXT("Rate="), SampleRate);
+            FParse::Value(*Arg, TEXT("Velocity="), Velocity);
+            FParse::Value(*Arg, TEXT("Resident="), BankSettings.ResidentMilliseconds);
+            FParse::Bool(*Arg, TEXT("Map="), BankSettings.bMemoryMap);
+            FParse::Value(*Arg, TEXT("Thin="), BankSettings.ThinningStride);
+            bQuit |= Arg.Equals(TEXT("Quit"), ESearchCase::IgnoreCase);
+        }
+
+        FPianoSampleBankPtr Bank = FPianoSampleBank::LoadFromDirectory(Directory, BankSettings);
+        if (!Bank.IsValid())
+        {
+            UE_LOG(LogVrPiano554, Error, TEXT("piano.SamplerRender: No samples in %s."), *Directory);
+            if (bQuit) FPlatformMisc::RequestExitWithStatus(false, 1);
+            return;
+        }
+
+        TArray<FString> NoteStrings;
+        NotesList.ParseIntoArray(NoteStrings, TEXT(","));
+        TArray<FOfflineNoteEvent> Events;
+        double Time = 0.0;
+        for (const FString& NoteString : NoteStrings)
+        {
+            const int32 MidiNote = FCString::Atoi(*NoteString);
+            Events.Add({ Time, MidiNote, Velocity });
+            Events.Add({ Time + 0.2, MidiNote, 0 });
+            Time += 0.25;
+        }
+        for (const FString& NoteString : NoteStrings)
+        {
+            Events.Add({ Time, FCString::Atoi(*NoteString), Velocity });
+            Events.Add({ Time + 2.0, FCString::Atoi(*NoteString), 0 });
+        }
+        const double Duration = Time + 2.0 + FPianoSampler::ReleaseSeconds + 0.5;
+        Events.StableSort([](const FOfflineNoteEvent& A, const FOfflineNoteEvent& B) { return A.Time < B.Time; });
+
+        FPianoSampler Sampler(64, SampleRate);
+        Sampler.SetBank(Bank);
+
+        const int32 TotalFrames = FMath::CeilToInt32(Duration * SampleRate);
+        TArray<float> Output;
+        Output.SetNumZeroed(TotalFrames * 2);
+
+        // Events are scheduled one block ahead and land on their exact frame.
+        int32 NextEvent = 0;
+        const uint64 RenderStart = FPlatformTime::Cycles64();
+        for (int32 Frame = 0; Frame < TotalFrames; Frame += OfflineBlockFrames)
+        {
+            const double ScheduleEndTime = double(Frame + 2 * OfflineBlockFrames) / SampleRate;
+            for (; NextEvent < Events.Num() && Events[NextEvent].Time < ScheduleEndTime; ++NextEvent)
+            {
+                const FOfflineNoteEvent& Event = Events[NextEvent];
+                const uint64 EventFrame = uint64(FMath::RoundToInt64(Event.Time * SampleRate));
+                Event.Velocity > 0 ? Sampler.ScheduleNoteOn(EventFrame, Event.MidiNote, Event.Velocity) : Sampler.ScheduleNoteOff(EventFrame, Event.MidiNote);
+            }
+            Sampler.Render(Output.GetData() + Frame * 2, FMath::Min(OfflineBlockFrames, TotalFrames - Frame));
+        }
+        const double RenderSeconds = FPlatformTime::ToSeconds64(FPlatformTime::Cycles64() - RenderStart);
+
+        float Peak = 0.0f;
+        for (float Sample : Output) Peak = FMath::Max(Peak, FMath::Abs(Sample));
+
+        const bool bSaved = PianoWaveFile::Save(OutputPath, Output, 2, SampleRate);
+        UE_LOG(LogVrPiano554, Display, TEXT("piano.SamplerRender: %d notes loaded (%d keys resampled) in %.2f s (%.1f MB resident, %.1f MB mapped); rendered %.2f s of audio in %.3f s (%.0fx realtime), peak %.3f, %s %s."),
+            Bank->GetNumSamples(), Bank->GetNumReconstructedNotes(), Bank->GetLoadSeconds(), Bank->GetAllocatedSize() / (1024.0 * 1024.0), Bank->GetMappedSize() / (1024.0 * 1024.0), Duration, RenderSeconds, Duration / FMath::Max(RenderSeconds, 1e-9), Peak,
+            bSaved ? TEXT("written to") : TEXT("could not write"), *OutputPath);
+
+        if (bQuit)
+        {
+            FPlatformMisc::RequestExitWithStatus(false, bSaved && Peak > 0.0f ? 0 : 1);
+        }
+    }
+
+    FAutoConsoleCommandWithArgs PianoSamplerRenderCommand(
+        TEXT("piano.SamplerRender"),
+        TEXT("Renders a test phrase through the native piano sampler to a WAV file. Args: Dir=Path Out=Path Notes=N,N,... Rate=Hz Velocity=V Resident=ms Map=true|false Thin=K Quit"),
+        FConsoleCommandWithArgsDelegate::CreateStatic(&RunPianoSamplerRender));
+}
+
+#endif // !UE_BUILD_SHIPPING
@@ -0,0 +1,314 @@
+// PianoSchedulerBenchmark.cpp
+//
+// Headless benchmark of the falling-block scheduler on synthetic songs. Run it in a -nullrhi game session, e.g.
+//   UnrealEditor-Cmd VrPiano554 -game -nullrhi -unattended -ExecCmds="piano.SchedulerBenchmark Quit"
+// Every song shape is generated at each size and put through the same steps AFallingBlockManager takes:
+// parsing the bridge's JSON, building the FPianoSong, seeking, advancing frame by frame and matching
+// played notes against the per-key block buckets. Results are logged and written to
+// Saved/Benchmarks/PianoSchedulerBenchmark.json so song-size limits can be set from data.
+
+#include "VrPiano554.h"
+#include "FallingBlock.h"
+#include "FallingBlockManager.h"
+#include "PianoBenchmark.h"
+#include "PianoSong.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformMemory.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/Paths.h"
+#include "Math/RandomStream.h"
+#include "Dom/JsonObject.h"
+#include "Serialization/JsonReader.h"
+#include "Serialization/JsonSerializer.h"
+
+#if !UE_BUILD_SHIPPING
+
+namespace
+{
+    // Same frame rate as the stress benchmark; the windows are the manager's own.
+    constexpr double SchedulerFrameDeltaTime = 1.0 / 72.0;
+    constexpr int32 NumSeeks = 1000;
+
+    struct FSongShape
+    {
+        const TCHAR* Name;
+
+        // Appends NumNotes notes. Each track is generated on its own, like tracks of a MIDI file,
+        // so the notes arrive out of onset order and Build has real sorting to do.
+        TFunction<void(int32 NumNotes, FRandomStream& Random, TArray<FPianoSongNote>& OutNotes)> Generate;
+    };
+
+    struct FSchedulerResult
+    {
+        FString Shape;
+        int32 NumNotes = 0;
+        double SongSeconds = 0.0;
+        double IngestMs = 0.0;
+        double BuildMs = 0.0;
+        double SeekMeanUs = 0.0;
+        PianoBenchmark::FTimingStats FrameUs;
+        double MatchMeanUs = 0.0;
+        int64 JsonBytes = 0;
+        int64 SongBytes = 0;
+        int64 UsedPhysicalDelta = 0;
+    };
+
+    FPianoSongNote MakeNote(double Time, int32 MidiNote, float Duration, int32 Track)
+    {
+        FPianoSongNote NoteInfo(float(Time), MidiNote, Duration);
+        NoteInfo.Track = uint8(Track);
+        return NoteInfo;
+    }
+
+    TArray<FSongShape> MakeShapes()
+    {
+        TArray<FSongShape> Shapes;
+
+        // Single notes at 8 per second and hand, random pitch within each hand's half of a 61-key range.
+        Shapes.Add({ TEXT("Uniform"), [](int32 NumNotes, FRandomStream& Random, TArray<FPianoSongNote>& OutNotes)
+        {
+            for (int32 Track = 0; Track < 2; ++Track)
+            {
+                const int32 TrackNotes = Track == 0 ? NumNotes / 2 : NumNotes - NumNotes / 2;
+                for (int32 Index = 0; Index < TrackNotes; ++Index)
+                {
+                    const int32 Note = Track == 0 ? 60 + Random.RandHelper(37) : 36 + Random.RandHelper(24);
+                    OutNotes.Add(MakeNote(Index * 0.125 + Random.FRandRange(0.0f, 0.01f), Note, 0.2f, Track));
+                }
+            }
+        } });
+
+        // Ten-note chords, five per hand, four times per second.
+        Shapes.Add({ TEXT("DenseChords"), [](int32 NumNotes, FRandomStream& Random, TArray<FPianoSongNote>& OutNotes)
+        {
+            for (int32 Track = 0; Track < 2; ++Track)
+            {
+                const int32 TrackNotes = Track == 0 ? NumNotes / 2 : NumNotes - NumNotes / 2;
+                for (int32 Index = 0; Index < TrackNotes; ++Index)
+                {
+                    const int32 Chord = Index / 5;
+                    const int32 Root = Track == 0 ? 60 + (Chord * 7) % 24 : 36 + (Chord * 5) % 19;
+                    OutNotes.Add(MakeNote(Chord * 0.25 + Random.FRandRange(0.0f, 0.02f), Root + (Index % 5) * 2, 0.5f, Track));
+                }
+            }
+        } });
+
+        // Both hands trilling on neighbouring keys at 16 notes per second.
+        Shapes.Add({ TEXT("Trills"), [](int32 NumNotes, FRandomStream& Random, TArray<FPianoSongNote>& OutNotes)
+        {
+            for (int32 Track = 0; Track < 2; ++Track)
+            {
+                const int32 TrackNotes = Track == 0 ? NumNotes / 2 : NumNotes - NumNotes / 2;
+                const int32 Base = Track == 0 ? 72 : 48;
+                for (int32 Index = 0; Index < TrackNotes; ++Index)
+                {
+                    OutNotes.Add(MakeNote(Index / 16.0, Base + (Index & 1) + (Index / 256) % 5, 0.06f, Track));
+                }
+            }
+        } });
+
+        return Shapes;
+    }
+
+    FString MakeSongJson(const TArray<FPianoSongNote>& Notes)
+    {
+        // The same message the bridge sends on port 5008.
+        FString Json;
+        Json.Reserve(Notes.Num() * 80 + 16);
+        Json += TEXT("{\"notes\":[");
+        for (int32 Index = 0; Index < Notes.Num(); ++Index)
+        {
+            const FPianoSongNote& NoteInfo = Notes[Index];
+            Json += FString::Printf(TEXT("%s{\"time\":%.4f,\"midi_note\":%d,\"duration\":%.4f,\"velocity\":%d,\"track\":%d}"),
+                Index > 0 ? TEXT(",") : TEXT(""), NoteInfo.Time, NoteInfo.MidiNote, NoteInfo.Duration, NoteInfo.Velocity, NoteInfo.Track);
+        }
+        Json += TEXT("]}");
+        return Json;
+    }
+
+    using PianoBenchmark::CyclesToUs;
+
+    FSchedulerResult RunSong(const FSongShape& Shape, int32 NumNotes)
+    {
+        const AFallingBlockManager& Manager = *GetDefault<AFallingBlockManager>();
+        const double Lookahead = Manager.LookaheadTime;
+
+        FSchedulerResult Result;
+        Result.Shape = Shape.Name;
+        Result.NumNotes = NumNotes;
+
+        FRandomStream Random(NumNotes);
+        TArray<FPianoSongNote> Generated;
+        Generated.Reserve(NumNotes);
+        Shape.Generate(NumNotes, Random, Generated);
+
+        // Ingest: the receiver thread's JSON parse.
+        const FString Json = MakeSongJson(Generated);
+        Result.JsonBytes = Json.Len();
+        Generated.Empty();
+
+        uint64 StartCycles = FPlatformTime::Cycles64();
+        TArray<FPianoSongNote> Notes;
+        TSharedPtr<FJsonObject> JsonObject;
+        if (FJsonSerializer::Deserialize(TJsonReaderFactory<>::Create(Json), JsonObject) && JsonObject.IsValid())
+        {
+            FPianoSong::ParseNotes(*JsonObject, Notes);
+        }
+        JsonObject.Reset();
+        Result.IngestMs = FPlatformTime::ToMilliseconds64(FPlatformTime::Cycles64() - StartCycles);
+
+        // Build: sorting, hand assignment, time index and chord groups.
+        const int64 UsedPhysicalBefore = int64(FPlatformMemory::GetStats().UsedPhysical);
+        StartCycles = FPlatformTime::Cycles64();
+        const TUniquePtr<FPianoSong> Song = FPianoSong::Build(MoveTemp(Notes), Manager.ChordTolerance);
+        Result.BuildMs = FPlatformTime::ToMilliseconds64(FPlatformTime::Cycles64() - StartCycles);
+        Result.UsedPhysicalDelta = int64(FPlatformMemory::GetStats().UsedPhysical) - UsedPhysicalBefore;
+        Result.SongBytes = int64(Song->GetAllocatedSize());
+
+        const FPianoSongView View = Song->GetView(EPianoHand::Any);
+        if (View.Num() == 0)
+        {
+            return Result;
+        }
+        for (int32 Position = 0; Position < View.Num(); ++Position)
+        {
+            Result.SongSeconds = FMath::Max(Result.SongSeconds, double(View[Position].Time + View[Position].Duration));
+        }
+
+        // Seek: the lookups SetSongTime does at a random time.
+        TArray<int32> SoundingNotes;
+        StartCycles = FPlatformTime::Cycles64();
+        int32 Checksum = 0;
+        for (int32 Seek = 0; Seek < NumSeeks; ++Seek)
+        {
+            const double Time = Random.FRandRange(0.0f, float(Result.SongSeconds));
+            SoundingNotes.Reset();
+            Song->TimeIndex.FindSounding(Time, SoundingNotes);
+            const int32 FirstVisible = View.LowerBound(Time - AFallingBlock::GracePeriod);
+            const int32 NextSpawn = View.LowerBound(Time + Lookahead);
+            const int32 NextHighlight = View.LowerBound(Time);
+            const int32 ChordGroup = View.FindChordGroup(NextHighlight, INDEX_NONE);
+            Checksum += SoundingNotes.Num() + FirstVisible + NextSpawn + ChordGroup;
+        }
+        Result.SeekMeanUs = CyclesToUs(FPlatformTime::Cycles64() - StartCycles) / NumSeeks;
+
+        // Frame advance and note match: the whole song at 72 Hz with a player who hits every note on time.
+        TStaticArray<FKeyBlockBucket, PianoKeys::NumMidiNotes> Buckets;
+        TArray<double> FrameUs;
+        FrameUs.Reserve(int32(Result.SongSeconds / SchedulerFrameDeltaTime) + 2);
+        uint64 MatchCycles = 0;
+        int32 NumMatches = 0;
+        int32 NextSpawnIndex = 0;
+        int32 NextHighlightIndex = 0;
+        int32 NextChordGroup = 0;
+
+        for (double SongTime = 0.0; SongTime <= Result.SongSeconds + SchedulerFrameDeltaTime; SongTime += SchedulerFrameDeltaTime)
+        {
+            const uint64 FrameStart = FPlatformTime::Cycles64();
+
+            while (NextSpawnIndex < View.Num() && SongTime >= View[NextSpawnIndex].Time - Lookahead)
+            {
+                const FPianoSongNote& NoteInfo = View[NextSpawnIndex];
+                FKeyBlockEntry Entry;
+                Entry.TargetTime = NoteInfo.Time;
+                Entry.DespawnTime = AFallingBlock::ComputeDespawnTime(NoteInfo.Time, NoteInfo.Duration);
+                Entry.Slot = NextSpawnIndex;
+
+                FKeyBlockBucket& Bucket = Buckets[NoteInfo.MidiNote];
+                Bucket.DropExpired(SongTime);
+                Bucket.PushBack(Entry);
+                ++NextSpawnIndex;
+            }
+
+            while (NextHighlightIndex < View.Num() && SongTime >= View[NextHighlightIndex].Time)
+            {
+                const int32 MidiNote = View[NextHighlightIndex].MidiNote;
+                ++NextHighlightIndex;
+                NextChordGroup = View.FindChordGroup(NextHighlightIndex, NextChordGroup);
+
+                // The simulated player presses the key right away; this is OnNotePlayed's bucket walk.
+                const uint64 MatchStart = FPlatformTime::Cycles64();
+                Buckets[MidiNote].PopHits(SongTime, [&Checksum](const FKeyBlockEntry&) { ++Checksum; });
+                MatchCycles += FPlatformTime::Cycles64() - MatchStart;
+                ++NumMatches;
+            }
+
+            FrameUs.Add(CyclesToUs(FPlatformTime::Cycles64() - FrameStart));
+        }
+
+        Result.FrameUs = PianoBenchmark::FTimingStats::FromSamples(FrameUs);
+        Checksum += NextChordGroup;
+        Result.MatchMeanUs = CyclesToUs(MatchCycles) / FMath::Max(1, NumMatches);
+
+        // Keeps the optimiser from dropping the seek and match loops.
+        UE_LOG(LogVrPiano554, Verbose, TEXT("piano.SchedulerBenchmark: checksum %d"), Checksum);
+        return Result;
+    }
+
+    void RunPianoSchedulerBenchmark(const TArray<FString>& Args)
+    {
+        TArray<int32> Sizes = { 1000, 10000, 100000, 1000000 };
+        FString ShapeFilter;
+        bool bQuit = false;
+
+        for (const FString& Arg : Args)
+        {
+            PianoBenchmark::ParseList(Arg, TEXT("Sizes="), Sizes);
+            FParse::Value(*Arg, TEXT("Shape="), ShapeFilter);
+            bQuit |= Arg.Equals(TEXT("Quit"), ESearchCase::IgnoreCase);
+        }
+
+        TArray<FSchedulerResult> Results;
+        for (const FSongShape& Shape : MakeShapes())
+        {
+            if (!ShapeFilter.IsEmpty() && !ShapeFilter.Equals(Shape.Name, ESearchCase::IgnoreCase))
+            {
+                continue;
+            }
+            for (int32 NumNotes : Sizes)
+            {
+                const FSchedulerResult& Result = Results.Add_GetRef(RunSong(Shape, NumNotes));
+                UE_LOG(LogVrPiano554, Display,
+                    TEXT("piano.SchedulerBenchmark: %-11s %8d notes (%.0f s): ingest %.1f ms, build %.1f ms, seek %.2f us, frame mean %.2f us p99 %.2f us max %.2f us, match %.3f us, json %.1f MB, song %.1f MB (rss %+.1f MB)"),
+                    *Result.Shape, Result.NumNotes, Result.SongSeconds, Result.IngestMs, Result.BuildMs, Result.SeekMeanUs,
+                    Result.FrameUs.Mean, Result.FrameUs.P99, Result.FrameUs.Max, Result.MatchMeanUs,
+                    Result.JsonBytes / (1024.0 * 1024.0), Result.SongBytes / (1024.0 * 1024.0), Result.UsedPhysicalDelta / (1024.0 * 1024.0));
+            }
+        }
+
+        TArray<TSharedPtr<FJsonValue>> Entries;
+        for (const FSchedulerResult& Result : Results)
+        {
+            TSharedRef<FJsonObject> Entry = MakeShared<FJsonObject>();
+            Entry->SetStringField(TEXT("Shape"), Result.Shape);
+            Entry->SetNumberField(TEXT("Notes"), Result.NumNotes);
+            Entry->SetNumberField(TEXT("SongSeconds"), Result.SongSeconds);
+            Entry->SetNumberField(TEXT("IngestMs"), Result.IngestMs);
+            Entry->SetNumberField(TEXT("BuildMs"), Result.BuildMs);
+            Entry->SetNumberField(TEXT("SeekMeanUs"), Result.SeekMeanUs);
+            Result.FrameUs.Write(*Entry, TEXT("Frame"), TEXT("Us"));
+            Entry->SetNumberField(TEXT("MatchMeanUs"), Result.MatchMeanUs);
+            Entry->SetNumberField(TEXT("JsonBytes"), double(Result.JsonBytes));
+            Entry->SetNumberField(TEXT("SongBytes"), double(Result.SongBytes));
+            Entry->SetNumberField(TEXT("UsedPhysicalDelta"), double(Result.UsedPhysicalDelta));
+            Entries.Add(MakeShared<FJsonValueObject>(Entry));
+        }
+
+        TSharedRef<FJsonObject> Report = MakeShared<FJsonObject>();
+        Report->SetArrayField(TEXT("Results"), Entries);
+
+        PianoBenchmark::WriteReport(TEXT("PianoSchedulerBenchmark.json"), Report, TEXT("piano.SchedulerBenchmark"));
+
+        if (bQuit)
+        {
+            FPlatformMisc::RequestExitWithStatus(false, 0);
+        }
+    }
+
+    FAutoConsoleCommandWithArgs PianoSchedulerBenchmarkCommand(
+        TEXT("piano.SchedulerBenchmark"),
+        TEXT("Benchmarks song ingest, build, seek, frame advance and note matching on synthetic songs. Args: Sizes=N,N,... Shape=Uniform|DenseChords|Trills Quit"),
+        FConsoleCommandWithArgsDelegate::CreateStatic(&RunPianoSchedulerBenchmark));
+}
+
+#endif // !UE_BUILD_SHIPPING
@@ -0,0 +1,254 @@
+#include "PianoSong.h"
+#include "Algo/BinarySearch.h"
+#include "Dom/JsonObject.h"
+
+int32 FPianoSongView::Num() const
+{
+    if (!Song)
+    {
+        return 0;
+    }
+    return bAllNotes ? Song->Notes.Num() : NoteIndices.Num();
+}
+
+const FPianoSongNote& FPianoSongView::operator[](int32 Position) const
+{
+    return Song->Notes[GetNoteIndex(Position)];
+}
+
+int32 FPianoSongView::LowerBound(double Time) const
+{
+    if (!Song)
+    {
+        return 0;
+    }
+    if (bAllNotes)
+    {
+        return Song->TimeIndex.LowerBound(Time);
+    }
+
+    const TArray<FPianoSongNote>& Notes = Song->Notes;
+    return Algo::LowerBoundBy(NoteIndices, float(Time), [&Notes](int32 NoteIndex) { return Notes[NoteIndex].Time; });
+}
+
+const TArray<FChordGroup>& FPianoSongView::GetChordGroups() const
+{
+    static const TArray<FChordGroup> NoChordGroups;
+    return ChordGroups ? *ChordGroups : NoChordGroups;
+}
+
+int32 FPianoSongView::FindChordGroup(int32 Position, int32 Hint) const
+{
+    const TArray<FChordGroup>& Groups = GetChordGroups();
+    int32 Group = Hint;
+    if (!Groups.IsValidIndex(Group) || Groups[Group].StartIndex > Position)
+    {
+        Group = Algo::UpperBoundBy(Groups, Position, &FChordGroup::EndIndex);
+    }
+    while (Group < Groups.Num() && Groups[Group].EndIndex() <= Position)
+    {
+        ++Group;
+    }
+    return Group;
+}
+
+TUniquePtr<FPianoSong> FPianoSong::Build(TArray<FPianoSongNote>&& InNotes, float ChordTolerance)
+{
+    TUniquePtr<FPianoSong> Song = MakeUnique<FPianoSong>();
+    Song->ChordTolerance = ChordTolerance;
+    Song->Notes = MoveTemp(InNotes);
+    Song->Notes.StableSort([](const FPianoSongNote& A, const FPianoSongNote& B) {
+        return A.Time < B.Time;
+    });
+    AssignHands(Song->Notes);
+
+    TArray<float> Onsets;
+    TArray<float> Ends;
+    Onsets.Reserve(Song->Notes.Num());
+    Ends.Reserve(Song->Notes.Num());
+    int32 NumTracks = 0;
+    for (const FPianoSongNote& NoteInfo : Song->Notes)
+    {
+        Onsets.Add(NoteInfo.Time);
+        Ends.Add(NoteInfo.Time + NoteInfo.Duration);
+        NumTracks = FMath::Max(NumTracks, NoteInfo.Track + 1);
+    }
+    Song->TimeIndex.Build(MoveTemp(Onsets), MoveTemp(Ends));
+    Song->TrackViews.SetNum(NumTracks);
+
+    BuildChordGroups(Song->GetView(EPianoHand::Any), ChordTolerance, Song->ChordGroups);
+    return Song;
+}
+
+bool FPianoSong::ParseNotes(const FJsonObject& SongObject, TArray<FPianoSongNote>& OutNotes)
+{
+    const TArray<TSharedPtr<FJsonValue>>* NotesJsonArray;
+    if (!SongObject.TryGetArrayField(TEXT("notes"), NotesJsonArray))
+    {
+        return false;
+    }
+
+    OutNotes.Reserve(OutNotes.Num() + NotesJsonArray->Num());
+    for (const auto& Value : *NotesJsonArray)
+    {
+        const TSharedPtr<FJsonObject>& NoteObject = Value->AsObject();
+        if (NoteObject.IsValid())
+        {
+            FPianoSongNote& NoteInfo = OutNotes.Add_GetRef(FPianoSongNote(
+                NoteObject->GetNumberField(TEXT("time")),
+                NoteObject->GetIntegerField(TEXT("midi_note")),
+                NoteObject->GetNumberField(TEXT("duration"))
+            ));
+
+            // Optional fields; older bridges only send time, note and duration.
+            int32 NumberField = 0;
+            if (NoteObject->TryGetNumberField(TEXT("velocity"), NumberField)) NoteInfo.Velocity = uint8(FMath::Clamp(NumberField, 0, 127));
+            if (NoteObject->TryGetNumberField(TEXT("channel"), NumberField)) NoteInfo.Channel = uint8(FMath::Clamp(NumberField, 0, 15));
+            if (NoteObject->TryGetNumberField(TEXT("track"), NumberField)) NoteInfo.Track = uint8(FMath::Clamp(NumberField, 0, 255));
+
+            FString HandName;
+            if (NoteObject->TryGetStringField(TEXT("hand"), HandName))
+            {
+                NoteInfo.Hand = HandName.Equals(TEXT("left"), ESearchCase::IgnoreCase) ? EPianoHand::Left
+                    : HandName.Equals(TEXT("right"), ESearchCase::IgnoreCase) ? EPianoHand::Right : EPianoHand::Any;
+            }
+        }
+    }
+    return true;
+}
+
+SIZE_T FPianoSong::GetAllocatedSize() const
+{
+    SIZE_T Size = Notes.GetAllocatedSize() + TimeIndex.GetAllocatedSize() + ChordGroups.GetAllocatedSize() + TrackViews.GetAllocatedSize();
+    auto AddView = [&Size](const FIndexedView& View) { Size += View.NoteIndices.GetAllocatedSize() + View.ChordGroups.GetAllocatedSize(); };
+    AddView(LeftHandView);
+    AddView(RightHandView);
+    for (const FIndexedView& View : TrackViews) AddView(View);
+    return Size;
+}
+
+template <typename FilterType>
+void FPianoSong::BuildIndexedView(FIndexedView& View, FilterType&& Filter) const
+{
+    if (View.bBuilt)
+    {
+        return;
+    }
+    View.bBuilt = true;
+    for (int32 NoteIndex = 0; NoteIndex < Notes.Num(); ++NoteIndex)
+    {
+        if (Filter(Notes[NoteIndex]))
+        {
+            View.NoteIndices.Add(NoteIndex);
+        }
+    }
+
+    FPianoSongView Indexed;
+    Indexed.Song = this;
+    Indexed.NoteIndices = View.NoteIndices;
+    BuildChordGroups(Indexed, ChordTolerance, View.ChordGroups);
+}
+
+FPianoSongView FPianoSong::GetView(EPianoHand Hand) const
+{
+    FPianoSongView View;
+    View.Song = this;
+    View.Hand = Hand;
+    if (Hand == EPianoHand::Any)
+    {
+        View.bAllNotes = true;
+        View.ChordGroups = &ChordGroups;
+        return View;
+    }
+
+    FIndexedView& Indexed = Hand == EPianoHand::Left ? LeftHandView : RightHandView;
+    BuildIndexedView(Indexed, [Hand](const FPianoSongNote& Note) { return Note.Hand == Hand; });
+    View.NoteIndices = Indexed.NoteIndices;
+    View.ChordGroups = &Indexed.ChordGroups;
+    return View;
+}
+
+FPianoSongView FPianoSong::GetTrackView(int32 Track) const
+{
+    FPianoSongView View;
+    View.Song = this;
+    View.Track = Track;
+    if (TrackViews.IsValidIndex(Track))
+    {
+        FIndexedView& Indexed = TrackViews[Track];
+        BuildIndexedView(Indexed, [Track](const FPianoSongNote& Note) { return Note.Track == Track; });
+        View.NoteIndices = Indexed.NoteIndices;
+        View.ChordGroups = &Indexed.ChordGroups;
+    }
+    return View;
+}
+
+void FPianoSong::AssignHands(TArray<FPianoSongNote>& Notes)
+{
+    // Piano files usually put the right hand on the higher-pitched track. With a single
+    // track, split at middle C instead.
+    TArray<double, TInlineAllocator<16>> PitchSums;
+    TArray<int32, TInlineAllocator<16>> PitchCounts;
+    for (const FPianoSongNote& NoteInfo : Notes)
+    {
+        if (PitchSums.Num() <= NoteInfo.Track)
+        {
+            PitchSums.SetNumZeroed(NoteInfo.Track + 1);
+            PitchCounts.SetNumZeroed(NoteInfo.Track + 1);
+        }
+        PitchSums[NoteInfo.Track] += NoteInfo.MidiNote;
+        ++PitchCounts[NoteInfo.Track];
+    }
+
+    int32 NumTracks = 0;
+    int32 RightHandTrack = INDEX_NONE;
+    double HighestMeanPitch = -1.0;
+    for (int32 Track = 0; Track < PitchCounts.Num(); ++Track)
+    {
+        if (PitchCounts[Track] > 0)
+        {
+            ++NumTracks;
+            const double MeanPitch = PitchSums[Track] / PitchCounts[Track];
+            if (MeanPitch > HighestMeanPitch)
+            {
+                HighestMeanPitch = MeanPitch;
+                RightHandTrack = Track;
+            }
+        }
+    }
+
+    for (FPianoSongNote& NoteInfo : Notes)
+    {
+        if (NoteInfo.Hand != EPianoHand::Any)
+        {
+            continue;
+        }
+        if (NumTracks > 1)
+        {
+            NoteInfo.Hand = NoteInfo.Track == RightHandTrack ? EPianoHand::Right : EPianoHand::Left;
+        }
+        else
+        {
+            NoteInfo.Hand = NoteInfo.MidiNote >= 60 ? EPianoHand::Right : EPianoHand::Left;
+        }
+    }
+}
+
+void FPianoSong::BuildChordGroups(const FPianoSongView& View, float ChordTolerance, TArray<FChordGroup>& OutGroups)
+{
+    OutGroups.Reset();
+    for (int32 Position = 0; Position < View.Num(); ++Position)
+    {
+        const FPianoSongNote& NoteInfo = View[Position];
+        if (OutGroups.IsEmpty() || NoteInfo.Time - OutGroups.Last().Time > ChordTolerance)
+        {
+            FChordGroup& Group = OutGroups.AddDefaulted_GetRef();
+            Group.StartIndex = Position;
+            Group.Time = NoteInfo.Time;
+        }
+
+        FChordGroup& Group = OutGroups.Last();
+        ++Group.Count;
+        Group.Mask.Add(NoteInfo.MidiNote);
+    }
+}
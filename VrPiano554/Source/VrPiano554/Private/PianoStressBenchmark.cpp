@@ -0,0 +1,330 @@
+// PianoStressBenchmark.cpp
+//
+// Headless polyphony stress benchmark for APianoActor. It runs as the automation test
+// VrPiano.Performance.PianoStress, e.g.
+//   UnrealEditor-Cmd VrPiano554 -nullrhi -unattended -ExecCmds="Automation RunTests VrPiano.Performance.PianoStress; Quit"
+// and as piano.StressTest in a running game, which can also rewrite the baseline. Each workload drives
+// PressKey/ReleaseKey/HighlightKeys and Tick for a fixed number of simulated frames, measures the
+// game-thread cost per frame and compares it with Benchmarks/PianoStressBaseline.json. There is no
+// baseline until one is recorded on the machine that runs the test, e.g.
+//   UnrealEditor VrPiano554 -game -nullrhi -unattended -ExecCmds="piano.StressTest UpdateBaseline Quit"
+// Without one the test only warns.
+
+#include "VrPiano554.h"
+#include "PianoActor.h"
+#include "PianoBenchmark.h"
+#include "Engine/Engine.h"
+#include "Engine/World.h"
+#include "Materials/Material.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Misc/AutomationTest.h"
+#include "Math/RandomStream.h"
+#include "Dom/JsonObject.h"
+#include "Serialization/JsonReader.h"
+#include "Serialization/JsonSerializer.h"
+#include "Serialization/JsonWriter.h"
+
+#if !UE_BUILD_SHIPPING
+
+namespace
+{
+    // Frame rate of the standalone headset the baseline is meant to protect.
+    constexpr float StressFrameDeltaTime = 1.0f / 72.0f;
+
+    using FStressKeyRange = PianoKeys::FKeyboardRange;
+
+    /** What a workload carries from one frame to the next; fresh for every run. */
+    struct FStressRunState
+    {
+        TArray<int32> HeldChord;
+    };
+
+    struct FStressWorkload
+    {
+        const TCHAR* Name;
+        TFunction<void(APianoActor& Piano, const FStressKeyRange& Keys, int32 Frame, FStressRunState& State)> DriveFrame;
+    };
+
+    struct FStressResult
+    {
+        FString Name;
+        PianoBenchmark::FTimingStats FrameMs;
+    };
+
+    TArray<FStressWorkload> MakeWorkloads()
+    {
+        TArray<FStressWorkload> Workloads;
+
+        // Ten-finger chords, re-struck 20 times per second.
+        Workloads.Add({ TEXT("Chords20Hz"), [](APianoActor& Piano, const FStressKeyRange& Keys, int32 Frame, FStressRunState& State)
+        {
+            const int32 FramesPerChord = FMath::Max(1, FMath::RoundToInt(1.0f / (20.0f * StressFrameDeltaTime)));
+            if (Frame % FramesPerChord != 0)
+            {
+                return;
+            }
+
+            for (int32 Note : State.HeldChord) Piano.ReleaseKey(Note);
+            State.HeldChord.Reset();
+
+            FRandomStream Random(Frame);
+            for (int32 Finger = 0; Finger < 10; ++Finger)
+            {
+                const int32 Note = Keys.FirstNote + Random.RandHelper(Keys.NumKeys());
+                State.HeldChord.Add(Note);
+                Piano.PressKey(Note);
+            }
+        } });
+
+        // Full-range glissandi up and down, two keys per frame with a short tail of held keys.
+        Workloads.Add({ TEXT("Glissando"), [](APianoActor& Piano, const FStressKeyRange& Keys, int32 Frame, FStressRunState&)
+        {
+            const int32 Span = Keys.NumKeys() * 2;
+            for (int32 Step = 0; Step < 2; ++Step)
+            {
+                const int32 Position = (Frame * 2 + Step) % Span;
+                const int32 Offset = Position < Keys.NumKeys() ? Position : Span - 1 - Position;
+                Piano.PressKey(Keys.FirstNote + Offset);
+
+                const int32 TailPosition = (Frame * 2 + Step + Span - 6) % Span;
+                const int32 TailOffset = TailPosition < Keys.NumKeys() ? TailPosition : Span - 1 - TailPosition;
+                Piano.ReleaseKey(Keys.FirstNote + TailOffset);
+            }
+        } });
+
+        // Every key held and highlighted for half a second, then released and unhighlighted.
+        Workloads.Add({ TEXT("Clusters"), [](APianoActor& Piano, const FStressKeyRange& Keys, int32 Frame, FStressRunState&)
+        {
+            const int32 FramesPerHalf = FMath::Max(1, FMath::RoundToInt(0.5f / StressFrameDeltaTime));
+            if (Frame % FramesPerHalf != 0)
+            {
+                return;
+            }
+
+            TArray<int32> Cluster;
+            for (int32 Note = Keys.FirstNote; Note <= Keys.LastNote; ++Note) Cluster.Add(Note);
+
+            const bool bPress = (Frame / FramesPerHalf) % 2 == 0;
+            for (int32 Note : Cluster)
+            {
+                bPress ? Piano.PressKey(Note) : Piano.ReleaseKey(Note);
+            }
+            bPress ? Piano.HighlightKeys(Cluster) : Piano.UnhighlightKeys(Cluster);
+        } });
+
+        return Workloads;
+    }
+
+    FString GetBaselinePath()
+    {
+        return FPaths::Combine(FPaths::ProjectDir(), TEXT("Benchmarks"), TEXT("PianoStressBaseline.json"));
+    }
+
+    FStressResult RunWorkload(UWorld& World, APianoActor& Piano, const FStressKeyRange& Keys, const FStressWorkload& Workload, int32 NumFrames)
+    {
+        TArray<double> FrameMs;
+        FrameMs.Reserve(NumFrames);
+
+        FStressRunState State;
+        for (int32 Frame = 0; Frame < NumFrames; ++Frame)
+        {
+            const uint64 StartCycles = FPlatformTime::Cycles64();
+            Workload.DriveFrame(Piano, Keys, Frame, State);
+            static_cast<AActor&>(Piano).Tick(StressFrameDeltaTime);
+            World.SendAllEndOfFrameUpdates();
+            FrameMs.Add(FPlatformTime::ToMilliseconds64(FPlatformTime::Cycles64() - StartCycles));
+        }
+
+        // Let every key settle so the next workload starts from rest.
+        for (int32 Note = Keys.FirstNote; Note <= Keys.LastNote; ++Note) Piano.ReleaseKey(Note);
+        for (int32 Frame = 0; Frame < 120; ++Frame) static_cast<AActor&>(Piano).Tick(StressFrameDeltaTime);
+
+        FStressResult Result;
+        Result.Name = Workload.Name;
+        Result.FrameMs = PianoBenchmark::FTimingStats::FromSamples(FrameMs);
+        return Result;
+    }
+
+    struct FStressSettings
+    {
+        int32 NumFrames = 600;
+        float Tolerance = 0.25f;
+        FString PianoClassPath = TEXT("/Game/BP_FinalePianino.BP_FinalePianino_C");
+        bool bUpdateBaseline = false;
+    };
+
+    /** Runs every workload in World and checks it against the baseline; regressions go to OutErrors, a missing baseline to OutWarnings. */
+    void RunPianoStress(UWorld& World, const FStressSettings& Settings, TArray<FString>& OutErrors, TArray<FString>& OutWarnings)
+    {
+        UClass* PianoClass = LoadClass<APianoActor>(nullptr, *Settings.PianoClassPath);
+        if (!PianoClass)
+        {
+            UE_LOG(LogVrPiano554, Warning, TEXT("PianoStress: Could not load %s, using APianoActor."), *Settings.PianoClassPath);
+            PianoClass = APianoActor::StaticClass();
+        }
+
+        FActorSpawnParameters SpawnParams;
+        SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+        APianoActor* Piano = World.SpawnActor<APianoActor>(PianoClass, FTransform::Identity, SpawnParams);
+        FKeyLayoutSnapshotPtr Layout = Piano ? Piano->GetKeyLayoutSnapshot() : nullptr;
+        if (!Layout.IsValid() || Layout->NumValidKeys == 0)
+        {
+            OutErrors.Add(TEXT("The spawned piano has no playable keys."));
+            if (Piano) Piano->Destroy();
+            return;
+        }
+
+        const FStressKeyRange Keys = Layout->Range;
+
+        if (!Piano->HighlightedKeyMaterial)
+        {
+            Piano->HighlightedKeyMaterial = UMaterial::GetDefaultMaterial(MD_Surface);
+        }
+
+        // The benchmark drives Tick itself so that every simulated frame is measured in one place.
+        Piano->PrimaryActorTick.UnRegisterTickFunction();
+
+        TArray<FStressResult> Results;
+        for (const FStressWorkload& Workload : MakeWorkloads())
+        {
+            Results.Add(RunWorkload(World, *Piano, Keys, Workload, Settings.NumFrames));
+        }
+        Piano->Destroy();
+
+        TSharedPtr<FJsonObject> Baseline;
+        FString BaselineText;
+        if (FFileHelper::LoadFileToString(BaselineText, *GetBaselinePath()))
+        {
+            FJsonSerializer::Deserialize(TJsonReaderFactory<>::Create(BaselineText), Baseline);
+        }
+        const FString Machine = FPlatformMisc::GetCPUBrand().TrimStartAndEnd();
+        FString BaselineMachine;
+        if (Baseline.IsValid() && Baseline->TryGetStringField(TEXT("Machine"), BaselineMachine) && BaselineMachine != Machine && !Settings.bUpdateBaseline)
+        {
+            OutWarnings.Add(FString::Printf(TEXT("The baseline was recorded on %s, not on this %s; expect false regressions."), *BaselineMachine, *Machine));
+        }
+        if (!Baseline.IsValid() && !Settings.bUpdateBaseline)
+        {
+            OutWarnings.Add(FString::Printf(TEXT("No baseline at %s, so nothing was checked; run piano.StressTest UpdateBaseline under -nullrhi to record one."), *GetBaselinePath()));
+        }
+
+        // Timings only compare on the machine that recorded them.
+        TSharedRef<FJsonObject> NewBaseline = MakeShared<FJsonObject>();
+        NewBaseline->SetStringField(TEXT("Machine"), Machine);
+        for (const FStressResult& Result : Results)
+        {
+            const TSharedPtr<FJsonObject>* Stored = nullptr;
+            double BaselineP95Ms = 0.0;
+            const bool bHasBaseline = Baseline.IsValid() && Baseline->TryGetObjectField(Result.Name, Stored) && (*Stored)->TryGetNumberField(TEXT("P95Ms"), BaselineP95Ms);
+            const bool bRegressed = bHasBaseline && Result.FrameMs.P95 > BaselineP95Ms * (1.0 + Settings.Tolerance);
+
+            UE_LOG(LogVrPiano554, Display, TEXT("PianoStress: %-10s mean %.3f ms, p95 %.3f ms, max %.3f ms (baseline p95 %s) %s"),
+                *Result.Name, Result.FrameMs.Mean, Result.FrameMs.P95, Result.FrameMs.Max,
+                bHasBaseline ? *FString::Printf(TEXT("%.3f ms"), BaselineP95Ms) : TEXT("none"),
+                bRegressed ? TEXT("REGRESSED") : TEXT("ok"));
+
+            if (bRegressed)
+            {
+                OutErrors.Add(FString::Printf(TEXT("%s: p95 %.3f ms exceeds the baseline %.3f ms by more than %.0f%%."),
+                    *Result.Name, Result.FrameMs.P95, BaselineP95Ms, Settings.Tolerance * 100.0f));
+            }
+            else if (Baseline.IsValid() && !bHasBaseline && !Settings.bUpdateBaseline)
+            {
+                OutWarnings.Add(FString::Printf(TEXT("%s: missing from the baseline, so it was not checked."), *Result.Name));
+            }
+
+            TSharedRef<FJsonObject> Entry = MakeShared<FJsonObject>();
+            Result.FrameMs.Write(*Entry, TEXT(""), TEXT("Ms"));
+            NewBaseline->SetObjectField(Result.Name, Entry);
+        }
+
+        if (Settings.bUpdateBaseline)
+        {
+            FString Output;
+            FJsonSerializer::Serialize(NewBaseline, TJsonWriterFactory<>::Create(&Output));
+            FFileHelper::SaveStringToFile(Output, *GetBaselinePath());
+            UE_LOG(LogVrPiano554, Display, TEXT("PianoStress: Baseline written to %s."), *GetBaselinePath());
+        }
+    }
+
+    void RunPianoStressCommand(const TArray<FString>& Args, UWorld* World)
+    {
+        FStressSettings Settings;
+        bool bQuit = false;
+        for (const FString& Arg : Args)
+        {
+            FParse::Value(*Arg, TEXT("Frames="), Settings.NumFrames);
+            FParse::Value(*Arg, TEXT("Tolerance="), Settings.Tolerance);
+            FParse::Value(*Arg, TEXT("Class="), Settings.PianoClassPath);
+            Settings.bUpdateBaseline |= Arg.Equals(TEXT("UpdateBaseline"), ESearchCase::IgnoreCase);
+            bQuit |= Arg.Equals(TEXT("Quit"), ESearchCase::IgnoreCase);
+        }
+
+        if (!World)
+        {
+            UE_LOG(LogVrPiano554, Error, TEXT("piano.StressTest: No world to spawn the piano in."));
+            return;
+        }
+
+        TArray<FString> Errors;
+        TArray<FString> Warnings;
+        RunPianoStress(*World, Settings, Errors, Warnings);
+        for (const FString& Warning : Warnings)
+        {
+            UE_LOG(LogVrPiano554, Warning, TEXT("piano.StressTest: %s"), *Warning);
+        }
+        for (const FString& Error : Errors)
+        {
+            UE_LOG(LogVrPiano554, Error, TEXT("piano.StressTest: %s"), *Error);
+        }
+
+        UE_LOG(LogVrPiano554, Display, TEXT("piano.StressTest: %s"), Errors.IsEmpty() ? TEXT("PASSED") : TEXT("FAILED"));
+        if (bQuit)
+        {
+            FPlatformMisc::RequestExitWithStatus(false, Errors.IsEmpty() ? 0 : 1);
+        }
+    }
+
+    FAutoConsoleCommandWithWorldAndArgs PianoStressTestCommand(
+        TEXT("piano.StressTest"),
+        TEXT("Runs the APianoActor polyphony stress workloads and compares them with Benchmarks/PianoStressBaseline.json. Args: Frames=N Tolerance=F Class=Path UpdateBaseline Quit"),
+        FConsoleCommandWithWorldAndArgsDelegate::CreateStatic([](const TArray<FString>& Args, UWorld* World) { RunPianoStressCommand(Args, World); }));
+}
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FPianoStressTest, "VrPiano.Performance.PianoStress",
+    EAutomationTestFlags_ApplicationContextMask | EAutomationTestFlags::PerfFilter)
+
+bool FPianoStressTest::RunTest(const FString& Parameters)
+{
+    // A world of its own, so the test runs the same from the editor, a game or a commandlet.
+    UWorld* World = UWorld::CreateWorld(EWorldType::Game, false, TEXT("PianoStressTest"));
+    FWorldContext& WorldContext = GEngine->CreateNewWorldContext(EWorldType::Game);
+    WorldContext.SetCurrentWorld(World);
+    World->InitializeActorsForPlay(FURL());
+    World->BeginPlay();
+
+    TArray<FString> Errors;
+    TArray<FString> Warnings;
+    RunPianoStress(*World, FStressSettings(), Errors, Warnings);
+    for (const FString& Warning : Warnings)
+    {
+        AddWarning(Warning);
+    }
+    for (const FString& Error : Errors)
+    {
+        AddError(Error);
+    }
+
+    GEngine->DestroyWorldContext(World);
+    World->DestroyWorld(false);
+    return Errors.IsEmpty();
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS
+
+#endif // !UE_BUILD_SHIPPING
@@ -0,0 +1,125 @@
+#include "PianoWaveFile.h"
+#include "Misc/FileHelper.h"
+
+namespace
+{
+    uint32 ReadUInt32(const uint8* Bytes) { return uint32(Bytes[0]) | (uint32(Bytes[1]) << 8) | (uint32(Bytes[2]) << 16) | (uint32(Bytes[3]) << 24); }
+    uint16 ReadUInt16(const uint8* Bytes) { return uint16(Bytes[0]) | (uint16(Bytes[1]) << 8); }
+
+    void WriteUInt32(TArray<uint8>& Out, uint32 Value) { for (int32 Byte = 0; Byte < 4; ++Byte) Out.Add(uint8(Value >> (Byte * 8))); }
+    void WriteUInt16(TArray<uint8>& Out, uint16 Value) { Out.Add(uint8(Value)); Out.Add(uint8(Value >> 8)); }
+    void WriteTag(TArray<uint8>& Out, const char* Tag) { Out.Append(reinterpret_cast<const uint8*>(Tag), 4); }
+
+    constexpr uint16 WaveFormatPcm = 1;
+    constexpr uint16 WaveFormatFloat = 3;
+    constexpr uint16 WaveFormatExtensible = 0xFFFE;
+}
+
+bool PianoWaveFile::ParseHeader(TConstArrayView<uint8> FileBytes, FPianoWaveFormat& OutFormat)
+{
+    const uint8* Bytes = FileBytes.GetData();
+    const int64 Size = FileBytes.Num();
+    if (Size < 12 || FMemory::Memcmp(Bytes, "RIFF", 4) != 0 || FMemory::Memcmp(Bytes + 8, "WAVE", 4) != 0)
+    {
+        return false;
+    }
+
+    bool bHasFormat = false;
+    uint16 FormatTag = 0;
+    int64 Offset = 12;
+    while (Offset + 8 <= Size)
+    {
+        const uint8* Chunk = Bytes + Offset;
+        const int64 ChunkSize = ReadUInt32(Chunk + 4);
+        const int64 ChunkData = Offset + 8;
+
+        if (FMemory::Memcmp(Chunk, "fmt ", 4) == 0 && ChunkSize >= 16 && ChunkData + 16 <= Size)
+        {
+            FormatTag = ReadUInt16(Bytes + ChunkData);
+            OutFormat.NumChannels = ReadUInt16(Bytes + ChunkData + 2);
+            OutFormat.SampleRate = int32(ReadUInt32(Bytes + ChunkData + 4));
+            OutFormat.BitsPerSample = ReadUInt16(Bytes + ChunkData + 14);
+            if (FormatTag == WaveFormatExtensible && ChunkSize >= 26 && ChunkData + 26 <= Size)
+            {
+                // The sub-format GUID starts with the plain format tag.
+                FormatTag = ReadUInt16(Bytes + ChunkData + 24);
+            }
+            bHasFormat = true;
+        }
+        else if (FMemory::Memcmp(Chunk, "data", 4) == 0 && bHasFormat)
+        {
+            const bool bPcm = FormatTag == WaveFormatPcm && (OutFormat.BitsPerSample == 16 || OutFormat.BitsPerSample == 24);
+            const bool bFloat = FormatTag == WaveFormatFloat && OutFormat.BitsPerSample == 32;
+            if ((!bPcm && !bFloat) || OutFormat.NumChannels <= 0 || OutFormat.SampleRate <= 0)
+            {
+                return false;
+            }
+
+            OutFormat.bFloat = bFloat;
+            OutFormat.DataOffset = ChunkData;
+            OutFormat.NumFrames = FMath::Min(ChunkSize, Size - ChunkData) / OutFormat.GetBytesPerFrame();
+            return true;
+        }
+
+        // Chunks are padded to an even size.
+        Offset = ChunkData + ChunkSize + (ChunkSize & 1);
+    }
+    return false;
+}
+
+void PianoWaveFile::DecodeChannel(TConstArrayView<uint8> FileBytes, const FPianoWaveFormat& Format, int32 Channel, int64 FirstFrame, int64 NumFrames, float* OutSamples)
+{
+    const int32 BytesPerSample = Format.BitsPerSample / 8;
+    const int32 Stride = Format.GetBytesPerFrame();
+    const uint8* Source = FileBytes.GetData() + Format.DataOffset + FirstFrame * Stride + Channel * BytesPerSample;
+
+    if (Format.bFloat)
+    {
+        for (int64 Frame = 0; Frame < NumFrames; ++Frame, Source += Stride)
+        {
+            FMemory::Memcpy(&OutSamples[Frame], Source, sizeof(float));
+        }
+    }
+    else if (BytesPerSample == 2)
+    {
+        for (int64 Frame = 0; Frame < NumFrames; ++Frame, Source += Stride)
+        {
+            OutSamples[Frame] = float(int16(ReadUInt16(Source))) * (1.0f / 32768.0f);
+        }
+    }
+    else
+    {
+        for (int64 Frame = 0; Frame < NumFrames; ++Frame, Source += Stride)
+        {
+            const int32 Value = int32((uint32(Source[0]) << 8) | (uint32(Source[1]) << 16) | (uint32(Source[2]) << 24)) >> 8;
+            OutSamples[Frame] = float(Value) * (1.0f / 8388608.0f);
+        }
+    }
+}
+
+bool PianoWaveFile::Save(const FString& Path, TConstArrayView<float> InterleavedSamples, int32 NumChannels, int32 SampleRate)
+{
+    const uint32 DataSize = uint32(InterleavedSamples.Num() * sizeof(int16));
+
+    TArray<uint8> Bytes;
+    Bytes.Reserve(44 + DataSize);
+    WriteTag(Bytes, "RIFF");
+    WriteUInt32(Bytes, 36 + DataSize);
+    WriteTag(Bytes, "WAVE");
+    WriteTag(Bytes, "fmt ");
+    WriteUInt32(Bytes, 16);
+    WriteUInt16(Bytes, WaveFormatPcm);
+    WriteUInt16(Bytes, uint16(NumChannels));
+    WriteUInt32(Bytes, uint32(SampleRate));
+    WriteUInt32(Bytes, uint32(SampleRate * NumChannels * sizeof(int16)));
+    WriteUInt16(Bytes, uint16(NumChannels * sizeof(int16)));
+    WriteUInt16(Bytes, 16);
+    WriteTag(Bytes, "data");
+    WriteUInt32(Bytes, DataSize);
+
+    for (float Sample : InterleavedSamples)
+    {
+        WriteUInt16(Bytes, uint16(int16(FMath::Clamp(FMath::RoundToInt(Sample * 32767.0f), -32768, 32767))));
+    }
+    return FFileHelper::SaveArrayToFile(Bytes, *Path);
+}
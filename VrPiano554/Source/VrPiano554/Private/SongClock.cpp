@@ -0,0 +1,61 @@
+#include "SongClock.h"
+#include "HAL/PlatformTime.h"
+
+FSongClock::FSongClock()
+    : SegmentReferenceTime(0.0)
+    , SegmentSongTime(0.0)
+    , Rate(1.0)
+    , bPaused(false)
+{
+    SegmentReferenceTime = ReadReference();
+}
+
+void FSongClock::SetReferenceClock(FReferenceClock InReferenceClock)
+{
+    const double SongTime = GetSongTime();
+    ReferenceClock = MoveTemp(InReferenceClock);
+    StartSegment(SongTime);
+}
+
+double FSongClock::GetSongTime() const
+{
+    if (bPaused)
+    {
+        return SegmentSongTime;
+    }
+    return SegmentSongTime + (ReadReference() - SegmentReferenceTime) * Rate;
+}
+
+void FSongClock::SetRate(double NewRate)
+{
+    if (NewRate != Rate)
+    {
+        StartSegment(GetSongTime());
+        Rate = NewRate;
+    }
+}
+
+void FSongClock::SetPaused(bool bNewPaused)
+{
+    if (bNewPaused != bPaused)
+    {
+        StartSegment(GetSongTime());
+        bPaused = bNewPaused;
+    }
+}
+
+void FSongClock::Seek(double SongTime)
+{
+    StartSegment(SongTime);
+}
+
+double FSongClock::ReadReference() const
+{
+    return ReferenceClock ? ReferenceClock() : FPlatformTime::Seconds();
+}
+
+void FSongClock::StartSegment(double SongTime)
+{
+    SegmentReferenceTime = ReadReference();
+    SegmentSongTime = SongTime;
+}
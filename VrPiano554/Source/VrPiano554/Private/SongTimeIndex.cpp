@@ -0,0 +1,61 @@
+#include "SongTimeIndex.h"
+#include "Algo/BinarySearch.h"
+
+void FSongTimeIndex::Build(TArray<float>&& InOnsets, TArray<float>&& InEnds)
+{
+    check(InOnsets.Num() == InEnds.Num());
+    Onsets = MoveTemp(InOnsets);
+    Ends = MoveTemp(InEnds);
+
+    NumLeaves = FMath::RoundUpToPowerOfTwo(FMath::Max(1, Onsets.Num()));
+    MaxEnds.Init(TNumericLimits<float>::Lowest(), NumLeaves * 2);
+    for (int32 Index = 0; Index < Ends.Num(); ++Index)
+    {
+        MaxEnds[NumLeaves + Index] = Ends[Index];
+    }
+    for (int32 Node = NumLeaves - 1; Node >= 1; --Node)
+    {
+        MaxEnds[Node] = FMath::Max(MaxEnds[Node * 2], MaxEnds[Node * 2 + 1]);
+    }
+}
+
+void FSongTimeIndex::Reset()
+{
+    Onsets.Reset();
+    Ends.Reset();
+    MaxEnds.Reset();
+    NumLeaves = 0;
+}
+
+int32 FSongTimeIndex::LowerBound(double Time) const
+{
+    return Algo::LowerBound(Onsets, float(Time));
+}
+
+void FSongTimeIndex::FindSounding(double Time, TArray<int32>& OutIndices) const
+{
+    // Only notes that started before Time can be sounding at Time.
+    const int32 QueryEnd = LowerBound(Time);
+    if (QueryEnd > 0)
+    {
+        CollectSounding(1, 0, NumLeaves, QueryEnd, Time, OutIndices);
+    }
+}
+
+void FSongTimeIndex::CollectSounding(int32 Node, int32 NodeBegin, int32 NodeEnd, int32 QueryEnd, double Time, TArray<int32>& OutIndices) const
+{
+    if (NodeBegin >= QueryEnd || MaxEnds[Node] <= Time)
+    {
+        return;
+    }
+
+    if (NodeEnd - NodeBegin == 1)
+    {
+        OutIndices.Add(NodeBegin);
+        return;
+    }
+
+    const int32 Mid = (NodeBegin + NodeEnd) / 2;
+    CollectSounding(Node * 2, NodeBegin, Mid, QueryEnd, Time, OutIndices);
+    CollectSounding(Node * 2 + 1, Mid, NodeEnd, QueryEnd, Time, OutIndices);
+}
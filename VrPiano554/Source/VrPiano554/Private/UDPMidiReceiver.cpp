@@ -2,14 +2,21 @@
 #include "Networking.h"
 #include "Sockets.h"
 #include "SocketSubsystem.h"
+#include "Common/UdpSocketBuilder.h"
+#include "Common/UdpSocketReceiver.h"
 #include "Json.h"
 #include "JsonUtilities.h"
 #include "Kismet/GameplayStatics.h"
+#include "PianoTickScheduling.h"
+#include "PianoLatencyTrace.h"
 
 AUDPMidiReceiver::AUDPMidiReceiver()
 {
+    // Ticks only while received packets are waiting to be processed.
     PrimaryActorTick.bCanEverTick = true;
+    PrimaryActorTick.bStartWithTickEnabled = false;
     ListenSocket = nullptr;
+    UDPReceiver = nullptr;
     PianoActorRef = nullptr;
 }
 
@@ -31,131 +38,177 @@ void AUDPMidiReceiver::BeginPlay()
     }
 
     // Utwórz socket UDP
-    ListenSocket = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->CreateSocket(NAME_DGram, TEXT("MidiReceiverSocket"), false);
+    const int32 ListenPort = 5005;
+    ListenSocket = FUdpSocketBuilder(TEXT("MidiReceiverSocket"))
+        .AsNonBlocking()
+        .BoundToPort(ListenPort);
+
     if (ListenSocket)
     {
-        TSharedRef<FInternetAddr> Addr = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->CreateInternetAddr();
-        Addr->SetAnyAddress();
-        Addr->SetPort(5005);
-
-        if (ListenSocket->Bind(*Addr))
-        {
-            UE_LOG(LogTemp, Log, TEXT("UDP Receiver: Socket bound to port %d."), Addr->GetPort());
-        }
-        else
-        {
-            UE_LOG(LogTemp, Error, TEXT("UDP Receiver: Failed to bind socket to port 55454!"));
-            ListenSocket->Close();
-            ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->DestroySocket(ListenSocket);
-            ListenSocket = nullptr;
-        }
+        UDPReceiver = new FUdpSocketReceiver(ListenSocket, FTimespan::FromMilliseconds(10), TEXT("MidiReceiver"));
+        UDPReceiver->OnDataReceived().BindUObject(this, &AUDPMidiReceiver::OnUDPMessageReceived);
+        UDPReceiver->Start();
+        UE_LOG(LogTemp, Log, TEXT("UDP Receiver: Socket bound to port %d."), ListenPort);
     }
     else
     {
-        UE_LOG(LogTemp, Error, TEXT("UDP Receiver: Failed to create socket!"));
+        UE_LOG(LogTemp, Error, TEXT("UDP Receiver: Failed to bind socket to port %d!"), ListenPort);
+    }
+}
+
+void AUDPMidiReceiver::OnUDPMessageReceived(const FArrayReaderPtr& Data, const FIPv4Endpoint& Endpoint)
+{
+    PendingPackets.Enqueue({ Data, FPlatformTime::Seconds() });
+
+    // Only the first packet after the actor went to sleep needs to schedule a wake-up.
+    if (!bWakePending.exchange(true))
+    {
+        PianoTickScheduling::WakeFromAnyThread(this);
     }
 }
 
 void AUDPMidiReceiver::Tick(float DeltaTime)
 {
     Super::Tick(DeltaTime);
+    PianoTickScheduling::NoteTicked();
 
-    if (!ListenSocket)
+    bWakePending = false;
+
+    FPendingPacket Packet;
+    while (PendingPackets.Dequeue(Packet))
     {
-        return;
+        ProcessPacket(Packet.Data, Packet.ReceiveTime);
     }
 
-    uint32 Size;
-    while (ListenSocket->HasPendingData(Size))
-    {
-        TArray<uint8> ReceivedData;
-        ReceivedData.SetNumUninitialized(FMath::Min(Size, 65507u));
+    PianoTickScheduling::SleepIfIdle(this, !PendingPackets.IsEmpty());
+}
 
-        int32 BytesRead = 0;
-        TSharedRef<FInternetAddr> FromAddress = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->CreateInternetAddr();
-        ListenSocket->RecvFrom(ReceivedData.GetData(), ReceivedData.Num(), BytesRead, *FromAddress);
+void AUDPMidiReceiver::ProcessPacket(const FArrayReaderPtr& Data, double ReceiveTime)
+{
+    if (!Data.IsValid() || Data->Num() == 0)
+    {
+        return;
+    }
 
-        if (BytesRead > 0)
-        {
-            ReceivedData.Add(0);
-            FString JsonString = FString(UTF8_TO_TCHAR(reinterpret_cast<const char *>(ReceivedData.GetData())));
+    TArray<uint8>& ReceivedData = *Data;
+    ReceivedData.Add(0);
+    FString JsonString = FString(UTF8_TO_TCHAR(reinterpret_cast<const char *>(ReceivedData.GetData())));
 
-            TSharedPtr<FJsonObject> JsonObject;
-            TSharedRef<TJsonReader<>> Reader = TJsonReaderFactory<>::Create(JsonString);
+    TSharedPtr<FJsonObject> JsonObject;
+    TSharedRef<TJsonReader<>> Reader = TJsonReaderFactory<>::Create(JsonString);
 
-            if (FJsonSerializer::Deserialize(Reader, JsonObject) && JsonObject.IsValid())
+    if (FJsonSerializer::Deserialize(Reader, JsonObject) && JsonObject.IsValid())
+    {
+        FString TypeString;
+        if (JsonObject->TryGetStringField(TEXT("type"), TypeString))
+        {
+            if (TypeString == TEXT("highlight_on") || TypeString == TEXT("highlight_off"))
             {
-                FString TypeString;
-                if (JsonObject->TryGetStringField(TEXT("type"), TypeString))
+                const TArray<TSharedPtr<FJsonValue>>* NotesJsonArray;
+                if (JsonObject->TryGetArrayField(TEXT("notes"), NotesJsonArray))
                 {
-                    if (TypeString == TEXT("highlight_on") || TypeString == TEXT("highlight_off"))
+                    TArray<int32> Notes;
+                    for (const TSharedPtr<FJsonValue>& Val : *NotesJsonArray)
                     {
-                        const TArray<TSharedPtr<FJsonValue>>* NotesJsonArray;
-                        if (JsonObject->TryGetArrayField(TEXT("notes"), NotesJsonArray))
-                        {
-                            TArray<int32> Notes;
-                            for (const TSharedPtr<FJsonValue>& Val : *NotesJsonArray)
-                            {
-                                Notes.Add(static_cast<int32>(Val->AsNumber()));
-                            }
-
-                            bool bIsHighlightOn = (TypeString == TEXT("highlight_on"));
-
-                            if (PianoActorRef)
-                            {
-                                if (bIsHighlightOn)
-                                {
-                                    PianoActorRef->HighlightKeys(Notes);
-                                }
-                                else
-                                {
-                                    PianoActorRef->UnhighlightKeys(Notes);
-                                }
-                            }
-
-                            if (OnMidiHighlightEvent.IsBound())
-                            {
-                                OnMidiHighlightEvent.Broadcast(Notes, bIsHighlightOn);
-                            }
-                        }
+                        Notes.Add(static_cast<int32>(Val->AsNumber()));
                     }
-                    else
-                    {
-                        int32 noteNumber = -1;
-                        JsonObject->TryGetNumberField(TEXT("note"), noteNumber);
-
-                        double duration = 0.0;
-                        JsonObject->TryGetNumberField(TEXT("duration"), duration);
 
-                        FString source = TEXT("live");
-                        JsonObject->TryGetStringField(TEXT("source"), source);
+                    bool bIsHighlightOn = (TypeString == TEXT("highlight_on"));
 
-                        bool isNoteOn = (TypeString == TEXT("note_on"));
-
-                        if (OnMidiNoteEvent.IsBound())
+                    if (PianoActorRef)
+                    {
+                        if (bIsHighlightOn)
                         {
-                            OnMidiNoteEvent.Broadcast(noteNumber, isNoteOn, static_cast<float>(duration), source);
+                            PianoActorRef->HighlightKeys(Notes);
                         }
-
-                        if (PianoActorRef)
+                        else
                         {
-                            PianoActorRef->HandleMidiEventWithSource(noteNumber, isNoteOn, source);
+                            PianoActorRef->UnhighlightKeys(Notes);
                         }
                     }
+
+                    if (OnMidiHighlightEvent.IsBound())
+                    {
+                        OnMidiHighlightEvent.Broadcast(Notes, bIsHighlightOn);
+                    }
+                }
+            }
+            else if (TypeString == TEXT("control_change"))
+            {
+                int32 controller = -1;
+                int32 value = 0;
+                FString source = TEXT("live");
+                JsonObject->TryGetNumberField(TEXT("control"), controller);
+                JsonObject->TryGetNumberField(TEXT("value"), value);
+                JsonObject->TryGetStringField(TEXT("source"), source);
+
+                if (PianoActorRef)
+                {
+                    PianoActorRef->HandleMidiControlChange(controller, value, source);
                 }
             }
             else
             {
-                UE_LOG(LogTemp, Error, TEXT("UDP Receiver: Failed to parse JSON: %s"), *JsonString);
+                int32 noteNumber = -1;
+                JsonObject->TryGetNumberField(TEXT("note"), noteNumber);
+
+                double duration = 0.0;
+                JsonObject->TryGetNumberField(TEXT("duration"), duration);
+
+                FString source = TEXT("live");
+                JsonObject->TryGetStringField(TEXT("source"), source);
+
+                int32 velocity = 100;
+                JsonObject->TryGetNumberField(TEXT("velocity"), velocity);
+
+                bool isNoteOn = (TypeString == TEXT("note_on"));
+
+                // Live note-ons from the bridge carry a trace id and the bridge's own Unix timestamps.
+                uint32 traceId = 0;
+                if (isNoteOn && PianoLatencyTrace::IsEnabled() && JsonObject->TryGetNumberField(TEXT("trace_id"), traceId))
+                {
+                    double bridgeTime = 0.0;
+                    if (JsonObject->TryGetNumberField(TEXT("t_capture"), bridgeTime))
+                    {
+                        PianoLatencyTrace::Record(traceId, EPianoLatencyStage::Capture, PianoLatencyTrace::UnixToPlatformSeconds(bridgeTime));
+                    }
+                    if (JsonObject->TryGetNumberField(TEXT("t_send"), bridgeTime))
+                    {
+                        PianoLatencyTrace::Record(traceId, EPianoLatencyStage::BridgeSend, PianoLatencyTrace::UnixToPlatformSeconds(bridgeTime));
+                    }
+                    PianoLatencyTrace::Record(traceId, EPianoLatencyStage::SocketReceive, ReceiveTime);
+                    PianoLatencyTrace::Record(traceId, EPianoLatencyStage::Decode, FPlatformTime::Seconds());
+                }
+                PianoLatencyTrace::FEventScope traceScope(traceId);
+
+                if (OnMidiNoteEvent.IsBound())
+                {
+                    OnMidiNoteEvent.Broadcast(noteNumber, isNoteOn, static_cast<float>(duration), source);
+                }
+
+                if (PianoActorRef)
+                {
+                    PianoActorRef->HandleMidiEventWithSource(noteNumber, isNoteOn, source, velocity);
+                }
             }
         }
     }
+    else
+    {
+        UE_LOG(LogTemp, Error, TEXT("UDP Receiver: Failed to parse JSON: %s"), *JsonString);
+    }
 }
 
 void AUDPMidiReceiver::EndPlay(const EEndPlayReason::Type EndPlayReason)
 {
     Super::EndPlay(EndPlayReason);
 
+    if (UDPReceiver)
+    {
+        UDPReceiver->Stop();
+        delete UDPReceiver;
+        UDPReceiver = nullptr;
+    }
     if (ListenSocket)
     {
         ListenSocket->Close();
@@ -163,4 +216,4 @@ void AUDPMidiReceiver::EndPlay(const EEndPlayReason::Type EndPlayReason)
         ListenSocket = nullptr;
         UE_LOG(LogTemp, Warning, TEXT("UDP Receiver: Socket closed."));
     }
-}
\ No newline at end of file
+}
@@ -1,18 +1,22 @@
 #include "VrPiano554.h"
 #include "Modules/ModuleManager.h"
+#include "PianoLatencyTrace.h"
 
 DEFINE_LOG_CATEGORY(LogVrPiano554);
+DEFINE_STAT(STAT_VrPianoTickedActors);
 
 void FVRPIANO554Module::StartupModule()
 {
     // This code will execute after your module is loaded into memory; the exact timing is specified in the .uplugin file per-module
     UE_LOG(LogVrPiano554, Log, TEXT("VrPiano554 module has started."));
+    PianoLatencyTrace::Startup();
 }
 
 void FVRPIANO554Module::ShutdownModule()
 {
     // This function may be called during shutdown to clean up your module.  For modules that support dynamic reloading,
     // we call this function before unloading the module.
+    PianoLatencyTrace::Shutdown();
     UE_LOG(LogVrPiano554, Log, TEXT("VrPiano554 module has shut down."));
 }
 
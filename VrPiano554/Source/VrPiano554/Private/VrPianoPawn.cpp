@@ -5,11 +5,17 @@
 #include "GameFramework/PlayerController.h"
 #include "DrawDebugHelpers.h"
 #include "Engine/World.h"
+#include "Kismet/GameplayStatics.h"
+#include "TimerManager.h"
+#include "PianoActor.h"
+#include "PianoTickScheduling.h"
 
 // Sets default values
 AVrPianoPawn::AVrPianoPawn()
 {
+	// Ticks only while the piano menu is visible; see OnPianoMenuToggled.
 	PrimaryActorTick.bCanEverTick = true;
+	PrimaryActorTick.bStartWithTickEnabled = false;
 
 	// Root for VR tracking
 	VRTrackingCenter = CreateDefaultSubobject<USceneComponent>(TEXT("VRTrackingCenter"));
@@ -59,12 +65,38 @@ void AVrPianoPawn::BeginPlay()
 	{
 		RightController->SetTrackingMotionSource(FName("Right"));
 	}
+
+	BindToPianoMenu();
+}
+
+void AVrPianoPawn::BindToPianoMenu()
+{
+	APianoActor* PianoActor = Cast<APianoActor>(UGameplayStatics::GetActorOfClass(GetWorld(), APianoActor::StaticClass()));
+	if (!PianoActor)
+	{
+		// The piano may be spawned later by APianoManager; try again shortly.
+		GetWorldTimerManager().SetTimer(BindToPianoMenuTimer, this, &AVrPianoPawn::BindToPianoMenu, 1.0f, false);
+		return;
+	}
+
+	PianoActor->OnMenuToggled.AddUniqueDynamic(this, &AVrPianoPawn::OnPianoMenuToggled);
+	OnPianoMenuToggled(PianoActor->MenuWidgetComponent && PianoActor->MenuWidgetComponent->IsVisible());
+}
+
+void AVrPianoPawn::OnPianoMenuToggled(bool bIsMenuVisible)
+{
+	SetActorTickEnabled(bIsMenuVisible);
+	if (!bIsMenuVisible && LaserPointerMesh)
+	{
+		LaserPointerMesh->SetVisibility(false);
+	}
 }
 
 // Called every frame
 void AVrPianoPawn::Tick(float DeltaTime)
 {
 	Super::Tick(DeltaTime);
+	PianoTickScheduling::NoteTicked();
 	UpdateLaserPointer();
 }
 
@@ -5,6 +5,7 @@
 #include "FallingBlock.generated.h"
 
 class AFallingBlockManager; // Forward declaration
+struct FKeyWorldFrame;
 
 UCLASS()
 class VRPIANO554_API AFallingBlock : public AActor
@@ -21,7 +22,13 @@ public:
 	virtual void Tick(float DeltaTime) override;
 
 	// Initializes the block's core properties
-	void Initialize(AFallingBlockManager* InManager, float InTargetTime, float InDuration, float InKeyWidth, int32 InMidiNote);
+	void Initialize(AFallingBlockManager* InManager, double InTargetTime, float InDuration, int32 InMidiNote);
+
+	// World scale of a block for a note of the given duration on a key of the given width.
+	// Shared with the manager's instanced renderer so both modes draw the same blocks.
+	static FVector ComputeBlockScale(float UnitsPerSecond, float InDuration, float InKeyWidth, const FVector& ScaleMultiplier);
+
+	UStaticMeshComponent* GetBlockMesh() const { return BlockMesh; }
 
 	// The MIDI note this block corresponds to
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Falling Block")
@@ -29,13 +36,19 @@ public:
 
 	// The target time of the fall, based on the song's timeline
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Falling Block")
-	float TargetTime;
+	double TargetTime;
 
-	// The location of the key this block is falling towards
-	FVector TargetKeyLocation;
-	
-	// The up vector of the key this block is falling towards
-	FVector TargetKeyUpVector;
+	// How long the note is held after TargetTime
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Falling Block")
+	float Duration;
+
+	// Blocks stay on screen at least this long after their target time, e.g. while waiting in learning mode.
+	static constexpr float GracePeriod = 2.0f;
+
+	// Song time after which a block for a note at InTargetTime lasting InDuration is removed.
+	static double ComputeDespawnTime(double InTargetTime, float InDuration) { return InTargetTime + FMath::Max(InDuration, GracePeriod); }
+
+	double GetDespawnTime() const { return ComputeDespawnTime(TargetTime, Duration); }
 
 private:
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Components", meta = (AllowPrivateAccess = "true"))
@@ -45,6 +58,15 @@ private:
 	UPROPERTY()
 	AFallingBlockManager* Manager;
 
+	// World frame of the key this block is falling towards, owned by the manager and updated when the piano moves
+	const FKeyWorldFrame* TargetKey;
+
+	// Speed and key width the mesh was last scaled for; the scale is recomputed when either changes.
+	float ScaledUnitsPerSecond;
+	float ScaledKeyWidth;
+
+	void UpdateScale();
+
 public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Falling Block", meta = (AllowPrivateAccess = "true"))
 	FVector BlockScaleMultiplier;
@@ -3,38 +3,128 @@
 #include "CoreMinimal.h"
 #include "GameFramework/Actor.h"
 #include "Networking.h"
+#include "PianoKeyLayout.h"
+#include "PianoSong.h"
+#include "SongClock.h"
+#include <atomic>
 #include "FallingBlockManager.generated.h"
 
 class AFallingBlock;
 class FUdpSocketReceiver;
+class UInstancedStaticMeshComponent;
+class UStaticMesh;
 class APianoActor; // Forward declaration
 class AVrPianoPawn; // Forward declaration
 
-// Struct to hold block spawn information (time and MIDI note)
-USTRUCT(BlueprintType)
-struct FBlockSpawnInfo
+UENUM(BlueprintType)
+enum class EFallingBlockRenderMode : uint8
 {
-    GENERATED_BODY()
+    /** One AFallingBlock actor per note, so Blueprint subclasses can customise each block. */
+    Actors,
+    /** Every block is an instance of the manager's BlockInstances component; no actors are spawned. */
+    Instanced
+};
+
+// World-space frame of one key, where its falling blocks land. Rebuilt whenever the piano moves.
+struct FKeyWorldFrame
+{
+    FVector Location = FVector::ZeroVector;
+    FVector UpVector = FVector::UpVector;
+    FQuat Rotation = FQuat::Identity;
+
+    // Key width in world units.
+    float Width = 0.0f;
+
+    bool bValid = false;
+};
+
+// One block of the instanced renderer. The slot index is also its instance index in BlockInstances.
+// Its key frame is looked up by MidiNote every update, so it follows the piano when it moves, and its
+// scale is derived from the current speed and key width, so it follows those too.
+struct FFallingBlockSlot
+{
+    int32 MidiNote = 0;
+    double TargetTime = 0.0;
+    double DespawnTime = 0.0;
+    float Duration = 0.0f;
+    bool bActive = false;
+
+    // Bumped every time the slot is reused, so stale FKeyBlockEntry handles can be told apart.
+    uint32 Serial = 0;
+};
+
+// Handle to one falling block in a FKeyBlockBucket; refers to either an actor or an instanced slot.
+struct FKeyBlockEntry
+{
+    double TargetTime = 0.0;
+    double DespawnTime = 0.0;
+    TWeakObjectPtr<AFallingBlock> Actor;
+    int32 Slot = INDEX_NONE;
+    uint32 Serial = 0;
+};
+
+// Falling blocks of one key, ordered by target time. Entries are pushed at the back as blocks spawn
+// and popped from the front as they are hit or go stale; the storage is reused and compacted lazily.
+struct FKeyBlockBucket
+{
+    // A played note hits a block whose target time is this close to the song time.
+    static constexpr double HitWindow = 0.05;
+
+    TArray<FKeyBlockEntry> Entries;
+    int32 Head = 0;
 
-    UPROPERTY(BlueprintReadWrite, Category = "Falling Block Info")
-    float Time;
+    bool IsEmpty() const { return Head >= Entries.Num(); }
+    const FKeyBlockEntry& Front() const { return Entries[Head]; }
 
-    UPROPERTY(BlueprintReadWrite, Category = "Falling Block Info")
-    int32 MidiNote;
+    void PopFront()
+    {
+        if (++Head >= Entries.Num())
+        {
+            Entries.Reset();
+            Head = 0;
+        }
+    }
 
-    UPROPERTY(BlueprintReadWrite, Category = "Falling Block Info")
-    float Duration;
+    void PushBack(const FKeyBlockEntry& Entry)
+    {
+        if (Head > 16 && Head * 2 > Entries.Num())
+        {
+            Entries.RemoveAt(0, Head, EAllowShrinking::No);
+            Head = 0;
+        }
+        Entries.Add(Entry);
+    }
 
-    // Default constructor
-    FBlockSpawnInfo() : Time(0.0f), MidiNote(0), Duration(0.0f) {}
+    void Reset()
+    {
+        Entries.Reset();
+        Head = 0;
+    }
 
-    // Constructor with parameters
-    FBlockSpawnInfo(float InTime, int32 InMidiNote, float InDuration) : Time(InTime), MidiNote(InMidiNote), Duration(InDuration) {}
+    /** Drops blocks that have already left the screen at SongTime. */
+    void DropExpired(double SongTime)
+    {
+        while (!IsEmpty() && Front().DespawnTime < SongTime)
+        {
+            PopFront();
+        }
+    }
 
-    // Comparison operator for sorting
-    bool operator<(const FBlockSpawnInfo& Other) const
+    /**
+     * Pops every block up to the end of the hit window around SongTime and calls OnHit for those inside
+     * it; only the front of a bucket can be hit, so anything before the window is stale.
+     */
+    template <typename FunctionType>
+    void PopHits(double SongTime, FunctionType&& OnHit)
     {
-        return Time < Other.Time;
+        while (!IsEmpty() && Front().TargetTime <= SongTime + HitWindow)
+        {
+            if (Front().TargetTime >= SongTime - HitWindow)
+            {
+                OnHit(Front());
+            }
+            PopFront();
+        }
     }
 };
 
@@ -55,14 +145,42 @@ public:
     virtual void Tick(float DeltaTime) override;
 
     UFUNCTION(BlueprintCallable, Category = "Falling Blocks")
-    float GetCurrentSongTime() const { return CurrentSongTime; }
+    double GetCurrentSongTime() const { return CurrentSongTime; }
+
+    // The entry lives as long as the manager, so blocks may keep a pointer to it.
+    const FKeyWorldFrame& GetKeyWorldFrame(int32 MidiNote) const { return KeyWorldFrames[MidiNote]; }
+
+    UFUNCTION(BlueprintCallable, Category = "Falling Blocks")
+    void SetSongTime(double Time);
+
+    /** Playback speed of the song, as set by the bridge's speed factor. */
+    UFUNCTION(BlueprintCallable, Category = "Falling Blocks")
+    float GetPlaybackRate() const { return float(SongClock.GetRate()); }
+
+    /** Hand to practise; notes of the other hand get no blocks, highlights or key presses. */
+    UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Falling Blocks")
+    EPianoHand PracticeHand = EPianoHand::Any;
 
     UFUNCTION(BlueprintCallable, Category = "Falling Blocks")
-    void SetSongTime(float Time);
+    void SetPracticeHand(EPianoHand NewPracticeHand);
+
+    /** Drive the song clock from the audio device clock instead of the platform clock, so blocks follow the audio. */
+    UPROPERTY(EditAnywhere, Category = "Falling Blocks")
+    bool bUseAudioClock = false;
 
     UPROPERTY(EditAnywhere, Category = "Falling Blocks")
     TSubclassOf<AFallingBlock> BlockClass;
 
+    UPROPERTY(EditAnywhere, Category = "Falling Blocks")
+    EFallingBlockRenderMode RenderMode = EFallingBlockRenderMode::Actors;
+
+    /** Mesh drawn for each block in Instanced mode. When unset, the mesh of BlockClass is used. */
+    UPROPERTY(EditAnywhere, Category = "Falling Blocks", meta = (EditCondition = "RenderMode == EFallingBlockRenderMode::Instanced"))
+    UStaticMesh* InstancedBlockMesh;
+
+    UPROPERTY(VisibleAnywhere, Category = "Falling Blocks")
+    UInstancedStaticMeshComponent* BlockInstances;
+
     UPROPERTY(EditAnywhere, Category = "Falling Blocks")
     float StartHeight = 200.f;
 
@@ -70,6 +188,22 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Falling Blocks", meta = (DisplayName = "Lookahead Time"))
 	float LookaheadTime = 3.0f;
 
+	/** Blocks may be spawned, hidden, up to this many seconds before they become visible, to spread spawning across frames. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Falling Blocks", meta = (ClampMin = "0.0", UIMin = "0.0"))
+	float PrespawnTime = 2.0f;
+
+	/** Time per frame spent spawning blocks ahead of need. Blocks that are due to become visible are spawned regardless. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Falling Blocks", meta = (ClampMin = "0.0", UIMin = "0.0", Units = "us"))
+	float SpawnBudgetMicroseconds = 500.0f;
+
+	/**
+	 * When the piano sounds the song on its native sampler, notes are handed to the audio thread this many
+	 * seconds before they play, so each lands on its exact sample whatever the frame rate. Must cover the
+	 * longest frame plus a few audio blocks.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Falling Blocks|Audio", meta = (ClampMin = "0.02", UIMin = "0.02", Units = "s"))
+	float AudioScheduleAhead = 0.2f;
+
     UPROPERTY(EditAnywhere, Category = "Falling Blocks")
     float TargetZHeight = 50.f;
 
@@ -77,6 +211,10 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Falling Blocks", meta = (ClampMin = "1.0", UIMin = "1.0"))
 	float UnitsPerSecond = 100.0f;
 
+	/** Notes starting within this many seconds of each other are one chord in learning mode. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Falling Blocks", meta = (ClampMin = "0.0", UIMin = "0.0"))
+	float ChordTolerance = 0.03f;
+
     /** Port UDP do nasłuchiwania (np. 5005) */
     UPROPERTY(EditAnywhere, Category = "Networking")
     int32 ListenPort = 5008; // Changed port to 5008 to avoid conflict
@@ -86,16 +224,52 @@ public:
 private:
     int32 NextSpawnIndex;
     int32 NextHighlightIndex;
-    float CurrentSongTime;
+
+    // Next note of SongView to hand to the sampler, or INDEX_NONE when nothing is scheduled.
+    int32 NextAudioIndex;
+
+    // Song time of the current frame, sampled from SongClock at the start of Tick.
+    double CurrentSongTime;
+    FSongClock SongClock;
+
+    // Speed factor received from the bridge, applied to SongClock on the next Tick; negative when none is pending.
+    std::atomic<float> PendingPlaybackRate;
 
     // UDP
     FSocket* ListenSocket;
     FUdpSocketReceiver* UDPReceiver;
 
-    FCriticalSection ArrivalTimesMutex;
-    TArray<FBlockSpawnInfo> ArrivalTimes;
+    // The song being played; only the game thread touches it. Never null.
+    TUniquePtr<FPianoSong> Song;
+
+    // The part of Song that is played, as selected by PracticeHand. All note indices of the
+    // scheduler (NextSpawnIndex, NextHighlightIndex, chord groups) are positions in this view.
+    FPianoSongView SongView;
+
+    // Song built by the UDP receiver thread and not yet picked up by Tick.
+    std::atomic<FPianoSong*> PendingSong;
+
+    // Set by /start_song on the UDP receiver thread; Tick restarts the current song.
+    std::atomic<bool> bRestartRequested;
+
+    // The chord group containing NextHighlightIndex.
+    int32 NextChordGroup;
+
+    // Chord group whose keys are highlighted and awaited in learning mode, or INDEX_NONE.
+    int32 WaitingChordGroup;
+
     TArray<AFallingBlock*> ActiveBlocks;
 
+    // Instanced renderer: slots are recycled through FreeBlockSlots and never removed,
+    // so BlockInstanceTransforms can be pushed to BlockInstances in a single batch.
+    TArray<FFallingBlockSlot> BlockSlots;
+    TArray<int32> FreeBlockSlots;
+    TArray<FTransform> BlockInstanceTransforms;
+    FVector InstancedBlockScaleMultiplier;
+
+    // Active blocks of both render modes, indexed by MIDI note, for matching played notes.
+    TStaticArray<FKeyBlockBucket, PianoKeys::NumMidiNotes> KeyBlockBuckets;
+
     void StartUDPListener();
 
 
@@ -103,8 +277,36 @@ private:
     AVrPianoPawn* VrPianoPawnRef;
 
     void PopulateKeyData();
-    void SetMidiData(const TArray<FBlockSpawnInfo>& NewArrivalTimes);
-	void SpawnBlockForNote(const FBlockSpawnInfo& NoteInfo);
+    // Hands a freshly built song to the game thread, replacing one that was not picked up yet.
+    void PublishSong(TUniquePtr<FPianoSong> NewSong);
+
+    // Picks up a published song or restart request at the start of Tick.
+    void ConsumePendingSong();
+
+    // Rewinds the current song to the start and clears all blocks and keys.
+    void RestartSong();
+	void SpawnBlockForNote(const FPianoSongNote& NoteInfo);
+
+    bool CanSpawnBlocks() const;
+
+    // Spawns due blocks and, within SpawnBudgetMicroseconds, blocks of the prespawn window.
+    void SpawnPendingBlocks();
+
+    // Schedules the notes starting within AudioScheduleAhead on the piano's sampler.
+    void ScheduleSongAudio();
+
+    // Drops the sampler's schedule and silences the notes it started, e.g. on a seek or pause.
+    void ResetSongAudio();
+
+    void SetupBlockInstances();
+    void UpdateBlockInstances();
+    void ReleaseBlockSlot(int32 SlotIndex);
+
+    void AddToKeyBucket(int32 MidiNote, const FKeyBlockEntry& Entry);
+    bool IsBlockAlive(const FKeyBlockEntry& Entry) const;
+
+    // Removes every falling block in both render modes.
+    void ClearBlocks();
 
 
     UFUNCTION()
@@ -121,11 +323,22 @@ private:
     UFUNCTION()
     void OnLearningModeChanged(bool bNewState);
 
-    TMap<int32, FTransform> KeyRelativeTransforms;
-    TMap<int32, float> KeyWidths;
+    // Key layout published by the piano; only re-read when its version changes.
+    FKeyLayoutSnapshotPtr KeyLayout;
+
+    // KeyLayout placed at the piano's current transform. Falling blocks read their key's entry
+    // every frame, so rebuilding the table re-targets every block in flight.
+    TStaticArray<FKeyWorldFrame, PianoKeys::NumMidiNotes> KeyWorldFrames;
+    FDelegateHandle PianoTransformUpdatedHandle;
+
+    void RebuildKeyWorldFrames();
+    void OnPianoTransformUpdated(USceneComponent* UpdatedComponent, EUpdateTransformFlags UpdateTransformFlags, ETeleportType Teleport);
+
+    // MIDI notes of WaitingChordGroup the player still has to press in learning mode
+    FNoteMask128 WaitingNotes;
 
-    // Set of MIDI notes that are currently waiting for the player to press in learning mode
-    TSet<int32> WaitingNotes;
+    void SyncNextChordGroup();
+    void ClearWaitingNotes();
 
     bool bIsCurrentlyPaused;
     bool bHasPopulatedKeyData;
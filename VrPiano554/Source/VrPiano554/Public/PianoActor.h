@@ -9,9 +9,13 @@
 #include "MotionControllerComponent.h"
 #include "Components/WidgetInteractionComponent.h"
 #include "PianoSaveGame.h"
+#include "PianoKeyLayout.h"
+#include "PianoMidiInput.h"
+#include <atomic>
 #include "PianoActor.generated.h"
 
 class UWidgetComponent;
+class UPianoSamplerComponent;
 class FSocket; // Forward declaration for FSocket
 
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnMenuToggled, bool, bIsMenuVisible);
@@ -58,7 +62,24 @@ public:
     void HandleMidiNote(int32 Note, bool bIsNoteOn);
     
     UFUNCTION(BlueprintCallable, Category = "MIDI")
-    void HandleMidiEventWithSource(int32 Note, bool bIsNoteOn, const FString& Source);
+    void HandleMidiEventWithSource(int32 Note, bool bIsNoteOn, const FString& Source, int32 Velocity = 100);
+
+    /** Control changes 64 (sustain) and 66 (sostenuto) work the pedals; others are ignored. */
+    UFUNCTION(BlueprintCallable, Category = "MIDI")
+    void HandleMidiControlChange(int32 Controller, int32 Value, const FString& Source);
+
+    UFUNCTION(BlueprintCallable, Category = "Piano|Pedals")
+    void SetSustainPedal(bool bDown);
+
+    UFUNCTION(BlueprintCallable, Category = "Piano|Pedals")
+    void SetSostenutoPedal(bool bDown);
+
+    UFUNCTION(BlueprintPure, Category = "Piano|Pedals")
+    bool IsSustainPedalDown() const { return bSustainPedalDown; }
+
+    /** Whether the key's string is free to ring: the key is held, or a pedal holds its damper off. */
+    UFUNCTION(BlueprintPure, Category = "Piano|Pedals")
+    bool IsDamperRaised(int32 MidiNote) const;
 
     UFUNCTION(BlueprintCallable, Category = "Piano|MIDI")
     void PrevMidi();
@@ -69,8 +90,11 @@ public:
     void SetLeftCalibrationPoint();
     void SetRightCalibrationPoint();
     void ApplyCalibration();
-    void PressKey(int32 MidiNote);
-    void ReleaseKey(int32 MidiNote);
+    // A non-zero velocity also sounds the note on the native sampler, when it is enabled.
+    void PressKey(int32 MidiNote, int32 Velocity = 0);
+
+    // bStopSound = false only moves the key, for keys whose note-off is scheduled on the sampler or never sounded.
+    void ReleaseKey(int32 MidiNote, bool bStopSound = true);
 
     // Functions to handle highlighting keys
     void HighlightKeys(const TArray<int32>& NotesToHighlight);
@@ -141,12 +165,31 @@ public:
     UFUNCTION(BlueprintCallable, Category = "Piano|Keys")
     bool GetKeyTransformAndWidth(int32 MidiNote, FTransform& OutTransform, float& OutWidth);
 
+    /** The current key layout; hold on to it and compare Version to detect changes. */
+    FKeyLayoutSnapshotPtr GetKeyLayoutSnapshot() const { return KeyLayoutSnapshot; }
+
+    /** Presses a key and releases it after Duration seconds; animation only, the sound comes from the bridge or the sampler's schedule. */
     UFUNCTION(BlueprintCallable, Category = "Piano|Keys")
     void PlayNote(int32 MidiNote, float Duration);
 
+    /** Whether song notes are sounded by scheduling them on the native sampler ahead of time. */
+    bool IsSchedulingSongAudio() const { return bUseNativeSampler && bScheduleSongAudio && Sampler; }
+
+    UPianoSamplerComponent* GetSampler() const { return Sampler; }
+
+    /** Releases every key held by PlayNote right away, e.g. before jumping to another point in the song. */
+    UFUNCTION(BlueprintCallable, Category = "Piano|Keys")
+    void ReleaseAllKeys();
+
     UFUNCTION(BlueprintCallable, Category = "Piano")
     void BroadcastKeysInitialized();
 
+#if WITH_EDITOR
+    /** Measures the key meshes and stores the result in KeyLayout, so BeginPlay does not have to. */
+    UFUNCTION(CallInEditor, Category = "Piano Setup")
+    void BakeKeyLayout();
+#endif
+
 protected:
     virtual void BeginPlay() override;
     virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override; // Added for socket cleanup
@@ -162,6 +205,20 @@ public:
     UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Piano Setup|Materials")
     UMaterialInterface* HighlightedKeyMaterial;
 
+    /** Baked key layout for this piano's mesh set. When unset, the layout is measured from the key meshes at BeginPlay. */
+    UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Piano Setup")
+    UPianoKeyLayout* KeyLayout;
+
+    /**
+     * Keys this piano model has. Key components outside the range are hidden and never played. Keys
+     * in it without a mesh are placed in line with the measured keys around them for the falling
+     * blocks; they sound and count as played, but there is no visible key to press.
+     */
+    UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Piano Setup")
+    EPianoKeyboardRange KeyboardRange;
+
+    PianoKeys::FKeyboardRange GetKeyboardRange() const { return PianoKeys::GetKeyboardRange(KeyboardRange); }
+
     //~ Begin Menu Properties
     UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Piano|Menu")
     UWidgetComponent* MenuWidgetComponent;
@@ -255,7 +312,41 @@ private:
     UPROPERTY(VisibleAnywhere, BlueprintReadOnly, meta = (AllowPrivateAccess = "true"))
     TMap<int32, UStaticMeshComponent*> KeyMeshComponents;
 
+    UPROPERTY(VisibleAnywhere)
+    TMap<int32, USceneComponent*> KeyPivotComponents;
+
+    UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Piano|Audio", meta = (AllowPrivateAccess = "true"))
+    UPianoSamplerComponent* Sampler;
+
 public:
+    /**
+     * Sound live and file notes with the in-engine sampler. Off for main.py, which plays every note
+     * through pygame; turn it on when running PianoBridge, which plays no audio (see its README).
+     */
+    UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Piano|Audio")
+    bool bUseNativeSampler = false;
+
+    /**
+     * With the native sampler, sound the song from the engine's own timeline: the falling block manager
+     * schedules each note on the audio thread ahead of time, and the bridge's file events only move keys.
+     */
+    UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Piano|Audio", meta = (EditCondition = "bUseNativeSampler"))
+    bool bScheduleSongAudio = true;
+
+    /**
+     * Read the keyboard in the engine instead of through the bridge, so live notes skip the Python
+     * process and its UDP hop. Start the bridge with --no-live-midi so notes do not arrive twice.
+     */
+    UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "MIDI")
+    bool bUseNativeMidiInput = false;
+
+    /**
+     * A device name substring such as "Arturia", an ALSA address such as "alsa:24:0", or "fifo:/tmp/vrpiano-midi"
+     * for a named pipe of raw MIDI bytes. Empty takes the first hardware input.
+     */
+    UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "MIDI", meta = (EditCondition = "bUseNativeMidiInput"))
+    FString NativeMidiInputDevice = TEXT("Arturia");
+
     UPROPERTY(EditAnywhere, Category = "Piano Setup")
     float PianoModelWidth = 122.0f;
 
@@ -269,17 +360,40 @@ private:
     void LoadMidiFile();
     void SetupControllers();
     void ToggleMenu();
+    void MeasureKeyLayout(TArray<FPianoKeyLayoutEntry>& OutKeys) const;
+
+    // Adds an entry for every key in KeyboardRange that Keys lacks, placed from the measured keys around it.
+    void AddMissingKeys(TArray<FPianoKeyLayoutEntry>& Keys) const;
+
+    void ApplyKeyLayout(const TArray<FPianoKeyLayoutEntry>& Keys);
+    void DispatchNativeMidiEvents();
 
     ECalibrationState CalibrationState;
     FTransform LeftCalibrationTransform;
     FTransform RightCalibrationTransform;
-    TMap<int32, USceneComponent*> KeyPivotMap;
+    // Pivots of the keys that are ready to animate, null for keys without a mesh, indexed by MIDI note
+    TArray<USceneComponent*> KeyPivots;
+    // Layout of every key in KeyboardRange, indexed by MIDI note; MidiNote stays 0 for keys outside it
+    TArray<FPianoKeyLayoutEntry> AppliedKeyLayout;
+    FKeyLayoutSnapshotPtr KeyLayoutSnapshot;
     TMap<int32, float> ActiveKeyAnimations;
+    // Latency trace ids of pressed keys that have not moved yet.
+    TMap<int32, uint32> KeyTraceIds;
 
     // Map to store original materials of highlighted keys
     TMap<int32, UMaterialInterface*> OriginalKeyMaterials;
     TMap<int32, FTimerHandle> KeyHighlightTimers;
+    TMap<int32, FTimerHandle> KeyReleaseTimers;
+
+    // Keys held down and keys caught by the sostenuto pedal, indexed by MIDI note.
+    TBitArray<> HeldKeys;
+    TBitArray<> SostenutoKeys;
+    bool bSustainPedalDown = false;
+    bool bSostenutoPedalDown = false;
 
+    // Filled by the MIDI input's reader thread, which wakes the actor once per batch of events.
+    TUniquePtr<FPianoMidiInput> MidiInput;
+    std::atomic<bool> bMidiWakePending { false };
 
     // Offset calculated at runtime to center the piano model
     FVector CalculatedOffset;
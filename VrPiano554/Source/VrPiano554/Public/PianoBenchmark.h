@@ -0,0 +1,44 @@
+// PianoBenchmark.h
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class FJsonObject;
+
+#if !UE_BUILD_SHIPPING
+
+/** Shared by the piano.*Benchmark console commands and the stress test. */
+namespace PianoBenchmark
+{
+    /** Mean and percentiles of a set of timings, in the unit they were taken in. */
+    struct FTimingStats
+    {
+        double Mean = 0.0;
+        double P50 = 0.0;
+        double P90 = 0.0;
+        double P95 = 0.0;
+        double P99 = 0.0;
+        double Max = 0.0;
+
+        /** Sorts Samples in place. All zero if there are none. */
+        static FTimingStats FromSamples(TArray<double>& Samples);
+
+        /** Sets <Prefix>Mean<Unit>, <Prefix>P50<Unit> and so on, e.g. BlockP99Us. */
+        void Write(FJsonObject& Entry, const TCHAR* Prefix, const TCHAR* Unit) const;
+    };
+
+    double CyclesToUs(uint64 Cycles);
+
+    /** Wall time an audio callback has for one block at SampleRate. */
+    double GetBlockBudgetUs(int32 BlockFrames, int32 SampleRate);
+
+    /** Parses "Key=A,B,C" into Out, replacing what it held; false if Arg is not that key. */
+    bool ParseList(const FString& Arg, const TCHAR* Key, TArray<int32>& Out);
+    bool ParseList(const FString& Arg, const TCHAR* Key, TArray<double>& Out);
+
+    /** Writes Report to Saved/Benchmarks/FileName and logs where it went. */
+    void WriteReport(const FString& FileName, const TSharedRef<FJsonObject>& Report, const TCHAR* CommandName);
+}
+
+#endif // !UE_BUILD_SHIPPING
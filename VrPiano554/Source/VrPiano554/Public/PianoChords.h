@@ -0,0 +1,59 @@
+// PianoChords.h
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+// Set of MIDI notes packed into two 64-bit words, one bit per note.
+struct FNoteMask128
+{
+    uint64 Words[2] = { 0, 0 };
+
+    void Add(int32 MidiNote) { Words[MidiNote >> 6] |= uint64(1) << (MidiNote & 63); }
+    void Remove(int32 MidiNote) { Words[MidiNote >> 6] &= ~(uint64(1) << (MidiNote & 63)); }
+    bool Contains(int32 MidiNote) const { return MidiNote >= 0 && MidiNote < 128 && (Words[MidiNote >> 6] >> (MidiNote & 63)) & 1; }
+
+    bool IsEmpty() const { return (Words[0] | Words[1]) == 0; }
+    int32 Num() const { return FMath::CountBits(Words[0]) + FMath::CountBits(Words[1]); }
+    void Reset() { Words[0] = Words[1] = 0; }
+
+    FNoteMask128 operator&(const FNoteMask128& Other) const { return { { Words[0] & Other.Words[0], Words[1] & Other.Words[1] } }; }
+    FNoteMask128 operator|(const FNoteMask128& Other) const { return { { Words[0] | Other.Words[0], Words[1] | Other.Words[1] } }; }
+    bool operator==(const FNoteMask128& Other) const { return Words[0] == Other.Words[0] && Words[1] == Other.Words[1]; }
+
+    /** Calls Func(MidiNote) for every note in the mask, lowest first. */
+    template <typename FuncType>
+    void ForEachNote(FuncType&& Func) const
+    {
+        for (int32 Word = 0; Word < 2; ++Word)
+        {
+            for (uint64 Bits = Words[Word]; Bits != 0; Bits &= Bits - 1)
+            {
+                Func(Word * 64 + int32(FMath::CountTrailingZeros64(Bits)));
+            }
+        }
+    }
+
+    TArray<int32> ToArray() const
+    {
+        TArray<int32> Notes;
+        Notes.Reserve(Num());
+        ForEachNote([&Notes](int32 MidiNote) { Notes.Add(MidiNote); });
+        return Notes;
+    }
+};
+
+// Notes of a song whose onsets fall within the chord tolerance of the first one.
+struct FChordGroup
+{
+    // Range of the group's notes, as positions in the song view the group was built for.
+    int32 StartIndex = 0;
+    int32 Count = 0;
+
+    // Onset of the first note of the group.
+    float Time = 0.0f;
+
+    FNoteMask128 Mask;
+
+    int32 EndIndex() const { return StartIndex + Count; }
+};
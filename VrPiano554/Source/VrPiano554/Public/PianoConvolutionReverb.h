@@ -0,0 +1,133 @@
+// PianoConvolutionReverb.h
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include <atomic>
+
+class FEvent;
+class FRunnableThread;
+class FPianoConvolutionTailWorker;
+
+namespace Audio
+{
+    class IFFTAlgorithm;
+}
+
+struct FPianoConvolutionSettings
+{
+    /** Partition length in frames; the wet signal is late by this much. Rounded up to a power of two. */
+    int32 PartitionFrames = 128;
+
+    /**
+     * Partitions mixed on the audio thread in the block they are needed. The rest, the tail, are
+     * summed by the worker thread this many blocks ahead, so it has that long to finish. Cover at
+     * least one host callback: partitions arrive in bursts of callback size / PartitionFrames.
+     */
+    int32 HeadPartitions = 8;
+
+    /** Without the worker, the audio thread sums the tail too; the benchmark compares the two. */
+    bool bUseWorkerThread = true;
+
+    float WetGain = 0.3f;
+    float DryGain = 1.0f;
+};
+
+/**
+ * Uniformly partitioned overlap-save convolution of a stereo stream with an impulse response,
+ * for soundboard and room resonance after the sampler mix. The response is cut into partitions
+ * of PartitionFrames whose spectra are precomputed. Each block's input spectrum joins a
+ * frequency-domain delay line, and the output spectrum is the sum of delayed input spectra times
+ * partition spectra, one inverse FFT per block and channel. Input is buffered to whole
+ * partitions, so any host block size works.
+ */
+class VRPIANO554_API FPianoConvolutionReverb
+{
+public:
+    /** ImpulseResponse holds one or two channels at the output sample rate; a mono response feeds both sides. */
+    FPianoConvolutionReverb(const TArray<TArray<float>>& ImpulseResponse, const FPianoConvolutionSettings& InSettings = FPianoConvolutionSettings());
+    ~FPianoConvolutionReverb();
+
+    /**
+     * Reads an impulse response WAV, converts it to SampleRate and trims it to MaxSeconds, if positive. The
+     * response is scaled so its louder channel has unit energy, which keeps WetGain meaningful
+     * across files.
+     */
+    static bool LoadImpulseResponse(const FString& Path, int32 SampleRate, float MaxSeconds, TArray<TArray<float>>& OutChannels);
+
+    /** Audio thread: convolves NumFrames frames of interleaved stereo in place and mixes dry and wet. */
+    void Process(float* InOutInterleaved, int32 NumFrames);
+
+    void SetGains(float InWetGain, float InDryGain);
+
+    int32 GetPartitionFrames() const { return PartitionFrames; }
+    int32 GetNumPartitions() const { return NumPartitions; }
+    int32 GetLatencyFrames() const { return PartitionFrames; }
+
+    /** False if no FFT was available for the partition size; Process then only applies the dry gain. */
+    bool IsValid() const { return FFT.IsValid(); }
+
+    /** Blocks whose tail the worker had not finished in time, so the audio thread summed it itself. */
+    int32 GetNumLateTailBlocks() const { return NumLateTailBlocks.load(std::memory_order_relaxed); }
+
+    /** Worker thread: sums the tail partitions of every block that is due. */
+    void ProcessPendingTails();
+
+private:
+    static constexpr int32 NumChannels = 2;
+
+    // One partition's spectrum, planar: SpectrumFloats / 2 real parts, then as many imaginary parts.
+    float* GetInputSpectrum(int32 Channel, int64 Block) { return InputSpectra[Channel].GetData() + (Block % RingSize) * SpectrumFloats; }
+    float* GetTailSpectrum(int32 Channel, int64 Block) { return TailSpectra[Channel].GetData() + (Block % TailSlots) * SpectrumFloats; }
+    const float* GetPartitionSpectrum(int32 Channel, int32 Partition) const { return PartitionSpectra[Channel].GetData() + Partition * SpectrumFloats; }
+
+    void ProcessPartition();
+
+    // Acc += sum over Partition in [FirstPartition, EndPartition) of Input(Block - Partition) * H(Partition).
+    void AccumulatePartitions(int32 Channel, int64 Block, int32 FirstPartition, int32 EndPartition, float* Acc);
+
+    FPianoConvolutionSettings Settings;
+    int32 PartitionFrames;
+    int32 FFTSize;
+    int32 NumBins;
+    int32 SpectrumFloats;
+    int32 NumPartitions;
+    int32 HeadPartitions;
+    int32 RingSize;
+    int32 TailSlots;
+    bool bUseWorker;
+
+    TUniquePtr<Audio::IFFTAlgorithm> FFT;
+
+    using FAlignedFloats = TArray<float, TAlignedHeapAllocator<16>>;
+    FAlignedFloats PartitionSpectra[NumChannels];
+    FAlignedFloats InputSpectra[NumChannels];
+    FAlignedFloats TailSpectra[NumChannels];
+
+    // Audio thread buffers.
+    FAlignedFloats TimeInput[NumChannels];
+    FAlignedFloats InputFifo[NumChannels];
+    FAlignedFloats OutputFifo[NumChannels];
+    FAlignedFloats Accumulator;
+    FAlignedFloats ComplexScratch;
+    FAlignedFloats TimeScratch;
+    int32 FifoPosition = 0;
+    int64 NextBlock = 0;
+
+    std::atomic<float> WetGain;
+    std::atomic<float> DryGain;
+
+    // Last block whose input spectrum is in the ring, and the block each tail slot was summed for.
+    std::atomic<int64> LatestInputBlock;
+    TUniquePtr<std::atomic<int64>[]> TailReadyBlock;
+    int64 LastTailBlock = -1;
+    std::atomic<int32> NumLateTailBlocks;
+
+    FEvent* WorkEvent = nullptr;
+    TUniquePtr<FPianoConvolutionTailWorker> Worker;
+    TUniquePtr<FRunnableThread> WorkerThread;
+
+    friend class FPianoConvolutionTailWorker;
+};
+
+using FPianoConvolutionReverbPtr = TSharedPtr<FPianoConvolutionReverb, ESPMode::ThreadSafe>;
@@ -0,0 +1,192 @@
+// PianoKeyLayout.h
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Containers/StaticArray.h"
+#include "Engine/DataAsset.h"
+#include "PianoKeyLayout.generated.h"
+
+UENUM(BlueprintType)
+enum class EPianoKeyboardRange : uint8
+{
+    Keys25 UMETA(DisplayName = "25 keys (C3-C5)"),
+    Keys49 UMETA(DisplayName = "49 keys (C2-C6)"),
+    Keys61 UMETA(DisplayName = "61 keys (C2-C7)"),
+    Keys76 UMETA(DisplayName = "76 keys (E1-G7)"),
+    Keys88 UMETA(DisplayName = "88 keys (A0-C8)")
+};
+
+// Key geometry of every MIDI note, generated at compile time.
+namespace PianoKeys
+{
+    constexpr int32 NumMidiNotes = 128;
+    constexpr int32 LowestPianoNote = 21;   // A0
+    constexpr int32 HighestPianoNote = 108; // C8
+
+    struct FNoteTableEntry
+    {
+        bool bIsBlack = false;
+
+        // Index of this white key, or of the white key just left of this black key, counted from MIDI note 0.
+        int32 WhiteKeyIndex = 0;
+
+        // Centre of the key along the keyboard, in white-key widths from the left edge of MIDI note 0.
+        float CenterOffset = 0.0f;
+
+        // Note name with octave, e.g. "C#4" for MIDI note 61.
+        TCHAR Name[6] = {};
+    };
+
+    struct FNoteTable
+    {
+        FNoteTableEntry Notes[NumMidiNotes];
+
+        constexpr FNoteTable()
+            : Notes()
+        {
+            // C#, D#, F#, G# and A# are the black keys of every octave.
+            constexpr bool BlackPitchClasses[12] = { false, true, false, true, false, false, true, false, true, false, true, false };
+            constexpr char Letters[12] = { 'C', 'C', 'D', 'D', 'E', 'F', 'F', 'G', 'G', 'A', 'A', 'B' };
+
+            int32 WhiteKeysBelow = 0;
+            for (int32 Note = 0; Note < NumMidiNotes; ++Note)
+            {
+                FNoteTableEntry& Entry = Notes[Note];
+                const int32 PitchClass = Note % 12;
+                const int32 Octave = Note / 12 - 1;
+
+                Entry.bIsBlack = BlackPitchClasses[PitchClass];
+                Entry.WhiteKeyIndex = Entry.bIsBlack ? WhiteKeysBelow - 1 : WhiteKeysBelow;
+                Entry.CenterOffset = Entry.bIsBlack ? float(WhiteKeysBelow) : float(WhiteKeysBelow) + 0.5f;
+
+                int32 Char = 0;
+                Entry.Name[Char++] = TCHAR(Letters[PitchClass]);
+                if (Entry.bIsBlack) Entry.Name[Char++] = TCHAR('#');
+                if (Octave < 0) Entry.Name[Char++] = TCHAR('-');
+                Entry.Name[Char++] = TCHAR('0' + (Octave < 0 ? -Octave : Octave));
+                Entry.Name[Char] = TCHAR(0);
+
+                if (!Entry.bIsBlack) ++WhiteKeysBelow;
+            }
+        }
+    };
+
+    inline constexpr FNoteTable NoteTable;
+
+    constexpr bool IsBlackKey(int32 MidiNote)
+    {
+        return NoteTable.Notes[MidiNote].bIsBlack;
+    }
+
+    // A contiguous range of keys, e.g. the 61 keys of a C2-C7 keyboard.
+    struct FKeyboardRange
+    {
+        int32 FirstNote = 0;
+        int32 LastNote = -1;
+
+        constexpr int32 NumKeys() const { return LastNote - FirstNote + 1; }
+        constexpr bool Contains(int32 MidiNote) const { return MidiNote >= FirstNote && MidiNote <= LastNote; }
+
+        constexpr int32 NumWhiteKeys() const
+        {
+            return NoteTable.Notes[LastNote].WhiteKeyIndex - NoteTable.Notes[FirstNote].WhiteKeyIndex + 1;
+        }
+
+        /** Centre of the key in white-key widths from the left edge of the range. */
+        constexpr float GetKeyOffset(int32 MidiNote) const
+        {
+            return NoteTable.Notes[MidiNote].CenterOffset - NoteTable.Notes[FirstNote].WhiteKeyIndex;
+        }
+    };
+
+    constexpr FKeyboardRange GetKeyboardRange(EPianoKeyboardRange Range)
+    {
+        switch (Range)
+        {
+        case EPianoKeyboardRange::Keys25: return { 48, 72 };
+        case EPianoKeyboardRange::Keys49: return { 36, 84 };
+        case EPianoKeyboardRange::Keys76: return { 28, 103 };
+        case EPianoKeyboardRange::Keys88: return { LowestPianoNote, HighestPianoNote };
+        case EPianoKeyboardRange::Keys61:
+        default: return { 36, 96 };
+        }
+    }
+
+    static_assert(GetKeyboardRange(EPianoKeyboardRange::Keys25).NumWhiteKeys() == 15, "25-key range");
+    static_assert(GetKeyboardRange(EPianoKeyboardRange::Keys49).NumWhiteKeys() == 29, "49-key range");
+    static_assert(GetKeyboardRange(EPianoKeyboardRange::Keys61).NumWhiteKeys() == 36, "61-key range");
+    static_assert(GetKeyboardRange(EPianoKeyboardRange::Keys76).NumWhiteKeys() == 45, "76-key range");
+    static_assert(GetKeyboardRange(EPianoKeyboardRange::Keys88).NumWhiteKeys() == 52, "88-key range");
+}
+
+// Pre-computed placement of a single key, relative to the piano's root component.
+USTRUCT(BlueprintType)
+struct FPianoKeyLayoutEntry
+{
+    GENERATED_BODY()
+
+    UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Key Layout")
+    int32 MidiNote = 0;
+
+    /** Location of the key's rotation pivot (the centre of the key mesh bounds) in piano-local space. */
+    UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Key Layout")
+    FVector PivotOffset = FVector::ZeroVector;
+
+    /** Width of the key in piano-local units. */
+    UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Key Layout")
+    float Width = 0.0f;
+
+    UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Key Layout")
+    bool bIsBlack = false;
+};
+
+/**
+ * Key layout baked from a piano's key meshes in the editor, so that BeginPlay
+ * only has to apply it instead of measuring every key mesh again.
+ */
+UCLASS(BlueprintType)
+class VRPIANO554_API UPianoKeyLayout : public UDataAsset
+{
+    GENERATED_BODY()
+
+public:
+    /** One entry per key, sorted by MIDI note. */
+    UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Key Layout")
+    TArray<FPianoKeyLayoutEntry> Keys;
+};
+
+// Rest-pose data of one key as published in a FKeyLayoutSnapshot.
+struct FKeyLayoutSnapshotEntry
+{
+    /** Key pivot relative to the piano actor. */
+    FTransform RelativeTransform = FTransform::Identity;
+
+    /** Key width in piano-local units; multiply by the actor's Y scale for world units. */
+    float Width = 0.0f;
+
+    bool bValid = false;
+};
+
+/**
+ * Immutable per-note view of a piano's key layout. APianoActor builds a new
+ * snapshot with a higher Version whenever its layout changes, so consumers can
+ * hold on to the shared pointer and only re-read it when the version moves.
+ */
+struct FKeyLayoutSnapshot
+{
+    uint32 Version = 0;
+    int32 NumValidKeys = 0;
+
+    // Keyboard range of the piano; only notes inside it can be valid.
+    PianoKeys::FKeyboardRange Range;
+
+    TStaticArray<FKeyLayoutSnapshotEntry, PianoKeys::NumMidiNotes> Keys;
+
+    const FKeyLayoutSnapshotEntry* Find(int32 MidiNote) const
+    {
+        return (MidiNote >= 0 && MidiNote < PianoKeys::NumMidiNotes && Keys[MidiNote].bValid) ? &Keys[MidiNote] : nullptr;
+    }
+};
+
+using FKeyLayoutSnapshotPtr = TSharedPtr<const FKeyLayoutSnapshot, ESPMode::ThreadSafe>;
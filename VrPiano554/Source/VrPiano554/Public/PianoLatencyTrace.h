@@ -0,0 +1,71 @@
+// PianoLatencyTrace.h
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+// Where a live note-on is along the way from the keyboard to the screen, in the order it gets there.
+enum class EPianoLatencyStage : uint8
+{
+    Capture,        // MIDI bytes read, by the bridge or the native input
+    BridgeSend,     // the bridge hands the JSON to its socket
+    SocketReceive,  // the engine's socket thread has the packet
+    Decode,         // the game thread has parsed it
+    PressKey,
+    AnimationStart, // the key's pivot first moves
+    FrameRendered,  // the render thread has finished the frame with that pose
+    Num
+};
+
+/**
+ * Follows note-ons through the pipeline by an id carried with each event, so the stage that
+ * dominates key-to-visual latency can be found and worked on. Times are FPlatformTime::Seconds;
+ * the bridge's wall-clock stamps are converted, so the BridgeSend to SocketReceive step also
+ * carries any difference between the two processes' clocks.
+ *
+ * A stage's latency is the time since the previous stage the event went through, so events from
+ * the native input, which skip the bridge, count their queue wait under Decode. Completed events
+ * feed per-stage histograms, read with `stat VrPianoLatency` or piano.LatencyReport and written
+ * as CSV by piano.LatencyExport. Every stage is also an Insights bookmark, and each completed
+ * event sets the Piano/Latency counters. piano.LatencyTrace 0 turns recording off.
+ */
+namespace PianoLatencyTrace
+{
+    /** Module startup and shutdown: hooks the render thread's end of frame. */
+    void Startup();
+    void Shutdown();
+
+    VRPIANO554_API bool IsEnabled();
+
+    /** A fresh id for events that start in the engine; the bridge numbers its own below these. */
+    VRPIANO554_API uint32 NewEventId();
+
+    /** Any thread. Id 0 is an untraced event and is ignored. */
+    VRPIANO554_API void Record(uint32 EventId, EPianoLatencyStage Stage, double Seconds);
+
+    /** Game thread: records FrameRendered when the render thread finishes the frame being built. */
+    VRPIANO554_API void RecordFrameRendered(uint32 EventId);
+
+    /** Converts a Unix time in seconds, as the bridge sends, to FPlatformTime::Seconds. */
+    VRPIANO554_API double UnixToPlatformSeconds(double UnixSeconds);
+
+    /** The event the game thread is handling, so calls without an id parameter can pick it up. */
+    VRPIANO554_API uint32 GetCurrentEventId();
+
+    struct VRPIANO554_API FEventScope
+    {
+        explicit FEventScope(uint32 EventId);
+        ~FEventScope();
+
+    private:
+        uint32 PreviousEventId;
+    };
+
+    VRPIANO554_API void Reset();
+
+    /** One line per stage: events, mean, p50, p95 and max in milliseconds. */
+    VRPIANO554_API FString FormatReport();
+
+    /** Writes Path with one row per recent event, and Path's _Histogram.csv sibling with the bucket counts. */
+    VRPIANO554_API bool ExportCsv(const FString& Path);
+}
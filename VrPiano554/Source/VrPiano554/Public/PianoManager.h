@@ -22,7 +22,6 @@ public:
 
 protected:
     virtual void BeginPlay() override;
-    virtual void Tick(float DeltaTime) override;
 
 public:
     // The Blueprint version of our Piano to spawn
@@ -0,0 +1,46 @@
+// PianoMidiFile.h
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+enum class EPianoMidiEventType : uint8
+{
+    NoteOn,
+    NoteOff,
+    Sustain,
+    Sostenuto
+};
+
+// A channel event of a Standard MIDI File that the piano plays, with its time in seconds.
+struct FPianoMidiEvent
+{
+    double Time = 0.0;
+    EPianoMidiEventType Type = EPianoMidiEventType::NoteOn;
+    uint8 Channel = 0;
+    uint8 MidiNote = 0;
+
+    // Velocity for NoteOn; for Sustain and Sostenuto, 64 or more is pedal down.
+    uint8 Value = 0;
+};
+
+namespace PianoMidiFile
+{
+    /** Data bytes following a channel status byte (0x80-0xEF), or -1 for anything else. */
+    VRPIANO554_API int32 GetChannelMessageDataLength(uint8 Status);
+
+    /**
+     * Fills OutEvent from a complete channel message and returns true if it is one the piano plays: a note
+     * on or off, or the sustain or sostenuto pedal. Leaves Time alone.
+     */
+    VRPIANO554_API bool DecodeChannelMessage(uint8 Status, uint8 Data0, uint8 Data1, FPianoMidiEvent& OutEvent);
+
+    /**
+     * Reads the note, sustain pedal and sostenuto pedal events of a format 0 or 1 file, merged across tracks and
+     * timed through the file's tempo map. Note-ons with velocity 0 become note-offs. Events are
+     * sorted by time; events at the same time keep their track order.
+     */
+    VRPIANO554_API bool Parse(TConstArrayView<uint8> FileBytes, TArray<FPianoMidiEvent>& OutEvents, FString* OutError = nullptr);
+
+    VRPIANO554_API bool Load(const FString& Path, TArray<FPianoMidiEvent>& OutEvents, FString* OutError = nullptr);
+}
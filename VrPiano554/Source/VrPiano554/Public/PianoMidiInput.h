@@ -0,0 +1,85 @@
+// PianoMidiInput.h
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Containers/Queue.h"
+#include "HAL/Runnable.h"
+#include "PianoMidiFile.h"
+#include <atomic>
+
+class FRunnableThread;
+
+/**
+ * Turns a raw MIDI byte stream into the events the piano plays. Keeps running status, lets real-time
+ * bytes (0xF8-0xFF) appear anywhere, even inside a message, and skips system exclusive and system
+ * common messages. A system common message cancels running status; a real-time byte does not.
+ */
+class VRPIANO554_API FPianoMidiByteParser
+{
+public:
+    /** Feeds one byte; returns true when it completes a note or pedal message, with OutEvent filled apart from Time. */
+    bool Push(uint8 Byte, FPianoMidiEvent& OutEvent);
+
+    void Reset();
+
+private:
+    uint8 RunningStatus = 0;
+    uint8 Data[2] = { 0, 0 };
+    int32 NumData = 0;
+};
+
+/** Where the reader thread gets its bytes from; see FPianoMidiInput::Open for the kinds. */
+class IPianoMidiByteSource
+{
+public:
+    virtual ~IPianoMidiByteSource() = default;
+
+    /** Waits up to TimeoutMs for input and returns the bytes read, 0 on timeout, or -1 once the source is gone. */
+    virtual int32 Read(uint8* Buffer, int32 Capacity, int32 TimeoutMs) = 0;
+
+    virtual FString Describe() const = 0;
+};
+
+/**
+ * Reads a MIDI keyboard on its own thread, so a key press does not wait for the Python bridge, two
+ * JSON round trips and the receiver's tick. Each event is stamped with FPlatformTime::Seconds when
+ * its bytes were read and queued for the game thread; OnEvents then wakes whoever drains the queue.
+ * If the device goes away, the reader tries to reopen it once a second.
+ */
+class VRPIANO554_API FPianoMidiInput : public FRunnable
+{
+public:
+    /**
+     * Device is one of:
+     *   "fifo:<path>"            raw MIDI bytes from a named pipe, created if missing (Linux and Mac; for tests),
+     *   "alsa:<client>:<port>"   an ALSA sequencer port by address (Linux),
+     *   "alsa:<name>" or "<name>" the first readable sequencer or WinMM input whose name contains <name>;
+     *                            an empty name takes the first hardware input.
+     * Returns null if the device cannot be opened on this platform.
+     */
+    static TUniquePtr<FPianoMidiInput> Open(const FString& Device, TFunction<void()> InOnEvents);
+
+    virtual ~FPianoMidiInput() override;
+
+    /** Game thread: the next event, with Time in FPlatformTime::Seconds. */
+    bool Dequeue(FPianoMidiEvent& OutEvent) { return Events.Dequeue(OutEvent); }
+    bool HasEvents() const { return !Events.IsEmpty(); }
+
+    FString Describe() const { return Description; }
+
+    virtual uint32 Run() override;
+    virtual void Stop() override;
+
+private:
+    FPianoMidiInput(const FString& InDevice, TUniquePtr<IPianoMidiByteSource> InSource, TFunction<void()> InOnEvents);
+
+    FString Device;
+    FString Description;
+    TUniquePtr<IPianoMidiByteSource> Source;
+    FPianoMidiByteParser Parser;
+    TQueue<FPianoMidiEvent, EQueueMode::Spsc> Events;
+    TFunction<void()> OnEvents;
+    std::atomic<bool> bStopping { false };
+    TUniquePtr<FRunnableThread> Thread;
+};
@@ -0,0 +1,44 @@
+// PianoResampler.h
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Windowed-sinc interpolator stored as a polyphase table. Row p holds the taps for a read
+ * position p / NumPhases of a frame past a source frame; positions between rows blend the two
+ * nearest rows, so one table serves any fixed resampling ratio with the same cutoff.
+ */
+class VRPIANO554_API FPianoResampleKernel
+{
+public:
+    static constexpr int32 NumTaps = 16;
+    static constexpr int32 NumPhases = 128;
+
+    /** Taps reach this many frames before the read position, and NumTaps - TapsBefore after it. */
+    static constexpr int32 TapsBefore = NumTaps / 2 - 1;
+
+    /**
+     * Cutoff as a fraction of the source Nyquist frequency. Playing a sample faster than its own
+     * rate needs a cutoff of 1 / Step to keep the shifted partials from aliasing.
+     */
+    explicit FPianoResampleKernel(float InCutoff = 1.0f);
+
+    float GetCutoff() const { return Cutoff; }
+
+    static float CutoffForStep(double Step) { return Step > 1.0 ? float(1.0 / Step) : 1.0f; }
+
+    /**
+     * Dst[i] += Interpolated(Src, Position + Step * i) * (GainStart + GainStep * i) for both channels.
+     * Src is indexed in source frames relative to Position's origin and must be readable from
+     * Src[int(Position) - TapsBefore] to Src[int(Position + Step * (NumFrames - 1)) + NumTaps - TapsBefore].
+     */
+    void Mix(const float* SrcLeft, const float* SrcRight, double Position, double Step, int32 NumFrames,
+        float GainStart, float GainStep, float* DstLeft, float* DstRight) const;
+
+private:
+    float Cutoff;
+
+    // (NumPhases + 1) rows of NumTaps; the extra row lets a position just below the next frame blend without wrapping.
+    TArray<float, TAlignedHeapAllocator<16>> Coefficients;
+};
@@ -0,0 +1,122 @@
+// PianoSampleBank.h
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Containers/StaticArray.h"
+#include "PianoKeyLayout.h"
+#include "PianoWaveFile.h"
+
+class IMappedFileHandle;
+class IMappedFileRegion;
+
+/**
+ * One channel of a recorded note. The attack is decoded to float and kept resident; the rest
+ * is read straight from the memory-mapped WAV file, so it only takes memory while it plays.
+ */
+struct VRPIANO554_API FPianoSampleChannel
+{
+    TArray<float> Head;
+
+    // The whole mapped file and the layout of its PCM data; empty when the note is fully resident.
+    TConstArrayView<uint8> MappedFile;
+    FPianoWaveFormat Format;
+
+    int32 NumFrames = 0;
+
+    /** Writes Count frames starting at FirstFrame to Out as float; frames before the start or past the end are silence. */
+    void CopyFrames(int32 FirstFrame, int32 Count, float* Out) const;
+
+    /** Reads one byte of every page of the mapped frames in [FirstFrame, FirstFrame + Count) so they are paged in. */
+    void TouchFrames(int32 FirstFrame, int32 Count) const;
+};
+
+struct FPianoSample
+{
+    FPianoSampleChannel Left;
+    FPianoSampleChannel Right;
+    int32 NumFrames = 0;
+
+    bool IsValid() const { return NumFrames > 0; }
+};
+
+struct FPianoSampleBankSettings
+{
+    /** Length of the attack kept decoded in memory. The rest of each note is streamed from the mapped file. */
+    float ResidentMilliseconds = 500.0f;
+
+    /** When false, or when a file cannot be mapped, notes are decoded into memory in full. */
+    bool bMemoryMap = true;
+
+    /**
+     * When 2 or more, every ThinningStride-th recorded note is left unloaded and played by
+     * resampling a neighbour, trading sound quality for memory. The lowest and highest recordings
+     * are always kept.
+     */
+    int32 ThinningStride = 0;
+};
+
+/**
+ * The recorded notes of a sample set, e.g. the "Clean Grand Mistral - GDCGM 060L.wav" /
+ * "...060R.wav" pairs in samples/. Immutable once loaded, so any number of samplers and
+ * threads can read it.
+ */
+class VRPIANO554_API FPianoSampleBank
+{
+public:
+    FPianoSampleBank();
+    ~FPianoSampleBank();
+
+    /**
+     * Loads every "<name>NNNL.wav" / "<name>NNNR.wav" pair in Directory, where NNN is the MIDI note,
+     * spreading the files over the task graph. A note with only one side recorded plays it on both
+     * channels. Returns null if nothing loaded.
+     */
+    static TSharedPtr<FPianoSampleBank, ESPMode::ThreadSafe> LoadFromDirectory(const FString& Directory, const FPianoSampleBankSettings& Settings = FPianoSampleBankSettings());
+
+    /** The recording of MidiNote, or null if it was not recorded or not loaded. */
+    const FPianoSample* Find(int32 MidiNote) const
+    {
+        return (MidiNote >= 0 && MidiNote < PianoKeys::NumMidiNotes && Samples[MidiNote].IsValid()) ? &Samples[MidiNote] : nullptr;
+    }
+
+    /**
+     * The loaded recording nearest in pitch to a piano key, for keys without their own.
+     * OutSourceNote is the note it was recorded at. Null outside the piano's range.
+     */
+    const FPianoSample* FindNearest(int32 MidiNote, int32& OutSourceNote) const
+    {
+        OutSourceNote = (MidiNote >= 0 && MidiNote < PianoKeys::NumMidiNotes) ? NearestSource[MidiNote] : -1;
+        return OutSourceNote >= 0 ? &Samples[OutSourceNote] : nullptr;
+    }
+
+    int32 GetSampleRate() const { return SampleRate; }
+    int32 GetNumSamples() const { return NumSamples; }
+
+    /** Piano keys played by resampling another note's recording. */
+    int32 GetNumReconstructedNotes() const { return NumReconstructedNotes; }
+
+    /** Whether any note streams its tail from a mapped file. */
+    bool HasStreamedTails() const { return MappedFiles.Num() > 0; }
+
+    /** Heap memory of the resident heads (or of the full notes when nothing is mapped). */
+    SIZE_T GetAllocatedSize() const;
+
+    /** Bytes of the mapped files; only the pages being played are resident. */
+    int64 GetMappedSize() const;
+
+    double GetLoadSeconds() const { return LoadSeconds; }
+
+private:
+    struct FMappedFile;
+
+    TStaticArray<FPianoSample, PianoKeys::NumMidiNotes> Samples;
+    TStaticArray<int8, PianoKeys::NumMidiNotes> NearestSource;
+    TArray<TUniquePtr<FMappedFile>> MappedFiles;
+    int32 SampleRate = 0;
+    int32 NumSamples = 0;
+    int32 NumReconstructedNotes = 0;
+    double LoadSeconds = 0.0;
+};
+
+using FPianoSampleBankPtr = TSharedPtr<const FPianoSampleBank, ESPMode::ThreadSafe>;
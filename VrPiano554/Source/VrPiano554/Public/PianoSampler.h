@@ -0,0 +1,275 @@
+// PianoSampler.h
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Containers/CircularQueue.h"
+#include "PianoConvolutionReverb.h"
+#include "PianoResampler.h"
+#include "PianoSampleBank.h"
+#include <atomic>
+
+class FRunnableThread;
+class FPianoSamplePrefetcher;
+
+enum class EPianoSamplerCommand : uint8
+{
+    NoteOn,
+    NoteOff,
+    AllNotesOff,
+    Sustain,
+    Sostenuto,
+    Volume,
+    ClearScheduled
+};
+
+struct FPianoSamplerCommand
+{
+    EPianoSamplerCommand Type = EPianoSamplerCommand::NoteOn;
+    uint8 MidiNote = 0;
+    uint8 Velocity = 0; // NoteOn velocity; for Sustain and Sostenuto, non-zero is pedal down
+    float Volume = 1.0f;
+
+    // Output frame the command takes effect at. Frames already rendered, such as 0, mean the start of the next block.
+    uint64 Frame = 0;
+};
+
+/**
+ * Polyphonic sample player. The game thread queues note commands through a lock-free ring,
+ * and the audio thread drains it at the start of every block and mixes the voices. Commands
+ * can carry an output frame; the audio thread keeps them in time order and splits its blocks
+ * so each one lands on exactly that frame, whatever the game's frame rate. Voices
+ * come from a pool allocated up front, so the audio thread never allocates or locks.
+ * When the bank streams note tails from mapped files, a prefetch thread pages in the
+ * part of every playing note that is about to be mixed. Keys without a recording of their own
+ * play the nearest one through a windowed-sinc resampler.
+ *
+ * Polyphony is capped. A note struck with the cap reached steals the voice that will be missed
+ * least: released or pedal-held notes before held ones, quiet before loud, and a key's earlier
+ * strikes before its latest. The stolen voice fades out over QuickFadeSeconds in a reserve slot
+ * while the new one starts, so stealing crossfades instead of clicking. The damper (sustain) and
+ * sostenuto pedals are tracked per key, as on the instrument.
+ */
+class VRPIANO554_API FPianoSampler
+{
+public:
+    /** InNumVoices caps the notes sounding at once; stolen voices fading out come on top of it. */
+    explicit FPianoSampler(int32 InNumVoices = 64, int32 InOutputSampleRate = 48000);
+    ~FPianoSampler();
+
+    /**
+     * Sets the sample bank. A sampler plays one bank for its lifetime; later calls are ignored. Safe while
+     * rendering, but must come from the thread that calls SetOutputSampleRate, normally the game thread.
+     */
+    bool SetBank(FPianoSampleBankPtr InBank);
+    const FPianoSampleBank* GetBank() const { return ActiveBank.load(std::memory_order_acquire); }
+
+    /** Sets the convolution stage run over the mix. Set once, like the bank; safe while rendering. */
+    bool SetReverb(FPianoConvolutionReverbPtr InReverb);
+    const FPianoConvolutionReverb* GetReverb() const { return ActiveReverb.load(std::memory_order_acquire); }
+
+    // Producer side. Commands must come from one thread at a time, normally the game thread.
+    bool NoteOn(int32 MidiNote, int32 Velocity) { return ScheduleNoteOn(0, MidiNote, Velocity); }
+    bool NoteOff(int32 MidiNote) { return ScheduleNoteOff(0, MidiNote); }
+    void AllNotesOff();
+    bool SetSustainPedal(bool bDown) { return ScheduleSustainPedal(0, bDown); }
+    bool SetSostenutoPedal(bool bDown) { return ScheduleSostenutoPedal(0, bDown); }
+
+    // Sample-accurate versions: the command applies at output frame Frame (see GetRenderedFrames).
+    bool ScheduleNoteOn(uint64 Frame, int32 MidiNote, int32 Velocity);
+    bool ScheduleNoteOff(uint64 Frame, int32 MidiNote);
+    bool ScheduleSustainPedal(uint64 Frame, bool bDown);
+    bool ScheduleSostenutoPedal(uint64 Frame, bool bDown);
+    bool ScheduleVolume(uint64 Frame, float InVolume);
+
+    /** Drops every scheduled command not yet applied, e.g. after a seek. Commands queued after this call are kept. */
+    void ClearScheduled();
+
+    /** Output frames rendered so far; the next block starts at this frame. */
+    uint64 GetRenderedFrames() const { return RenderedFrames.load(std::memory_order_relaxed); }
+
+    /**
+     * The output frame rendered at a given FPlatformTime::Seconds, extrapolated from a smoothed
+     * record of when blocks were rendered. Differs from when the frame is heard only by the
+     * device's constant output latency.
+     */
+    uint64 PlatformSecondsToFrame(double Seconds) const;
+
+    /** Scheduled commands dropped because the audio thread's schedule was full. */
+    int32 GetNumDroppedCommands() const { return NumDroppedCommands.load(std::memory_order_relaxed); }
+
+    /** Must not be called while rendering, nor alongside SetBank; the synth component calls it from Init. */
+    void SetOutputSampleRate(int32 InOutputSampleRate);
+    int32 GetOutputSampleRate() const { return OutputSampleRate; }
+
+    void SetMasterGain(float InGain) { MasterGain.store(InGain, std::memory_order_relaxed); }
+
+    /** Audio thread: writes the next NumFrames frames of interleaved stereo to OutInterleaved. */
+    void Render(float* OutInterleaved, int32 NumFrames);
+
+    /** The voice cap. */
+    int32 GetNumVoices() const { return MaxVoices; }
+
+    /** Voices mixed in the last block, stolen ones still fading out included. */
+    int32 GetNumActiveVoices() const { return NumActiveVoices.load(std::memory_order_relaxed); }
+
+    /** Voices taken from a sounding note for a new one since the sampler was created. */
+    int32 GetNumStolenVoices() const { return NumStolenVoices.load(std::memory_order_relaxed); }
+
+    /** Time for a released note to fade out, standing in for the damper. */
+    static constexpr float ReleaseSeconds = 0.25f;
+
+    /** Fade of a voice cut short by a retrigger of its key or by voice stealing. */
+    static constexpr float QuickFadeSeconds = 0.01f;
+
+    /** Strikes of one key that ring on together under a pedal; a further strike steals the oldest. */
+    static constexpr int32 MaxStrikesPerKey = 4;
+
+    // Render works in blocks of at most this many frames so the mix buffers never grow.
+    static constexpr int32 MaxBlockFrames = 512;
+
+    /** Scheduled commands the audio thread can hold at once, and the size of the command ring. */
+    static constexpr int32 MaxScheduledCommands = 4096;
+
+    /** Volume changes ramp over this many frames instead of stepping. */
+    static constexpr int32 VolumeRampFrames = 64;
+
+    /** How far ahead of every playing voice the prefetch thread pages in streamed tails. */
+    static constexpr float PrefetchSeconds = 1.0f;
+
+    /** Prefetch thread, when the audio thread wakes it: pages in the upcoming part of every streamed voice. */
+    void PrefetchActiveVoices() const;
+
+private:
+    struct FVoice
+    {
+        const FPianoSample* Sample = nullptr;
+        const FPianoResampleKernel* Kernel = nullptr; // null when the sample plays at its own rate
+        double Position = 0.0;
+        double Step = 1.0;
+        float Gain = 0.0f;
+
+        // Source frame at which the prefetcher is next woken for this voice; MAX_int32 when fully resident.
+        int32 NextPrefetchFrame = MAX_int32;
+
+        // 1 while the key is held; falls to 0 by FadeRate per output frame once released.
+        float Envelope = 1.0f;
+        float FadeRate = 0.0f;
+
+        uint32 StartOrder = 0;
+        uint8 MidiNote = 0;
+        bool bActive = false;
+        bool bReleased = false;
+
+        // Key let go, or struck again, while a pedal held its damper; released when the pedals let go of it.
+        bool bSustained = false;
+
+        // Fading out after being stolen; no longer counts against the cap.
+        bool bStolen = false;
+    };
+
+    bool Enqueue(const FPianoSamplerCommand& Command);
+
+    // Moves queued commands into Scheduled, in frame order.
+    void ProcessCommands();
+    void ApplyCommand(const FPianoSamplerCommand& Command);
+    void StartVoice(int32 MidiNote, int32 Velocity);
+    void KeyUp(int32 MidiNote);
+    void ReleaseVoices(int32 MidiNote, float FadeSeconds);
+
+    // Releases the voices no key or pedal holds any more, after a pedal came up.
+    void ReleaseUnheldVoices();
+    bool IsDamperRaised(int32 MidiNote) const { return bSustainDown || SostenutoKeys[MidiNote]; }
+
+    FVoice& AllocateVoice();
+    FVoice* ChooseVoiceToSteal() const;
+    void StealVoice(FVoice& Voice);
+
+    // Rough loudness of a voice now, from its velocity, envelope and the typical decay of its register.
+    float EstimateLevel(const FVoice& Voice) const;
+
+    // Mixes NumFrames frames of the voice into the mix buffers from frame Offset of the block.
+    void MixVoice(FVoice& Voice, int32 Offset, int32 NumFrames);
+
+    // Records when the block ending at RenderedFrames was rendered, for PlatformSecondsToFrame.
+    void UpdateFrameClock(int32 NumFrames);
+
+    // Fills KeyPlayback for the current bank and output rate. Not while rendering, except before the bank is published.
+    void UpdateKeyPlayback(const FPianoSampleBank& InBank);
+
+    // How each key plays: the recording it uses, the read step through it and the kernel for that step.
+    struct FKeyPlayback
+    {
+        int32 SourceNote = INDEX_NONE;
+        double Step = 1.0;
+        const FPianoResampleKernel* Kernel = nullptr;
+    };
+    TStaticArray<FKeyPlayback, PianoKeys::NumMidiNotes> KeyPlayback;
+    TArray<TUniquePtr<FPianoResampleKernel>> Kernels;
+
+    FPianoSampleBankPtr Bank;
+    std::atomic<const FPianoSampleBank*> ActiveBank;
+
+    FPianoConvolutionReverbPtr Reverb;
+    std::atomic<FPianoConvolutionReverb*> ActiveReverb;
+
+    TCircularQueue<FPianoSamplerCommand> Commands;
+
+    // Audio thread: commands waiting for their frame, sorted by frame from ScheduledHead on.
+    TArray<FPianoSamplerCommand> Scheduled;
+    int32 ScheduledHead = 0;
+
+    // MaxVoices sounding voices, then a reserve that stolen voices fade out in.
+    int32 MaxVoices;
+    TArray<FVoice> Voices;
+    TArray<float> MixLeft;
+    TArray<float> MixRight;
+
+    // Source frames of the current voice, decoded from the resident head or the mapped tail,
+    // with room for the resampler's taps on either side.
+    TArray<float> ScratchLeft;
+    TArray<float> ScratchRight;
+
+    // Recorded note and source frame of every voice, published by the audio thread for the prefetcher; note -1 when idle.
+    struct FVoiceStreamState
+    {
+        std::atomic<int32> SourceNote { -1 };
+        std::atomic<int32> Frame { 0 };
+    };
+    TUniquePtr<FVoiceStreamState[]> VoiceStreams;
+
+    TUniquePtr<FPianoSamplePrefetcher> Prefetcher;
+    TUniquePtr<FRunnableThread> PrefetchThread;
+
+    // PrefetchSeconds in source frames of the bank.
+    int32 PrefetchFrames = 0;
+
+    int32 OutputSampleRate;
+    uint32 NextStartOrder = 0;
+    std::atomic<float> MasterGain;
+    std::atomic<int32> NumActiveVoices;
+    std::atomic<int32> NumDroppedCommands;
+    std::atomic<int32> NumStolenVoices;
+
+    // Audio thread state changed by commands.
+    bool bSustainDown = false;
+    bool bSostenutoDown = false;
+
+    // Keys held down, and keys whose dampers the sostenuto pedal caught when it went down.
+    TStaticArray<bool, PianoKeys::NumMidiNotes> KeyDown;
+    TStaticArray<bool, PianoKeys::NumMidiNotes> SostenutoKeys;
+    float Volume = 1.0f;
+    float VolumeTarget = 1.0f;
+    float VolumeStep = 0.0f;
+    int32 VolumeRampLeft = 0;
+
+    std::atomic<uint64> RenderedFrames;
+
+    // Platform time at which RenderedFrames was reached, smoothed over blocks. Written by the audio
+    // thread under a sequence count so readers see a matching frame and time.
+    std::atomic<uint32> FrameClockSequence;
+    std::atomic<uint64> FrameClockFrame;
+    std::atomic<double> FrameClockSeconds;
+};
+
+using FPianoSamplerPtr = TSharedPtr<FPianoSampler, ESPMode::ThreadSafe>;
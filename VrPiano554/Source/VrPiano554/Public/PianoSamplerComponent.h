@@ -0,0 +1,123 @@
+// PianoSamplerComponent.h
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/SynthComponent.h"
+#include "PianoSampler.h"
+#include "PianoSamplerComponent.generated.h"
+
+/**
+ * Plays the piano sample set natively. Notes are queued from the game thread and mixed by
+ * FPianoSampler on the audio render thread, so a key press no longer has to round-trip
+ * through the Python bridge to be heard.
+ */
+UCLASS(ClassGroup = (Piano), meta = (BlueprintSpawnableComponent))
+class VRPIANO554_API UPianoSamplerComponent : public USynthComponent
+{
+    GENERATED_BODY()
+
+public:
+    UPianoSamplerComponent(const FObjectInitializer& ObjectInitializer);
+
+    /** Folder with the "<name>NNNL.wav" / "<name>NNNR.wav" pairs. Relative paths start at the project folder. */
+    UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Piano Sampler")
+    FString SampleDirectory = TEXT("../samples");
+
+    /**
+     * Notes that sound at once. Beyond it a new note steals the quietest released, pedal-held or
+     * re-struck one, which fades out over a few milliseconds.
+     */
+    UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Piano Sampler", meta = (ClampMin = "1", UIMin = "1"))
+    int32 NumVoices = 64;
+
+    /** Length of every note's attack kept decoded in memory; the rest streams from the memory-mapped file. */
+    UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Piano Sampler", meta = (ClampMin = "0.0", UIMin = "0.0", Units = "ms"))
+    float ResidentAttackMilliseconds = 500.0f;
+
+    /** Stream note tails from memory-mapped files. Off decodes the whole set into memory (about 1 GB). */
+    UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Piano Sampler")
+    bool bMemoryMapSamples = true;
+
+    /**
+     * Memory against quality: when 2 or more, every SampleThinning-th recording is not loaded and
+     * its key is resampled from a neighbour, like the keys the sample set has no recording for.
+     */
+    UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Piano Sampler", meta = (ClampMin = "0", UIMin = "0", UIMax = "4"))
+    int32 SampleThinning = 0;
+
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Piano Sampler", meta = (ClampMin = "0.0", UIMin = "0.0"))
+    float MasterGain = 0.5f;
+
+    /** Impulse response WAV convolved with the mix for soundboard and room resonance; empty for none. Relative paths start at the project folder. */
+    UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Piano Sampler|Reverb")
+    FString ImpulseResponsePath;
+
+    UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Piano Sampler|Reverb", meta = (ClampMin = "0.0", UIMin = "0.0", UIMax = "1.0"))
+    float ReverbWetGain = 0.3f;
+
+    UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Piano Sampler|Reverb", meta = (ClampMin = "0.0", UIMin = "0.0", UIMax = "1.0"))
+    float ReverbDryGain = 1.0f;
+
+    /** The response is cut off after this long; the tail's cost grows linearly with it. */
+    UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Piano Sampler|Reverb", meta = (ClampMin = "0.1", UIMin = "0.1", UIMax = "4.0", Units = "s"))
+    float ReverbMaxSeconds = 3.0f;
+
+    /** Partition length; the reverb starts this many frames after the dry sound. */
+    UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Piano Sampler|Reverb", meta = (ClampMin = "16", UIMin = "64", UIMax = "1024"))
+    int32 ReverbPartitionFrames = 128;
+
+    /**
+     * Partitions convolved on the audio thread; the tail thread works this many partitions ahead.
+     * Should cover the audio device's callback size.
+     */
+    UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Piano Sampler|Reverb", meta = (ClampMin = "1", UIMin = "1", UIMax = "32"))
+    int32 ReverbHeadPartitions = 8;
+
+    UFUNCTION(BlueprintCallable, Category = "Piano Sampler")
+    void NoteOn(int32 MidiNote, int32 Velocity);
+
+    UFUNCTION(BlueprintCallable, Category = "Piano Sampler")
+    void NoteOff(int32 MidiNote);
+
+    UFUNCTION(BlueprintCallable, Category = "Piano Sampler")
+    void AllNotesOff();
+
+    UFUNCTION(BlueprintCallable, Category = "Piano Sampler")
+    void SetSustainPedal(bool bDown);
+
+    UFUNCTION(BlueprintCallable, Category = "Piano Sampler")
+    void SetSostenutoPedal(bool bDown);
+
+    // Sample-accurate scheduling. Times are FPlatformTime::Seconds and should be far enough ahead
+    // (a few audio blocks) to reach the audio thread in time; late commands apply at the next block.
+    void ScheduleNote(int32 MidiNote, int32 Velocity, double StartSeconds, double EndSeconds);
+
+    /** Drops every scheduled command that has not been applied yet. */
+    void ClearScheduled();
+
+    UFUNCTION(BlueprintCallable, Category = "Piano Sampler")
+    int32 GetNumActiveVoices() const { return Sampler.IsValid() ? Sampler->GetNumActiveVoices() : 0; }
+
+    UFUNCTION(BlueprintCallable, Category = "Piano Sampler")
+    int32 GetNumStolenVoices() const { return Sampler.IsValid() ? Sampler->GetNumStolenVoices() : 0; }
+
+protected:
+    virtual void BeginPlay() override;
+
+    //~ USynthComponent interface
+    virtual bool Init(int32& SampleRate) override;
+    virtual int32 OnGenerateAudio(float* OutAudio, int32 NumSamples) override;
+
+private:
+    FString GetSampleDirectoryPath() const;
+
+    // Loads the sample set off the game thread and hands it to the sampler.
+    void LoadBank();
+
+    // Loads the impulse response off the game thread and hands the reverb to the sampler.
+    void LoadReverb(int32 SampleRate);
+
+    // Shared with the loading task and the audio thread, which may outlive the component briefly.
+    FPianoSamplerPtr Sampler;
+};
@@ -0,0 +1,189 @@
+// PianoSong.h
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "SongTimeIndex.h"
+#include "PianoChords.h"
+#include "PianoSong.generated.h"
+
+UENUM(BlueprintType)
+enum class EPianoHand : uint8
+{
+    Any,
+    Left,
+    Right
+};
+
+struct FPianoSongNote;
+
+// One note of a song, as Blueprints see it.
+USTRUCT(BlueprintType)
+struct FBlockSpawnInfo
+{
+    GENERATED_BODY()
+
+    UPROPERTY(BlueprintReadWrite, Category = "Falling Block Info")
+    float Time;
+
+    UPROPERTY(BlueprintReadWrite, Category = "Falling Block Info")
+    int32 MidiNote;
+
+    UPROPERTY(BlueprintReadWrite, Category = "Falling Block Info")
+    float Duration;
+
+    UPROPERTY(BlueprintReadWrite, Category = "Falling Block Info")
+    int32 Velocity;
+
+    UPROPERTY(BlueprintReadWrite, Category = "Falling Block Info")
+    int32 Channel;
+
+    UPROPERTY(BlueprintReadWrite, Category = "Falling Block Info")
+    int32 Track;
+
+    UPROPERTY(BlueprintReadWrite, Category = "Falling Block Info")
+    EPianoHand Hand;
+
+    // Default constructor
+    FBlockSpawnInfo() : Time(0.0f), MidiNote(0), Duration(0.0f), Velocity(100), Channel(0), Track(0), Hand(EPianoHand::Any) {}
+
+    // Constructor with parameters
+    FBlockSpawnInfo(float InTime, int32 InMidiNote, float InDuration)
+        : Time(InTime), MidiNote(InMidiNote), Duration(InDuration), Velocity(100), Channel(0), Track(0), Hand(EPianoHand::Any) {}
+
+    explicit FBlockSpawnInfo(const FPianoSongNote& Note);
+
+    // Comparison operator for sorting
+    bool operator<(const FBlockSpawnInfo& Other) const
+    {
+        return Time < Other.Time;
+    }
+};
+
+// One note of a song as FPianoSong stores it, packed into 16 bytes.
+struct FPianoSongNote
+{
+    float Time = 0.0f;
+    float Duration = 0.0f;
+    uint8 MidiNote = 0;
+    uint8 Velocity = 100;
+    uint8 Channel = 0;
+    uint8 Track = 0;
+    EPianoHand Hand = EPianoHand::Any;
+
+    FPianoSongNote() = default;
+
+    FPianoSongNote(float InTime, int32 InMidiNote, float InDuration)
+        : Time(InTime), Duration(InDuration), MidiNote(uint8(FMath::Clamp(InMidiNote, 0, 127))) {}
+
+    /** Narrows a Blueprint note, clamping each field to its MIDI range. */
+    explicit FPianoSongNote(const FBlockSpawnInfo& Info)
+        : Time(Info.Time), Duration(Info.Duration), MidiNote(uint8(FMath::Clamp(Info.MidiNote, 0, 127)))
+        , Velocity(uint8(FMath::Clamp(Info.Velocity, 0, 127))), Channel(uint8(FMath::Clamp(Info.Channel, 0, 15)))
+        , Track(uint8(FMath::Clamp(Info.Track, 0, 255))), Hand(Info.Hand) {}
+};
+
+static_assert(sizeof(FPianoSongNote) == 16, "FPianoSongNote is meant to stay a 16-byte record.");
+
+inline FBlockSpawnInfo::FBlockSpawnInfo(const FPianoSongNote& Note)
+    : Time(Note.Time), MidiNote(Note.MidiNote), Duration(Note.Duration), Velocity(Note.Velocity), Channel(Note.Channel), Track(Note.Track), Hand(Note.Hand) {}
+
+class FPianoSong;
+class FJsonObject;
+
+/**
+ * The notes of one hand or track of a song, in onset order. A view only refers to index
+ * arrays stored once in the song, so practising one hand never copies the notes.
+ */
+struct VRPIANO554_API FPianoSongView
+{
+    const FPianoSong* Song = nullptr;
+
+    // Positions of the view's notes in Song->Notes; unused when bAllNotes is set.
+    TConstArrayView<int32> NoteIndices;
+    bool bAllNotes = false;
+
+    // What the view selects; used to test notes found through the song-wide time index.
+    EPianoHand Hand = EPianoHand::Any;
+    int32 Track = INDEX_NONE;
+
+    // Learning-mode chord groups over the view's positions.
+    const TArray<FChordGroup>* ChordGroups = nullptr;
+
+    int32 Num() const;
+    int32 GetNoteIndex(int32 Position) const { return bAllNotes ? Position : NoteIndices[Position]; }
+    const FPianoSongNote& operator[](int32 Position) const;
+
+    /** Position of the first note of the view with an onset at or after Time, or Num(). */
+    int32 LowerBound(double Time) const;
+
+    bool Contains(const FPianoSongNote& Note) const
+    {
+        return (Hand == EPianoHand::Any || Note.Hand == Hand) && (Track == INDEX_NONE || Note.Track == Track);
+    }
+
+    const TArray<FChordGroup>& GetChordGroups() const;
+
+    /**
+     * Index of the chord group containing or following Position. Hint is the previous answer: walking
+     * forward from it is amortised O(1) per note, and a seek backwards falls back to a binary search.
+     */
+    int32 FindChordGroup(int32 Position, int32 Hint) const;
+};
+
+/**
+ * A song as received from the bridge, sorted and indexed. It is built once, off the game thread,
+ * and its notes are never modified afterwards, so the game thread can read them without locks.
+ * The per-hand and per-track views are only built when one is first asked for, so GetView and
+ * GetTrackView may only be called by the song's owner: the thread that built it until it is
+ * published, the game thread afterwards.
+ */
+class VRPIANO554_API FPianoSong
+{
+public:
+    /**
+     * Sorts the notes, assigns a hand to notes that arrived without one and builds the time index
+     * and the chord groups of the whole song, which every consumer starts with.
+     */
+    static TUniquePtr<FPianoSong> Build(TArray<FPianoSongNote>&& InNotes, float ChordTolerance);
+
+    /** Reads the "notes" array of a song message from the bridge. Returns false if there is none. */
+    static bool ParseNotes(const FJsonObject& SongObject, TArray<FPianoSongNote>& OutNotes);
+
+    FPianoSongView GetView(EPianoHand Hand) const;
+    FPianoSongView GetTrackView(int32 Track) const;
+    int32 GetNumTracks() const { return TrackViews.Num(); }
+
+    /** Heap memory held by the notes, the time index and the views built so far. */
+    SIZE_T GetAllocatedSize() const;
+
+    /** Notes sorted by onset time. */
+    TArray<FPianoSongNote> Notes;
+
+    FSongTimeIndex TimeIndex;
+    TArray<FChordGroup> ChordGroups;
+
+private:
+    // Index span of one hand or track, in onset order, and its chord groups.
+    struct FIndexedView
+    {
+        TArray<int32> NoteIndices;
+        TArray<FChordGroup> ChordGroups;
+        bool bBuilt = false;
+    };
+
+    static void AssignHands(TArray<FPianoSongNote>& Notes);
+    static void BuildChordGroups(const FPianoSongView& View, float ChordTolerance, TArray<FChordGroup>& OutGroups);
+
+    // Fills View with the notes Filter accepts, unless it already holds them.
+    template <typename FilterType>
+    void BuildIndexedView(FIndexedView& View, FilterType&& Filter) const;
+
+    float ChordTolerance = 0.0f;
+
+    mutable FIndexedView LeftHandView;
+    mutable FIndexedView RightHandView;
+
+    // One per track up to the highest track number, sized by Build so entries never move.
+    mutable TArray<FIndexedView> TrackViews;
+};
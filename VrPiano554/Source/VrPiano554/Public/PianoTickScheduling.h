@@ -0,0 +1,56 @@
+// PianoTickScheduling.h
+
+#pragma once
+
+#include "VrPiano554.h"
+#include "CoreMinimal.h"
+#include "GameFramework/Actor.h"
+#include "Async/Async.h"
+
+/**
+ * Helpers for actors that only tick while they have pending work.
+ * An actor starts with its tick disabled, wakes itself (or is woken) when work
+ * arrives and puts itself back to sleep at the end of a Tick that left nothing to do.
+ */
+namespace PianoTickScheduling
+{
+    /** Counts the calling actor towards the "Ticked Actors" stat. Call at the top of Tick. */
+    inline void NoteTicked()
+    {
+        INC_DWORD_STAT(STAT_VrPianoTickedActors);
+    }
+
+    /** Enables the actor's tick if it is asleep. Game thread only. */
+    inline void Wake(AActor* Actor)
+    {
+        if (Actor && !Actor->IsActorTickEnabled())
+        {
+            Actor->SetActorTickEnabled(true);
+        }
+    }
+
+    /** Disables the actor's tick once it has nothing left to do. Game thread only. */
+    inline void SleepIfIdle(AActor* Actor, bool bHasPendingWork)
+    {
+        if (Actor && !bHasPendingWork)
+        {
+            Actor->SetActorTickEnabled(false);
+        }
+    }
+
+    /** Wakes the actor from a worker thread; the tick is re-enabled on the game thread. */
+    inline void WakeFromAnyThread(AActor* Actor)
+    {
+        if (IsInGameThread())
+        {
+            Wake(Actor);
+            return;
+        }
+
+        TWeakObjectPtr<AActor> WeakActor(Actor);
+        AsyncTask(ENamedThreads::GameThread, [WeakActor]()
+        {
+            Wake(WeakActor.Get());
+        });
+    }
+}
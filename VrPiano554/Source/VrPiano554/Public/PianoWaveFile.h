@@ -0,0 +1,34 @@
+// PianoWaveFile.h
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+// Layout of the PCM data in a RIFF/WAVE file.
+struct FPianoWaveFormat
+{
+    int32 NumChannels = 0;
+    int32 SampleRate = 0;
+
+    // 16 or 24 for integer PCM, 32 for float.
+    int32 BitsPerSample = 0;
+    bool bFloat = false;
+
+    // Byte offset and frame count of the "data" chunk.
+    int64 DataOffset = 0;
+    int64 NumFrames = 0;
+
+    int32 GetBytesPerFrame() const { return NumChannels * BitsPerSample / 8; }
+};
+
+namespace PianoWaveFile
+{
+    /** Reads the fmt and data chunk headers. Only uncompressed PCM and IEEE float files are accepted. */
+    VRPIANO554_API bool ParseHeader(TConstArrayView<uint8> FileBytes, FPianoWaveFormat& OutFormat);
+
+    /** Converts NumFrames frames of one channel, starting at frame FirstFrame, to float in [-1, 1]. */
+    VRPIANO554_API void DecodeChannel(TConstArrayView<uint8> FileBytes, const FPianoWaveFormat& Format, int32 Channel, int64 FirstFrame, int64 NumFrames, float* OutSamples);
+
+    /** Writes interleaved float samples as a 16-bit PCM WAV file. */
+    VRPIANO554_API bool Save(const FString& Path, TConstArrayView<float> InterleavedSamples, int32 NumChannels, int32 SampleRate);
+}
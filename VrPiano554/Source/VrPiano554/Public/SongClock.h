@@ -0,0 +1,44 @@
+// SongClock.h
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Song time in double precision, derived from a reference clock instead of summed frame times.
+ * The mapping from reference time to song time is piecewise linear: every rate change, pause or
+ * seek closes the current segment and starts a new one at the current song time, so no error
+ * accumulates however long the song plays or how often the tempo changes.
+ */
+class VRPIANO554_API FSongClock
+{
+public:
+    /** Returns the reference time in seconds; must be monotonic. */
+    using FReferenceClock = TFunction<double()>;
+
+    FSongClock();
+
+    /** Slaves the clock to another reference, e.g. the audio device clock. Pass nullptr for FPlatformTime::Seconds. */
+    void SetReferenceClock(FReferenceClock InReferenceClock);
+
+    double GetSongTime() const;
+
+    double GetRate() const { return Rate; }
+    bool IsPaused() const { return bPaused; }
+
+    void SetRate(double NewRate);
+    void SetPaused(bool bNewPaused);
+    void Seek(double SongTime);
+
+private:
+    double ReadReference() const;
+
+    // Starts a new segment at the given song time and the current reference time.
+    void StartSegment(double SongTime);
+
+    FReferenceClock ReferenceClock;
+    double SegmentReferenceTime;
+    double SegmentSongTime;
+    double Rate;
+    bool bPaused;
+};
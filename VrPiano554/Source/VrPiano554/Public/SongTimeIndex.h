@@ -0,0 +1,39 @@
+// SongTimeIndex.h
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Time index over a song's notes, built once when the song is loaded.
+ * Onsets are kept sorted so finding the first note at or after a time is a binary search,
+ * and a segment tree of note end times over the same order answers "which notes are
+ * still sounding at time T" in O(log n + k) for k sounding notes.
+ */
+class VRPIANO554_API FSongTimeIndex
+{
+public:
+    /** Builds the index. Onsets must be sorted; Ends[i] is the end of the note starting at Onsets[i]. */
+    void Build(TArray<float>&& InOnsets, TArray<float>&& InEnds);
+    void Reset();
+
+    int32 Num() const { return Onsets.Num(); }
+
+    SIZE_T GetAllocatedSize() const { return Onsets.GetAllocatedSize() + Ends.GetAllocatedSize() + MaxEnds.GetAllocatedSize(); }
+
+    /** Index of the first note with an onset at or after Time, or Num() if there is none. */
+    int32 LowerBound(double Time) const;
+
+    /** Appends the indices of all notes with Onset < Time < End, in onset order. */
+    void FindSounding(double Time, TArray<int32>& OutIndices) const;
+
+private:
+    void CollectSounding(int32 Node, int32 NodeBegin, int32 NodeEnd, int32 QueryEnd, double Time, TArray<int32>& OutIndices) const;
+
+    TArray<float> Onsets;
+    TArray<float> Ends;
+
+    // Max end time of every subtree; node 1 is the root and covers [0, NumLeaves).
+    TArray<float> MaxEnds;
+    int32 NumLeaves = 0;
+};
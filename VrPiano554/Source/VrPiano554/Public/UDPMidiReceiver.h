@@ -1,10 +1,15 @@
 // Fill out your copyright notice in the Description page of Project Settings.
 #pragma once
 #include "CoreMinimal.h"
+#include <atomic>
 #include "GameFramework/Actor.h"
+#include "Containers/Queue.h"
+#include "Networking.h"
 #include "PianoActor.h"
 #include "UDPMidiReceiver.generated.h"
 
+class FUdpSocketReceiver;
+
 // Delegat dla zdarzeń nutowych
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_FourParams(FOnMidiNoteSignature, int32, Note, bool, bIsNoteOn, float, Duration, const FString&, Source);
 
@@ -32,7 +37,22 @@ protected:
     virtual void BeginPlay() override;
     virtual void EndPlay(const EEndPlayReason::Type EndPlayReason);
 
+    // Called on the socket receiver thread; queues the packet and wakes the actor.
+    void OnUDPMessageReceived(const FArrayReaderPtr& Data, const FIPv4Endpoint& Endpoint);
+    void ProcessPacket(const FArrayReaderPtr& Data, double ReceiveTime);
+
 protected:
     FSocket* ListenSocket;
+    FUdpSocketReceiver* UDPReceiver;
     APianoActor* PianoActorRef;
-};
\ No newline at end of file
+
+    struct FPendingPacket
+    {
+        FArrayReaderPtr Data;
+        double ReceiveTime = 0.0;
+    };
+
+    // Packets waiting for the game thread, stamped on arrival for the latency trace. The actor only ticks while this is non-empty.
+    TQueue<FPendingPacket, EQueueMode::Spsc> PendingPackets;
+    std::atomic<bool> bWakePending { false };
+};
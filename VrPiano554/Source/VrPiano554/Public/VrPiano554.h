@@ -7,6 +7,9 @@
 
 DECLARE_LOG_CATEGORY_EXTERN(LogVrPiano554, Log, All);
 
+DECLARE_STATS_GROUP(TEXT("VrPiano"), STATGROUP_VrPiano, STATCAT_Advanced);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Ticked Actors"), STAT_VrPianoTickedActors, STATGROUP_VrPiano, VRPIANO554_API);
+
 class VRPIANO554_API FVRPIANO554Module : public IModuleInterface
 {
 public:
@@ -61,4 +61,12 @@ protected:
 
 	// Update laser mesh position/scale
 	void UpdateLaserPointer();
+
+	// The laser is only needed while the piano menu is open, so the pawn ticks only then.
+	void BindToPianoMenu();
+
+	UFUNCTION()
+	void OnPianoMenuToggled(bool bIsMenuVisible);
+
+	FTimerHandle BindToPianoMenuTimer;
 };
@@ -7,14 +7,20 @@ public class VrPiano554 : ModuleRules
     {
         PCHUsage = PCHUsageMode.UseExplicitOrSharedPCHs;
 
-        PublicDependencyModuleNames.AddRange(new string[] { "Core", "CoreUObject", "Engine", "InputCore", "EnhancedInput", "HeadMountedDisplay", "XRBase", "Sockets", "Networking", "Json", "JsonUtilities", "UMG", "Slate", "SlateCore" });
+        PublicDependencyModuleNames.AddRange(new string[] { "Core", "CoreUObject", "Engine", "InputCore", "EnhancedInput", "HeadMountedDisplay", "XRBase", "Sockets", "Networking", "Json", "JsonUtilities", "UMG", "Slate", "SlateCore", "AudioMixer", "SignalProcessing" });
 
         if (Target.bBuildEditor == true)
         {
             PublicDependencyModuleNames.Add("UnrealEd");
         }
 
-        PrivateDependencyModuleNames.AddRange(new string[] {  });
+        PrivateDependencyModuleNames.AddRange(new string[] { "RenderCore", "RHI" });
+
+        // Native MIDI input; on Linux libasound is loaded at run time instead.
+        if (Target.Platform == UnrealTargetPlatform.Win64)
+        {
+            PublicSystemLibraries.Add("winmm.lib");
+        }
 
         // PublicIncludePaths.Add(Path.Combine(ModuleDirectory, "ThirdParty/MidiFileLib/src"));
     }
@@ -0,0 +1,880 @@
+#include "Bridge.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+namespace PianoBridge
+{
+    namespace
+    {
+        constexpr const char* LocalAddress = "127.0.0.1";
+        constexpr uint16_t NotePort = 5005;
+        constexpr uint16_t UiPort = 5007;
+        constexpr uint16_t BlocksPort = 5008;
+        constexpr uint16_t CommandPort = 5009;
+
+        // Datagrams from the engine are small; main.py read them with the same limit.
+        constexpr size_t CommandBufferBytes = 1024;
+
+        // The first note follows the song data by this much, as it did in main.py, so the falling
+        // block manager has built the song before the piano plays from it.
+        constexpr auto SongDataLeadTime = std::chrono::milliseconds(100);
+
+        // Note-offs go out up to this early, so one that falls due with a note-on of the same key, give
+        // or take rounding, goes first and does not let go of the key that was just struck again.
+        constexpr auto NoteOffSlack = std::chrono::milliseconds(1);
+
+        constexpr double SpeedStep = 0.05;
+        constexpr double MinSpeed = 0.1;
+        constexpr double MaxSpeed = 4.0;
+
+        constexpr uint8_t ControlSustain = 64;
+        constexpr uint8_t ControlSostenuto = 66;
+
+        // The notes the song data carries; main.py dropped the rest, which have no key to fall onto.
+        constexpr uint8_t LowestPianoNote = 21;
+        constexpr uint8_t HighestPianoNote = 108;
+
+        struct FCalibrationCommand
+        {
+            const char* Command;
+            const char* UiCommand;
+            double Value;
+        };
+
+        constexpr FCalibrationCommand CalibrationCommands[] = {
+            { "kalibracja_x_mniej", "adjust_x", -1.0 },
+            { "kalibracja_x_wiecej", "adjust_x", 1.0 },
+            { "kalibracja_y_mniej", "adjust_y", -1.0 },
+            { "kalibracja_y_wiecej", "adjust_y", 1.0 },
+            { "kalibracja_z_mniej", "adjust_z", -1.0 },
+            { "kalibracja_z_wiecej", "adjust_z", 1.0 },
+        };
+
+        FClock::duration ToClockDuration(double Seconds)
+        {
+            return std::chrono::duration_cast<FClock::duration>(std::chrono::duration<double>(Seconds));
+        }
+
+        std::string GetNoteName(int Note)
+        {
+            static constexpr const char* NoteNames[] = { "C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B" };
+            if (Note < LowestPianoNote || Note > HighestPianoNote)
+            {
+                return "Invalid Note";
+            }
+            return std::string(NoteNames[Note % 12]) + std::to_string(Note / 12 - 1);
+        }
+
+        bool IsMidiFile(const std::filesystem::path& Path)
+        {
+            const std::string Extension = Path.extension().u8string();
+            return Extension == ".mid" || Extension == ".midi";
+        }
+
+        // main.py skipped positions that were empty or null.
+        bool IsEmptyJsonValue(std::string_view Json)
+        {
+            return Json.empty() || Json == "null" || Json == "{}" || Json == "[]" || Json == "\"\"" || Json == "false" || Json == "0";
+        }
+
+        std::string_view TrimWhitespace(std::string_view Text)
+        {
+            while (!Text.empty() && std::isspace(static_cast<unsigned char>(Text.front())))
+            {
+                Text.remove_prefix(1);
+            }
+            while (!Text.empty() && (std::isspace(static_cast<unsigned char>(Text.back())) || Text.back() == '\0'))
+            {
+                Text.remove_suffix(1);
+            }
+            return Text;
+        }
+    }
+
+    FBridge::FBridge(const FBridgeOptions& InOptions)
+        : Options(InOptions)
+        , NoteEndpoint(MakeEndpoint(LocalAddress, NotePort))
+        , UiEndpoint(MakeEndpoint(LocalAddress, UiPort))
+        , BlocksEndpoint(MakeEndpoint(LocalAddress, BlocksPort))
+    {
+        Writer.Reserve(1024);
+    }
+
+    FBridge::~FBridge()
+    {
+        // The reader thread posts into the loop; stop it first.
+        MidiInput.reset();
+    }
+
+    bool FBridge::Init()
+    {
+        if (!Loop.Init() || !SendSocket.Open())
+        {
+            std::printf("ERROR: Could not open UDP sockets.\n");
+            return false;
+        }
+        if (!CommandSocket.Open(LocalAddress, CommandPort))
+        {
+            std::printf("ERROR: Could not listen on UDP %s:%d; is main.py or another bridge running?\n", LocalAddress, CommandPort);
+            return false;
+        }
+        Loop.Watch(CommandSocket, [this]() { ReceiveCommands(); });
+        Loop.SetPostedHandler([this](const FPostedEvent& Event)
+        {
+            if (Event.Type == FPostedEvent::EType::MidiMessage)
+            {
+                HandleLiveMessage(Event.Midi, Event.CaptureUnixSeconds);
+            }
+            else
+            {
+                HandleConsoleLine(Event.Line);
+            }
+        });
+
+        std::printf("Komendy:\n"
+            " s - start/restart file MIDI playback\n"
+            " n - next MIDI file\n"
+            " b - previous MIDI file\n"
+            " w - toggle practice mode (wait for key press)\n"
+            " p - toggle pause\n"
+            " rain - toggle rain mode\n"
+            " f - toggle mute file playback\n"
+            " v - toggle mute live MIDI\n"
+            " m - toggle mute all\n"
+            " u - unmute all\n"
+            " h - toggle LIVE hold\n"
+            " . - przyspiesz o 5%%\n"
+            " , - zwolnij o 5%%\n"
+            " q - quit\n\n");
+
+        UpdateMidiFiles(true);
+        if (Options.bLiveMidi)
+        {
+            MidiInput = FMidiInput::Open(Options.MidiInputDevice, [this](const uint8_t Message[3], double CaptureUnixSeconds)
+            {
+                FPostedEvent Event;
+                Event.Type = FPostedEvent::EType::MidiMessage;
+                std::copy(Message, Message + 3, Event.Midi);
+                Event.CaptureUnixSeconds = CaptureUnixSeconds;
+                if (!Loop.Post(Event))
+                {
+                    std::printf("[LiveMIDI] Event queue full; dropped a message.\n");
+                }
+            });
+        }
+        else
+        {
+            std::printf("[LiveMIDI] Disabled; the game reads the keyboard itself.\n");
+        }
+
+        SendMidiInfo();
+        SendTempo();
+        SendSpeedFactor();
+        std::printf("Listening for commands on UDP %s:%d\n", LocalAddress, CommandPort);
+        return true;
+    }
+
+    void FBridge::Run()
+    {
+        while (!bQuit)
+        {
+            Loop.RunUntil(GetNextDeadline());
+            PumpFilePlayback(FClock::now());
+        }
+
+        StopFilePlayback();
+        std::printf("Program zakończył działanie.\n");
+    }
+
+    void FBridge::PostConsoleLine(const std::string& Line)
+    {
+        FPostedEvent Event;
+        Event.Type = FPostedEvent::EType::ConsoleLine;
+        const size_t Length = std::min(Line.size(), sizeof(Event.Line) - 1);
+        std::memcpy(Event.Line, Line.data(), Length);
+        Event.Line[Length] = '\0';
+        Loop.Post(Event);
+    }
+
+    void FBridge::SendGameCommand(const char* Command)
+    {
+        if (Options.bVerbose)
+        {
+            std::printf("[DEBUG] --> UE (GameCommand): Sending to %s:%d: %s\n", LocalAddress, BlocksPort, Command);
+        }
+        SendSocket.SendTo(BlocksEndpoint, Command, std::strlen(Command) + 1);
+    }
+
+    void FBridge::UpdateMidiFiles(bool bForce)
+    {
+        // main.py listed the directory on every next/previous; its write time says whether anything changed.
+        const std::filesystem::path Directory = std::filesystem::u8path(Options.MidiDirectory);
+        std::error_code Error;
+        const std::filesystem::file_time_type WriteTime = std::filesystem::last_write_time(Directory, Error);
+        if (!Error && bMidiFilesScanned && !bForce && WriteTime == MidiDirectoryWriteTime)
+        {
+            return;
+        }
+
+        const std::filesystem::path Current = GetCurrentMidiPath();
+        std::vector<std::filesystem::path> Files;
+        std::filesystem::directory_iterator Entries(Directory, Error);
+        if (Error)
+        {
+            std::printf("ERROR: Could not read MIDI directory: %s\n", Error.message().c_str());
+            MidiFiles.clear();
+            bMidiFilesScanned = false;
+            return;
+        }
+        for (const std::filesystem::directory_entry& Entry : Entries)
+        {
+            if (IsMidiFile(Entry.path()))
+            {
+                Files.push_back(Entry.path());
+            }
+        }
+        std::sort(Files.begin(), Files.end());
+
+        MidiFiles = std::move(Files);
+        MidiDirectoryWriteTime = WriteTime;
+        bMidiFilesScanned = true;
+
+        // Stay on the selected file if it is still there.
+        const auto Found = std::find(MidiFiles.begin(), MidiFiles.end(), Current);
+        CurrentMidiIndex = Found != MidiFiles.end() ? size_t(Found - MidiFiles.begin()) : 0;
+
+        if (MidiFiles.empty())
+        {
+            std::printf("WARNING: No MIDI files found in the specified directory.\n");
+            return;
+        }
+        std::printf("INFO: Found %zu MIDI files.\n", MidiFiles.size());
+        for (size_t Index = 0; Index < MidiFiles.size(); ++Index)
+        {
+            std::printf("  %zu: %s\n", Index, MidiFiles[Index].filename().u8string().c_str());
+        }
+    }
+
+    std::filesystem::path FBridge::GetCurrentMidiPath() const
+    {
+        return CurrentMidiIndex < MidiFiles.size() ? MidiFiles[CurrentMidiIndex] : std::filesystem::path();
+    }
+
+    std::shared_ptr<const FBridge::FSong> FBridge::LoadSong(const std::filesystem::path& Path)
+    {
+        std::error_code Error;
+        const std::filesystem::file_time_type WriteTime = std::filesystem::last_write_time(Path, Error);
+        if (Error)
+        {
+            std::printf("[FilePlayback] MIDI file not found: %s\n", Path.u8string().c_str());
+            return nullptr;
+        }
+        const auto Cached = SongCache.find(Path);
+        if (Cached != SongCache.end() && Cached->second.WriteTime == WriteTime)
+        {
+            return Cached->second.Song;
+        }
+
+        std::printf("[SongData] Parsing %s to send full song data.\n", Path.u8string().c_str());
+        std::shared_ptr<FSong> NewSong = std::make_shared<FSong>();
+        std::string LoadError;
+        if (!LoadMidiNotes(Path, NewSong->Notes, LoadError))
+        {
+            std::printf("ERROR: Could not parse MIDI file: %s\n", LoadError.c_str());
+            return nullptr;
+        }
+
+        for (const FSongNote& Note : NewSong->Notes)
+        {
+            NewSong->Length = std::max(NewSong->Length, Note.Start + Note.Duration);
+        }
+
+        // Song time, unscaled: the falling block manager follows the speed through speed_factor.
+        Writer.Reset();
+        Writer.BeginObject().BeginArray("notes");
+        for (const FSongNote& Note : NewSong->Notes)
+        {
+            if (Note.Pitch < LowestPianoNote || Note.Pitch > HighestPianoNote)
+            {
+                continue;
+            }
+            Writer.BeginObject()
+                .Number("time", Note.Start)
+                .Int("midi_note", Note.Pitch)
+                .Number("duration", Note.Duration)
+                .Int("velocity", Note.Velocity)
+                .Int("track", Note.Part)
+                .EndObject();
+        }
+        Writer.EndArray().EndObject();
+        NewSong->SongData = Writer.GetText();
+
+        SongCache[Path] = { WriteTime, NewSong };
+        return NewSong;
+    }
+
+    void FBridge::SelectMidi(int Step)
+    {
+        UpdateMidiFiles(false);
+        if (MidiFiles.empty())
+        {
+            return;
+        }
+        CurrentMidiIndex = (CurrentMidiIndex + MidiFiles.size() + Step) % MidiFiles.size();
+        std::printf("Selected %s MIDI: %s\n", Step > 0 ? "next" : "previous", GetCurrentMidiPath().filename().u8string().c_str());
+        SendMidiInfo();
+        RestartFilePlayback();
+    }
+
+    void FBridge::RestartFilePlayback()
+    {
+        StopFilePlayback();
+        std::printf("[FilePlayback] Restarting MIDI playback...\n");
+
+        const std::filesystem::path Path = GetCurrentMidiPath();
+        if (Path.empty())
+        {
+            std::printf("ERROR: No MIDI file selected.\n");
+            return;
+        }
+        std::shared_ptr<const FSong> NewSong = LoadSong(Path);
+        if (!NewSong)
+        {
+            return;
+        }
+
+        std::printf("[SongData] Sending song data (%zu bytes) to %s:%d\n", NewSong->SongData.size(), LocalAddress, BlocksPort);
+        if (!SendSocket.SendTo(BlocksEndpoint, NewSong->SongData.data(), NewSong->SongData.size()))
+        {
+            std::printf("ERROR: Could not send song data; it may be too large for one datagram.\n");
+        }
+
+        // Every note-off the song can have pending, with room for the tail of a previous loop.
+        Song = std::move(NewSong);
+        NoteOffs.Reserve(Song->Notes.size() * 2);
+        NextNote = 0;
+        AnchorSongSeconds = 0.0;
+        AnchorTime = FClock::now() + SongDataLeadTime;
+        bPlaying = true;
+
+        SendMidiInfo();
+        std::printf("[FilePlayback] Starting playback of %s with %zu notes.\n", Path.u8string().c_str(), Song->Notes.size());
+    }
+
+    void FBridge::StopFilePlayback()
+    {
+        // main.py cancelled pending note-offs here, which left their keys down; they are sent instead.
+        FlushNoteOffs();
+        if (WaitingNote >= 0)
+        {
+            SendHighlight("highlight_off", Song->Notes[WaitingNote].Pitch);
+            WaitingNote = -1;
+        }
+        if (bPlaying)
+        {
+            std::printf("[FilePlayback] Finished playback.\n");
+        }
+        bPlaying = false;
+    }
+
+    void FBridge::PumpFilePlayback(FTimePoint Now)
+    {
+        uint8_t Pitch;
+        while (NoteOffs.PopDue(Now + NoteOffSlack, Pitch))
+        {
+            SendNoteMessage("note_off", Pitch, "file");
+        }
+
+        if (!bPlaying || bPaused || WaitingNote >= 0)
+        {
+            return;
+        }
+
+        const std::vector<FSongNote>& Notes = Song->Notes;
+        while (NextNote < Notes.size())
+        {
+            const FSongNote& Note = Notes[NextNote];
+            if (bPracticeMode)
+            {
+                // Practice mode ignores the clock: each note waits for its key.
+                WaitingNote = int64_t(NextNote);
+                SendHighlight("highlight_on", Note.Pitch);
+                std::printf("\033[93m[PRACTICE] Waiting for key: %s (%d)\033[0m\n", GetNoteName(Note.Pitch).c_str(), Note.Pitch);
+                return;
+            }
+            if (GetTimeOfSongSeconds(Note.Start) > Now)
+            {
+                return;
+            }
+            PlayFileNote(Note, Now);
+            ++NextNote;
+        }
+
+        if (bLoop && Song->Length > 0.0)
+        {
+            // main.py started over with the last note-on; waiting for the last note to end keeps the bar.
+            const FTimePoint LoopTime = GetTimeOfSongSeconds(Song->Length);
+            if (LoopTime > Now)
+            {
+                return;
+            }
+            NextNote = 0;
+            AnchorSongSeconds = 0.0;
+            AnchorTime = LoopTime;
+            SendMidiInfo();
+            PumpFilePlayback(Now);
+            return;
+        }
+        bPlaying = false;
+        std::printf("[FilePlayback] Finished playback.\n");
+    }
+
+    void FBridge::PlayFileNote(const FSongNote& Note, FTimePoint Now)
+    {
+        // A muted file still moves the keys, at a velocity too soft to sound.
+        const double Duration = Note.Duration / Speed;
+        SendNoteMessage("note_on", Note.Pitch, "file", bMutedFile ? 1 : Note.Velocity, Duration);
+        if (Duration > 0.0)
+        {
+            NoteOffs.Add(Now + ToClockDuration(Duration), Note.Pitch);
+        }
+        else
+        {
+            SendNoteMessage("note_off", Note.Pitch, "file");
+        }
+    }
+
+    void FBridge::ReleaseWaitingNote(FTimePoint Now)
+    {
+        if (WaitingNote < 0)
+        {
+            return;
+        }
+        const FSongNote& Note = Song->Notes[WaitingNote];
+        WaitingNote = -1;
+        PlayFileNote(Note, Now);
+        ++NextNote;
+
+        // The song resumes from the released note, so leaving practice mode does not rush to catch up.
+        AnchorSongSeconds = Note.Start;
+        AnchorTime = Now;
+    }
+
+    void FBridge::FlushNoteOffs()
+    {
+        uint8_t Pitch;
+        while (NoteOffs.Pop(Pitch))
+        {
+            SendNoteMessage("note_off", Pitch, "file");
+        }
+    }
+
+    double FBridge::GetSongSeconds(FTimePoint Now) const
+    {
+        if (bPaused)
+        {
+            return AnchorSongSeconds;
+        }
+        return AnchorSongSeconds + std::chrono::duration<double>(Now - AnchorTime).count() * Speed;
+    }
+
+    FTimePoint FBridge::GetTimeOfSongSeconds(double SongSeconds) const
+    {
+        return AnchorTime + ToClockDuration((SongSeconds - AnchorSongSeconds) / Speed);
+    }
+
+    FTimePoint FBridge::GetNextDeadline() const
+    {
+        FTimePoint Deadline = NoteOffs.GetNextDeadline();
+        if (bPlaying && !bPaused && !bPracticeMode && WaitingNote < 0)
+        {
+            const double NextSongSeconds = NextNote < Song->Notes.size() ? Song->Notes[NextNote].Start : Song->Length;
+            Deadline = std::min(Deadline, GetTimeOfSongSeconds(NextSongSeconds));
+        }
+        return Deadline;
+    }
+
+    void FBridge::ReceiveCommands()
+    {
+        char Buffer[CommandBufferBytes];
+        std::string Command;
+        int Size;
+        while ((Size = CommandSocket.Receive(Buffer, sizeof(Buffer))) >= 0)
+        {
+            const std::string_view Message = TrimWhitespace(std::string_view(Buffer, size_t(Size)));
+            std::string_view CommandValue;
+            if (!FindJsonMember(Message, "command", CommandValue) || !ParseJsonString(CommandValue, Command))
+            {
+                std::printf("Error processing command: %.*s\n", int(Message.size()), Message.data());
+                continue;
+            }
+            HandleCommand(Command, Message);
+        }
+    }
+
+    void FBridge::HandleCommand(std::string_view Command, std::string_view Message)
+    {
+        for (const FCalibrationCommand& Calibration : CalibrationCommands)
+        {
+            if (Command == Calibration.Command)
+            {
+                Writer.Reset();
+                Writer.BeginObject().String("command", Calibration.UiCommand).Number("value", Calibration.Value).EndObject();
+                SendUi();
+                return;
+            }
+        }
+
+        if (Command == "reset_pozycji")
+        {
+            Writer.Reset();
+            Writer.BeginObject().String("command", "reset_position").EndObject();
+            SendUi();
+        }
+        else if (Command == "wczytaj_pozycje")
+        {
+            std::ifstream File(std::filesystem::u8path(Options.PositionFile));
+            if (!File)
+            {
+                return;
+            }
+            const std::string Contents((std::istreambuf_iterator<char>(File)), std::istreambuf_iterator<char>());
+            const std::string_view Position = TrimWhitespace(Contents);
+            if (!IsJsonValue(Position))
+            {
+                std::printf("ERROR loading position: %s is not valid JSON\n", Options.PositionFile.c_str());
+                return;
+            }
+            std::printf("Position loaded from %s\n", Options.PositionFile.c_str());
+            if (!IsEmptyJsonValue(Position))
+            {
+                Writer.Reset();
+                Writer.BeginObject().String("command", "set_position").Raw("position", Position).EndObject();
+                SendUi();
+            }
+        }
+        else if (Command == "zapisz_pozycje")
+        {
+            std::string_view Position;
+            if (!FindJsonMember(Message, "position", Position) || IsEmptyJsonValue(Position))
+            {
+                return;
+            }
+            std::ofstream File(std::filesystem::u8path(Options.PositionFile), std::ios::trunc);
+            if (!(File << Position) || !File.flush())
+            {
+                std::printf("ERROR saving position: could not write %s\n", Options.PositionFile.c_str());
+                return;
+            }
+            std::printf("Position saved to %s\n", Options.PositionFile.c_str());
+        }
+        else if (Command == "start_restart")
+        {
+            RestartFilePlayback();
+        }
+        else if (Command == "next_midi")
+        {
+            SelectMidi(1);
+        }
+        else if (Command == "prev_midi")
+        {
+            SelectMidi(-1);
+        }
+        else if (Command == "pauza")
+        {
+            TogglePause();
+        }
+        else if (Command == "tryb_nauki")
+        {
+            if (!Options.bLiveMidi && !bPracticeMode)
+            {
+                // Practice mode waits for our own keyboard input, which is off.
+                std::printf("Tryb nauki wymaga wejścia MIDI mostka (uruchom bez --no-live-midi).\n");
+                return;
+            }
+            TogglePracticeMode();
+            std::printf("Tryb nauki %s\n", bPracticeMode ? "WŁĄCZONY" : "WYŁĄCZONY");
+        }
+        else if (Command == "life_hold")
+        {
+            bLiveHold = !bLiveHold;
+            std::printf("LIVE hold %s.\n", bLiveHold ? "włączone" : "wyłączone");
+        }
+        else if (Command == "midi_wolniej" || Command == "midi_szybciej")
+        {
+            ChangeSpeed(Command == "midi_szybciej" ? SpeedStep : -SpeedStep);
+            std::printf("[DEBUG] Prędkość odtwarzania zmieniona na: %ld%%\n", std::lround(Speed * 100.0));
+        }
+        else if (Command == "mute_file")
+        {
+            bMutedFile = !bMutedFile;
+            std::printf("Plik MIDI %s.\n", bMutedFile ? "wyciszony" : "odtwarzany");
+        }
+        else if (Command == "mute_live")
+        {
+            bMutedLive = !bMutedLive;
+            std::printf("Live MIDI %s.\n", bMutedLive ? "wyciszone" : "odtwarzane");
+        }
+        else if (Command == "unmute_all")
+        {
+            bMutedAll = false;
+            bMutedLive = false;
+            bMutedFile = false;
+            std::printf("Wszystkie tryby wyciszenia wyłączone.\n");
+        }
+        else if (Command == "toggle_loop")
+        {
+            bLoop = !bLoop;
+            Writer.Reset();
+            Writer.BeginObject().String("command", "update_button_state").String("button", "toggle_loop").Bool("is_active", bLoop).EndObject();
+            SendUi();
+            std::printf("Looping MIDI %s.\n", bLoop ? "włączone" : "wyłączone");
+        }
+        else if (Command == "toggle_file_animation_mute")
+        {
+            std::printf("Received toggle_file_animation_mute command from Unreal.\n");
+        }
+    }
+
+    void FBridge::HandleConsoleLine(std::string Line)
+    {
+        Line = std::string(TrimWhitespace(Line));
+        std::transform(Line.begin(), Line.end(), Line.begin(), [](unsigned char Character) { return char(std::tolower(Character)); });
+        if (Line.empty())
+        {
+            return;
+        }
+
+        if (Line == "q")
+        {
+            std::printf("Zamykanie programu...\n");
+            bQuit = true;
+        }
+        else if (Line == "s" || Line == "r")
+        {
+            RestartFilePlayback();
+        }
+        else if (Line == "n")
+        {
+            SelectMidi(1);
+        }
+        else if (Line == "b")
+        {
+            SelectMidi(-1);
+        }
+        else if (Line == "rain")
+        {
+            SendGameCommand("/rain");
+            std::printf("Toggled Rain Mode in game.\n");
+        }
+        else if (Line == "w")
+        {
+            TogglePracticeMode();
+            std::printf("[PRACTICE] Tryb nauki %s\n", bPracticeMode ? "WŁĄCZONY" : "WYŁĄCZONY");
+        }
+        else if (Line == "f")
+        {
+            HandleCommand("mute_file", {});
+        }
+        else if (Line == "v")
+        {
+            HandleCommand("mute_live", {});
+        }
+        else if (Line == "u")
+        {
+            HandleCommand("unmute_all", {});
+        }
+        else if (Line == "m")
+        {
+            if (!bMutedAll)
+            {
+                // Muting everything ends playback, like main.py; its pending note-offs still go out first.
+                StopFilePlayback();
+            }
+            bMutedAll = !bMutedAll;
+            std::printf("Całkowite wyciszenie %s.\n", bMutedAll ? "włączone" : "wyłączone");
+        }
+        else if (Line == "p")
+        {
+            TogglePause();
+        }
+        else if (Line == "h")
+        {
+            HandleCommand("life_hold", {});
+        }
+        else if (Line == "." || Line == ",")
+        {
+            ChangeSpeed(Line == "." ? SpeedStep : -SpeedStep);
+            std::printf("[SPEED] Prędkość odtwarzania: %ld%%\n", std::lround(Speed * 100.0));
+        }
+        else
+        {
+            std::printf("Nieznana komenda: %s\n", Line.c_str());
+        }
+    }
+
+    void FBridge::HandleLiveMessage(const uint8_t Message[3], double CaptureUnixSeconds)
+    {
+        const uint8_t Kind = Message[0] & 0xF0;
+        const int Note = Message[1];
+        const int Value = Message[2];
+        const bool bNoteOn = Kind == 0x90 && Value > 0;
+        const bool bNoteOff = Kind == 0x80 || (Kind == 0x90 && Value == 0);
+        const bool bPedal = Kind == 0xB0 && (Note == ControlSustain || Note == ControlSostenuto);
+
+        const bool bPracticeHit = bNoteOn && WaitingNote >= 0 && Song->Notes[WaitingNote].Pitch == Note;
+        if (bPracticeHit)
+        {
+            SendHighlight("highlight_off", Note);
+            std::printf("\033[94m[PRACTICE] Sent highlight_off for %s (%d)\033[0m\n", GetNoteName(Note).c_str(), Note);
+            std::printf("\033[92m[PRACTICE] Correct key: %d. Remaining: 0\033[0m\n", Note);
+        }
+
+        // Muting live input only silences it: the keys, highlights and pedal state still follow the
+        // keyboard, and a note-on of velocity 0 moves its key without sounding it.
+        if (!bMutedAll)
+        {
+            if (bNoteOn)
+            {
+                SendNoteMessage("note_on", Note, "live", bMutedLive ? 0 : Value, -1.0, CaptureUnixSeconds);
+            }
+            else if (bNoteOff)
+            {
+                SendNoteMessage("note_off", Note, "live");
+            }
+            else if (bPedal)
+            {
+                SendControlChange(Note, Value);
+            }
+        }
+
+        if (bPracticeHit)
+        {
+            ReleaseWaitingNote(FClock::now());
+        }
+    }
+
+    void FBridge::TogglePause()
+    {
+        const FTimePoint Now = FClock::now();
+        AnchorSongSeconds = GetSongSeconds(Now);
+        AnchorTime = Now;
+        bPaused = !bPaused;
+
+        Writer.Reset();
+        Writer.BeginObject().String("command", "toggle_pause").Bool("is_paused", bPaused).EndObject();
+        SendUi();
+        std::printf("Pauza %s.\n", bPaused ? "włączona" : "wyłączona");
+    }
+
+    void FBridge::TogglePracticeMode()
+    {
+        bPracticeMode = !bPracticeMode;
+
+        // Like main.py, toggling lets a note that is waiting for its key play.
+        ReleaseWaitingNote(FClock::now());
+    }
+
+    void FBridge::ChangeSpeed(double Step)
+    {
+        const FTimePoint Now = FClock::now();
+        AnchorSongSeconds = GetSongSeconds(Now);
+        AnchorTime = Now;
+        Speed = std::clamp(std::round((Speed + Step) * 100.0) / 100.0, MinSpeed, MaxSpeed);
+
+        SendTempo();
+        SendSpeedFactor();
+    }
+
+    void FBridge::SendNoteMessage(const char* Type, int Note, const char* Source, int Velocity, double Duration, double CaptureUnixSeconds)
+    {
+        if (bMutedAll)
+        {
+            return;
+        }
+
+        Writer.Reset();
+        Writer.BeginObject().String("type", Type).Int("note", Note).String("source", Source);
+        if (Velocity >= 0)
+        {
+            Writer.Int("velocity", Velocity);
+        }
+        if (Duration >= 0.0)
+        {
+            Writer.Number("duration", Duration);
+        }
+        if (CaptureUnixSeconds > 0.0)
+        {
+            // Lets the engine's latency trace follow this note from the keyboard to the screen.
+            Writer.Int("trace_id", int64_t(NextTraceId++)).Number("t_capture", CaptureUnixSeconds).Number("t_send", GetUnixSeconds());
+        }
+        Writer.EndObject();
+        SendNotes();
+        if (Options.bVerbose)
+        {
+            std::printf("Sent: %s\n", Writer.GetText().c_str());
+        }
+    }
+
+    void FBridge::SendHighlight(const char* Type, int Note)
+    {
+        Writer.Reset();
+        Writer.BeginObject().String("type", Type).BeginArray("notes").Int(nullptr, Note).EndArray().EndObject();
+        SendNotes();
+    }
+
+    void FBridge::SendControlChange(int Control, int Value)
+    {
+        if (bMutedAll)
+        {
+            return;
+        }
+        Writer.Reset();
+        Writer.BeginObject().String("type", "control_change").Int("control", Control).Int("value", Value).String("source", "live").EndObject();
+        SendNotes();
+    }
+
+    void FBridge::SendMidiInfo()
+    {
+        const std::filesystem::path Path = GetCurrentMidiPath();
+        const std::string Name = Path.empty() ? "None" : Path.filename().u8string();
+        Writer.Reset();
+        Writer.BeginObject().String("command", "update_midi_info").String("midi_info", "MIDI: " + Name).EndObject();
+        SendUi();
+    }
+
+    void FBridge::SendTempo()
+    {
+        Writer.Reset();
+        Writer.BeginObject().String("command", "update_tempo").Int("tempo", std::lround(Speed * 100.0)).EndObject();
+        SendUi();
+    }
+
+    void FBridge::SendSpeedFactor()
+    {
+        // The falling block manager takes this one without a terminating null.
+        Writer.Reset();
+        Writer.BeginObject().Number("speed_factor", Speed).EndObject();
+        SendSocket.SendTo(BlocksEndpoint, Writer.GetText().data(), Writer.GetText().size());
+    }
+
+    void FBridge::SendNotes()
+    {
+        SendSocket.SendTo(NoteEndpoint, Writer.GetText().c_str(), Writer.GetText().size() + 1);
+    }
+
+    void FBridge::SendUi()
+    {
+        if (Options.bVerbose)
+        {
+            std::printf("[DEBUG] --> UE (UI): Sending to %s:%d: %s\n", LocalAddress, UiPort, Writer.GetText().c_str());
+        }
+        SendSocket.SendTo(UiEndpoint, Writer.GetText().c_str(), Writer.GetText().size() + 1);
+    }
+}
@@ -0,0 +1,155 @@
+// Bridge.h
+
+#pragma once
+
+#include "EventLoop.h"
+#include "Json.h"
+#include "MidiFile.h"
+#include "MidiInput.h"
+#include "Udp.h"
+
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace PianoBridge
+{
+    struct FBridgeOptions
+    {
+        std::string MidiDirectory;
+        std::string PositionFile;
+        std::string MidiInputDevice = "Arturia";
+        bool bLiveMidi = true;
+        bool bVerbose = false;
+    };
+
+    /**
+     * The PC side of the piano, speaking main.py's protocol: notes to the piano on 5005, UI state on
+     * 5007, song data and game commands on 5008, and commands from the game on 5009. Everything runs
+     * on one thread around an FEventLoop; file playback is a cursor into the song's sorted notes plus
+     * a timer heap of note-offs, so nothing waits in a sleeping thread and nothing allocates per note.
+     * There is no audio here: the piano's native sampler plays what it receives, so the piano needs
+     * bUseNativeSampler on.
+     */
+    class FBridge
+    {
+    public:
+        explicit FBridge(const FBridgeOptions& InOptions);
+        ~FBridge();
+
+        bool Init();
+
+        /** Runs until the quit command. */
+        void Run();
+
+        /** Any thread: queues a console command for the loop. */
+        void PostConsoleLine(const std::string& Line);
+
+        /** Sends a plain text command to the falling block manager, e.g. "/rain". */
+        void SendGameCommand(const char* Command);
+
+    private:
+        struct FSong
+        {
+            std::vector<FSongNote> Notes;
+
+            // When the last note ends, where a loop starts over.
+            double Length = 0.0;
+
+            // The {"notes": [...]} datagram for the falling block manager, built once per file.
+            std::string SongData;
+        };
+
+        struct FCachedSong
+        {
+            std::filesystem::file_time_type WriteTime;
+            std::shared_ptr<const FSong> Song;
+        };
+
+        // Song list and cache.
+        void UpdateMidiFiles(bool bForce);
+        std::filesystem::path GetCurrentMidiPath() const;
+        std::shared_ptr<const FSong> LoadSong(const std::filesystem::path& Path);
+        void SelectMidi(int Step);
+
+        // File playback.
+        void RestartFilePlayback();
+        void StopFilePlayback();
+        void PumpFilePlayback(FTimePoint Now);
+        void PlayFileNote(const FSongNote& Note, FTimePoint Now);
+        void ReleaseWaitingNote(FTimePoint Now);
+        void FlushNoteOffs();
+        double GetSongSeconds(FTimePoint Now) const;
+        FTimePoint GetTimeOfSongSeconds(double SongSeconds) const;
+        FTimePoint GetNextDeadline() const;
+
+        // Input.
+        void ReceiveCommands();
+        void HandleCommand(std::string_view Command, std::string_view Message);
+        void HandleConsoleLine(std::string Line);
+        void HandleLiveMessage(const uint8_t Message[3], double CaptureUnixSeconds);
+
+        // State changes shared by engine and console commands.
+        void TogglePause();
+        void TogglePracticeMode();
+        void ChangeSpeed(double Step);
+
+        // Output.
+        void SendNoteMessage(const char* Type, int Note, const char* Source, int Velocity = -1, double Duration = -1.0,
+            double CaptureUnixSeconds = 0.0);
+        void SendHighlight(const char* Type, int Note);
+        void SendControlChange(int Control, int Value);
+        void SendMidiInfo();
+        void SendTempo();
+        void SendSpeedFactor();
+
+        /** Send what Writer holds, null-terminated as the engine's receivers expect. */
+        void SendNotes();
+        void SendUi();
+
+        FBridgeOptions Options;
+
+        FEventLoop Loop;
+        FUdpSocket SendSocket;
+        FUdpSocket CommandSocket;
+        sockaddr_in NoteEndpoint {};
+        sockaddr_in UiEndpoint {};
+        sockaddr_in BlocksEndpoint {};
+        FJsonWriter Writer;
+        std::unique_ptr<FMidiInput> MidiInput;
+
+        std::vector<std::filesystem::path> MidiFiles;
+        size_t CurrentMidiIndex = 0;
+        std::filesystem::file_time_type MidiDirectoryWriteTime {};
+        bool bMidiFilesScanned = false;
+        std::map<std::filesystem::path, FCachedSong> SongCache;
+
+        bool bMutedAll = false;
+        bool bMutedLive = false;
+        bool bMutedFile = true;
+        bool bPaused = false;
+
+        // Only shaped the Python bridge's own audio; kept so the toggle still answers.
+        bool bLiveHold = false;
+        bool bLoop = false;
+        bool bPracticeMode = false;
+        bool bQuit = false;
+        double Speed = 1.0;
+        uint64_t NextTraceId = 1;
+
+        // The song clock: song time AnchorSongSeconds at AnchorTime, advancing at Speed unless paused.
+        std::shared_ptr<const FSong> Song;
+        bool bPlaying = false;
+        size_t NextNote = 0;
+        FTimePoint AnchorTime {};
+        double AnchorSongSeconds = 0.0;
+
+        // Index of the note practice mode waits for, or -1.
+        int64_t WaitingNote = -1;
+
+        TTimerQueue<uint8_t> NoteOffs;
+    };
+}
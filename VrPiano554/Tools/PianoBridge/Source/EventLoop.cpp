@@ -0,0 +1,134 @@
+#include "EventLoop.h"
+
+#include <thread>
+
+namespace PianoBridge
+{
+    namespace
+    {
+        // poll() only counts whole milliseconds and may wake a little early or late; the last stretch
+        // before a deadline is waited out by yielding instead.
+        constexpr auto SpinWindow = std::chrono::microseconds(1500);
+    }
+
+    double GetUnixSeconds()
+    {
+        return std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    bool FEventLoop::Init()
+    {
+        if (!WakeSocket.Open("127.0.0.1", 0))
+        {
+            return false;
+        }
+        WakeEndpoint = MakeEndpoint("127.0.0.1", WakeSocket.GetPort());
+        Watches.push_back({ &WakeSocket, nullptr });
+        Descriptors.push_back({ WakeSocket.GetHandle(), POLLIN, 0 });
+        return true;
+    }
+
+    void FEventLoop::Watch(const FUdpSocket& Socket, std::function<void()> OnReadable)
+    {
+        Watches.push_back({ &Socket, std::move(OnReadable) });
+        Descriptors.push_back({ Socket.GetHandle(), POLLIN, 0 });
+    }
+
+    bool FEventLoop::Post(const FPostedEvent& Event)
+    {
+        {
+            std::lock_guard<std::mutex> Lock(QueueMutex);
+            if (QueueCount == QueueCapacity)
+            {
+                return false;
+            }
+            Queue[(QueueHead + QueueCount) % QueueCapacity] = Event;
+            ++QueueCount;
+        }
+
+        // One datagram per wake-up is enough; the loop drains the whole ring.
+        if (!bWakePending.exchange(true))
+        {
+            const char Byte = 0;
+            WakeSocket.SendTo(WakeEndpoint, &Byte, 1);
+        }
+        return true;
+    }
+
+    void FEventLoop::DrainPosted()
+    {
+        char Discard[16];
+        while (WakeSocket.Receive(Discard, sizeof(Discard)) >= 0)
+        {
+        }
+        bWakePending = false;
+
+        for (;;)
+        {
+            FPostedEvent Event;
+            {
+                std::lock_guard<std::mutex> Lock(QueueMutex);
+                if (QueueCount == 0)
+                {
+                    return;
+                }
+                Event = Queue[QueueHead];
+                QueueHead = (QueueHead + 1) % QueueCapacity;
+                --QueueCount;
+            }
+            if (OnPosted)
+            {
+                OnPosted(Event);
+            }
+        }
+    }
+
+    void FEventLoop::RunUntil(FTimePoint Deadline)
+    {
+        for (;;)
+        {
+            const FTimePoint Now = FClock::now();
+            if (Now >= Deadline)
+            {
+                return;
+            }
+
+            int TimeoutMs = -1;
+            if (Deadline != FTimePoint::max())
+            {
+                const auto Remaining = Deadline - Now - SpinWindow;
+                TimeoutMs = Remaining > FClock::duration::zero() ? int(std::chrono::duration_cast<std::chrono::milliseconds>(Remaining).count()) : 0;
+            }
+
+            for (FPollDescriptor& Descriptor : Descriptors)
+            {
+                Descriptor.revents = 0;
+            }
+            const int Ready = PollSockets(Descriptors.data(), Descriptors.size(), TimeoutMs);
+            if (Ready > 0)
+            {
+                for (size_t Index = 0; Index < Descriptors.size(); ++Index)
+                {
+                    if ((Descriptors[Index].revents & POLLIN) == 0)
+                    {
+                        continue;
+                    }
+                    if (Watches[Index].OnReadable)
+                    {
+                        Watches[Index].OnReadable();
+                    }
+                    else
+                    {
+                        DrainPosted();
+                    }
+                }
+                return;
+            }
+
+            if (TimeoutMs == 0)
+            {
+                std::this_thread::yield();
+            }
+        }
+    }
+}
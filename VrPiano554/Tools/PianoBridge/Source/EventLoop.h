@@ -0,0 +1,147 @@
+// EventLoop.h
+
+#pragma once
+
+#include "Udp.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace PianoBridge
+{
+    using FClock = std::chrono::steady_clock;
+    using FTimePoint = FClock::time_point;
+
+    /** Wall-clock seconds since the Unix epoch, the timebase of the engine's latency trace. */
+    double GetUnixSeconds();
+
+    /** Something another thread hands to the loop. Fixed size, so posting never allocates. */
+    struct FPostedEvent
+    {
+        enum class EType : uint8_t
+        {
+            MidiMessage,
+            ConsoleLine
+        };
+
+        EType Type = EType::MidiMessage;
+
+        // A complete channel message: status and up to two data bytes.
+        uint8_t Midi[3] = {};
+        double CaptureUnixSeconds = 0.0;
+
+        char Line[128] = {};
+    };
+
+    /**
+     * Single-threaded core of the bridge: waits on its sockets until a deadline, with sub-millisecond
+     * precision at the end, and runs the handlers of whatever arrived. Other threads post events
+     * through a fixed ring and wake the loop with a datagram to its own loopback socket, which works
+     * the same with poll() and WSAPoll().
+     */
+    class FEventLoop
+    {
+    public:
+        bool Init();
+
+        /** Setup only: OnReadable runs on the loop thread while Socket has datagrams waiting. */
+        void Watch(const FUdpSocket& Socket, std::function<void()> OnReadable);
+
+        void SetPostedHandler(std::function<void(const FPostedEvent&)> InOnPosted) { OnPosted = std::move(InOnPosted); }
+
+        /** Any thread. False if the ring is full and the event was dropped. */
+        bool Post(const FPostedEvent& Event);
+
+        /** Handles input until Deadline passes; returns early once something was handled. */
+        void RunUntil(FTimePoint Deadline);
+
+    private:
+        void DrainPosted();
+
+        struct FWatch
+        {
+            const FUdpSocket* Socket;
+            std::function<void()> OnReadable;
+        };
+
+        static constexpr size_t QueueCapacity = 1024;
+
+        FUdpSocket WakeSocket;
+        sockaddr_in WakeEndpoint {};
+        std::vector<FWatch> Watches;
+        std::vector<FPollDescriptor> Descriptors;
+        std::function<void(const FPostedEvent&)> OnPosted;
+
+        std::mutex QueueMutex;
+        std::array<FPostedEvent, QueueCapacity> Queue;
+        size_t QueueHead = 0;
+        size_t QueueCount = 0;
+        std::atomic<bool> bWakePending { false };
+    };
+
+    /**
+     * Deadlines in a binary heap over storage reserved up front, so adding a timer does not allocate
+     * while the reservation lasts. Timers with the same deadline fire in the order they were added.
+     */
+    template <typename PayloadType>
+    class TTimerQueue
+    {
+    public:
+        void Reserve(size_t Capacity) { Heap.reserve(Capacity); }
+        void Clear() { Heap.clear(); }
+        bool IsEmpty() const { return Heap.empty(); }
+        size_t Num() const { return Heap.size(); }
+
+        FTimePoint GetNextDeadline() const { return Heap.empty() ? FTimePoint::max() : Heap.front().Deadline; }
+
+        void Add(FTimePoint Deadline, const PayloadType& Payload)
+        {
+            Heap.push_back({ Deadline, NextSequence++, Payload });
+            std::push_heap(Heap.begin(), Heap.end(), &IsLater);
+        }
+
+        /** Takes the earliest timer if it is due by Now. */
+        bool PopDue(FTimePoint Now, PayloadType& OutPayload)
+        {
+            if (Heap.empty() || Heap.front().Deadline > Now)
+            {
+                return false;
+            }
+            return Pop(OutPayload);
+        }
+
+        /** Takes the earliest timer regardless of its deadline. */
+        bool Pop(PayloadType& OutPayload)
+        {
+            if (Heap.empty())
+            {
+                return false;
+            }
+            std::pop_heap(Heap.begin(), Heap.end(), &IsLater);
+            OutPayload = Heap.back().Payload;
+            Heap.pop_back();
+            return true;
+        }
+
+    private:
+        struct FEntry
+        {
+            FTimePoint Deadline;
+            uint64_t Sequence;
+            PayloadType Payload;
+        };
+
+        static bool IsLater(const FEntry& A, const FEntry& B)
+        {
+            return A.Deadline != B.Deadline ? A.Deadline > B.Deadline : A.Sequence > B.Sequence;
+        }
+
+        std::vector<FEntry> Heap;
+        uint64_t NextSequence = 0;
+    };
+}
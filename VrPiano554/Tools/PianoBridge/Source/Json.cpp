@@ -0,0 +1,375 @@
+#include "Json.h"
+
+#include <cctype>
+#include <charconv>
+#include <cmath>
+
+namespace PianoBridge
+{
+    namespace
+    {
+        constexpr int MaxNesting = 64;
+
+        struct FJsonCursor
+        {
+            std::string_view Text;
+            size_t Offset = 0;
+
+            bool AtEnd() const { return Offset >= Text.size(); }
+            char Peek() const { return AtEnd() ? '\0' : Text[Offset]; }
+
+            void SkipWhitespace()
+            {
+                while (!AtEnd() && (Text[Offset] == ' ' || Text[Offset] == '\t' || Text[Offset] == '\n' || Text[Offset] == '\r'))
+                {
+                    ++Offset;
+                }
+            }
+
+            bool Consume(char Expected)
+            {
+                SkipWhitespace();
+                if (Peek() != Expected)
+                {
+                    return false;
+                }
+                ++Offset;
+                return true;
+            }
+
+            bool SkipString()
+            {
+                if (Peek() != '"')
+                {
+                    return false;
+                }
+                for (++Offset; !AtEnd(); ++Offset)
+                {
+                    if (Text[Offset] == '\\')
+                    {
+                        ++Offset;
+                    }
+                    else if (Text[Offset] == '"')
+                    {
+                        ++Offset;
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            bool SkipValue(int Depth = 0)
+            {
+                SkipWhitespace();
+                const char First = Peek();
+                if (First == '"')
+                {
+                    return SkipString();
+                }
+                if (First == '{' || First == '[')
+                {
+                    if (Depth >= MaxNesting)
+                    {
+                        return false;
+                    }
+                    const char Close = First == '{' ? '}' : ']';
+                    ++Offset;
+                    if (Consume(Close))
+                    {
+                        return true;
+                    }
+                    do
+                    {
+                        if (First == '{')
+                        {
+                            SkipWhitespace();
+                            if (!SkipString() || !Consume(':'))
+                            {
+                                return false;
+                            }
+                        }
+                        if (!SkipValue(Depth + 1))
+                        {
+                            return false;
+                        }
+                    } while (Consume(','));
+                    return Consume(Close);
+                }
+
+                // Numbers, true, false and null.
+                const size_t Start = Offset;
+                while (!AtEnd() && (std::isalnum(static_cast<unsigned char>(Text[Offset])) || Text[Offset] == '-' || Text[Offset] == '+' || Text[Offset] == '.'))
+                {
+                    ++Offset;
+                }
+                return Offset > Start;
+            }
+        };
+
+        void AppendUtf8(std::string& Out, uint32_t CodePoint)
+        {
+            if (CodePoint < 0x80)
+            {
+                Out += char(CodePoint);
+            }
+            else if (CodePoint < 0x800)
+            {
+                Out += char(0xC0 | (CodePoint >> 6));
+                Out += char(0x80 | (CodePoint & 0x3F));
+            }
+            else if (CodePoint < 0x10000)
+            {
+                Out += char(0xE0 | (CodePoint >> 12));
+                Out += char(0x80 | ((CodePoint >> 6) & 0x3F));
+                Out += char(0x80 | (CodePoint & 0x3F));
+            }
+            else
+            {
+                Out += char(0xF0 | (CodePoint >> 18));
+                Out += char(0x80 | ((CodePoint >> 12) & 0x3F));
+                Out += char(0x80 | ((CodePoint >> 6) & 0x3F));
+                Out += char(0x80 | (CodePoint & 0x3F));
+            }
+        }
+
+        bool ReadHex4(std::string_view Text, size_t Offset, uint32_t& OutValue)
+        {
+            if (Offset + 4 > Text.size())
+            {
+                return false;
+            }
+            const auto Result = std::from_chars(Text.data() + Offset, Text.data() + Offset + 4, OutValue, 16);
+            return Result.ec == std::errc() && Result.ptr == Text.data() + Offset + 4;
+        }
+    }
+
+    void FJsonWriter::Reset()
+    {
+        Buffer.clear();
+        bNeedsComma = false;
+    }
+
+    void FJsonWriter::WriteKey(const char* Key)
+    {
+        if (bNeedsComma)
+        {
+            Buffer += ',';
+        }
+        if (Key)
+        {
+            WriteString(Key);
+            Buffer += ':';
+        }
+    }
+
+    void FJsonWriter::WriteString(std::string_view Value)
+    {
+        static constexpr char HexDigits[] = "0123456789abcdef";
+        Buffer += '"';
+        for (const char Character : Value)
+        {
+            switch (Character)
+            {
+            case '"': Buffer += "\\\""; break;
+            case '\\': Buffer += "\\\\"; break;
+            case '\n': Buffer += "\\n"; break;
+            case '\r': Buffer += "\\r"; break;
+            case '\t': Buffer += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(Character) < 0x20)
+                {
+                    Buffer += "\\u00";
+                    Buffer += HexDigits[(Character >> 4) & 0xF];
+                    Buffer += HexDigits[Character & 0xF];
+                }
+                else
+                {
+                    Buffer += Character;
+                }
+            }
+        }
+        Buffer += '"';
+    }
+
+    FJsonWriter& FJsonWriter::BeginObject(const char* Key)
+    {
+        WriteKey(Key);
+        Buffer += '{';
+        bNeedsComma = false;
+        return *this;
+    }
+
+    FJsonWriter& FJsonWriter::EndObject()
+    {
+        Buffer += '}';
+        bNeedsComma = true;
+        return *this;
+    }
+
+    FJsonWriter& FJsonWriter::BeginArray(const char* Key)
+    {
+        WriteKey(Key);
+        Buffer += '[';
+        bNeedsComma = false;
+        return *this;
+    }
+
+    FJsonWriter& FJsonWriter::EndArray()
+    {
+        Buffer += ']';
+        bNeedsComma = true;
+        return *this;
+    }
+
+    FJsonWriter& FJsonWriter::String(const char* Key, std::string_view Value)
+    {
+        WriteKey(Key);
+        WriteString(Value);
+        bNeedsComma = true;
+        return *this;
+    }
+
+    FJsonWriter& FJsonWriter::Int(const char* Key, int64_t Value)
+    {
+        WriteKey(Key);
+        char Digits[24];
+        const auto Result = std::to_chars(Digits, Digits + sizeof(Digits), Value);
+        Buffer.append(Digits, Result.ptr);
+        bNeedsComma = true;
+        return *this;
+    }
+
+    FJsonWriter& FJsonWriter::Number(const char* Key, double Value)
+    {
+        WriteKey(Key);
+        if (!std::isfinite(Value))
+        {
+            // JSON has no infinities or NaN.
+            Buffer += "null";
+        }
+        else
+        {
+            // The shortest text that reads back as the same double, like Python's repr.
+            char Digits[32];
+            const auto Result = std::to_chars(Digits, Digits + sizeof(Digits), Value);
+            Buffer.append(Digits, Result.ptr);
+        }
+        bNeedsComma = true;
+        return *this;
+    }
+
+    FJsonWriter& FJsonWriter::Bool(const char* Key, bool Value)
+    {
+        WriteKey(Key);
+        Buffer += Value ? "true" : "false";
+        bNeedsComma = true;
+        return *this;
+    }
+
+    FJsonWriter& FJsonWriter::Raw(const char* Key, std::string_view Json)
+    {
+        WriteKey(Key);
+        Buffer += Json;
+        bNeedsComma = true;
+        return *this;
+    }
+
+    bool FindJsonMember(std::string_view Json, std::string_view Key, std::string_view& OutValue)
+    {
+        FJsonCursor Cursor { Json };
+        if (!Cursor.Consume('{') || Cursor.Consume('}'))
+        {
+            return false;
+        }
+
+        std::string MemberKey;
+        do
+        {
+            Cursor.SkipWhitespace();
+            const size_t KeyStart = Cursor.Offset;
+            if (!Cursor.SkipString() || !ParseJsonString(Json.substr(KeyStart, Cursor.Offset - KeyStart), MemberKey) || !Cursor.Consume(':'))
+            {
+                return false;
+            }
+            Cursor.SkipWhitespace();
+            const size_t ValueStart = Cursor.Offset;
+            if (!Cursor.SkipValue())
+            {
+                return false;
+            }
+            if (MemberKey == Key)
+            {
+                OutValue = Json.substr(ValueStart, Cursor.Offset - ValueStart);
+                return true;
+            }
+        } while (Cursor.Consume(','));
+        return false;
+    }
+
+    bool IsJsonValue(std::string_view Text)
+    {
+        FJsonCursor Cursor { Text };
+        if (!Cursor.SkipValue())
+        {
+            return false;
+        }
+        Cursor.SkipWhitespace();
+        return Cursor.AtEnd();
+    }
+
+    bool ParseJsonString(std::string_view Literal, std::string& OutValue)
+    {
+        OutValue.clear();
+        if (Literal.size() < 2 || Literal.front() != '"' || Literal.back() != '"')
+        {
+            return false;
+        }
+        for (size_t Offset = 1; Offset + 1 < Literal.size(); ++Offset)
+        {
+            const char Character = Literal[Offset];
+            if (Character != '\\')
+            {
+                OutValue += Character;
+                continue;
+            }
+            if (++Offset + 1 >= Literal.size())
+            {
+                return false;
+            }
+            switch (Literal[Offset])
+            {
+            case '"': OutValue += '"'; break;
+            case '\\': OutValue += '\\'; break;
+            case '/': OutValue += '/'; break;
+            case 'b': OutValue += '\b'; break;
+            case 'f': OutValue += '\f'; break;
+            case 'n': OutValue += '\n'; break;
+            case 'r': OutValue += '\r'; break;
+            case 't': OutValue += '\t'; break;
+            case 'u':
+            {
+                uint32_t CodePoint;
+                if (!ReadHex4(Literal, Offset + 1, CodePoint))
+                {
+                    return false;
+                }
+                Offset += 4;
+
+                // A surrogate pair spells one code point above the basic plane.
+                uint32_t Low;
+                if (CodePoint >= 0xD800 && CodePoint < 0xDC00 && Offset + 7 < Literal.size() && Literal[Offset + 1] == '\\'
+                    && Literal[Offset + 2] == 'u' && ReadHex4(Literal, Offset + 3, Low) && Low >= 0xDC00 && Low < 0xE000)
+                {
+                    CodePoint = 0x10000 + ((CodePoint - 0xD800) << 10) + (Low - 0xDC00);
+                    Offset += 6;
+                }
+                AppendUtf8(OutValue, CodePoint);
+                break;
+            }
+            default:
+                return false;
+            }
+        }
+        return true;
+    }
+}
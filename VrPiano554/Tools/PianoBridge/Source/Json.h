@@ -0,0 +1,57 @@
+// Json.h
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace PianoBridge
+{
+    /**
+     * Writes compact JSON into a buffer that is kept between messages, so once it has grown to the
+     * largest message, writing one allocates nothing. Members take a key; array elements pass nullptr.
+     */
+    class FJsonWriter
+    {
+    public:
+        void Reserve(size_t Capacity) { Buffer.reserve(Capacity); }
+
+        /** Empties the buffer, keeping its capacity. */
+        void Reset();
+
+        FJsonWriter& BeginObject(const char* Key = nullptr);
+        FJsonWriter& EndObject();
+        FJsonWriter& BeginArray(const char* Key = nullptr);
+        FJsonWriter& EndArray();
+
+        FJsonWriter& String(const char* Key, std::string_view Value);
+        FJsonWriter& Int(const char* Key, int64_t Value);
+        FJsonWriter& Number(const char* Key, double Value);
+        FJsonWriter& Bool(const char* Key, bool Value);
+
+        /** Json must already be a complete JSON value. */
+        FJsonWriter& Raw(const char* Key, std::string_view Json);
+
+        const std::string& GetText() const { return Buffer; }
+
+    private:
+        void WriteKey(const char* Key);
+        void WriteString(std::string_view Value);
+
+        std::string Buffer;
+        bool bNeedsComma = false;
+    };
+
+    /**
+     * Finds Key among the members of the object Json holds and returns the raw text of its value.
+     * Enough for the flat commands the engine sends; false if Json is not an object or lacks Key.
+     */
+    bool FindJsonMember(std::string_view Json, std::string_view Key, std::string_view& OutValue);
+
+    /** True if Text holds exactly one JSON value, with nothing but whitespace around it. */
+    bool IsJsonValue(std::string_view Text);
+
+    /** Decodes a JSON string literal, quotes included; \u escapes become UTF-8. */
+    bool ParseJsonString(std::string_view Literal, std::string& OutValue);
+}
@@ -0,0 +1,145 @@
+// PianoBridge: a native stand-in for main.py, compatible with the VrPiano554 module.
+
+#include "Bridge.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <timeapi.h>
+#endif
+
+namespace
+{
+    // main.py's defaults.
+    constexpr const char* DefaultMidiDirectory = "C:\\Users\\Bartek\\Documents\\Unreal Projects\\VrPiano554\\Source\\VrPiano554\\midi";
+    constexpr const char* DefaultPositionFile = "C:\\Users\\Bartek\\Documents\\Unreal Projects\\VrPiano554\\piano_position.json";
+
+    void PrintUsage(const char* Program)
+    {
+        std::printf("Usage: %s [options]\n"
+            "  --midi-dir <path>       MIDI files to play (default: main.py's)\n"
+            "  --position-file <path>  where the piano position is saved (default: main.py's)\n"
+            "  --midi-in <device>      keyboard to read: a name substring (default: Arturia),\n"
+            "                          alsa:<client>:<port>, or fifo:<path> for raw MIDI bytes\n"
+            "  --no-live-midi          do not open the keyboard; use with the piano's native MIDI input.\n"
+            "                          Disables practice mode.\n"
+            "  --rain                  toggle rain mode in the game on startup\n"
+            "  --verbose               print every message sent\n",
+            Program);
+    }
+}
+
+int main(int ArgCount, char** Args)
+{
+    PianoBridge::FBridgeOptions Options;
+    Options.MidiDirectory = DefaultMidiDirectory;
+    Options.PositionFile = DefaultPositionFile;
+    bool bRain = false;
+
+    for (int Index = 1; Index < ArgCount; ++Index)
+    {
+        const char* Arg = Args[Index];
+        const bool bHasValue = Index + 1 < ArgCount;
+        if (std::strcmp(Arg, "--midi-dir") == 0 && bHasValue)
+        {
+            Options.MidiDirectory = Args[++Index];
+        }
+        else if (std::strcmp(Arg, "--position-file") == 0 && bHasValue)
+        {
+            Options.PositionFile = Args[++Index];
+        }
+        else if (std::strcmp(Arg, "--midi-in") == 0 && bHasValue)
+        {
+            Options.MidiInputDevice = Args[++Index];
+        }
+        else if (std::strcmp(Arg, "--no-live-midi") == 0)
+        {
+            Options.bLiveMidi = false;
+        }
+        else if (std::strcmp(Arg, "--rain") == 0)
+        {
+            bRain = true;
+        }
+        else if (std::strcmp(Arg, "--verbose") == 0)
+        {
+            Options.bVerbose = true;
+        }
+        else
+        {
+            PrintUsage(Args[0]);
+            return std::strcmp(Arg, "--help") == 0 || std::strcmp(Arg, "-h") == 0 ? 0 : 2;
+        }
+    }
+
+    // Console output is occasional and should appear at once, even through a pipe.
+    std::setvbuf(stdout, nullptr, _IONBF, 0);
+
+#ifdef _WIN32
+    // Polish messages and the practice mode's colours, as run.bat set up for main.py.
+    SetConsoleOutputCP(CP_UTF8);
+    DWORD ConsoleMode = 0;
+    const HANDLE Console = GetStdHandle(STD_OUTPUT_HANDLE);
+    if (GetConsoleMode(Console, &ConsoleMode))
+    {
+        SetConsoleMode(Console, ConsoleMode | ENABLE_VIRTUAL_TERMINAL_PROCESSING);
+    }
+
+    // The scheduler's default 15.6 ms tick would blur every note deadline.
+    timeBeginPeriod(1);
+#endif
+
+    if (!PianoBridge::StartupSockets())
+    {
+        std::printf("ERROR: Could not start networking.\n");
+        return 1;
+    }
+
+    PianoBridge::FBridge Bridge(Options);
+    if (!Bridge.Init())
+    {
+        return 1;
+    }
+
+    if (bRain)
+    {
+        // Give the game a moment to start up and listen on the socket.
+        std::this_thread::sleep_for(std::chrono::seconds(2));
+        Bridge.SendGameCommand("/rain");
+        std::printf("Sent /rain command to Unreal Engine.\n");
+    }
+
+    std::thread([&Bridge]()
+    {
+        std::string Line;
+        for (;;)
+        {
+            std::printf("Podaj komende: ");
+            if (!std::getline(std::cin, Line))
+            {
+                std::printf("\nExiting...\n");
+                Bridge.PostConsoleLine("q");
+                return;
+            }
+            Bridge.PostConsoleLine(Line);
+        }
+    }).detach();
+
+    Bridge.Run();
+
+#ifdef _WIN32
+    timeEndPeriod(1);
+#endif
+    PianoBridge::ShutdownSockets();
+
+    // The console reader may still be blocked in getline, holding on to the bridge, and a blocking
+    // read cannot be interrupted portably; leave without unwinding.
+    std::fflush(stdout);
+    std::_Exit(0);
+}
@@ -0,0 +1,318 @@
+#include "MidiFile.h"
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <tuple>
+
+namespace PianoBridge
+{
+    namespace
+    {
+        uint32_t ReadUInt32BE(const uint8_t* Bytes) { return (uint32_t(Bytes[0]) << 24) | (uint32_t(Bytes[1]) << 16) | (uint32_t(Bytes[2]) << 8) | uint32_t(Bytes[3]); }
+        uint16_t ReadUInt16BE(const uint8_t* Bytes) { return uint16_t((Bytes[0] << 8) | Bytes[1]); }
+
+        constexpr uint8_t MetaEvent = 0xFF;
+        constexpr uint8_t MetaSetTempo = 0x51;
+        constexpr uint8_t SysExStart = 0xF0;
+        constexpr uint8_t SysExContinue = 0xF7;
+
+        // 120 bpm, the default until the first tempo event.
+        constexpr uint32_t DefaultMicrosecondsPerQuarter = 500000;
+
+        struct FTrackReader
+        {
+            const uint8_t* Cursor;
+            const uint8_t* End;
+
+            bool AtEnd() const { return Cursor >= End; }
+
+            bool ReadByte(uint8_t& OutByte)
+            {
+                if (Cursor >= End)
+                {
+                    return false;
+                }
+                OutByte = *Cursor++;
+                return true;
+            }
+
+            // Variable-length quantity: seven bits per byte, most significant first, at most four bytes.
+            bool ReadVariableLength(uint32_t& OutValue)
+            {
+                OutValue = 0;
+                for (int Index = 0; Index < 4; ++Index)
+                {
+                    uint8_t Byte;
+                    if (!ReadByte(Byte))
+                    {
+                        return false;
+                    }
+                    OutValue = (OutValue << 7) | (Byte & 0x7F);
+                    if ((Byte & 0x80) == 0)
+                    {
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            bool Skip(uint32_t Count)
+            {
+                if (Count > uint32_t(End - Cursor))
+                {
+                    return false;
+                }
+                Cursor += Count;
+                return true;
+            }
+        };
+
+        struct FChannelEvent
+        {
+            uint64_t Tick;
+            uint8_t Status;
+            uint8_t Data[2];
+        };
+
+        struct FTempoChange
+        {
+            uint64_t Tick;
+            double Seconds;
+            double SecondsPerTick;
+        };
+
+        bool Fail(std::string& OutError, const std::string& Message)
+        {
+            OutError = Message;
+            return false;
+        }
+    }
+
+    int GetChannelMessageDataLength(uint8_t Status)
+    {
+        switch (Status & 0xF0)
+        {
+        case 0x80: case 0x90: case 0xA0: case 0xB0: case 0xE0:
+            return 2;
+        case 0xC0: case 0xD0:
+            return 1;
+        default:
+            return -1;
+        }
+    }
+
+    bool LoadMidiNotes(const std::filesystem::path& Path, std::vector<FSongNote>& OutNotes, std::string& OutError)
+    {
+        OutNotes.clear();
+        std::ifstream File(Path, std::ios::binary);
+        if (!File)
+        {
+            return Fail(OutError, "could not read " + Path.u8string());
+        }
+        const std::vector<uint8_t> FileBytes((std::istreambuf_iterator<char>(File)), std::istreambuf_iterator<char>());
+        const uint8_t* Bytes = FileBytes.data();
+        const int64_t Size = int64_t(FileBytes.size());
+        if (Size < 14 || std::equal(Bytes, Bytes + 4, "MThd") == false || ReadUInt32BE(Bytes + 4) < 6)
+        {
+            return Fail(OutError, "not a Standard MIDI File");
+        }
+
+        const uint16_t Format = ReadUInt16BE(Bytes + 8);
+        const uint16_t NumTracks = ReadUInt16BE(Bytes + 10);
+        const uint16_t Division = ReadUInt16BE(Bytes + 12);
+        if (Format > 1)
+        {
+            return Fail(OutError, "format " + std::to_string(Format) + " files are not supported");
+        }
+
+        // Either ticks per quarter note, or SMPTE frames per second times ticks per frame.
+        const bool bSmpte = (Division & 0x8000) != 0;
+        const double TicksPerQuarter = bSmpte ? 0.0 : double(std::max<uint16_t>(Division, 1));
+        const double SmpteTicksPerSecond = bSmpte ? double(-int8_t(Division >> 8)) * double(Division & 0xFF) : 0.0;
+        if (bSmpte && SmpteTicksPerSecond <= 0.0)
+        {
+            return Fail(OutError, "invalid SMPTE division");
+        }
+
+        std::vector<std::vector<FChannelEvent>> Tracks;
+        std::vector<std::pair<uint64_t, uint32_t>> TempoEvents;
+        int64_t Offset = 8 + ReadUInt32BE(Bytes + 4);
+        while (int(Tracks.size()) < NumTracks && Offset + 8 <= Size)
+        {
+            const uint32_t ChunkSize = ReadUInt32BE(Bytes + Offset + 4);
+            const bool bIsTrack = std::equal(Bytes + Offset, Bytes + Offset + 4, "MTrk");
+            const int64_t ChunkData = Offset + 8;
+            Offset = ChunkData + ChunkSize;
+            if (!bIsTrack)
+            {
+                // Unknown chunks are skipped, as the standard asks.
+                continue;
+            }
+            const int Track = int(Tracks.size()) + 1;
+            std::vector<FChannelEvent>& Events = Tracks.emplace_back();
+
+            FTrackReader Reader { Bytes + ChunkData, Bytes + std::min(Offset, Size) };
+            uint64_t Tick = 0;
+            uint8_t RunningStatus = 0;
+            while (!Reader.AtEnd())
+            {
+                uint32_t Delta;
+                uint8_t Status;
+                if (!Reader.ReadVariableLength(Delta) || !Reader.ReadByte(Status))
+                {
+                    return Fail(OutError, "track " + std::to_string(Track) + " is truncated");
+                }
+                Tick += Delta;
+
+                if (Status == MetaEvent)
+                {
+                    uint8_t Type;
+                    uint32_t Length;
+                    if (!Reader.ReadByte(Type) || !Reader.ReadVariableLength(Length) || Length > uint32_t(Reader.End - Reader.Cursor))
+                    {
+                        return Fail(OutError, "track " + std::to_string(Track) + " has a truncated meta event");
+                    }
+                    if (Type == MetaSetTempo && Length == 3)
+                    {
+                        const uint8_t* Data = Reader.Cursor;
+                        TempoEvents.emplace_back(Tick, (uint32_t(Data[0]) << 16) | (uint32_t(Data[1]) << 8) | uint32_t(Data[2]));
+                    }
+                    Reader.Skip(Length);
+                    RunningStatus = 0;
+                    continue;
+                }
+                if (Status == SysExStart || Status == SysExContinue)
+                {
+                    uint32_t Length;
+                    if (!Reader.ReadVariableLength(Length) || !Reader.Skip(Length))
+                    {
+                        return Fail(OutError, "track " + std::to_string(Track) + " has a truncated system exclusive event");
+                    }
+                    RunningStatus = 0;
+                    continue;
+                }
+
+                // A data byte where a status byte should be repeats the previous channel status.
+                FChannelEvent Event { Tick, Status, { 0, 0 } };
+                int DataIndex = 0;
+                if (Status < 0x80)
+                {
+                    if (RunningStatus == 0)
+                    {
+                        return Fail(OutError, "track " + std::to_string(Track) + " uses running status without a status byte");
+                    }
+                    Event.Data[DataIndex++] = Status;
+                    Event.Status = Status = RunningStatus;
+                }
+                const int DataLength = GetChannelMessageDataLength(Status);
+                if (DataLength < 0)
+                {
+                    return Fail(OutError, "track " + std::to_string(Track) + " has an unexpected status byte");
+                }
+                RunningStatus = Status;
+                for (; DataIndex < DataLength; ++DataIndex)
+                {
+                    if (!Reader.ReadByte(Event.Data[DataIndex]))
+                    {
+                        return Fail(OutError, "track " + std::to_string(Track) + " is truncated");
+                    }
+                }
+                const uint8_t Kind = Status & 0xF0;
+                if (Kind == 0x80 || Kind == 0x90 || Kind == 0xC0)
+                {
+                    Events.push_back(Event);
+                }
+            }
+        }
+
+        // The tempo map as segments, each starting at a tempo change; SMPTE time ignores tempo.
+        std::stable_sort(TempoEvents.begin(), TempoEvents.end(), [](const auto& A, const auto& B) { return A.first < B.first; });
+        std::vector<FTempoChange> TempoMap;
+        TempoMap.push_back({ 0, 0.0, bSmpte ? 1.0 / SmpteTicksPerSecond : DefaultMicrosecondsPerQuarter * 1e-6 / TicksPerQuarter });
+        for (const auto& [Tick, MicrosecondsPerQuarter] : TempoEvents)
+        {
+            if (bSmpte)
+            {
+                break;
+            }
+            const FTempoChange Last = TempoMap.back();
+            TempoMap.push_back({ Tick, Last.Seconds + (Tick - Last.Tick) * Last.SecondsPerTick, MicrosecondsPerQuarter * 1e-6 / TicksPerQuarter });
+        }
+        auto TickToSeconds = [&TempoMap](uint64_t Tick)
+        {
+            const auto Segment = std::prev(std::upper_bound(TempoMap.begin(), TempoMap.end(), Tick,
+                [](uint64_t Value, const FTempoChange& Change) { return Value < Change.Tick; }));
+            return Segment->Seconds + (Tick - Segment->Tick) * Segment->SecondsPerTick;
+        };
+
+        struct FOpenNote
+        {
+            uint64_t Tick;
+            uint8_t Velocity;
+        };
+        std::map<std::tuple<int, uint8_t, uint8_t>, uint16_t> PartIndices;
+        std::vector<std::vector<FSongNote>> Parts;
+
+        for (int Track = 0; Track < int(Tracks.size()); ++Track)
+        {
+            std::array<uint8_t, 16> Programs {};
+            std::vector<std::vector<FOpenNote>> OpenNotes(16 * 128);
+            for (const FChannelEvent& Event : Tracks[Track])
+            {
+                const uint8_t Channel = Event.Status & 0x0F;
+                const uint8_t Kind = Event.Status & 0xF0;
+                if (Kind == 0xC0)
+                {
+                    Programs[Channel] = Event.Data[0] & 0x7F;
+                    continue;
+                }
+
+                const uint8_t Pitch = Event.Data[0] & 0x7F;
+                const uint8_t Velocity = Event.Data[1] & 0x7F;
+                std::vector<FOpenNote>& Open = OpenNotes[Channel * 128 + Pitch];
+                if (Kind == 0x90 && Velocity > 0)
+                {
+                    Open.push_back({ Event.Tick, Velocity });
+                    continue;
+                }
+                if (Open.empty())
+                {
+                    continue;
+                }
+
+                // Ends the notes that started before this tick; if all started on it, ends them all.
+                const bool bAnyEarlier = std::any_of(Open.begin(), Open.end(), [&Event](const FOpenNote& Note) { return Note.Tick != Event.Tick; });
+                const auto Key = std::make_tuple(Track, Channel, Programs[Channel]);
+                auto Part = PartIndices.find(Key);
+                if (Part == PartIndices.end())
+                {
+                    Part = PartIndices.emplace(Key, uint16_t(Parts.size())).first;
+                    Parts.emplace_back();
+                }
+                const double EndSeconds = TickToSeconds(Event.Tick);
+                auto Remaining = Open.begin();
+                for (const FOpenNote& Note : Open)
+                {
+                    if (bAnyEarlier && Note.Tick == Event.Tick)
+                    {
+                        *Remaining++ = Note;
+                        continue;
+                    }
+                    const double StartSeconds = TickToSeconds(Note.Tick);
+                    Parts[Part->second].push_back({ StartSeconds, std::max(0.0, EndSeconds - StartSeconds), Pitch, Note.Velocity, Part->second });
+                }
+                Open.erase(Remaining, Open.end());
+            }
+        }
+
+        for (const std::vector<FSongNote>& PartNotes : Parts)
+        {
+            OutNotes.insert(OutNotes.end(), PartNotes.begin(), PartNotes.end());
+        }
+        std::stable_sort(OutNotes.begin(), OutNotes.end(), [](const FSongNote& A, const FSongNote& B) { return A.Start < B.Start; });
+        return true;
+    }
+}
@@ -0,0 +1,33 @@
+// MidiFile.h
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace PianoBridge
+{
+    struct FSongNote
+    {
+        double Start = 0.0;
+        double Duration = 0.0;
+        uint8_t Pitch = 0;
+        uint8_t Velocity = 0;
+
+        // Index of the (track, channel, program) part the note belongs to, as pretty_midi numbers its instruments.
+        uint16_t Part = 0;
+    };
+
+    /** Data bytes following a channel status byte (0x80-0xEF), or -1 for anything else. */
+    int GetChannelMessageDataLength(uint8_t Status);
+
+    /**
+     * Reads the notes of a format 0 or 1 Standard MIDI File, timed through its tempo map, the way the
+     * Python bridge got them from pretty_midi: a note-off ends every open note of its key and channel
+     * in that track that started earlier, note-ons with velocity 0 are note-offs, and notes are grouped
+     * into parts by track, channel and program. The result is sorted by start, stably, parts in order.
+     */
+    bool LoadMidiNotes(const std::filesystem::path& Path, std::vector<FSongNote>& OutNotes, std::string& OutError);
+}
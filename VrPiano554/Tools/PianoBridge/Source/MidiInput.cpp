@@ -0,0 +1,643 @@
+#include "MidiInput.h"
+#include "EventLoop.h"
+#include "MidiFile.h"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <mmsystem.h>
+#else
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace PianoBridge
+{
+    namespace
+    {
+        constexpr int ReadBufferBytes = 256;
+
+        // Bounds how long closing the input waits for the reader.
+        constexpr int ReadTimeoutMs = 50;
+
+        constexpr auto ReopenInterval = std::chrono::seconds(1);
+
+        bool MatchesDeviceName(const std::string& Name, const std::string& Filter)
+        {
+            return Name.find(Filter) != std::string::npos && Name.find("MIDIOUT2") == std::string::npos;
+        }
+
+#ifndef _WIN32
+        // Waits for any of Fds to become readable; returns 1 if one is, 0 on timeout, -1 on error.
+        int PollReadable(pollfd* Fds, int NumFds, int TimeoutMs)
+        {
+            const int Ready = poll(Fds, NumFds, TimeoutMs);
+            if (Ready < 0)
+            {
+                return errno == EINTR ? 0 : -1;
+            }
+            for (int Index = 0; Index < NumFds; ++Index)
+            {
+                if (Fds[Index].revents & (POLLERR | POLLNVAL))
+                {
+                    return -1;
+                }
+            }
+            return Ready > 0 ? 1 : 0;
+        }
+
+        // A named pipe carrying raw MIDI bytes, e.g. from `amidi -d` or a test script.
+        class FFifoSource : public IMidiByteSource
+        {
+        public:
+            static std::unique_ptr<IMidiByteSource> Open(const std::string& Path)
+            {
+                if (mkfifo(Path.c_str(), 0666) != 0 && errno != EEXIST)
+                {
+                    std::printf("[LiveMIDI] Could not create FIFO %s (errno %d).\n", Path.c_str(), errno);
+                    return nullptr;
+                }
+                struct stat Info;
+                if (stat(Path.c_str(), &Info) != 0 || !S_ISFIFO(Info.st_mode))
+                {
+                    std::printf("[LiveMIDI] %s exists and is not a FIFO.\n", Path.c_str());
+                    return nullptr;
+                }
+
+                // Opened for writing too, so the pipe never reports end of file between writers.
+                const int Fd = open(Path.c_str(), O_RDWR | O_NONBLOCK);
+                if (Fd < 0)
+                {
+                    std::printf("[LiveMIDI] Could not open FIFO %s (errno %d).\n", Path.c_str(), errno);
+                    return nullptr;
+                }
+                return std::make_unique<FFifoSource>(Fd, Path);
+            }
+
+            FFifoSource(int InFd, const std::string& InPath)
+                : Fd(InFd)
+                , Path(InPath)
+            {
+            }
+
+            ~FFifoSource() override
+            {
+                close(Fd);
+            }
+
+            int Read(uint8_t* Buffer, int Capacity, int TimeoutMs) override
+            {
+                pollfd Poll { Fd, POLLIN, 0 };
+                const int Ready = PollReadable(&Poll, 1, TimeoutMs);
+                if (Ready <= 0)
+                {
+                    return Ready;
+                }
+                const ssize_t NumBytes = read(Fd, Buffer, size_t(Capacity));
+                if (NumBytes < 0)
+                {
+                    return errno == EAGAIN || errno == EINTR ? 0 : -1;
+                }
+                return int(NumBytes);
+            }
+
+            std::string Describe() const override
+            {
+                return "FIFO " + Path;
+            }
+
+        private:
+            int Fd;
+            std::string Path;
+        };
+
+        // libasound is loaded at run time, so the bridge builds and runs without it; the sequencer's
+        // structs stay opaque and are only handled through pointers.
+        struct snd_seq_t;
+        struct snd_seq_event_t;
+        struct snd_midi_event_t;
+        struct snd_seq_client_info_t;
+        struct snd_seq_port_info_t;
+
+        constexpr int SND_SEQ_OPEN_INPUT = 2;
+        constexpr int SND_SEQ_NONBLOCK = 1;
+        constexpr unsigned int SND_SEQ_PORT_CAP_READ = 1 << 0;
+        constexpr unsigned int SND_SEQ_PORT_CAP_WRITE = 1 << 1;
+        constexpr unsigned int SND_SEQ_PORT_CAP_SUBS_READ = 1 << 5;
+        constexpr unsigned int SND_SEQ_PORT_CAP_SUBS_WRITE = 1 << 6;
+        constexpr unsigned int SND_SEQ_PORT_TYPE_MIDI_GENERIC = 1 << 1;
+        constexpr unsigned int SND_SEQ_PORT_TYPE_APPLICATION = 1 << 20;
+
+        struct FAlsaApi
+        {
+            int (*seq_open)(snd_seq_t**, const char*, int, int) = nullptr;
+            int (*seq_close)(snd_seq_t*) = nullptr;
+            int (*seq_client_id)(snd_seq_t*) = nullptr;
+            int (*seq_set_client_name)(snd_seq_t*, const char*) = nullptr;
+            int (*seq_create_simple_port)(snd_seq_t*, const char*, unsigned int, unsigned int) = nullptr;
+            int (*seq_connect_from)(snd_seq_t*, int, int, int) = nullptr;
+            int (*seq_poll_descriptors_count)(snd_seq_t*, short) = nullptr;
+            int (*seq_poll_descriptors)(snd_seq_t*, pollfd*, unsigned int, short) = nullptr;
+            int (*seq_event_input)(snd_seq_t*, snd_seq_event_t**) = nullptr;
+            int (*seq_event_input_pending)(snd_seq_t*, int) = nullptr;
+            int (*midi_event_new)(size_t, snd_midi_event_t**) = nullptr;
+            void (*midi_event_free)(snd_midi_event_t*) = nullptr;
+            void (*midi_event_no_status)(snd_midi_event_t*, int) = nullptr;
+            long (*midi_event_decode)(snd_midi_event_t*, unsigned char*, long, const snd_seq_event_t*) = nullptr;
+            int (*seq_client_info_malloc)(snd_seq_client_info_t**) = nullptr;
+            void (*seq_client_info_free)(snd_seq_client_info_t*) = nullptr;
+            void (*seq_client_info_set_client)(snd_seq_client_info_t*, int) = nullptr;
+            int (*seq_client_info_get_client)(const snd_seq_client_info_t*) = nullptr;
+            const char* (*seq_client_info_get_name)(snd_seq_client_info_t*) = nullptr;
+            int (*seq_query_next_client)(snd_seq_t*, snd_seq_client_info_t*) = nullptr;
+            int (*seq_port_info_malloc)(snd_seq_port_info_t**) = nullptr;
+            void (*seq_port_info_free)(snd_seq_port_info_t*) = nullptr;
+            void (*seq_port_info_set_client)(snd_seq_port_info_t*, int) = nullptr;
+            void (*seq_port_info_set_port)(snd_seq_port_info_t*, int) = nullptr;
+            int (*seq_port_info_get_port)(const snd_seq_port_info_t*) = nullptr;
+            unsigned int (*seq_port_info_get_capability)(const snd_seq_port_info_t*) = nullptr;
+            const char* (*seq_port_info_get_name)(const snd_seq_port_info_t*) = nullptr;
+            int (*seq_query_next_port)(snd_seq_t*, snd_seq_port_info_t*) = nullptr;
+
+            bool Load()
+            {
+                void* Library = dlopen("libasound.so.2", RTLD_NOW);
+                if (!Library)
+                {
+                    return false;
+                }
+#define PIANO_ALSA_LOAD(Name) \
+                Name = reinterpret_cast<decltype(Name)>(dlsym(Library, "snd_" #Name)); \
+                if (!Name) { std::printf("[LiveMIDI] libasound has no snd_%s.\n", #Name); return false; }
+                PIANO_ALSA_LOAD(seq_open)
+                PIANO_ALSA_LOAD(seq_close)
+                PIANO_ALSA_LOAD(seq_client_id)
+                PIANO_ALSA_LOAD(seq_set_client_name)
+                PIANO_ALSA_LOAD(seq_create_simple_port)
+                PIANO_ALSA_LOAD(seq_connect_from)
+                PIANO_ALSA_LOAD(seq_poll_descriptors_count)
+                PIANO_ALSA_LOAD(seq_poll_descriptors)
+                PIANO_ALSA_LOAD(seq_event_input)
+                PIANO_ALSA_LOAD(seq_event_input_pending)
+                PIANO_ALSA_LOAD(midi_event_new)
+                PIANO_ALSA_LOAD(midi_event_free)
+                PIANO_ALSA_LOAD(midi_event_no_status)
+                PIANO_ALSA_LOAD(midi_event_decode)
+                PIANO_ALSA_LOAD(seq_client_info_malloc)
+                PIANO_ALSA_LOAD(seq_client_info_free)
+                PIANO_ALSA_LOAD(seq_client_info_set_client)
+                PIANO_ALSA_LOAD(seq_client_info_get_client)
+                PIANO_ALSA_LOAD(seq_client_info_get_name)
+                PIANO_ALSA_LOAD(seq_query_next_client)
+                PIANO_ALSA_LOAD(seq_port_info_malloc)
+                PIANO_ALSA_LOAD(seq_port_info_free)
+                PIANO_ALSA_LOAD(seq_port_info_set_client)
+                PIANO_ALSA_LOAD(seq_port_info_set_port)
+                PIANO_ALSA_LOAD(seq_port_info_get_port)
+                PIANO_ALSA_LOAD(seq_port_info_get_capability)
+                PIANO_ALSA_LOAD(seq_port_info_get_name)
+                PIANO_ALSA_LOAD(seq_query_next_port)
+#undef PIANO_ALSA_LOAD
+                return true;
+            }
+        };
+
+        const FAlsaApi* GetAlsaApi()
+        {
+            static FAlsaApi Api;
+            static const bool bLoaded = Api.Load();
+            return bLoaded ? &Api : nullptr;
+        }
+
+        // Our own sequencer client with one writable port, subscribed to the keyboard's output port.
+        // Sequencer events are turned back into MIDI bytes, so the one parser serves every source.
+        class FAlsaSource : public IMidiByteSource
+        {
+        public:
+            static std::unique_ptr<IMidiByteSource> Open(const std::string& Name)
+            {
+                const FAlsaApi* Api = GetAlsaApi();
+                if (!Api)
+                {
+                    std::printf("[LiveMIDI] libasound.so.2 is not available.\n");
+                    return nullptr;
+                }
+
+                snd_seq_t* Seq = nullptr;
+                if (Api->seq_open(&Seq, "default", SND_SEQ_OPEN_INPUT, SND_SEQ_NONBLOCK) < 0)
+                {
+                    std::printf("[LiveMIDI] Could not open the ALSA sequencer.\n");
+                    return nullptr;
+                }
+                std::unique_ptr<FAlsaSource> Source = std::make_unique<FAlsaSource>(*Api, Seq);
+
+                Api->seq_set_client_name(Seq, "VrPiano Bridge");
+                const int Port = Api->seq_create_simple_port(Seq, "VrPiano Bridge In", SND_SEQ_PORT_CAP_WRITE | SND_SEQ_PORT_CAP_SUBS_WRITE,
+                    SND_SEQ_PORT_TYPE_MIDI_GENERIC | SND_SEQ_PORT_TYPE_APPLICATION);
+                if (Port < 0 || Api->midi_event_new(ReadBufferBytes, &Source->Decoder) < 0)
+                {
+                    std::printf("[LiveMIDI] Could not create an ALSA sequencer port.\n");
+                    return nullptr;
+                }
+                Api->midi_event_no_status(Source->Decoder, 1);
+
+                int SourceClient = -1;
+                int SourcePort = -1;
+                if (std::sscanf(Name.c_str(), "%d:%d", &SourceClient, &SourcePort) == 2)
+                {
+                    Source->PortName = Name;
+                }
+                else if (!Source->FindPort(Name, SourceClient, SourcePort))
+                {
+                    std::printf("[LiveMIDI] No MIDI input devices found.\n");
+                    return nullptr;
+                }
+                if (Api->seq_connect_from(Seq, Port, SourceClient, SourcePort) < 0)
+                {
+                    std::printf("[LiveMIDI] Could not subscribe to ALSA port %d:%d.\n", SourceClient, SourcePort);
+                    return nullptr;
+                }
+
+                const int NumFds = Api->seq_poll_descriptors_count(Seq, POLLIN);
+                Source->PollFds.resize(size_t(std::max(NumFds, 1)));
+                Api->seq_poll_descriptors(Seq, Source->PollFds.data(), unsigned(Source->PollFds.size()), POLLIN);
+                return Source;
+            }
+
+            FAlsaSource(const FAlsaApi& InApi, snd_seq_t* InSeq)
+                : Api(InApi)
+                , Seq(InSeq)
+            {
+            }
+
+            ~FAlsaSource() override
+            {
+                if (Decoder)
+                {
+                    Api.midi_event_free(Decoder);
+                }
+                Api.seq_close(Seq);
+            }
+
+            int Read(uint8_t* Buffer, int Capacity, int TimeoutMs) override
+            {
+                // Events already fetched into the library's buffer do not wake poll().
+                if (Api.seq_event_input_pending(Seq, 0) <= 0)
+                {
+                    const int Ready = PollReadable(PollFds.data(), int(PollFds.size()), TimeoutMs);
+                    if (Ready <= 0)
+                    {
+                        return Ready;
+                    }
+                }
+
+                // Channel messages decode to at most three bytes; longer ones are not ours to play.
+                int NumBytes = 0;
+                while (Capacity - NumBytes >= 3)
+                {
+                    snd_seq_event_t* Event = nullptr;
+                    const int Result = Api.seq_event_input(Seq, &Event);
+                    if (Result == -ENOSPC)
+                    {
+                        // The kernel queue overflowed and dropped events; what follows is still good.
+                        continue;
+                    }
+                    if (Result < 0 || !Event)
+                    {
+                        break;
+                    }
+                    const long Decoded = Api.midi_event_decode(Decoder, Buffer + NumBytes, Capacity - NumBytes, Event);
+                    if (Decoded > 0)
+                    {
+                        NumBytes += int(Decoded);
+                    }
+                }
+                return NumBytes;
+            }
+
+            std::string Describe() const override
+            {
+                return "ALSA " + PortName;
+            }
+
+        private:
+            // The first port that others can read and subscribe to whose name matches, else the first
+            // such port outside the system and Midi Through clients.
+            bool FindPort(const std::string& Name, int& OutClient, int& OutPort)
+            {
+                snd_seq_client_info_t* ClientInfo = nullptr;
+                snd_seq_port_info_t* PortInfo = nullptr;
+                Api.seq_client_info_malloc(&ClientInfo);
+                Api.seq_port_info_malloc(&PortInfo);
+                const int OwnClient = Api.seq_client_id(Seq);
+                constexpr unsigned int Readable = SND_SEQ_PORT_CAP_READ | SND_SEQ_PORT_CAP_SUBS_READ;
+
+                bool bFound = false;
+                bool bHaveFallback = false;
+                Api.seq_client_info_set_client(ClientInfo, -1);
+                while (!bFound && Api.seq_query_next_client(Seq, ClientInfo) >= 0)
+                {
+                    const int Client = Api.seq_client_info_get_client(ClientInfo);
+                    const std::string ClientName = Api.seq_client_info_get_name(ClientInfo);
+                    if (Client == 0 || Client == OwnClient || ClientName.find("Midi Through") != std::string::npos)
+                    {
+                        continue;
+                    }
+                    Api.seq_port_info_set_client(PortInfo, Client);
+                    Api.seq_port_info_set_port(PortInfo, -1);
+                    while (Api.seq_query_next_port(Seq, PortInfo) >= 0)
+                    {
+                        if ((Api.seq_port_info_get_capability(PortInfo) & Readable) != Readable)
+                        {
+                            continue;
+                        }
+                        const std::string FullName = ClientName + " " + Api.seq_port_info_get_name(PortInfo);
+                        const bool bMatches = MatchesDeviceName(FullName, Name);
+                        if (bMatches || !bHaveFallback)
+                        {
+                            OutClient = Client;
+                            OutPort = Api.seq_port_info_get_port(PortInfo);
+                            PortName = FullName + " (" + std::to_string(OutClient) + ":" + std::to_string(OutPort) + ")";
+                            bHaveFallback = true;
+                        }
+                        if (bMatches)
+                        {
+                            bFound = true;
+                            break;
+                        }
+                    }
+                }
+
+                Api.seq_port_info_free(PortInfo);
+                Api.seq_client_info_free(ClientInfo);
+                return bFound || bHaveFallback;
+            }
+
+            const FAlsaApi& Api;
+            snd_seq_t* Seq;
+            snd_midi_event_t* Decoder = nullptr;
+            std::vector<pollfd> PollFds;
+            std::string PortName;
+        };
+#else
+        // A WinMM input device. The driver calls back on its own thread with one short message at a
+        // time; they pass through a lock-free ring, since the callback must not block.
+        class FWinMMSource : public IMidiByteSource
+        {
+        public:
+            static std::unique_ptr<IMidiByteSource> Open(const std::string& Name)
+            {
+                const UINT NumDevices = midiInGetNumDevs();
+                UINT Chosen = NumDevices;
+                std::string ChosenName;
+                for (UINT Device = 0; Device < NumDevices; ++Device)
+                {
+                    MIDIINCAPSA Caps;
+                    if (midiInGetDevCapsA(Device, &Caps, sizeof(Caps)) != MMSYSERR_NOERROR)
+                    {
+                        continue;
+                    }
+                    const bool bMatches = MatchesDeviceName(Caps.szPname, Name);
+                    if (bMatches || Chosen == NumDevices)
+                    {
+                        Chosen = Device;
+                        ChosenName = Caps.szPname;
+                    }
+                    if (bMatches)
+                    {
+                        break;
+                    }
+                }
+                if (Chosen == NumDevices)
+                {
+                    std::printf("[LiveMIDI] No MIDI input devices found.\n");
+                    return nullptr;
+                }
+
+                std::unique_ptr<FWinMMSource> Source = std::make_unique<FWinMMSource>(ChosenName);
+                if (midiInOpen(&Source->Handle, Chosen, reinterpret_cast<DWORD_PTR>(&FWinMMSource::Callback),
+                        reinterpret_cast<DWORD_PTR>(Source.get()), CALLBACK_FUNCTION) != MMSYSERR_NOERROR)
+                {
+                    std::printf("[LiveMIDI] Could not open %s; is another program using it?\n", ChosenName.c_str());
+                    Source->Handle = nullptr;
+                    return nullptr;
+                }
+                midiInStart(Source->Handle);
+                return Source;
+            }
+
+            explicit FWinMMSource(const std::string& InDeviceName)
+                : DeviceName(InDeviceName)
+                , DataEvent(CreateEventA(nullptr, FALSE, FALSE, nullptr))
+            {
+            }
+
+            ~FWinMMSource() override
+            {
+                if (Handle)
+                {
+                    midiInStop(Handle);
+                    midiInReset(Handle);
+                    midiInClose(Handle);
+                }
+                CloseHandle(DataEvent);
+            }
+
+            int Read(uint8_t* Buffer, int Capacity, int TimeoutMs) override
+            {
+                if (Head.load(std::memory_order_acquire) == Tail.load(std::memory_order_relaxed))
+                {
+                    WaitForSingleObject(DataEvent, DWORD(TimeoutMs));
+                }
+                int NumBytes = 0;
+                size_t ReadIndex = Tail.load(std::memory_order_relaxed);
+                while (Capacity - NumBytes >= 3 && ReadIndex != Head.load(std::memory_order_acquire))
+                {
+                    const uint32_t Message = Ring[ReadIndex % RingSize];
+                    const uint8_t Status = uint8_t(Message);
+                    const int DataLength = std::max(GetChannelMessageDataLength(Status), 0);
+                    Buffer[NumBytes++] = Status;
+                    for (int Index = 1; Index <= DataLength; ++Index)
+                    {
+                        Buffer[NumBytes++] = uint8_t(Message >> (8 * Index));
+                    }
+                    Tail.store(++ReadIndex, std::memory_order_release);
+                }
+                return NumBytes;
+            }
+
+            std::string Describe() const override
+            {
+                return "WinMM " + DeviceName;
+            }
+
+        private:
+            static void CALLBACK Callback(HMIDIIN, UINT Message, DWORD_PTR Instance, DWORD_PTR Param1, DWORD_PTR)
+            {
+                if (Message != MIM_DATA)
+                {
+                    return;
+                }
+                FWinMMSource* Source = reinterpret_cast<FWinMMSource*>(Instance);
+                const size_t Write = Source->Head.load(std::memory_order_relaxed);
+                if (Write - Source->Tail.load(std::memory_order_acquire) < RingSize)
+                {
+                    Source->Ring[Write % RingSize] = uint32_t(Param1);
+                    Source->Head.store(Write + 1, std::memory_order_release);
+                }
+                SetEvent(Source->DataEvent);
+            }
+
+            static constexpr size_t RingSize = 1024;
+
+            std::string DeviceName;
+            HMIDIIN Handle = nullptr;
+            HANDLE DataEvent;
+            std::array<uint32_t, RingSize> Ring {};
+            std::atomic<size_t> Head { 0 };
+            std::atomic<size_t> Tail { 0 };
+        };
+#endif
+
+        std::unique_ptr<IMidiByteSource> OpenMidiSource(const std::string& Device)
+        {
+            if (Device.rfind("fifo:", 0) == 0)
+            {
+#ifdef _WIN32
+                std::printf("[LiveMIDI] FIFO devices are not supported on Windows.\n");
+                return nullptr;
+#else
+                return FFifoSource::Open(Device.substr(5));
+#endif
+            }
+
+            const std::string Name = Device.rfind("alsa:", 0) == 0 ? Device.substr(5) : Device;
+#ifdef _WIN32
+            return FWinMMSource::Open(Name);
+#else
+            return FAlsaSource::Open(Name);
+#endif
+        }
+    }
+
+    bool FMidiByteParser::Push(uint8_t Byte, uint8_t OutMessage[3])
+    {
+        // Clock, start, stop, active sensing and reset may interleave with anything.
+        if (Byte >= 0xF8)
+        {
+            return false;
+        }
+        if (Byte & 0x80)
+        {
+            // System exclusive and system common messages cancel running status, so their data is dropped below.
+            RunningStatus = Byte < 0xF0 ? Byte : 0;
+            NumData = 0;
+            return false;
+        }
+        if (RunningStatus == 0)
+        {
+            return false;
+        }
+
+        Data[NumData++] = Byte;
+        const int DataLength = GetChannelMessageDataLength(RunningStatus);
+        if (NumData < DataLength)
+        {
+            return false;
+        }
+        NumData = 0;
+        OutMessage[0] = RunningStatus;
+        OutMessage[1] = Data[0];
+        OutMessage[2] = DataLength > 1 ? Data[1] : 0;
+        return true;
+    }
+
+    void FMidiByteParser::Reset()
+    {
+        RunningStatus = 0;
+        NumData = 0;
+    }
+
+    std::unique_ptr<FMidiInput> FMidiInput::Open(const std::string& Device, FMessageHandler InOnMessage)
+    {
+        std::unique_ptr<IMidiByteSource> Source = OpenMidiSource(Device);
+        if (!Source)
+        {
+            return nullptr;
+        }
+        return std::unique_ptr<FMidiInput>(new FMidiInput(Device, std::move(Source), std::move(InOnMessage)));
+    }
+
+    FMidiInput::FMidiInput(const std::string& InDevice, std::unique_ptr<IMidiByteSource> InSource, FMessageHandler InOnMessage)
+        : Device(InDevice)
+        , Description(InSource->Describe())
+        , Source(std::move(InSource))
+        , OnMessage(std::move(InOnMessage))
+    {
+        std::printf("[LiveMIDI] Listening on %s ...\n", Description.c_str());
+        Thread = std::thread(&FMidiInput::Run, this);
+    }
+
+    FMidiInput::~FMidiInput()
+    {
+        bStopping = true;
+        if (Thread.joinable())
+        {
+            Thread.join();
+        }
+    }
+
+    void FMidiInput::Run()
+    {
+        uint8_t Buffer[ReadBufferBytes];
+        FTimePoint ReopenTime;
+        while (!bStopping.load(std::memory_order_relaxed))
+        {
+            if (!Source)
+            {
+                if (FClock::now() < ReopenTime)
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(ReadTimeoutMs));
+                    continue;
+                }
+                Source = OpenMidiSource(Device);
+                ReopenTime = FClock::now() + ReopenInterval;
+                if (Source)
+                {
+                    std::printf("[LiveMIDI] Reopened %s.\n", Source->Describe().c_str());
+                    Parser.Reset();
+                }
+                continue;
+            }
+
+            const int NumBytes = Source->Read(Buffer, ReadBufferBytes, ReadTimeoutMs);
+            if (NumBytes < 0)
+            {
+                std::printf("[LiveMIDI] Lost %s; retrying.\n", Description.c_str());
+                Source.reset();
+                ReopenTime = FClock::now() + ReopenInterval;
+                continue;
+            }
+
+            // Everything in one read arrived together, so it shares one capture time.
+            const double CaptureTime = GetUnixSeconds();
+            for (int Index = 0; Index < NumBytes; ++Index)
+            {
+                uint8_t Message[3];
+                if (Parser.Push(Buffer[Index], Message))
+                {
+                    OnMessage(Message, CaptureTime);
+                }
+            }
+        }
+    }
+}
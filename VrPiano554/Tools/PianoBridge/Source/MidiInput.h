@@ -0,0 +1,77 @@
+// MidiInput.h
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+
+namespace PianoBridge
+{
+    /**
+     * Turns a raw MIDI byte stream into complete channel messages. Keeps running status, lets
+     * real-time bytes (0xF8-0xFF) appear anywhere, and drops system exclusive and system common
+     * messages, which cancel running status.
+     */
+    class FMidiByteParser
+    {
+    public:
+        /** Returns true when Byte completes a channel message, copied to OutMessage with unused bytes zeroed. */
+        bool Push(uint8_t Byte, uint8_t OutMessage[3]);
+
+        void Reset();
+
+    private:
+        uint8_t RunningStatus = 0;
+        uint8_t Data[2] = {};
+        int NumData = 0;
+    };
+
+    class IMidiByteSource
+    {
+    public:
+        virtual ~IMidiByteSource() = default;
+
+        /** Waits up to TimeoutMs for input and returns the bytes read, 0 on timeout, or -1 once the source is gone. */
+        virtual int Read(uint8_t* Buffer, int Capacity, int TimeoutMs) = 0;
+
+        virtual std::string Describe() const = 0;
+    };
+
+    /**
+     * Reads a MIDI keyboard on its own thread and hands each channel message to OnMessage there,
+     * with the Unix time its bytes were read. Reopens the device once a second after losing it.
+     */
+    class FMidiInput
+    {
+    public:
+        using FMessageHandler = std::function<void(const uint8_t Message[3], double CaptureUnixSeconds)>;
+
+        /**
+         * Device is "fifo:<path>" for a named pipe of raw MIDI bytes (not on Windows), "alsa:<client>:<port>"
+         * for an ALSA sequencer address, or a name substring: the first input whose name contains it,
+         * skipping MIDIOUT2 ports as the Python bridge did, else the first input there is.
+         */
+        static std::unique_ptr<FMidiInput> Open(const std::string& Device, FMessageHandler InOnMessage);
+
+        ~FMidiInput();
+
+        std::string Describe() const { return Description; }
+
+    private:
+        FMidiInput(const std::string& InDevice, std::unique_ptr<IMidiByteSource> InSource, FMessageHandler InOnMessage);
+
+        void Run();
+
+        std::string Device;
+        std::string Description;
+        std::unique_ptr<IMidiByteSource> Source;
+        FMidiByteParser Parser;
+        FMessageHandler OnMessage;
+        std::atomic<bool> bStopping { false };
+        std::thread Thread;
+    };
+}
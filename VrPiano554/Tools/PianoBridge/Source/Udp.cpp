@@ -0,0 +1,119 @@
+#include "Udp.h"
+
+#include <cstring>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace PianoBridge
+{
+    bool StartupSockets()
+    {
+#ifdef _WIN32
+        WSADATA Data;
+        return WSAStartup(MAKEWORD(2, 2), &Data) == 0;
+#else
+        return true;
+#endif
+    }
+
+    void ShutdownSockets()
+    {
+#ifdef _WIN32
+        WSACleanup();
+#endif
+    }
+
+    int PollSockets(FPollDescriptor* Descriptors, size_t Count, int TimeoutMs)
+    {
+#ifdef _WIN32
+        return WSAPoll(Descriptors, ULONG(Count), TimeoutMs);
+#else
+        return poll(Descriptors, nfds_t(Count), TimeoutMs);
+#endif
+    }
+
+    sockaddr_in MakeEndpoint(const char* Address, uint16_t Port)
+    {
+        sockaddr_in Endpoint;
+        std::memset(&Endpoint, 0, sizeof(Endpoint));
+        Endpoint.sin_family = AF_INET;
+        Endpoint.sin_port = htons(Port);
+        inet_pton(AF_INET, Address, &Endpoint.sin_addr);
+        return Endpoint;
+    }
+
+    FUdpSocket::~FUdpSocket()
+    {
+        Close();
+    }
+
+    bool FUdpSocket::Open(const char* Address, uint16_t Port)
+    {
+        Close();
+        Handle = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (Handle == InvalidSocket)
+        {
+            return false;
+        }
+
+#ifdef _WIN32
+        u_long NonBlocking = 1;
+        ioctlsocket(Handle, FIONBIO, &NonBlocking);
+#else
+        fcntl(Handle, F_SETFL, fcntl(Handle, F_GETFL, 0) | O_NONBLOCK);
+#endif
+
+        if (Address)
+        {
+            const sockaddr_in Endpoint = MakeEndpoint(Address, Port);
+            if (bind(Handle, reinterpret_cast<const sockaddr*>(&Endpoint), sizeof(Endpoint)) != 0)
+            {
+                Close();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void FUdpSocket::Close()
+    {
+        if (Handle == InvalidSocket)
+        {
+            return;
+        }
+#ifdef _WIN32
+        closesocket(Handle);
+#else
+        close(Handle);
+#endif
+        Handle = InvalidSocket;
+    }
+
+    bool FUdpSocket::SendTo(const sockaddr_in& Endpoint, const void* Data, size_t Size) const
+    {
+        const auto Sent = sendto(Handle, static_cast<const char*>(Data), int(Size), 0, reinterpret_cast<const sockaddr*>(&Endpoint), sizeof(Endpoint));
+        return Sent >= 0 && size_t(Sent) == Size;
+    }
+
+    int FUdpSocket::Receive(void* Buffer, size_t Capacity) const
+    {
+        const auto Received = recv(Handle, static_cast<char*>(Buffer), int(Capacity), 0);
+        return Received < 0 ? -1 : int(Received);
+    }
+
+    uint16_t FUdpSocket::GetPort() const
+    {
+        sockaddr_in Endpoint;
+        socklen_t Size = sizeof(Endpoint);
+        if (getsockname(Handle, reinterpret_cast<sockaddr*>(&Endpoint), &Size) != 0)
+        {
+            return 0;
+        }
+        return ntohs(Endpoint.sin_port);
+    }
+}
@@ -0,0 +1,68 @@
+// Udp.h
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <netinet/in.h>
+#include <poll.h>
+#endif
+
+namespace PianoBridge
+{
+#ifdef _WIN32
+    using FSocketHandle = SOCKET;
+    using FPollDescriptor = WSAPOLLFD;
+    constexpr FSocketHandle InvalidSocket = INVALID_SOCKET;
+#else
+    using FSocketHandle = int;
+    using FPollDescriptor = pollfd;
+    constexpr FSocketHandle InvalidSocket = -1;
+#endif
+
+    /** Winsock needs starting once per process; a no-op elsewhere. */
+    bool StartupSockets();
+    void ShutdownSockets();
+
+    /** poll() or WSAPoll(); returns the number of ready descriptors, 0 on timeout, -1 on error. */
+    int PollSockets(FPollDescriptor* Descriptors, size_t Count, int TimeoutMs);
+
+    sockaddr_in MakeEndpoint(const char* Address, uint16_t Port);
+
+    /** A non-blocking IPv4 datagram socket. */
+    class FUdpSocket
+    {
+    public:
+        FUdpSocket() = default;
+        ~FUdpSocket();
+        FUdpSocket(const FUdpSocket&) = delete;
+        FUdpSocket& operator=(const FUdpSocket&) = delete;
+
+        /** Binds to Address:Port if Address is given; port 0 picks a free one. */
+        bool Open(const char* Address = nullptr, uint16_t Port = 0);
+        void Close();
+
+        bool SendTo(const sockaddr_in& Endpoint, const void* Data, size_t Size) const;
+
+        /** The next datagram, truncated to Capacity; -1 when none is waiting. */
+        int Receive(void* Buffer, size_t Capacity) const;
+
+        uint16_t GetPort() const;
+        FSocketHandle GetHandle() const { return Handle; }
+        bool IsOpen() const { return Handle != InvalidSocket; }
+
+    private:
+        FSocketHandle Handle = InvalidSocket;
+    };
+}
@@ -10,6 +10,7 @@ import time
 import threading
 import pretty_midi
 import argparse
+import itertools
 
 # Path to your MIDI files
 MIDI_DIR = r"C:\Users\Bartek\Documents\Unreal Projects\VrPiano554\Source\VrPiano554\midi"
@@ -128,12 +129,25 @@ log_parser = True
 is_paused = False
 volume = 0.5
 speed_factor = 1.0
-active_channels = {}
+active_channels = {}  # note -> channel, oldest first
 file_thread = None
 note_off_timers = []
 was_playing = False
 live_hold_mode = False
 loop_midi = False
+live_midi_enabled = True  # off when the engine reads the keyboard itself
+trace_ids = itertools.count(1)  # latency trace ids of live note-ons; the engine numbers its own from 2**31
+
+# --- Pedals and voice cap ---
+MAX_VOICES = 48          # notes sounding at once; more steal the least missed one
+STEAL_FADE_MS = 30       # fade of a stolen or re-struck note, instead of a hard stop
+CONTROL_SUSTAIN = 64
+CONTROL_SOSTENUTO = 66
+held_keys = set()        # live keys down
+sustained_notes = set()  # live notes let go while a pedal held their damper
+sostenuto_notes = set()  # keys the sostenuto pedal caught
+sustain_down = False
+sostenuto_down = False
 
 # --- NEW: Wait-for-key-press (Practice Mode) ---
 wait_for_key_mode = False
@@ -142,6 +156,9 @@ key_pressed_event = threading.Event()
 
 stop_event = threading.Event()
 state_lock = threading.Lock()
+# Guards active_channels and the pedal bookkeeping, which the live, receiver and main threads all touch.
+# Reentrant because the voice helpers call each other; taken after state_lock, never before it.
+voice_lock = threading.RLock()
 
 def send_game_command(command):
     """Sends a command to the game's falling block manager."""
@@ -152,6 +169,14 @@ def send_game_command(command):
     except Exception as e:
         print(f"ERROR sending game command: {e}")
 
+def send_speed_factor():
+    """Tells the game's falling block manager the current playback speed, so its song clock can follow."""
+    try:
+        message_bytes = json.dumps({"speed_factor": speed_factor}).encode('utf-8')
+        falling_block_sock.sendto(message_bytes, (UDP_IP_SEND, UDP_PORT_FALLING_BLOCKS))
+    except Exception as e:
+        print(f"ERROR sending speed factor: {e}")
+
 def send_ui_update(message_dict):
     """Sends a UI update message to Unreal."""
     try:
@@ -173,7 +198,7 @@ def send_note_event(message_dict):
     except Exception as e:
         print(f"ERROR sending note event: {e}")
 
-def send_midi_message(msg_type, note, velocity=None, duration=None, source="live"):
+def send_midi_message(msg_type, note, velocity=None, duration=None, source="live", capture_time=None):
     global muted_all, muted_parser, speed_factor
     with state_lock:
         if muted_all:
@@ -188,16 +213,46 @@ def send_midi_message(msg_type, note, velocity=None, duration=None, source="live
                 message["duration"] = adj_duration
             except Exception:
                 pass
+        if capture_time is not None:
+            # Lets the engine's latency trace follow this note from the keyboard to the screen.
+            message["trace_id"] = next(trace_ids)
+            message["t_capture"] = capture_time
+            message["t_send"] = time.time()
         send_note_event(message)
         if (source == "live" and log_live) or (source == "file" and log_parser):
             print(f"Sent: {json.dumps(message)}")
 
+def send_control_change(control, value, source="live"):
+    with state_lock:
+        if muted_all:
+            return
+    send_note_event({"type": "control_change", "control": int(control), "value": int(value), "source": source})
+
+def steal_voice():
+    """Frees a channel when MAX_VOICES notes sound: the oldest pedal-held note, else the oldest note."""
+    with voice_lock:
+        victim = next((n for n in active_channels if n in sustained_notes), None)
+        if victim is None:
+            victim = next(iter(active_channels), None)
+        if victim is not None:
+            active_channels.pop(victim).fadeout(STEAL_FADE_MS)
+            sustained_notes.discard(victim)
+
 def play_sound(note, source="live"):
     global muted_all, muted_live, volume
     with state_lock:
         if muted_all or (source == "live" and muted_live) or (source == "file" and muted_parser):
             return
-    if note in sounds:
+    if note not in sounds:
+        return
+    with voice_lock:
+        # A re-struck note fades its previous strike out rather than cutting it.
+        previous = active_channels.pop(note, None)
+        if previous is not None:
+            previous.fadeout(STEAL_FADE_MS)
+        sustained_notes.discard(note)
+        while len(active_channels) >= MAX_VOICES:
+            steal_voice()
         channel = pygame.mixer.find_channel()
         if channel:
             channel.set_volume(volume)
@@ -209,10 +264,16 @@ def play_sound(note, source="live"):
 
 def stop_sound(note, source="live", force=False):
     global live_hold_mode, active_channels
-    if note in active_channels:
+    with voice_lock:
+        if note not in active_channels:
+            return
         if not force and source == "live" and live_hold_mode:
             active_channels.pop(note, None)
             return
+        if not force and source == "live" and (sustain_down or note in sostenuto_notes):
+            sustained_notes.add(note)
+            return
+        sustained_notes.discard(note)
         try:
             active_channels[note].stop() # Immediately stop the sound
             active_channels.pop(note, None)
@@ -220,6 +281,36 @@ def stop_sound(note, source="live", force=False):
         except (KeyError, Exception) as e:
             print(f"[WARNING] Error stopping sound for note {note}: {e}")
 
+def stop_all_sounds(source="live"):
+    with voice_lock:
+        for note in list(active_channels.keys()):
+            stop_sound(note, source=source, force=True)
+
+def release_unheld_notes():
+    """After a pedal comes up, stops the notes neither a key nor a pedal holds any more."""
+    with voice_lock:
+        for note in list(sustained_notes):
+            if note not in held_keys and not sustain_down and note not in sostenuto_notes:
+                stop_sound(note, source="live", force=True)
+        sustained_notes.intersection_update(active_channels.keys())
+
+def handle_pedal(control, value):
+    global sustain_down, sostenuto_down
+    down = value >= 64
+    with voice_lock:
+        if control == CONTROL_SUSTAIN and down != sustain_down:
+            sustain_down = down
+            if not down:
+                release_unheld_notes()
+        elif control == CONTROL_SOSTENUTO and down != sostenuto_down:
+            sostenuto_down = down
+            # The pedal catches the dampers that are up as it goes down: held keys, or all under sustain.
+            sostenuto_notes.clear()
+            if down:
+                sostenuto_notes.update(range(128) if sustain_down else held_keys)
+            else:
+                release_unheld_notes()
+
 def midi_to_note_name(midi_note):
     if not 21 <= midi_note <= 108:
         return "Invalid Note"
@@ -236,13 +327,15 @@ def send_full_song_data(file_path):
     try:
         pm = pretty_midi.PrettyMIDI(file_path)
         notes_list = []
-        for instrument in pm.instruments:
+        for track, instrument in enumerate(pm.instruments):
             for note in instrument.notes:
                 if 21 <= note.pitch <= 108:
                     notes_list.append({
                         "time": note.start, # Send original time, speed factor is handled in UE
                         "midi_note": int(note.pitch),
-                        "duration": max(0.0, note.end - note.start)
+                        "duration": max(0.0, note.end - note.start),
+                        "velocity": int(note.velocity),
+                        "track": track  # UE assigns hands per track
                     })
         
         payload = {"notes": notes_list}
@@ -376,8 +469,7 @@ def restart_file_playback():
         file_thread.join(timeout=2.0)
         stop_event.clear()
 
-    for note in list(active_channels.keys()):
-        stop_sound(note, force=True)
+    stop_all_sounds()
     for timer in note_off_timers:
         timer.cancel()
     note_off_timers.clear()
@@ -423,11 +515,18 @@ def live_midi_thread(preferred_port_substr="Arturia"):
         with mido.open_input(selected_port) as inport:
             print(f"[LiveMIDI] Listening on {selected_port} ...")
             for msg in inport:
+                capture_time = time.time()
                 if stop_event.is_set():
                     break
                 
                 is_note_on = msg.type == "note_on" and msg.velocity > 0
                 is_note_off = msg.type == "note_off" or (msg.type == "note_on" and msg.velocity == 0)
+                is_pedal = msg.type == "control_change" and msg.control in (CONTROL_SUSTAIN, CONTROL_SOSTENUTO)
+                with voice_lock:
+                    if is_note_on:
+                        held_keys.add(msg.note)
+                    elif is_note_off:
+                        held_keys.discard(msg.note)
 
                 if wait_for_key_mode and is_note_on:
                     with state_lock:
@@ -446,11 +545,14 @@ def live_midi_thread(preferred_port_substr="Arturia"):
                         continue
 
                 if is_note_on:
-                    send_midi_message("note_on", msg.note, velocity=msg.velocity, source="live")
+                    send_midi_message("note_on", msg.note, velocity=msg.velocity, source="live", capture_time=capture_time)
                     play_sound(msg.note, source="live")
                 elif is_note_off:
                     send_midi_message("note_off", msg.note, source="live")
                     stop_sound(msg.note, source="live")
+                elif is_pedal:
+                    send_control_change(msg.control, msg.value, source="live")
+                    handle_pedal(msg.control, msg.value)
     except Exception as e:
         print(f"[LiveMIDI] Exception in MIDI input thread: {e}")
 
@@ -526,6 +628,10 @@ def udp_receiver_thread():
                     send_ui_update({"command": "toggle_pause", "is_paused": is_paused})  # Notify Unreal
                 print(f"Pauza {'włączona' if is_paused else 'wyłączona'}.")
             elif command == "tryb_nauki":
+                if not live_midi_enabled and not wait_for_key_mode:
+                    # Practice mode waits for our own keyboard input, which is off.
+                    print("Tryb nauki wymaga wejścia MIDI mostka (uruchom bez --no-live-midi).")
+                    continue
                 with state_lock:
                     old_wait_for_key_mode = wait_for_key_mode
                     wait_for_key_mode = not wait_for_key_mode
@@ -533,8 +639,7 @@ def udp_receiver_thread():
                 print(f"Tryb nauki {'WŁĄCZONY' if wait_for_key_mode else 'WYŁĄCZONY'}")
                 if not wait_for_key_mode and old_wait_for_key_mode:
                     print("Exiting learning mode: Stopping all active sounds.")
-                    for note in list(active_channels.keys()):
-                        stop_sound(note, source="file", force=True)
+                    stop_all_sounds(source="file")
             elif command == "life_hold":
                 with state_lock:
                     live_hold_mode = not live_hold_mode
@@ -543,11 +648,13 @@ def udp_receiver_thread():
                 with state_lock:
                     speed_factor = round(max(speed_factor - 0.05, 0.1), 2)
                     send_ui_update({"command": "update_tempo", "tempo": int(speed_factor * 100)})
+                    send_speed_factor()
                 print(f"[DEBUG] Prędkość odtwarzania zmieniona na: {int(speed_factor * 100)}%")
             elif command == "midi_szybciej":
                 with state_lock:
                     speed_factor = round(min(speed_factor + 0.05, 4.0), 2)
                     send_ui_update({"command": "update_tempo", "tempo": int(speed_factor * 100)})
+                    send_speed_factor()
                 print(f"[DEBUG] Prędkość odtwarzania zmieniona na: {int(speed_factor * 100)}%")
             elif command == "mute_file":
                 with state_lock:
@@ -598,11 +705,15 @@ def main_loop():
           " q - quit\n")
     
     update_midi_files()
-    start_live_midi()
+    if live_midi_enabled:
+        start_live_midi()
+    else:
+        print("[LiveMIDI] Disabled; the game reads the keyboard itself.")
     
     initial_midi = os.path.basename(get_current_midi_path()) if get_current_midi_path() else "None"
     send_ui_update({"command": "update_midi_info", "midi_info": f"MIDI: {initial_midi}"})
     send_ui_update({"command": "update_tempo", "tempo": int(speed_factor * 100)})
+    send_speed_factor()
 
     receiver = threading.Thread(target=udp_receiver_thread, daemon=True)
     receiver.start()
@@ -645,8 +756,7 @@ def main_loop():
             with state_lock:
                 muted_all = not muted_all
                 if muted_all:
-                    for n in list(active_channels.keys()):
-                        stop_sound(n, force=True)
+                    stop_all_sounds()
                     print("Całkowite wyciszenie włączone.")
                 else:
                     print("Całkowite wyciszenie wyłączone.")
@@ -663,11 +773,13 @@ def main_loop():
             with state_lock:
                 speed_factor = round(min(speed_factor + 0.05, 4.0), 2)
                 send_ui_update({"command": "update_tempo", "tempo": int(speed_factor * 100)})
+                send_speed_factor()
             print(f"[SPEED] Prędkość odtwarzania: {int(speed_factor * 100)}%")
         elif cmd == ",":
             with state_lock:
                 speed_factor = round(max(speed_factor - 0.05, 0.1), 2)
                 send_ui_update({"command": "update_tempo", "tempo": int(speed_factor * 100)})
+                send_speed_factor()
             print(f"[SPEED] Prędkość odtwarzania: {int(speed_factor * 100)}%")
         else:
             print(f"Nieznana komenda: {cmd}")
@@ -679,8 +791,7 @@ def main_loop():
         file_thread.join(timeout=2)
     if receiver and receiver.is_alive(): # Add this check and join
         receiver.join(timeout=2) # Give it some time to exit
-    for n in list(active_channels.keys()):
-        stop_sound(n, force=True)
+    stop_all_sounds()
     ui_sock.close()
     note_sock.close()
     falling_block_sock.close()
@@ -691,7 +802,10 @@ def main_loop():
 if __name__ == "__main__":
     parser = argparse.ArgumentParser(description="VR Piano Python Backend")
     parser.add_argument("--rain", action="store_true", help="Toggle rain mode in the Unreal project on startup.")
+    parser.add_argument("--no-live-midi", action="store_true",
+                        help="Do not open the MIDI keyboard; use with the piano's native MIDI input. Disables practice mode.")
     args = parser.parse_args()
+    live_midi_enabled = not args.no_live_midi
 
     if args.rain:
         # Give the game a moment to start up and listen on the socket